@@ -4,6 +4,7 @@ check_function_exists(mkstemp HAVE_MKSTEMP)
 
 include(CheckIncludeFiles)
 check_include_files(unistd.h HAVE_UNISTD_H)
+check_include_files(sys/mman.h HAVE_SYS_MMAN_H)
 
 configure_file("${CMAKE_SOURCE_DIR}/include/solarus/config.h.in" "${CMAKE_BINARY_DIR}/include/solarus/config.h")
 
@@ -17,5 +17,6 @@ include_directories(SYSTEM
   "${OGG_INCLUDE_DIR}"
   "${LUA_INCLUDE_DIR}"
   "${PHYSFS_INCLUDE_DIR}"
+  "${ZLIB_INCLUDE_DIR}"
 )
 
@@ -17,8 +17,8 @@ if(SOLARUS_BUNDLE)
     BUNDLE DESTINATION ${SOLARUS_EXECUTABLE_INSTALL_DESTINATION}
   )
 else()
-  # Install the shared library and the solarus_run executable.
-  install(TARGETS solarus solarus_run
+  # Install the shared library and the executables.
+  install(TARGETS solarus solarus_run solarus_compile
     LIBRARY DESTINATION ${SOLARUS_LIBRARY_INSTALL_DESTINATION}
     RUNTIME DESTINATION ${SOLARUS_EXECUTABLE_INSTALL_DESTINATION}
   )
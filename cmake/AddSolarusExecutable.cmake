@@ -35,3 +35,53 @@ target_link_libraries(solarus_run
   "${MODPLUG_LIBRARY}"
 )
 
+
+# Tool that compiles quest data files into their binary version.
+add_executable(solarus_compile
+  src/main/Compile.cpp
+)
+
+target_link_libraries(solarus_compile
+  solarus
+  "${SDL2_LIBRARY}"
+  "${SDL2_IMAGE_LIBRARY}"
+  "${SDL2_TTF_LIBRARY}"
+  "${OPENAL_LIBRARY}"
+  "${LUA_LIBRARY}"
+  "${DL_LIBRARY}"
+  "${PHYSFS_LIBRARY}"
+  "${VORBISFILE_LIBRARY}"
+  "${OGG_LIBRARY}"
+  "${MODPLUG_LIBRARY}"
+)
+
+# Game server, which can host a game, and its load generator.
+if(${CMAKE_SYSTEM_NAME} MATCHES "Linux")
+  add_executable(solarus_server
+    src/server/main.cpp
+  )
+
+  target_link_libraries(solarus_server
+    solarus
+    "${SDL2_LIBRARY}"
+    "${SDL2_IMAGE_LIBRARY}"
+    "${SDL2_TTF_LIBRARY}"
+    "${OPENAL_LIBRARY}"
+    "${LUA_LIBRARY}"
+    "${DL_LIBRARY}"
+    "${PHYSFS_LIBRARY}"
+    "${VORBISFILE_LIBRARY}"
+    "${OGG_LIBRARY}"
+    "${MODPLUG_LIBRARY}"
+    "${CMAKE_THREAD_LIBS_INIT}"
+  )
+
+  add_executable(solarus_server_load
+    src/server/LoadGenerator.cpp
+  )
+
+  target_link_libraries(solarus_server_load
+    solarus
+    "${CMAKE_THREAD_LIBS_INIT}"
+  )
+endif()
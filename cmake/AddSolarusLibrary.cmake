@@ -90,8 +90,11 @@ file(
   include/solarus/hero/VictoryState.h
 
   include/solarus/lowlevel/apple/AppleInterface.h
+  include/solarus/lowlevel/BinaryData.h
   include/solarus/lowlevel/Color.h
+  include/solarus/lowlevel/DataFileView.h
   include/solarus/lowlevel/Debug.h
+  include/solarus/lowlevel/FileWriter.h
   include/solarus/lowlevel/FontResource.h
   include/solarus/lowlevel/Geometry.h
   include/solarus/lowlevel/Hq2xFilter.h
@@ -100,11 +103,13 @@ file(
   include/solarus/lowlevel/InputEvent.h
   include/solarus/lowlevel/ItDecoder.h
   include/solarus/lowlevel/Music.h
+  include/solarus/lowlevel/OfflineAudio.h
   include/solarus/lowlevel/PixelBits.h
   include/solarus/lowlevel/PixelFilter.h
   include/solarus/lowlevel/Point.h
   include/solarus/lowlevel/Point.inl
   include/solarus/lowlevel/Output.h
+  include/solarus/lowlevel/QuestArchive.h
   include/solarus/lowlevel/QuestFiles.h
   include/solarus/lowlevel/Random.h
   include/solarus/lowlevel/Rectangle.h
@@ -117,6 +122,7 @@ file(
   include/solarus/lowlevel/Size.h
   include/solarus/lowlevel/Size.inl
   include/solarus/lowlevel/Sound.h
+  include/solarus/lowlevel/SpcCache.h
   include/solarus/lowlevel/SpcDecoder.h
   include/solarus/lowlevel/Surface.h
   include/solarus/lowlevel/SurfacePtr.h
@@ -125,11 +131,15 @@ file(
   include/solarus/lowlevel/Video.h
   include/solarus/lowlevel/VideoMode.h
 
+  include/solarus/lua/EntityFfiApi.h
   include/solarus/lua/ExportableToLua.h
   include/solarus/lua/ExportableToLuaPtr.h
+  include/solarus/lua/LuaBytecodeCache.h
   include/solarus/lua/LuaContext.h
   include/solarus/lua/LuaData.h
   include/solarus/lua/LuaException.h
+  include/solarus/lua/LuaProfiler.h
+  include/solarus/lua/LuaThread.h
   include/solarus/lua/LuaTools.h
   include/solarus/lua/LuaTools.inl
   include/solarus/lua/ScopedLuaRef.h
@@ -150,9 +160,8 @@ file(
   include/solarus/movements/StraightMovement.h
   include/solarus/movements/TargetMovement.h
 
-  include/solarus/server/ClientHandler.h
-  include/solarus/server/Client.h
- 
+  include/solarus/server/Types.h
+
   include/solarus/third_party/hqx/common.h
   include/solarus/third_party/hqx/hqx.h
   include/solarus/third_party/snes_spc/blargg_common.h
@@ -169,6 +178,7 @@ file(
   include/solarus/Ability.h
   include/solarus/AbilityInfo.h
   include/solarus/Arguments.h
+  include/solarus/BakedMapData.h
   include/solarus/Camera.h
   include/solarus/Common.h
   include/solarus/config.h
@@ -187,6 +197,7 @@ file(
   include/solarus/KeysEffect.h
   include/solarus/MainLoop.h
   include/solarus/Map.h
+  include/solarus/MapCache.h
   include/solarus/MapData.h
   include/solarus/MapLoader.h
   include/solarus/QuestProperties.h
@@ -288,8 +299,11 @@ file(
   src/hero/UsingItemState.cpp
   src/hero/VictoryState.cpp
 
+  src/lowlevel/BinaryData.cpp
   src/lowlevel/Color.cpp
+  src/lowlevel/DataFileView.cpp
   src/lowlevel/Debug.cpp
+  src/lowlevel/FileWriter.cpp
   src/lowlevel/FontResource.cpp
   src/lowlevel/Geometry.cpp
   src/lowlevel/Hq2xFilter.cpp
@@ -298,10 +312,12 @@ file(
   src/lowlevel/InputEvent.cpp
   src/lowlevel/ItDecoder.cpp
   src/lowlevel/Music.cpp
+  src/lowlevel/OfflineAudio.cpp
   src/lowlevel/Output.cpp
   src/lowlevel/PixelBits.cpp
   src/lowlevel/PixelFilter.cpp
   src/lowlevel/Point.cpp
+  src/lowlevel/QuestArchive.cpp
   src/lowlevel/QuestFiles.cpp
   src/lowlevel/Random.cpp
   src/lowlevel/Rectangle.cpp
@@ -313,6 +329,7 @@ file(
   src/lowlevel/shaders/Shader.cpp
   src/lowlevel/Size.cpp
   src/lowlevel/Sound.cpp
+  src/lowlevel/SpcCache.cpp
   src/lowlevel/SpcDecoder.cpp
   src/lowlevel/Surface.cpp
   src/lowlevel/System.cpp
@@ -323,15 +340,19 @@ file(
   src/lua/AudioApi.cpp
   src/lua/DrawableApi.cpp
   src/lua/EntityApi.cpp
+  src/lua/EntityFfiApi.cpp
   src/lua/ExportableToLua.cpp
   src/lua/FileApi.cpp
   src/lua/GameApi.cpp
   src/lua/InputApi.cpp
   src/lua/ItemApi.cpp
   src/lua/LanguageApi.cpp
+  src/lua/LuaBytecodeCache.cpp
   src/lua/LuaContext.cpp
   src/lua/LuaData.cpp
   src/lua/LuaException.cpp
+  src/lua/LuaProfiler.cpp
+  src/lua/LuaThread.cpp
   src/lua/LuaTools.cpp
   src/lua/MainApi.cpp
   src/lua/MapApi.cpp
@@ -341,6 +362,7 @@ file(
   src/lua/SpriteApi.cpp
   src/lua/SurfaceApi.cpp
   src/lua/TextSurfaceApi.cpp
+  src/lua/ThreadApi.cpp
   src/lua/TimerApi.cpp
   src/lua/VideoApi.cpp
 
@@ -359,11 +381,9 @@ file(
   src/movements/StraightMovement.cpp
   src/movements/TargetMovement.cpp
 
-  src/server/ClientHandler.cpp
-  src/server/Client.cpp
-
   src/AbilityInfo.cpp
   src/Arguments.cpp
+  src/BakedMapData.cpp
   src/Camera.cpp
   src/CurrentQuest.cpp
   src/DialogBoxSystem.cpp
@@ -380,6 +400,7 @@ file(
   src/MainLoop.cpp
   src/main/Main.cpp
   src/Map.cpp
+  src/MapCache.cpp
   src/MapData.cpp
   src/MapLoader.cpp
   src/QuestProperties.cpp
@@ -424,6 +445,30 @@ if(${CMAKE_SYSTEM_NAME} MATCHES "Darwin")
   )
 endif()
 
+# Additional source files for Linux systems: the game server uses epoll,
+# and the client goes with it.
+if(${CMAKE_SYSTEM_NAME} MATCHES "Linux")
+  set(source_files
+    ${source_files}
+    include/solarus/server/Client.h
+    include/solarus/server/ClientHandler.h
+    include/solarus/server/GameSession.h
+    include/solarus/server/PacketReader.h
+    include/solarus/server/Protocol.h
+    include/solarus/server/RingBuffer.h
+    include/solarus/server/Server.h
+    include/solarus/server/SnapshotCodec.h
+    src/server/Client.cpp
+    src/server/ClientHandler.cpp
+    src/server/GameSession.cpp
+    src/server/PacketReader.cpp
+    src/server/Protocol.cpp
+    src/server/RingBuffer.cpp
+    src/server/Server.cpp
+    src/server/SnapshotCodec.cpp
+  )
+endif()
+
 # Build the Solarus library.
 add_library(solarus
   SHARED
@@ -438,9 +483,11 @@ target_link_libraries(solarus
   "${LUA_LIBRARY}"
   "${DL_LIBRARY}"
   "${PHYSFS_LIBRARY}"
+  "${ZLIB_LIBRARY}"
   "${VORBISFILE_LIBRARY}"
   "${OGG_LIBRARY}"
   "${MODPLUG_LIBRARY}"
+  "${CMAKE_THREAD_LIBS_INIT}"
 )
 
 # Configuration for OSX and iOS build and deployment.
@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_BAKED_MAP_DATA_H
+#define SOLARUS_BAKED_MAP_DATA_H
+
+#include "solarus/Common.h"
+#include "solarus/entities/Ground.h"
+#include "solarus/entities/Layer.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace Solarus {
+
+class MapData;
+class TilesetData;
+
+/**
+ * \brief Information about the tiles of a map computed in advance.
+ *
+ * When a map is loaded, the ground of each 8x8 square is determined from
+ * the tiles, and tiles are split into animated and non-animated regions.
+ * This only depends on the map data file and on its tileset, so the
+ * solarus_compile tool can do it once for all and save the result
+ * in maps/<map_id>.baked.
+ *
+ * The baked file remembers a hash of the map and tileset data it was
+ * computed from.
+ * If any of them changed since then, the engine ignores the baked file
+ * and computes everything when loading the map as before.
+ */
+class SOLARUS_API BakedMapData {
+
+  public:
+
+    BakedMapData();
+
+    static std::string get_file_name(const std::string& map_id);
+    static uint64_t compute_hash(
+        const MapData& map_data,
+        const TilesetData& tileset_data
+    );
+    static std::shared_ptr<const BakedMapData> load(
+        const std::string& map_id,
+        const MapData& map_data,
+        const TilesetData& tileset_data
+    );
+
+    bool build(const MapData& map_data, const TilesetData& tileset_data);
+
+    uint64_t get_hash() const;
+    int get_width8() const;
+    int get_height8() const;
+    const std::vector<Ground>& get_tiles_ground(Layer layer) const;
+    const std::vector<bool>& get_animated_squares(Layer layer) const;
+    const std::vector<uint32_t>& get_rejected_tiles(Layer layer) const;
+    uint32_t get_num_tiles(Layer layer) const;
+
+    bool import_from_binary(const char* buffer, size_t size);
+    bool export_to_binary(std::string& buffer) const;
+
+  private:
+
+    /**
+     * \brief What is computed in advance for each layer.
+     */
+    struct LayerData {
+      uint32_t num_tiles;                  /**< Number of tiles on this layer
+                                            * after splitting tile data into
+                                            * tile patterns. */
+      std::vector<Ground> tiles_ground;    /**< Ground of each 8x8 square. */
+      std::vector<bool> animated_squares;  /**< Whether each 8x8 square has
+                                            * animated tiles. */
+      std::vector<uint32_t> rejected_tiles;  /**< Indexes of tiles in animated
+                                              * regions, in increasing order. */
+    };
+
+    uint64_t hash;                         /**< Hash of the map and tileset data. */
+    int width8;                            /**< Number of 8x8 squares on a row. */
+    int height8;                           /**< Number of 8x8 squares on a column. */
+    LayerData layers[LAYER_NB];            /**< Data of each layer. */
+
+};
+
+}
+
+#endif
+
@@ -20,6 +20,7 @@
 #include "solarus/Common.h"
 #include "solarus/entities/EntityType.h"
 #include "solarus/entities/Layer.h"
+#include "solarus/lowlevel/BinaryData.h"
 #include "solarus/lowlevel/Point.h"
 #include "solarus/lua/LuaData.h"
 #include <iosfwd>
@@ -123,6 +124,8 @@ class SOLARUS_API EntityData : public LuaData {
 
     bool import_from_lua(lua_State* l) override;
     bool export_to_lua(std::ostream& out) const override;
+    bool read_binary(BinaryData::Reader& reader);
+    void write_binary(BinaryData::Writer& writer) const;
 
     static EntityData check_entity_data(lua_State* l, int index, EntityType type);
     static const std::map<EntityType, const EntityTypeDescription> get_entity_type_descriptions();
@@ -111,8 +111,6 @@ class SOLARUS_API Equipment {
     std::map<std::string, std::shared_ptr<EquipmentItem>>
         items;                                   /**< Each item (properties loaded from item scripts). */
 
-    std::string get_ability_savegame_variable(Ability ability) const;
-
 };
 
 }
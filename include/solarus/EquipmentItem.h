@@ -20,6 +20,7 @@
 #include "solarus/Common.h"
 #include "solarus/lua/ExportableToLua.h"
 #include "solarus/Ability.h"
+#include "solarus/Savegame.h"
 #include <string>
 
 namespace Solarus {
@@ -29,7 +30,6 @@ class Game;
 class LuaContext;
 class Map;
 class Pickable;
-class Savegame;
 
 /**
  * \brief An item possibly possessed by the player.
@@ -103,6 +103,8 @@ class EquipmentItem: public ExportableToLua {
     std::string savegame_variable;       /**< savegame variable that stores the possession state */
     std::string amount_savegame_variable; /**< savegame variable that stores the amount associated to this item
                                           * or an empty string if there is no amount */
+    Savegame::Key savegame_key;          /**< key of savegame_variable if any */
+    Savegame::Key amount_savegame_key;   /**< key of amount_savegame_variable if any */
     int max_amount;                      /**< limit of the amount associated to this item, or 0 */
     bool obtainable;                     /**< whether the player can receive this item */
     bool assignable;                     /**< indicates that this item can be assigned to an item key an then
@@ -83,6 +83,8 @@ class SOLARUS_API Game {
     // simulate commands
     void simulate_command_pressed(GameCommand command);
     void simulate_command_released(GameCommand command);
+    void hold_command(GameCommand command);
+    void release_held_command(GameCommand command);
 
     // map
     bool has_current_map() const;
@@ -164,6 +166,7 @@ class SOLARUS_API Game {
     void update_keys_effect();
     void update_transitions();
     void update_gameover_sequence();
+    void load_next_map();
     void notify_map_changed();
 
 };
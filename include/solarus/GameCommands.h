@@ -71,6 +71,10 @@ class GameCommands {
     void game_command_pressed(GameCommand command);
     void game_command_released(GameCommand command);
 
+    // Commands held without a keyboard or joypad.
+    void hold_command(GameCommand command);
+    void release_held_command(GameCommand command);
+
   private:
 
     Savegame& get_savegame();
@@ -111,6 +115,10 @@ class GameCommands {
                                           * when customizing is true. */
     ScopedLuaRef customize_callback_ref; /**< Lua ref to a function to call
                                           * when the customization finishes. */
+    std::set<GameCommand>
+        held_commands;                   /**< Commands pressed by
+                                          * hold_command() and not
+                                          * released yet. */
 
     static const uint16_t
         direction_masks[4];              /**< Bit mask associated to each direction:
@@ -26,6 +26,7 @@
 #include "solarus/lua/ExportableToLua.h"
 #include "solarus/Camera.h"
 #include "solarus/MapData.h"
+#include "solarus/MapLoader.h"
 #include "solarus/Transition.h"
 #include <memory>
 #include <string>
@@ -37,7 +38,6 @@ class Detector;
 class InputEvent;
 class LuaContext;
 class MapEntities;
-class MapLoader;
 class Tileset;
 class Sprite;
 
@@ -89,6 +89,8 @@ class SOLARUS_API Map: public ExportableToLua {
 
     // loading
     bool is_loaded() const;
+    void start_preparing();
+    bool is_prepared() const;
     void load(Game& game);
     void unload();
     Game& get_game();
@@ -179,6 +181,9 @@ class SOLARUS_API Map: public ExportableToLua {
     void draw_foreground();
 
     static MapLoader map_loader;  /**< The map file parser. */
+    std::unique_ptr<MapLoader::Preparation>
+        preparation;              /**< Files of the map being read in advance,
+                                   * until the map is started. */
 
     // map properties
 
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_MAP_CACHE_H
+#define SOLARUS_MAP_CACHE_H
+
+#include "solarus/Common.h"
+#include "solarus/lowlevel/SurfacePtr.h"
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Solarus {
+
+class Arguments;
+class MapData;
+class TilesetData;
+
+/**
+ * \brief Keeps the data of recently visited maps to avoid loading them again.
+ *
+ * Players often go back and forth between a few maps.
+ * This class remembers the parsed map data files, the parsed tileset data
+ * files and the decoded tileset images, so that going back to a map only
+ * has to create its entities.
+ *
+ * Each element is identified by its file name and is loaded again if the
+ * modification date of the file has changed.
+ * When the memory used exceeds the budget (option -map-cache-size),
+ * the least recently used elements are forgotten.
+ *
+ * Elements can be requested from any thread.
+ * Elements removed from the cache are destroyed by the main thread in
+ * update(), since tileset images must not be destroyed by another thread.
+ */
+class MapCache {
+
+  public:
+
+    static void initialize(const Arguments& args);
+    static void quit();
+    static void update();
+
+    static std::shared_ptr<const MapData> get_map_data(const std::string& map_id);
+    static std::shared_ptr<const TilesetData> get_tileset_data(const std::string& tileset_id);
+    static SurfacePtr get_tileset_image(const std::string& file_name);
+
+    static int get_num_hits();
+    static int get_num_misses();
+    static size_t get_memory_used();
+
+  private:
+
+    /**
+     * \brief An element in the cache.
+     */
+    struct Entry {
+      int64_t modification_date;           /**< Date of the file when it was loaded. */
+      std::shared_ptr<const void> element; /**< The parsed or decoded file. */
+      size_t size;                         /**< Approximate memory used in bytes. */
+    };
+
+    static std::shared_ptr<const void> get_element(
+        const std::string& file_name,
+        int64_t& modification_date
+    );
+    static void add_element(
+        const std::string& file_name,
+        int64_t modification_date,
+        const std::shared_ptr<const void>& element,
+        size_t size
+    );
+
+    static size_t max_memory;                        /**< Memory budget in bytes, 0 to disable. */
+    static size_t memory_used;                       /**< Memory used by all entries. */
+    static std::map<std::string, Entry> entries;     /**< Elements indexed by file name. */
+    static std::list<std::string> entries_order;     /**< File names, most recently used first. */
+    static std::vector<std::shared_ptr<const void>>
+        elements_to_release;                         /**< Elements removed from the cache,
+                                                      * to be released by the main thread. */
+    static int num_hits;                             /**< Elements found in the cache. */
+    static int num_misses;                           /**< Elements that had to be loaded. */
+    static std::mutex mutex;                         /**< Lock for the cache. */
+
+};
+
+}
+
+#endif
+
@@ -18,29 +18,99 @@
 #define SOLARUS_MAP_LOADER_H
 
 #include "solarus/Common.h"
+#include "solarus/entities/TilesetData.h"
+#include "solarus/lowlevel/DataFileView.h"
+#include "solarus/lowlevel/SurfacePtr.h"
+#include "solarus/MapData.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 struct lua_State;
 
 namespace Solarus {
 
+class BakedMapData;
+class EntityData;
 class Game;
 class Map;
+class SpriteAnimationSet;
 
 /**
  * \brief Parses a map file.
  *
  * This class loads a map and its content from a map file.
+ *
+ * Loading is done in two phases.
+ * The preparation reads and parses the map and tileset data files,
+ * decodes the tileset images, reads the baked ground of the map if any
+ * and compiles the map script.
+ * Meanwhile, a few other threads load the sprites and compile the scripts
+ * that entities of the map are going to need.
+ * It does not touch the game and can run in a separate thread,
+ * for example during the closing transition of the previous map.
+ * Then load_map() creates the tileset and the entities from the prepared
+ * data in the main thread.
  */
 class MapLoader {
 
   public:
 
+    /**
+     * \brief Work done in a separate thread before loading a map.
+     *
+     * The preparation starts when the object is created.
+     */
+    class Preparation {
+
+      public:
+
+        explicit Preparation(const std::string& map_id);
+        ~Preparation();
+
+        Preparation(const Preparation& other) = delete;
+        Preparation& operator=(const Preparation& other) = delete;
+
+        bool is_done() const;
+        void wait();
+
+      private:
+
+        friend class MapLoader;
+
+        void run();
+
+        const std::string map_id;          /**< Id of the map to prepare. */
+        std::shared_ptr<const MapData>
+            data;                          /**< The map data file parsed. */
+        std::shared_ptr<const TilesetData>
+            tileset_data;                  /**< The tileset data file parsed. */
+        SurfacePtr tiles_image;            /**< Tiles image of the tileset or nullptr. */
+        SurfacePtr entities_image;         /**< Entities image of the tileset or nullptr. */
+        std::shared_ptr<const BakedMapData>
+            baked_data;                    /**< Ground and tile regions computed in
+                                            * advance, or nullptr. */
+        std::vector<std::shared_ptr<SpriteAnimationSet>>
+            sprite_animation_sets;         /**< Sprites needed by the map that
+                                            * were not in memory yet. */
+        DataFileViewPtr script;            /**< Map script, kept in the data file cache
+                                            * until the map is started. */
+        std::exception_ptr error;          /**< Error thrown by the worker if any. */
+        std::atomic<bool> done;            /**< Whether the worker has finished. */
+        std::thread worker;                /**< The thread doing the preparation. */
+    };
+
     MapLoader();
 
-    void load_map(Game& game, Map& map);
+    void load_map(Game& game, Map& map, Preparation& preparation);
 
   private:
 
+    void create_tiles(Map& map, const EntityData& entity_data, bool update_ground);
+
     static int l_properties(lua_State* l);
 };
 
@@ -19,9 +19,11 @@
 
 #include "solarus/Common.h"
 #include "solarus/Equipment.h"
+#include "solarus/lowlevel/FileWriter.h"
 #include "solarus/lua/ExportableToLua.h"
-#include <map>
 #include <string>
+#include <utility>
+#include <vector>
 
 struct lua_State;
 
@@ -34,52 +36,84 @@ class MainLoop;
  * \brief Manages the game data saved.
  *
  * This class provides read and write access to the saved data.
+ *
+ * Values are stored in an open-addressing hash table indexed by interned
+ * keys, so that reading a value does not hash or compare strings.
+ * Built-in keys are interned once, and functions called often should keep
+ * a Key rather than a name.
  */
 class SOLARUS_API Savegame: public ExportableToLua {
 
   public:
 
+    /**
+     * \brief Handle to the name of a savegame variable.
+     *
+     * Each distinct name is given a small index the first time a key
+     * is created from it.
+     * Keys are valid for the whole execution and can be shared between
+     * savegames. They must only be created from the main thread.
+     */
+    class SOLARUS_API Key {
+
+      public:
+
+        Key();
+        explicit Key(const std::string& name);
+
+        int get_index() const;
+        const std::string& get_name() const;
+
+        static Key from_index(int index);
+        static int get_num_keys();
+
+      private:
+
+        int index;           /**< Index of the name, -1 for an invalid key. */
+
+    };
+
     static const int SAVEGAME_VERSION;  /**< Version number of the savegame file format. */
 
     // Keys to built-in values saved.
-    static const std::string KEY_SAVEGAME_VERSION;
-    static const std::string KEY_STARTING_MAP;
-    static const std::string KEY_STARTING_POINT;
-    static const std::string KEY_KEYBOARD_ACTION;
-    static const std::string KEY_KEYBOARD_ATTACK;
-    static const std::string KEY_KEYBOARD_ITEM_1;
-    static const std::string KEY_KEYBOARD_ITEM_2;
-    static const std::string KEY_KEYBOARD_PAUSE;
-    static const std::string KEY_KEYBOARD_RIGHT;
-    static const std::string KEY_KEYBOARD_UP;
-    static const std::string KEY_KEYBOARD_LEFT;
-    static const std::string KEY_KEYBOARD_DOWN;
-    static const std::string KEY_JOYPAD_ACTION;
-    static const std::string KEY_JOYPAD_ATTACK;
-    static const std::string KEY_JOYPAD_ITEM_1;
-    static const std::string KEY_JOYPAD_ITEM_2;
-    static const std::string KEY_JOYPAD_PAUSE;
-    static const std::string KEY_JOYPAD_RIGHT;
-    static const std::string KEY_JOYPAD_UP;
-    static const std::string KEY_JOYPAD_LEFT;
-    static const std::string KEY_JOYPAD_DOWN;
-    static const std::string KEY_CURRENT_LIFE;
-    static const std::string KEY_CURRENT_MONEY;
-    static const std::string KEY_CURRENT_MAGIC;
-    static const std::string KEY_MAX_LIFE;
-    static const std::string KEY_MAX_MONEY;
-    static const std::string KEY_MAX_MAGIC;
-    static const std::string KEY_ITEM_SLOT_1;
-    static const std::string KEY_ITEM_SLOT_2;
-    static const std::string KEY_ABILITY_TUNIC;
-    static const std::string KEY_ABILITY_SWORD;
-    static const std::string KEY_ABILITY_SWORD_KNOWLEDGE;
-    static const std::string KEY_ABILITY_SHIELD;
-    static const std::string KEY_ABILITY_LIFT;
-    static const std::string KEY_ABILITY_SWIM;
-    static const std::string KEY_ABILITY_RUN;
-    static const std::string KEY_ABILITY_DETECT_WEAK_WALLS;
-    static const std::string KEY_ABILITY_GET_BACK_FROM_DEATH;
+    static const Key KEY_SAVEGAME_VERSION;
+    static const Key KEY_STARTING_MAP;
+    static const Key KEY_STARTING_POINT;
+    static const Key KEY_KEYBOARD_ACTION;
+    static const Key KEY_KEYBOARD_ATTACK;
+    static const Key KEY_KEYBOARD_ITEM_1;
+    static const Key KEY_KEYBOARD_ITEM_2;
+    static const Key KEY_KEYBOARD_PAUSE;
+    static const Key KEY_KEYBOARD_RIGHT;
+    static const Key KEY_KEYBOARD_UP;
+    static const Key KEY_KEYBOARD_LEFT;
+    static const Key KEY_KEYBOARD_DOWN;
+    static const Key KEY_JOYPAD_ACTION;
+    static const Key KEY_JOYPAD_ATTACK;
+    static const Key KEY_JOYPAD_ITEM_1;
+    static const Key KEY_JOYPAD_ITEM_2;
+    static const Key KEY_JOYPAD_PAUSE;
+    static const Key KEY_JOYPAD_RIGHT;
+    static const Key KEY_JOYPAD_UP;
+    static const Key KEY_JOYPAD_LEFT;
+    static const Key KEY_JOYPAD_DOWN;
+    static const Key KEY_CURRENT_LIFE;
+    static const Key KEY_CURRENT_MONEY;
+    static const Key KEY_CURRENT_MAGIC;
+    static const Key KEY_MAX_LIFE;
+    static const Key KEY_MAX_MONEY;
+    static const Key KEY_MAX_MAGIC;
+    static const Key KEY_ITEM_SLOT_1;
+    static const Key KEY_ITEM_SLOT_2;
+    static const Key KEY_ABILITY_TUNIC;
+    static const Key KEY_ABILITY_SWORD;
+    static const Key KEY_ABILITY_SWORD_KNOWLEDGE;
+    static const Key KEY_ABILITY_SHIELD;
+    static const Key KEY_ABILITY_LIFT;
+    static const Key KEY_ABILITY_SWIM;
+    static const Key KEY_ABILITY_RUN;
+    static const Key KEY_ABILITY_DETECT_WEAK_WALLS;
+    static const Key KEY_ABILITY_GET_BACK_FROM_DEATH;
 
     // creation and destruction
     Savegame(MainLoop& main_loop, const std::string& file_name);
@@ -87,20 +121,31 @@ class SOLARUS_API Savegame: public ExportableToLua {
     // file state
     bool is_empty() const;
     void initialize();
-    void save();
+    void save(const FileWriter::Callback& callback = nullptr);
     const std::string& get_file_name() const;
 
     // data
     bool is_string(const std::string& key) const;
+    bool is_string(Key key) const;
     const std::string& get_string(const std::string& key) const;
+    const std::string& get_string(Key key) const;
     void set_string(const std::string& key, const std::string& value);
+    void set_string(Key key, const std::string& value);
     bool is_integer(const std::string& key) const;
+    bool is_integer(Key key) const;
     int get_integer(const std::string& key) const;
+    int get_integer(Key key) const;
     void set_integer(const std::string& key, int value);
+    void set_integer(Key key, int value);
     bool is_boolean(const std::string& key) const;
+    bool is_boolean(Key key) const;
     bool get_boolean(const std::string& key) const;
+    bool get_boolean(Key key) const;
     void set_boolean(const std::string& key, bool value);
+    void set_boolean(Key key, bool value);
     void unset(const std::string& key);
+    void unset(Key key);
+    int get_num_values() const;
 
     // unsaved data
     MainLoop& get_main_loop();
@@ -128,7 +173,26 @@ class SOLARUS_API Savegame: public ExportableToLua {
       int int_data;  // Also used for boolean
     };
 
-    std::map<std::string, SavedValue> saved_values;
+    /**
+     * \brief An entry of the hash table of values.
+     */
+    struct Slot {
+      int key_index = -1;    /**< Index of the key, -1 if the slot is free. */
+      SavedValue value;      /**< The value stored. */
+    };
+
+    using SavedValueList = std::vector<std::pair<std::string, SavedValue>>;
+
+    const SavedValue* find_value(Key key) const;
+    SavedValue& get_or_add_value(Key key);
+    size_t get_home_slot(int key_index) const;
+    void grow_slots();
+
+    static std::string serialize(SavedValueList& saved_values);
+
+    std::vector<Slot> slots; /**< Hash table of values with linear probing.
+                              * Its size is a power of two. */
+    int num_values;          /**< Number of slots used. */
 
     bool empty;
     std::string file_name;   /**< Savegame file name relative to the quest write directory. */
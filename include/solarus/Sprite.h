@@ -20,11 +20,17 @@
 #include "solarus/Common.h"
 #include "solarus/Drawable.h"
 #include "solarus/SpritePtr.h"
+#include <cstddef>
+#include <list>
 #include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
 
 namespace Solarus {
 
+class Arguments;
 class LuaContext;
 class Size;
 class SpriteAnimation;
@@ -41,6 +47,12 @@ class Tileset;
  * Several sprites can have the same animation set (i.e. they share
  * the same SpriteAnimationSet object).
  *
+ * Animation sets are kept in memory as long as a sprite uses them.
+ * Animation sets no longer used stay in memory too, in case they are
+ * needed again soon, until the memory they use exceeds a budget
+ * (option -sprite-cache-size).
+ * Then the least recently used ones are freed.
+ *
  * A sprite can be drawn directly on a surface, or it can
  * be attached to a map entity.
  */
@@ -49,11 +61,20 @@ class Sprite: public Drawable {
   public:
 
     // initialization
-    static void initialize();
+    static void initialize(const Arguments& args);
     static void quit();
 
+    // cache of animation sets
+    static bool has_animation_set(const std::string& id);
+    static void add_animation_sets(
+        const std::vector<std::shared_ptr<SpriteAnimationSet>>& animation_sets
+    );
+    static int get_num_animation_sets();
+    static size_t get_unused_animation_sets_memory();
+
     // creation and destruction
     Sprite(const std::string& id);
+    ~Sprite();
 
     void set_tileset(Tileset& tileset);
 
@@ -118,17 +139,37 @@ class Sprite: public Drawable {
 
   private:
 
-    static SpriteAnimationSet& get_animation_set(const std::string& id);
+    static std::shared_ptr<SpriteAnimationSet> get_animation_set(const std::string& id);
+    static void release_animation_set(std::shared_ptr<SpriteAnimationSet>& animation_set);
+    static void remove_unused_animation_sets();
     int get_next_frame() const;
     Surface& get_intermediate_surface() const ;
     void set_frame_changed(bool frame_changed);
 
     LuaContext* lua_context;           /**< The Solarus Lua API (nullptr means no callbacks for this sprite). TODO move this to ExportableToLua */
 
+    /**
+     * \brief An animation set in memory.
+     */
+    struct AnimationSetInfo {
+      std::shared_ptr<SpriteAnimationSet> animation_set;  /**< The animation set. */
+      int num_sprites;                 /**< Number of sprites using it. */
+    };
+
     // animation set
-    static std::map<std::string, SpriteAnimationSet*> all_animation_sets;
+    static std::map<std::string, AnimationSetInfo>
+        all_animation_sets;            /**< animation sets in memory, used or not */
+    static std::list<std::string>
+        unused_animation_sets;         /**< animation sets used by no sprite,
+                                        * most recently released first */
+    static size_t unused_memory;       /**< memory used by unused animation sets in bytes */
+    static size_t max_unused_memory;   /**< budget of unused animation sets in bytes */
+    static std::mutex
+        animation_sets_mutex;          /**< lock for the animation sets, which can be
+                                        * prefetched from another thread */
     const std::string animation_set_id;  /**< id of this sprite's animation set */
-    SpriteAnimationSet& animation_set;   /**< animation set of this sprite */
+    std::shared_ptr<SpriteAnimationSet>
+        animation_set;                 /**< animation set of this sprite */
 
     // current state of the sprite
 
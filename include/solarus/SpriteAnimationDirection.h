@@ -59,6 +59,8 @@ class SpriteAnimationDirection {
     bool are_pixel_collisions_enabled() const;
     const PixelBits& get_pixel_bits(int frame) const;
 
+    size_t get_memory_used() const;
+
   private:
 
     std::vector<Rectangle> frames;      /**< position of each frame of the sequence on the image */
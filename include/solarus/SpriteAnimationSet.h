@@ -19,6 +19,7 @@
 
 #include "solarus/Common.h"
 #include "solarus/lowlevel/Size.h"
+#include <cstddef>
 #include <map>
 #include <string>
 
@@ -37,6 +38,9 @@ class Tileset;
  * and is an instance of SpriteAnimation.
  * For example, an NPC usually has an animation "stopped"
  * and an animation "walking".
+ *
+ * Animation sets can be created from any thread, but they must then only
+ * be used from the main thread.
  */
 class SpriteAnimationSet {
 
@@ -44,6 +48,7 @@ class SpriteAnimationSet {
 
     SpriteAnimationSet(const std::string& id);
 
+    const std::string& get_id() const;
     void set_tileset(Tileset& tileset);
 
     bool has_animation(const std::string& animation_name) const;
@@ -55,6 +60,8 @@ class SpriteAnimationSet {
     bool are_pixel_collisions_enabled() const;
     const Size& get_max_size() const;
 
+    size_t get_memory_used() const;
+
   private:
 
     void load();
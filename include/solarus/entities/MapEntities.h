@@ -79,6 +79,12 @@ class SOLARUS_API MapEntities {
 
     // handle entities
     void add_entity(const EntityPtr& entity);
+    void add_tiles(
+        Layer layer,
+        const Rectangle& area,
+        const std::string& tile_pattern_id,
+        bool update_ground = true
+    );
     void remove_entity(Entity* entity);
     void remove_entity(const std::string& name);
     void remove_entities_with_prefix(const std::string& prefix);
@@ -89,6 +95,13 @@ class SOLARUS_API MapEntities {
     void set_entity_layer(Entity& entity, Layer layer);
     void notify_entity_ground_observer_changed(Entity& entity);
     void notify_entity_ground_modifier_changed(Entity& entity);
+    static void add_tile_ground(
+        std::vector<Ground>& grid,
+        int grid_width8,
+        int grid_height8,
+        const Rectangle& tile_box,
+        Ground ground
+    );
 
     // specific to some entity types
     bool overlaps_raised_blocks(Layer layer, const Rectangle& rectangle);
@@ -111,8 +124,7 @@ class SOLARUS_API MapEntities {
 
     friend class MapLoader;            /**< the map loader initializes the private fields of MapEntities */
 
-    void add_tile(const TilePtr& tile);
-    void set_tile_ground(Layer layer, int x8, int y8, Ground ground);
+    void add_tile(const TilePtr& tile, bool update_ground);
     void remove_marked_entities();
     void notify_entity_removed(Entity* entity);
     void update_crystal_blocks();
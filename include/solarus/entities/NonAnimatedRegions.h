@@ -22,11 +22,13 @@
 #include "solarus/entities/Layer.h"
 #include "solarus/entities/TilePtr.h"
 #include "solarus/lowlevel/SurfacePtr.h"
+#include <cstdint>
 #include <vector>
 
 namespace Solarus {
 
 class Map;
+class Rectangle;
 
 /**
  * \brief Manages the tiles that are in non-animated regions.
@@ -42,14 +44,32 @@ class NonAnimatedRegions {
 
     NonAnimatedRegions(Map& map, Layer layer);
 
+    void reserve_tiles(int nb_tiles);
     void add_tile(const TilePtr& tile);
+    void set_baked_partition(
+        const std::vector<bool>& animated_squares,
+        const std::vector<uint32_t>& rejected_tiles,
+        uint32_t num_tiles
+    );
     void build(std::vector<TilePtr>& rejected_tiles);
     void notify_tileset_changed();
     void draw_on_map();
 
+    static void mark_animated_squares(
+        std::vector<bool>& animated_squares,
+        int map_width8,
+        int map_height8,
+        const Rectangle& tile_box
+    );
+    static bool overlaps_animated_squares(
+        const std::vector<bool>& animated_squares,
+        int map_width8,
+        int map_height8,
+        const Rectangle& tile_box
+    );
+
   private:
 
-    bool overlaps_animated_tile(Tile& tile) const;
     void build_cell(int cell_index);
 
     Map& map;                               /**< The map. */
@@ -58,6 +78,10 @@ class NonAnimatedRegions {
         tiles;                              /**< All tiles contained in this layer and candidates to
                                              * be optimized. This list is cleared after build() is called. */
     std::vector<bool> are_squares_animated; /**< Whether each 8x8 square of the map has animated tiles. */
+    bool has_baked_partition;               /**< Whether build() can use a partition computed in advance. */
+    std::vector<uint32_t>
+        baked_rejected_tiles;               /**< Indexes of tiles in animated regions, computed in advance. */
+    uint32_t baked_num_tiles;               /**< Number of tiles the baked partition was computed for. */
 
     // Handle the lazy drawing.
     Grid<TilePtr>
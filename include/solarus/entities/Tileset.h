@@ -30,6 +30,7 @@ namespace Solarus {
 
 class TilePattern;
 class TilePatternData;
+class TilesetData;
 
 /**
  * \brief A set of tile patterns that are used to compose a map.
@@ -43,6 +44,11 @@ class Tileset {
     Tileset(const std::string& id);
 
     void load();
+    void load(
+        const TilesetData& data,
+        const SurfacePtr& tiles_image,
+        const SurfacePtr& entities_image
+    );
     void unload();
 
     const std::string& get_id();
@@ -50,6 +56,7 @@ class Tileset {
     bool is_loaded();
     const SurfacePtr& get_tiles_image();
     const SurfacePtr& get_entities_image();
+    bool has_tile_pattern(const std::string& id) const;
     TilePattern& get_tile_pattern(const std::string& id);
     void set_images(const std::string& other_id);
 
@@ -120,6 +120,8 @@ class SOLARUS_API TilesetData : public LuaData {
 
     virtual bool import_from_lua(lua_State* l) override;
     virtual bool export_to_lua(std::ostream& out) const override;
+    virtual bool import_from_binary(const char* buffer, size_t size) override;
+    virtual bool export_to_binary(std::string& buffer) const override;
 
   private:
 
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_BINARY_DATA_H
+#define SOLARUS_BINARY_DATA_H
+
+#include "solarus/Common.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Solarus {
+
+/**
+ * \brief Compact binary representation of quest data files.
+ *
+ * Data files like maps, tilesets and sprites are Lua source files.
+ * They can also be compiled into a binary file that is much faster to load:
+ * no Lua parser and no Lua state are involved.
+ *
+ * A binary data file has a header (magic number, format name, version),
+ * then a table of all distinct strings of the file and finally the
+ * records of the data, which are little-endian integers and indexes in the
+ * string table.
+ * Files are read directly from memory, typically from a memory-mapped file.
+ *
+ * The text files remain the reference: binary files are only a cache
+ * generated by the solarus_compile tool.
+ */
+class SOLARUS_API BinaryData {
+
+  public:
+
+    static constexpr uint32_t version = 1;  /**< Version of the binary format.
+                                             * Increase it when a record changes. */
+
+    /**
+     * \brief Builds a binary data file.
+     */
+    class SOLARUS_API Writer {
+
+      public:
+
+        explicit Writer(const std::string& format);
+
+        void write_uint8(uint8_t value);
+        void write_uint32(uint32_t value);
+        void write_int32(int32_t value);
+        void write_string(const std::string& value);
+
+        std::string get_buffer() const;
+
+      private:
+
+        static void append_uint32(std::string& buffer, uint32_t value);
+
+        std::string format;                 /**< Name of the format, 4 characters. */
+        std::string records;                /**< Data written so far. */
+        std::vector<std::string> strings;   /**< Distinct strings written so far. */
+        std::unordered_map<std::string, uint32_t>
+            string_indexes;                 /**< Index of each string in the table. */
+
+    };
+
+    /**
+     * \brief Reads a binary data file from memory.
+     *
+     * Reading past the end or an invalid string index makes the reader
+     * invalid: callers only have to check is_valid() at the end.
+     */
+    class SOLARUS_API Reader {
+
+      public:
+
+        Reader(const char* buffer, size_t size, const std::string& format);
+
+        bool is_valid() const;
+        bool is_finished() const;
+
+        uint8_t read_uint8();
+        uint32_t read_uint32();
+        int32_t read_int32();
+        const std::string& read_string();
+
+      private:
+
+        bool check_remaining(size_t size);
+
+        const char* buffer;                 /**< The file content. */
+        size_t size;                        /**< Size of the file in bytes. */
+        size_t position;                    /**< Position of the next record to read. */
+        bool valid;                         /**< \c false if an error occurred. */
+        std::vector<std::string> strings;   /**< The string table. */
+
+    };
+
+};
+
+}
+
+#endif
+
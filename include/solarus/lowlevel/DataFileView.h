@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_DATA_FILE_VIEW_H
+#define SOLARUS_DATA_FILE_VIEW_H
+
+#include "solarus/Common.h"
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace Solarus {
+
+class DataFileView;
+
+/**
+ * \brief Alias for shared_ptr of a read-only DataFileView.
+ */
+using DataFileViewPtr = std::shared_ptr<const DataFileView>;
+
+/**
+ * \brief Read-only content of a data file.
+ *
+ * A view either maps a regular file into memory, owns a buffer read
+ * from an archive, or is a part of another view (an entry stored without
+ * compression in a mapped archive).
+ * Views are shared: the memory stays valid as long as a DataFileViewPtr
+ * to it exists, which lets decoders keep using it without copying it.
+ *
+ * Views are obtained with QuestFiles::data_file_read_view().
+ */
+class SOLARUS_API DataFileView {
+
+  public:
+
+    ~DataFileView();
+
+    DataFileView(const DataFileView& other) = delete;
+    DataFileView& operator=(const DataFileView& other) = delete;
+
+    static DataFileViewPtr create_from_buffer(std::string&& buffer);
+    static DataFileViewPtr create_from_file(
+        const std::string& path,
+        size_t min_size
+    );
+    static DataFileViewPtr create_from_part(
+        const DataFileViewPtr& parent,
+        size_t offset,
+        size_t size
+    );
+
+    const char* data() const;
+    size_t size() const;
+    bool empty() const;
+    bool is_mapped() const;
+    std::string to_string() const;
+
+  private:
+
+    DataFileView();
+
+    std::string buffer;         /**< Content of the file when it is not mapped. */
+    const char* mapped_data;    /**< Content of the file when it is mapped,
+                                 * or nullptr. */
+    size_t mapped_size;         /**< Size of the mapped content. */
+    DataFileViewPtr parent;     /**< View that owns the mapped content when
+                                 * this view is only a part of it. */
+
+};
+
+}
+
+#endif
+
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_FILE_WRITER_H
+#define SOLARUS_FILE_WRITER_H
+
+#include "solarus/Common.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Solarus {
+
+/**
+ * \brief Writes files on a background I/O thread.
+ *
+ * Each file is first written to a temporary file, flushed to the disk
+ * and then renamed to its final name.
+ * A crash or a power loss in the middle of a save therefore leaves
+ * either the old file or the new one, never a truncated file.
+ *
+ * The content is produced by a serializer function that also runs on the
+ * I/O thread, so that the caller only has to snapshot its data.
+ * When a file is saved again before the previous request is started,
+ * both requests are coalesced: only the most recent content is written
+ * and all callbacks are called.
+ *
+ * Callbacks are called from the main thread, by update().
+ * When the I/O thread is not running (for example in tools that do not
+ * initialize the engine), files are written directly by the caller.
+ */
+class SOLARUS_API FileWriter {
+
+  public:
+
+    /**
+     * \brief Produces the content of a file to write.
+     */
+    using Serializer = std::function<std::string()>;
+
+    /**
+     * \brief Function called when a file is written.
+     *
+     * Its parameter tells whether the file was saved successfully.
+     */
+    using Callback = std::function<void(bool)>;
+
+    static void initialize();
+    static void quit();
+    static bool is_running();
+
+    static void write_async(
+        const std::string& file_name,
+        const Serializer& serializer,
+        const Callback& callback = nullptr
+    );
+    static bool write(
+        const std::string& file_name,
+        const std::string& content
+    );
+    static void flush();
+    static void finish();
+    static void update();
+
+    static bool write_atomically(
+        const std::string& file_name,
+        const std::string& content
+    );
+
+  private:
+
+    /**
+     * \brief Result of a request, for callers that wait for it.
+     */
+    struct Completion {
+      bool done = false;             /**< Whether the file was written. */
+      bool success = false;          /**< Whether the write was successful. */
+    };
+
+    /**
+     * \brief A file waiting to be written.
+     */
+    struct Request {
+      Serializer serializer;         /**< Produces the content to write. */
+      std::vector<Callback>
+          callbacks;                 /**< Functions to call from the main thread. */
+      std::vector<std::shared_ptr<Completion>>
+          completions;               /**< Callers waiting for this request. */
+    };
+
+    static void enqueue(
+        const std::string& file_name,
+        const Serializer& serializer,
+        const Callback& callback,
+        const std::shared_ptr<Completion>& completion
+    );
+    static void run();
+
+    static std::thread thread;                       /**< The I/O thread. */
+    static std::mutex mutex;                         /**< Lock for the fields below. */
+    static std::condition_variable condition;        /**< Notified when requests
+                                                      * are added or done. */
+    static bool running;                             /**< Whether the thread should run. */
+    static std::deque<std::string> queue;            /**< Files to write in order. */
+    static std::map<std::string, Request>
+        pending_requests;                            /**< Request of each file in the queue. */
+    static bool busy;                                /**< Whether a file is being written. */
+    static std::vector<std::pair<Callback, bool>>
+        finished_callbacks;                          /**< Callbacks to call from the main
+                                                      * thread with their result. */
+
+};
+
+}
+
+#endif
+
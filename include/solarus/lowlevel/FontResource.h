@@ -18,6 +18,7 @@
 #define SOLARUS_FONT_RESOURCE_H
 
 #include "solarus/Common.h"
+#include "solarus/lowlevel/DataFileView.h"
 #include "solarus/lowlevel/SurfacePtr.h"
 #include <map>
 #include <memory>
@@ -71,7 +72,7 @@ class FontResource {
      */
     struct FontFile {
       std::string file_name;                          /**< Name of the font file, relative to the data directory. */
-      std::string buffer;                             /**< The font file loaded into memory. */
+      DataFileViewPtr buffer;                         /**< The font file loaded into memory. */
 
       SurfacePtr bitmap_font;                         /**< The font bitmap. Only used for bitmap fonts. */
       std::map<int, OutlineFontReader>
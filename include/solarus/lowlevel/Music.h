@@ -19,15 +19,21 @@
 
 #include "solarus/Common.h"
 #include "solarus/lowlevel/ItDecoder.h"
+#include "solarus/lowlevel/SpcCache.h"
 #include "solarus/lowlevel/SpcDecoder.h"
 #include "solarus/lowlevel/Sound.h"
 #include "solarus/lua/ScopedLuaRef.h"
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
 namespace Solarus {
 
+class Arguments;
+
 /**
  * \brief Represents a music that can be played.
  *
@@ -38,6 +44,26 @@ namespace Solarus {
  * initialized, by calling Sound::initialize().
  * Sound and Music are the only classes that depends on audio libraries.
  *
+ * Musics are decoded and streamed to OpenAL by a dedicated thread,
+ * so that decoding does not slow down the main loop and a slow frame does not
+ * starve the audio.
+ * Public functions are called from the main thread. They only change the
+ * state of the music, protected by a mutex that the streaming thread only
+ * takes to get the current music: decoding is done without it.
+ * Each music has its own decoder mutex, which the main thread only takes
+ * to access the channels and the tempo of .it musics.
+ * A music stopped while the streaming thread decodes it is released
+ * by the streaming thread when it is done.
+ * The number and the size of streaming buffers can be set with the
+ * -music-buffer-count and -music-buffer-size options to trade latency
+ * for robustness.
+ * With the option -spc-prerender=yes, SPC musics are played from samples
+ * rendered once by SpcCache rather than emulated.
+ *
+ * The next music can be preloaded: the streaming thread then opens it and
+ * fills its first buffers in advance, and playing it later starts
+ * immediately if the loop setting is the same.
+ *
  * TODO move the non-static parts to an internal private class.
  * TODO make a subclass for each format?
  */
@@ -60,7 +86,7 @@ class Music {
     static const std::vector<std::string>
         format_names;                            /**< Name of each format. */
 
-    static void initialize();
+    static void initialize(const Arguments& args);
     static void quit();
     static bool is_initialized();
     static void update();
@@ -88,6 +114,9 @@ class Music {
     );
     static void stop_playing();
     static const std::string& get_current_music_id();
+    static void preload(const std::string& music_id, bool loop);
+
+    ~Music();
 
   private:
 
@@ -99,7 +128,9 @@ class Music {
     );
 
     bool start();
+    bool load(std::string& error);
     void stop();
+    void release();
     bool is_paused();
     void set_paused(bool pause);
     void set_callback(const ScopedLuaRef& callback_ref);
@@ -108,8 +139,12 @@ class Music {
     void decode_it(ALuint destination_buffer, ALsizei nb_samples);
     void decode_ogg(ALuint destination_buffer, ALsizei nb_samples);
 
+    void fill_buffers();
     bool update_playing();
 
+    static void stream();
+    static void preload_next_music();
+
     std::string id;                              /**< id of this music */
     std::string file_name;                       /**< name of the file to play */
     Format format;                               /**< format of the music, detected from the file name */
@@ -120,17 +155,37 @@ class Music {
     OggVorbis_File ogg_file;                     /**< the file used by the vorbisfile lib */
     Sound::SoundFromMemory ogg_mem;              /**< the encoded music loaded in memory, passed to the vorbisfile lib as user data */
 
-    static constexpr int nb_buffers = 8;
-    ALuint buffers[nb_buffers];                  /**< multiple buffers used to stream the music */
+    // SPC specific
+    std::unique_ptr<SpcDecoder> spc_decoder;     /**< the SPC decoder */
+    std::unique_ptr<SpcCache::Reader>
+        spc_reader;                              /**< the prerendered music if any, instead of the SPC decoder */
+
+    // IT specific
+    std::unique_ptr<ItDecoder> it_decoder;       /**< the IT decoder */
+
+    std::vector<ALuint> buffers;                 /**< multiple buffers used to stream the music */
+    std::vector<ALuint> free_buffers;            /**< buffers to fill and queue */
     ALuint source;                               /**< the OpenAL source streaming the buffers */
+    std::atomic<bool> finished;                  /**< whether the end was reached */
+    std::atomic<bool> stopped;                   /**< whether stop() was called */
+    std::mutex decoder_mutex;                    /**< protects the decoders and the buffers
+                                                  * while the music is decoded */
 
-    static std::unique_ptr<SpcDecoder>
-        spc_decoder;                             /**< the SPC decoder */
-    static std::unique_ptr<ItDecoder>
-        it_decoder;                              /**< the IT decoder */
+    static bool initialized;                     /**< whether the music system is initialized */
     static float volume;                         /**< volume of musics (0.0 to 1.0) */
-
-    static std::unique_ptr<Music> current_music; /**< the music currently played (if any) */
+    static int nb_buffers;                       /**< number of streaming buffers */
+    static int buffer_size;                      /**< number of samples per streaming buffer */
+
+    static std::shared_ptr<Music> current_music; /**< the music currently played (if any) */
+    static std::shared_ptr<Music> preloaded_music; /**< the next music, ready to play (if any) */
+    static std::string music_to_preload;         /**< id of the music to preload, empty if none */
+    static bool music_to_preload_loop;           /**< whether the music to preload should loop */
+    static std::string preloading_error;         /**< error to print from the main thread */
+
+    static std::thread streaming_thread;         /**< thread that decodes and queues buffers */
+    static std::atomic<bool> streaming_stopped;  /**< tells the streaming thread to finish */
+    static std::mutex mutex;                     /**< protects the current and the preloaded
+                                                  * musics from the streaming thread */
 
 };
 
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_OFFLINE_AUDIO_H
+#define SOLARUS_OFFLINE_AUDIO_H
+
+#include "solarus/Common.h"
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <alc.h>
+
+namespace Solarus {
+
+/**
+ * \brief Renders the audio without a sound card.
+ *
+ * With the option -audio-output=null or -audio-output=<file.wav>, OpenAL
+ * mixes musics and sounds in software into memory instead of playing them
+ * on a device.
+ * Samples are rendered at each update of the main loop according to the
+ * simulated time, so that audio follows the simulation even when it runs
+ * faster than real time, like in tests.
+ * The result can be saved as a WAV file.
+ *
+ * The time spent decoding each audio format is measured and printed
+ * when the audio system is closed.
+ *
+ * This requires the ALC_SOFT_loopback extension of OpenAL Soft.
+ */
+class OfflineAudio {
+
+  public:
+
+    static ALCdevice* open_device(
+        const std::string& output,
+        std::vector<ALCint>& context_attributes
+    );
+    static void close();
+    static bool is_enabled();
+
+    static void render(uint32_t duration);
+
+    static void add_decoding_time(
+        const std::string& format,
+        std::chrono::steady_clock::duration time,
+        int nb_frames,
+        int sample_rate
+    );
+
+  private:
+
+    /**
+     * \brief Decoding statistics of an audio format.
+     */
+    struct DecodingStats {
+      std::chrono::steady_clock::duration time;  /**< Total time spent decoding. */
+      double audio_duration;                     /**< Seconds of audio decoded. */
+    };
+
+    static void write_wav_header(uint32_t data_size);
+    static void print_decoding_stats();
+
+    static bool enabled;                         /**< Whether the offline device is used. */
+    static ALCdevice* device;                    /**< The loopback device. */
+    static int frequency;                        /**< Output sample rate. */
+    static uint64_t rendering_remainder;         /**< Fraction of frame not rendered yet. */
+    static std::vector<int16_t> samples;         /**< Buffer of rendered samples. */
+    static std::ofstream wav_file;               /**< Output file if any. */
+    static uint64_t wav_data_size;               /**< Bytes of samples written. */
+    static std::mutex stats_mutex;               /**< Protects the statistics
+                                                  * (decoding threads update them). */
+    static std::map<std::string, DecodingStats>
+        decoding_stats;                          /**< Statistics of each format. */
+
+};
+
+}
+
+#endif
+
@@ -18,6 +18,7 @@
 #define SOLARUS_PIXEL_BITS_H
 
 #include "solarus/Common.h"
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -43,6 +44,8 @@ class PixelBits {
     bool test_collision(const PixelBits& other,
         const Point& location1, const Point& location2) const;
 
+    size_t get_memory_used() const;
+
   private:
 
     void print() const;
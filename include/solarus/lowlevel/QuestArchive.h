@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_QUEST_ARCHIVE_H
+#define SOLARUS_QUEST_ARCHIVE_H
+
+#include "solarus/Common.h"
+#include "solarus/lowlevel/DataFileView.h"
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Solarus {
+
+/**
+ * \brief Fast read-only access to the entries of a quest data archive.
+ *
+ * The archive (data.solarus or data.solarus.zip) is mapped into memory and
+ * its central directory is read once to build a hash index of all entries.
+ * Entries stored without compression (usually images and musics, which are
+ * already compressed) are returned as views of the mapped archive, without
+ * any copy.
+ * Compressed entries are inflated directly into their final buffer.
+ *
+ * Several entries can also be inflated in parallel in advance by a pool of
+ * worker threads with prefetch().
+ * Entries prefetched and still not read when prefetch() is called again
+ * are released.
+ *
+ * Only zip archives without encryption nor zip64 extensions are supported,
+ * with stored or deflated entries.
+ * QuestFiles falls back to PhysFS for anything else.
+ */
+class SOLARUS_API QuestArchive {
+
+  public:
+
+    static std::unique_ptr<QuestArchive> open(const std::string& path);
+    ~QuestArchive();
+
+    QuestArchive(const QuestArchive& other) = delete;
+    QuestArchive& operator=(const QuestArchive& other) = delete;
+
+    size_t get_num_entries() const;
+    bool has_entry(const std::string& file_name) const;
+    DataFileViewPtr read(const std::string& file_name);
+    void prefetch(const std::vector<std::string>& file_names);
+
+  private:
+
+    /**
+     * \brief Location of an entry in the archive.
+     */
+    struct Entry {
+      uint32_t header_offset;          /**< Position of the local header. */
+      uint32_t compressed_size;        /**< Size of the data in the archive. */
+      uint32_t uncompressed_size;      /**< Size of the file. */
+      uint16_t method;                 /**< 0 (stored) or 8 (deflated). */
+    };
+
+    explicit QuestArchive(const DataFileViewPtr& mapping);
+
+    bool read_index();
+    DataFileViewPtr read_entry(const Entry& entry) const;
+    void release_stale_prefetches();
+    void run_worker();
+
+    DataFileViewPtr mapping;             /**< The whole archive mapped in memory. */
+    std::unordered_map<std::string, Entry>
+        entries;                         /**< Entries indexed by file name. */
+
+    std::mutex prefetch_mutex;           /**< Lock for the prefetching state. */
+    std::condition_variable
+        prefetch_condition;              /**< Notified when prefetching
+                                          * state changes. */
+    std::deque<std::string> files_to_prefetch;  /**< Entries waiting for a worker. */
+    std::set<std::string> files_prefetching;    /**< Entries being inflated by
+                                                 * a worker. */
+    std::map<std::string, DataFileViewPtr>
+        prefetched;                      /**< Inflated entries not read yet. */
+    std::map<std::string, uint32_t>
+        prefetch_requests;               /**< Call to prefetch() that last requested
+                                          * each entry queued, being inflated
+                                          * or inflated and not read yet. */
+    uint32_t prefetch_generation;        /**< Number of calls to prefetch(). */
+    size_t prefetched_size;              /**< Total size of prefetched entries,
+                                          * including the ones being inflated. */
+    bool stopping;                       /**< Whether workers should stop. */
+    std::vector<std::thread> workers;    /**< Threads that inflate entries. */
+
+};
+
+}
+
+#endif
+
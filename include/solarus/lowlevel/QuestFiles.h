@@ -18,6 +18,11 @@
 #define SOLARUS_QUEST_FILES_H
 
 #include "solarus/Common.h"
+#include "solarus/lowlevel/DataFileView.h"
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -26,6 +31,7 @@ struct lua_State;
 namespace Solarus {
 
 class Arguments;
+class QuestArchive;
 
 /**
  * \brief Handles access to data files of the current quest.
@@ -36,6 +42,13 @@ class Arguments;
  * current quest (including the language-specific ones)
  * and is the only one that calls the PHYSFS library to get data files from
  * the data archive when necessary.
+ *
+ * Big files can be read without copying them with data_file_read_view():
+ * large files of the data directory are mapped into memory, and the content
+ * of an archive entry is shared by all views of it that are still alive.
+ *
+ * When the quest is a data archive, its entries are indexed at
+ * initialization and read without PhysFS by QuestArchive.
  */
 class SOLARUS_API QuestFiles {
 
@@ -68,6 +81,12 @@ class SOLARUS_API QuestFiles {
         const std::string& file_name,
         bool language_specific = false
     );
+    static DataFileViewPtr data_file_read_view(
+        const std::string& file_name,
+        bool language_specific = false
+    );
+    static void data_files_prefetch(const std::vector<std::string>& file_names);
+    static int64_t data_file_get_modification_date(const std::string& file_name);
     static void data_file_save(
         const std::string& file_name,
         const std::string& buffer
@@ -94,6 +113,11 @@ class SOLARUS_API QuestFiles {
   private:
 
     static void set_solarus_write_dir(const std::string& solarus_write_dir);
+    static std::string get_full_file_name(
+        const std::string& file_name,
+        bool language_specific
+    );
+    static std::string read_file(const std::string& full_file_name);
 
     static std::string quest_path;                       /**< Path of the data/ directory, the data.solarus archive
                                                           * or the data.solarus.zip archive,
@@ -103,6 +127,15 @@ class SOLARUS_API QuestFiles {
 
     static std::vector<std::string> temporary_files;     /**< Name of all temporary files created. */
 
+    static std::map<std::string, std::weak_ptr<const DataFileView>>
+        views;                                           /**< Views of data files still in use,
+                                                          * indexed by file name. */
+    static std::mutex views_mutex;                       /**< Lock for views, which can be
+                                                          * requested by any thread. */
+    static std::unique_ptr<QuestArchive> archive;        /**< Index of the data archive, or nullptr
+                                                          * if the quest is not an archive or if
+                                                          * it is read with PhysFS. */
+
 };
 
 }
@@ -18,9 +18,17 @@
 #define SOLARUS_SOUND_H
 
 #include "solarus/Common.h"
+#include "solarus/lowlevel/DataFileView.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <string>
 #include <list>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <al.h>
 #include <alc.h>
 #include <vorbis/vorbisfile.h>
@@ -37,6 +45,19 @@ class Arguments;
  * rather than calling directly the constructor of Sound.
  * This class is the only one that depends on the sound decoding library (libsndfile).
  * This class and the Music class are the only ones that depend on the audio mixer library (OpenAL).
+ *
+ * Sounds preloaded with load_all() are decoded in parallel by background
+ * threads while the game continues. Playing a sound that is not decoded yet
+ * waits only for that sound.
+ * With the option -sound-cache=yes, decoded samples are also saved in the
+ * quest write directory to skip decoding on the next runs.
+ *
+ * Sounds are played by a fixed pool of OpenAL sources created at
+ * initialization (option -sound-voices, default 32).
+ * Each sound can limit how many instances of itself play at the same time.
+ * When no source is free, the oldest voice of lowest priority is stolen,
+ * unless all playing sounds have a higher priority: then the new sound is
+ * dropped.
  */
 class Sound {
 
@@ -48,7 +69,7 @@ class Sound {
      * \brief Buffer containing an encoded sound file.
      */
     struct SoundFromMemory {
-      std::string data;         /**< the buffer */
+      DataFileViewPtr data;     /**< the buffer */
       size_t position;          /**< current position in the buffer */
       bool loop;                /**< true to restart the sound when finished */
     };
@@ -74,23 +95,104 @@ class Sound {
     static int get_volume();
     static void set_volume(int volume);
 
+    static int get_priority(const std::string& sound_id);
+    static void set_priority(const std::string& sound_id, int priority);
+    static int get_max_voices(const std::string& sound_id);
+    static void set_max_voices(const std::string& sound_id, int max_voices);
+
+    /**
+     * \brief Usage statistics of the pool of sources.
+     */
+    struct VoiceStats {
+      int nb_sources;           /**< Size of the pool. */
+      int nb_active_voices;     /**< Sources currently playing a sound. */
+      int max_active_voices;    /**< Highest number of sources used at the same time. */
+      int nb_stolen_voices;     /**< Voices interrupted to play another sound. */
+      int nb_dropped_voices;    /**< Sounds not played because no source was available. */
+    };
+
+    static VoiceStats get_voice_stats();
+
   private:
 
-    ALuint decode_file(const std::string &file_name);
-    bool update_playing();
+    /**
+     * \brief A source of the pool currently playing a sound.
+     */
+    struct Voice {
+      ALuint source;            /**< The OpenAL source. */
+      Sound* sound;             /**< The sound played. */
+      uint32_t serial;          /**< Increasing number telling the oldest voices. */
+    };
+
+    /**
+     * \brief State of a sound being decoded.
+     */
+    enum DecodingState {
+      DECODING_PENDING,     /**< Not started yet. */
+      DECODING_RUNNING,     /**< Being decoded by some thread. */
+      DECODING_DONE         /**< Samples ready (or error). */
+    };
+
+    /**
+     * \brief A sound file to decode, possibly by another thread.
+     */
+    struct DecodingJob {
+      std::string file_name;            /**< The sound file. */
+      DataFileViewPtr encoded;          /**< Content of the file, released once decoded. */
+      uint64_t hash;                    /**< Hash of the file content. */
+      std::vector<int16_t> samples;     /**< Decoded stereo samples. */
+      ALsizei sample_rate;              /**< Sample rate of the samples. */
+      bool from_cache;                  /**< Whether samples come from the disk cache. */
+      std::string error;                /**< Error message in case of failure. */
+      std::atomic<int> state;           /**< A DecodingState. */
+    };
+
+    static Sound& get_sound(const std::string& sound_id);
+
+    std::shared_ptr<DecodingJob> create_decoding_job() const;
+    void finish_loading();
+    ALuint acquire_source();
+    int find_voice_to_steal() const;
+
+    static void release_voice(size_t index);
+    static void stop_all_voices();
+
+    static void decode(DecodingJob& job);
+    static void run_decoding_thread();
+    static void stop_decoding_threads();
+    static bool load_from_cache(DecodingJob& job);
+    static void save_to_cache(const std::shared_ptr<const DecodingJob>& job);
+    static std::string get_cache_file_name(const std::string& file_name);
 
     static ALCdevice* device;
     static ALCcontext* context;
 
     std::string id;                              /**< id of this sound */
     ALuint buffer;                               /**< the OpenAL buffer containing the PCM decoded data of this sound */
-    std::list<ALuint> sources;                   /**< the sources currently playing this sound */
-    static std::list<Sound*> current_sounds;     /**< the sounds currently playing */
+    std::shared_ptr<DecodingJob> decoding_job;   /**< decoding in progress if any */
+    int nb_voices;                               /**< number of sources currently playing this sound */
+    int max_voices;                              /**< maximum number of simultaneous voices (0 means no limit) */
+    int priority;                                /**< voices of higher priority are stolen last */
     static std::map<std::string, Sound> all_sounds;   /**< all sounds created before */
 
+    static std::vector<ALuint> free_sources;     /**< sources of the pool not playing */
+    static std::vector<Voice> voices;            /**< sources of the pool playing, in no particular order */
+    static uint32_t next_voice_serial;           /**< serial number of the next voice */
+    static VoiceStats voice_stats;               /**< usage statistics of the pool */
+
     static bool initialized;                     /**< indicates that the audio system is initialized */
     static bool sounds_preloaded;                /**< true if load_all() was called */
     static float volume;                         /**< the volume of sound effects (0.0 to 1.0) */
+    static bool cache_enabled;                   /**< whether decoded sounds are saved in the quest write directory */
+
+    static std::vector<std::thread> decoding_threads;  /**< threads decoding preloaded sounds */
+    static std::vector<std::shared_ptr<DecodingJob>>
+        decoding_queue;                          /**< sounds to decode by the threads */
+    static std::atomic<size_t> next_decoding_job;  /**< index of the next job of the queue */
+    static std::mutex decoding_mutex;            /**< to wait for a sound being decoded */
+    static std::condition_variable
+        decoding_finished;                       /**< notified when a sound is decoded */
+    static std::list<Sound*> sounds_decoding;    /**< preloaded sounds not ready yet */
 
 };
 
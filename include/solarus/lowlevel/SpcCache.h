@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_SPC_CACHE_H
+#define SOLARUS_SPC_CACHE_H
+
+#include "solarus/Common.h"
+#include "solarus/lowlevel/DataFileView.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Solarus {
+
+class Arguments;
+
+/**
+ * \brief Keeps SPC musics rendered once to avoid emulating the SPC700 forever.
+ *
+ * With the option -spc-prerender=yes, the first time an SPC music is played,
+ * a background thread emulates it as fast as possible until it finds the
+ * point where the music loops.
+ * The intro and one iteration of the loop are stored as losslessly compressed
+ * PCM, in memory and in the quest write directory.
+ * The next times, the music is streamed from these samples and resampled
+ * to the output frequency instead of being emulated.
+ *
+ * Musics whose loop cannot be found in the first minutes are still
+ * emulated in real time.
+ */
+class SpcCache {
+
+  public:
+
+    /**
+     * \brief An SPC music rendered as PCM.
+     *
+     * Samples are stereo at 32 KHz, split in blocks compressed independently.
+     */
+    struct Track {
+      std::vector<uint8_t> data;            /**< Compressed blocks. */
+      std::vector<uint32_t> block_offsets;  /**< Position of each block in data. */
+      int nb_frames;                        /**< Number of stereo frames (intro and loop). */
+      int loop_start;                       /**< First frame of the loop. */
+    };
+
+    /**
+     * \brief Streams a rendered track at the output frequency, looping forever.
+     *
+     * Readers are used by the music streaming thread.
+     */
+    class Reader {
+
+      public:
+
+        explicit Reader(const std::shared_ptr<const Track>& track);
+
+        void read(int16_t* output, int nb_frames);
+
+      private:
+
+        void read_frames(int16_t* output, int nb_frames);
+        void decode_block(int block_index);
+
+        std::shared_ptr<const Track> track;   /**< The track to play. */
+        int position;                         /**< Next frame of the track to read. */
+        int decoded_block_index;              /**< Block currently in decoded_block or -1. */
+        std::vector<int16_t> decoded_block;   /**< Samples of the current block. */
+        std::vector<int16_t> input;           /**< Frames waiting to be resampled. */
+        int nb_input_frames;                  /**< Number of frames in input. */
+        uint32_t phase;                       /**< Position in input, in 16.16 fixed point. */
+
+    };
+
+    static void initialize(const Arguments& args);
+    static void quit();
+    static bool is_enabled();
+    static void update();
+
+    static int get_output_frequency();
+    static std::shared_ptr<const Track> get_track(
+        const std::string& file_name,
+        const DataFileViewPtr& spc_data
+    );
+
+  private:
+
+    /**
+     * \brief An SPC music to render by the background thread.
+     */
+    struct RenderingJob {
+      std::string file_name;                /**< The SPC file. */
+      DataFileViewPtr spc_data;             /**< Content of the file. */
+      uint64_t hash;                        /**< Hash of the file content. */
+      std::shared_ptr<Track> track;         /**< Result. */
+      std::string error;                    /**< Error message in case of failure. */
+    };
+
+    /**
+     * \brief A track known by the cache.
+     */
+    struct Entry {
+      uint64_t hash;                        /**< Hash of the SPC file it was rendered from. */
+      std::shared_ptr<const Track> track;   /**< The track, nullptr if it has no loop. */
+    };
+
+    static void run_rendering_thread();
+    static bool render(RenderingJob& job);
+    static void compress(const std::vector<uint32_t>& frames, Track& track);
+    static void add_entry(const std::string& file_name, const Entry& entry);
+    static std::string get_cache_file_name(const std::string& file_name);
+    static bool load_from_disk(const std::string& file_name, uint64_t hash, Entry& entry);
+    static void save_to_disk(const std::string& file_name, const Entry& entry);
+
+    static bool enabled;                           /**< Whether SPC musics are prerendered. */
+    static int output_frequency;                   /**< Sample rate of the audio device. */
+    static std::map<std::string, Entry> entries;   /**< Tracks in memory indexed by file name. */
+    static std::list<std::string> entries_order;   /**< Tracks in memory, most recently used first. */
+    static std::list<std::string> files_rendering; /**< Files queued or being rendered. */
+
+    static std::thread rendering_thread;           /**< Thread rendering SPC musics. */
+    static std::atomic<bool> rendering_stopped;    /**< Tells the thread to finish. */
+    static std::mutex rendering_mutex;             /**< Protects the tracks and the job lists. */
+    static std::condition_variable rendering_condition;  /**< Notified when a job is queued. */
+    static std::list<std::shared_ptr<RenderingJob>>
+        jobs_to_render;                            /**< Jobs waiting for the thread. */
+    static std::list<std::shared_ptr<RenderingJob>>
+        jobs_rendered;                             /**< Jobs finished, not collected yet. */
+
+};
+
+}
+
+#endif
+
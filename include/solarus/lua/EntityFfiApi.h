@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_ENTITY_FFI_API_H
+#define SOLARUS_ENTITY_FFI_API_H
+
+#include "solarus/Common.h"
+
+/**
+ * \file EntityFfiApi.h
+ * \brief C functions giving fast access to entities from the LuaJIT FFI.
+ *
+ * Lua functions like entity:get_distance() are called very often by enemy
+ * scripts, and most of their cost is in the Lua/C++ binding itself.
+ * With LuaJIT, the engine replaces these methods by Lua wrappers that call
+ * the functions below through the FFI, which the JIT compiler can inline
+ * into traces.
+ *
+ * An entity handle is the address of the Lua userdata of an entity,
+ * which is what the FFI passes for a userdata given as a void* argument.
+ * These functions do not check their parameters: the Lua wrappers do,
+ * and fall back to the classic binding in case of doubt.
+ * They must not call Lua nor throw exceptions.
+ */
+
+extern "C" {
+
+SOLARUS_API void solarus_entity_get_position(const void* entity, int* xyz);
+SOLARUS_API int solarus_entity_get_distance(const void* entity, int x, int y);
+SOLARUS_API int solarus_entity_get_distance_to_entity(const void* entity, const void* other);
+SOLARUS_API int solarus_entity_get_direction4_to(const void* entity, int x, int y);
+SOLARUS_API int solarus_entity_get_direction4_to_entity(const void* entity, const void* other);
+SOLARUS_API int solarus_entity_get_direction8_to(const void* entity, int x, int y);
+SOLARUS_API int solarus_entity_get_direction8_to_entity(const void* entity, const void* other);
+SOLARUS_API int solarus_entity_overlaps(const void* entity, int x, int y, int width, int height);
+SOLARUS_API int solarus_entity_overlaps_entity(const void* entity, const void* other);
+
+}
+
+#endif
+
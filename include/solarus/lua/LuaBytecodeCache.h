@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_LUA_BYTECODE_CACHE_H
+#define SOLARUS_LUA_BYTECODE_CACHE_H
+
+#include "solarus/Common.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+struct lua_State;
+
+namespace Solarus {
+
+class Arguments;
+
+/**
+ * \brief Keeps compiled Lua chunks to avoid parsing quest files again.
+ *
+ * Map scripts and Lua data files (maps, tilesets, sprites, dialogs...)
+ * are loaded many times during a game.
+ * This class remembers the bytecode of each chunk compiled, identified by
+ * its file name and a hash of its source.
+ * Loading the same source again then skips the Lua parser.
+ *
+ * The cache always lives in memory.
+ * With the option -lua-bytecode-cache=disk, it is also persisted in the
+ * quest write directory so that the next run of the quest benefits from it.
+ *
+ * Chunks that are already precompiled (for example quest archives built
+ * with only bytecode) are loaded directly and never cached.
+ *
+ * Chunks can be loaded from any thread, for example when data files of
+ * a map are parsed in the background.
+ * The lock is only held to look up and insert entries: compiling, hashing
+ * and file accesses are done outside of it.
+ */
+class SOLARUS_API LuaBytecodeCache {
+
+  public:
+
+    /**
+     * \brief Where compiled chunks are kept.
+     */
+    enum class Mode {
+      DISABLED,      /**< Always compile from source. */
+      MEMORY,        /**< Keep bytecode in memory during the execution. */
+      DISK           /**< Also store bytecode in the quest write directory. */
+    };
+
+    static void initialize(const Arguments& args);
+    static void quit();
+
+    static Mode get_mode();
+    static void set_mode(Mode mode);
+
+    static int load_buffer(
+        lua_State* l,
+        const std::string& buffer,
+        const std::string& chunk_name
+    );
+    static int load_buffer(
+        lua_State* l,
+        const char* buffer,
+        size_t size,
+        const std::string& chunk_name
+    );
+    static bool is_bytecode(const std::string& buffer);
+    static bool is_bytecode(const char* buffer, size_t size);
+
+    static int get_num_hits();
+    static int get_num_misses();
+
+  private:
+
+    /**
+     * \brief A compiled chunk.
+     */
+    struct Entry {
+      uint64_t source_hash;    /**< Hash of the source it was compiled from. */
+      std::shared_ptr<const std::string>
+          bytecode;            /**< The compiled chunk. Shared so that it can
+                                * be loaded after the lock is released. */
+    };
+
+    static uint64_t compute_hash(const char* buffer, size_t size);
+    static bool insert_entry(
+        const std::string& chunk_name,
+        const Entry& entry
+    );
+    static std::string get_disk_file_name(const std::string& chunk_name);
+    static bool load_from_disk(
+        const std::string& chunk_name,
+        uint64_t source_hash,
+        std::string& bytecode
+    );
+    static void save_to_disk(
+        const std::string& chunk_name,
+        const Entry& entry
+    );
+
+    static Mode mode;                                /**< Current caching policy. */
+    static std::map<std::string, Entry> entries;     /**< Compiled chunks indexed by chunk name. */
+    static std::atomic<int> num_hits;                /**< Chunks loaded from bytecode. */
+    static std::atomic<int> num_misses;              /**< Chunks compiled from source. */
+    static std::mutex mutex;                         /**< Lock for the mode and the entries. */
+
+};
+
+}
+
+#endif
+
@@ -38,6 +38,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 struct lua_State;
 struct luaL_Reg;
@@ -61,6 +62,8 @@ class ExportableToLua;
 class EquipmentItem;
 class Game;
 class JumpMovement;
+class LuaProfiler;
+class LuaThread;
 class MainLoop;
 class Map;
 class Entity;
@@ -112,6 +115,7 @@ class LuaContext {
     static const std::string input_module_name;
     static const std::string file_module_name;
     static const std::string timer_module_name;
+    static const std::string thread_module_name;
     static const std::string game_module_name;
     static const std::string map_module_name;
     static const std::string item_module_name;
@@ -226,6 +230,11 @@ class LuaContext {
     );
     void stop_movement_on_point(const std::shared_ptr<Movement>& movement);
     void update_movements();
+    void destroy_movements();
+
+    // Worker threads.
+    void destroy_threads();
+    void update_threads();
 
     // Entities.
     static const std::string& get_entity_internal_type_name(EntityType entity_type);
@@ -297,6 +306,10 @@ class LuaContext {
     void movement_on_changed(Movement& movement);
     void movement_on_finished(Movement& movement);
 
+    // Thread events.
+    void thread_on_message(LuaThread& thread, const std::string& message);
+    void thread_on_finished(LuaThread& thread);
+
     // Equipment item events.
     void item_on_created(EquipmentItem& item);
     void item_on_started(EquipmentItem& item);
@@ -430,16 +443,24 @@ class LuaContext {
       main_api_get_angle,     // TODO remove?
       main_api_get_metatable,
       main_api_get_os,
+      main_api_start_profiler,
+      main_api_stop_profiler,
 
       // Audio API.
       audio_api_get_sound_volume,
       audio_api_set_sound_volume,
       audio_api_play_sound,
       audio_api_preload_sounds,
+      audio_api_get_sound_priority,
+      audio_api_set_sound_priority,
+      audio_api_get_sound_max_voices,
+      audio_api_set_sound_max_voices,
+      audio_api_get_sound_stats,
       audio_api_get_music_volume,
       audio_api_set_music_volume,
       audio_api_play_music,
       audio_api_stop_music,
+      audio_api_preload_music,
       audio_api_get_music,
       audio_api_get_music_format,
       audio_api_get_music_num_channels,
@@ -501,6 +522,12 @@ class LuaContext {
       timer_api_set_remaining_time,
       // TODO remove is_with_sound, set_with_sound (do this in pure Lua, possibly with a second timer)
 
+      // Thread API.
+      thread_api_start,
+      thread_api_post,
+      thread_api_stop,
+      thread_api_is_running,
+
       // Language API.
       language_api_get_language,
       language_api_set_language,
@@ -984,6 +1011,11 @@ class LuaContext {
     void print_lua_version();
 
     // Initialization of modules.
+    void register_api_function_names(
+        const std::string& module_name,
+        const luaL_Reg* functions,
+        const std::string& separator
+    );
     void register_functions(
         const std::string& module_name,
         const luaL_Reg* functions
@@ -1001,16 +1033,20 @@ class LuaContext {
     void register_input_module();
     void register_file_module();
     void register_timer_module();
+    void register_thread_module();
     void register_item_module();
     void register_surface_module();
     void register_text_surface_module();
     void register_sprite_module();
     void register_movement_module();
+    void push_movements_on_points_sentinel();
+    void find_movements_on_collected_points();
     void register_menu_module();
     void register_language_module();
     void register_game_module();
     void register_map_module();
     void register_entity_module();
+    void register_entity_ffi_api();
     void register_testing_module();
 
     // Pushing objects to Lua.
@@ -1020,6 +1056,7 @@ class LuaContext {
     static void push_userdata(lua_State* l, ExportableToLua& userdata);
     static void push_dialog(lua_State* l, const Dialog& dialog);
     static void push_timer(lua_State* l, const TimerPtr& timer);
+    static void push_thread(lua_State* l, LuaThread& thread);
     static void push_surface(lua_State* l, Surface& surface);
     static void push_text_surface(lua_State* l, TextSurface& text_surface);
     static void push_sprite(lua_State* l, Sprite& sprite);
@@ -1052,6 +1089,8 @@ class LuaContext {
     );
     static bool is_timer(lua_State* l, int index);
     static TimerPtr check_timer(lua_State* l, int index);
+    static bool is_thread(lua_State* l, int index);
+    static std::shared_ptr<LuaThread> check_thread(lua_State* l, int index);
     static bool is_drawable(lua_State* l, int index);
     static std::shared_ptr<Drawable> check_drawable(lua_State* l, int index);
     static bool is_surface(lua_State* l, int index);
@@ -1215,6 +1254,7 @@ class LuaContext {
       l_panic,
       l_loader,
       l_get_map_entity_or_global,
+      l_movements_on_points_gc,
       l_camera_do_callback,
       l_camera_restore,
       l_treasure_dialog_finished,
@@ -1258,18 +1298,38 @@ class LuaContext {
     std::list<TimerPtr>
         timers_to_remove;           /**< Timers to be removed at the next cycle. */
 
-    std::set<std::shared_ptr<Drawable>>
+    std::vector<std::shared_ptr<Drawable>>
         drawables;                  /**< All drawable objects created by
-                                     * this script. */
-    std::set<std::shared_ptr<Drawable>>
+                                     * this script, updated at each cycle. */
+    std::set<const Drawable*>
+        drawables_index;            /**< Drawable objects currently registered,
+                                     * for fast lookups. */
+    std::set<const Drawable*>
         drawables_to_remove;        /**< Drawable objects to be removed at the
                                      * next cycle. */
+    std::vector<std::shared_ptr<Movement>>
+        movements_on_points;        /**< Movements applied to x,y points,
+                                     * updated at each cycle. The Lua registry
+                                     * only keeps their x,y tables. */
+    std::set<const Movement*>
+        movements_on_points_to_remove;  /**< Movements on points to be removed
+                                         * at the next cycle. */
+    std::vector<std::shared_ptr<LuaThread>>
+        threads;                    /**< Worker threads started by this script
+                                     * and not finished yet. */
     std::map<const ExportableToLua*, std::set<std::string>>
         userdata_fields;            /**< Existing string keys created on each
                                      * userdata with our __newindex. This is
                                      * only for performance, to avoid Lua
                                      * lookups for callbacks like on_update. */
 
+    std::map<lua_CFunction, std::string>
+        api_function_names;         /**< Name of each C++ function registered
+                                     * in the Solarus API, for profiling. */
+    std::unique_ptr<LuaProfiler>
+        profiler;                   /**< Profiler of scripts, created by
+                                     * sol.main.start_profiler(). */
+
     static const std::map<EntityType, lua_CFunction>
         entity_creation_functions;  /**< Creation function of each entity type. */
     static std::map<lua_State*, LuaContext*>
@@ -18,6 +18,7 @@
 #define SOLARUS_LUA_DATA_FILE_H
 
 #include "solarus/Common.h"
+#include <cstddef>
 #include <iosfwd>
 #include <string>
 
@@ -27,6 +28,10 @@ namespace Solarus {
 
 /**
  * \brief Abstract class for data the can be loaded and optionally saved as Lua.
+ *
+ * Some data can also be compiled into a binary file (see BinaryData).
+ * When loading a quest file, an up-to-date compiled version is preferred
+ * if it exists.
  */
 class SOLARUS_API LuaData {
 
@@ -37,8 +42,13 @@ class SOLARUS_API LuaData {
 
     virtual bool import_from_lua(lua_State* l) = 0;
     virtual bool export_to_lua(std::ostream& out) const;  // Optional.
+    virtual bool import_from_binary(const char* buffer, size_t size);  // Optional.
+    virtual bool export_to_binary(std::string& buffer) const;  // Optional.
 
-    bool import_from_buffer(const std::string& buffer);
+    bool import_from_buffer(
+        const std::string& buffer,
+        const std::string& file_name = ""
+    );
     bool import_from_file(const std::string& file_name);
     bool import_from_quest_file(
         const std::string& quest_file_name,
@@ -47,6 +57,19 @@ class SOLARUS_API LuaData {
 
     bool export_to_buffer(std::string& buffer) const;
     bool export_to_file(const std::string& file_name) const;
+    bool export_to_binary_file(const std::string& file_name) const;
+
+    static std::string get_compiled_file_name(const std::string& quest_file_name);
+
+  private:
+
+    bool import_from_compiled_quest_file(const std::string& quest_file_name);
+
+    bool import_from_memory(
+        const char* buffer,
+        size_t size,
+        const std::string& file_name
+    );
 
 };
 
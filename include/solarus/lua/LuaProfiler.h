@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_LUA_PROFILER_H
+#define SOLARUS_LUA_PROFILER_H
+
+#include "solarus/Common.h"
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+struct lua_State;
+struct lua_Debug;
+typedef int (*lua_CFunction) (lua_State* l);
+
+namespace Solarus {
+
+/**
+ * \brief Measures where quest scripts spend their time.
+ *
+ * The profiler installs Lua hooks on the main Lua state.
+ * Call hooks count the calls to each C++ function of the Solarus API
+ * and track the current function.
+ * A count hook samples the current line every few instructions.
+ * The wall-clock time elapsed between two hook events is attributed to the
+ * source line and function that were running, and optionally to the whole
+ * call stack to build a callgraph.
+ *
+ * Only time spent in Lua is measured: LuaTools::call_function() notifies
+ * the profiler when the engine enters and leaves Lua.
+ *
+ * With LuaJIT, hooks are not triggered from JIT-compiled code.
+ * Call jit.off() before starting the profiler to get a complete profile.
+ */
+class LuaProfiler {
+
+  public:
+
+    /**
+     * \brief Formats of profiling reports.
+     */
+    enum class ReportFormat {
+      FLAT,          /**< Self time of each source line, and API call counts. */
+      CALLGRAPH,     /**< Time of each call stack, one collapsed stack per line. */
+      JSON           /**< Everything, as a JSON object. */
+    };
+
+    LuaProfiler(
+        lua_State* l,
+        const std::map<lua_CFunction, std::string>& api_function_names
+    );
+    ~LuaProfiler();
+
+    void start(int sample_interval, int callgraph_depth);
+    void stop();
+    bool is_running() const;
+
+    std::string get_report(ReportFormat format) const;
+
+    static void notify_lua_entered();
+    static void notify_lua_left();
+
+  private:
+
+    /**
+     * \brief Time spent on a source line.
+     */
+    struct LocationStats {
+      std::string function_name;  /**< Function the line belongs to. */
+      uint64_t time;              /**< Total time in microseconds. */
+      int num_samples;            /**< Number of hook events on this line. */
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    static void hook(lua_State* l, lua_Debug* ar);
+    void on_hook_event(lua_State* l, lua_Debug* ar);
+    void add_elapsed_time();
+    void set_current_location(lua_State* l, lua_Debug& ar, bool use_current_line);
+    std::string get_stack(lua_State* l) const;
+
+    std::string get_flat_report() const;
+    std::string get_callgraph_report() const;
+    std::string get_json_report() const;
+
+    lua_State* l;                        /**< The Lua state profiled. */
+    const std::map<lua_CFunction, std::string>&
+        api_function_names;              /**< Name of each C++ function of the API. */
+    bool running;                        /**< Whether hooks are installed. */
+    int callgraph_depth;                 /**< Maximum number of stack levels
+                                          * recorded, 0 means no callgraph. */
+    int lua_nesting;                     /**< Number of nested entries into Lua
+                                          * from the engine. */
+    Clock::time_point last_event_date;   /**< Date of the last hook event. */
+    std::string current_location;        /**< Line running since the last event. */
+    std::string current_function;        /**< Function running since the last event. */
+    std::string current_stack;           /**< Call stack since the last event. */
+    uint64_t total_time;                 /**< Time measured in Lua in microseconds. */
+
+    std::map<std::string, LocationStats>
+        locations;                       /**< Statistics of each source line. */
+    std::map<std::string, uint64_t>
+        stacks;                          /**< Time of each collapsed call stack. */
+    std::map<lua_CFunction, int>
+        api_calls;                       /**< Number of calls to API functions. */
+
+    static LuaProfiler* running_profiler;  /**< The profiler whose hooks are
+                                            * installed, if any. */
+
+};
+
+}
+
+#endif
+
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_LUA_THREAD_H
+#define SOLARUS_LUA_THREAD_H
+
+#include "solarus/Common.h"
+#include "solarus/lua/ExportableToLua.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct lua_State;
+struct lua_Debug;
+
+namespace Solarus {
+
+/**
+ * \brief A Lua script running in its own Lua state on a worker thread.
+ *
+ * This is for expensive pure computations that would otherwise block the
+ * main loop.
+ * The worker script has the standard Lua libraries but no access to the
+ * Solarus API: it only gets sol.thread.post() to send a message to the main
+ * thread and sol.thread.receive() to get messages sent by the main thread.
+ *
+ * Messages are Lua values copied from one state to the other:
+ * nil, booleans, numbers, strings and tables of such values.
+ * Messages from the worker are delivered to the main Lua state
+ * by LuaContext at each cycle.
+ */
+class LuaThread: public ExportableToLua {
+
+  public:
+
+    LuaThread(const std::string& script_name, const std::string& source);
+    ~LuaThread();
+
+    const std::string& get_script_name() const;
+
+    void start();
+    void stop();
+    bool is_finished() const;
+    std::string get_error() const;
+
+    void post_to_worker(std::string&& message);
+    bool receive_from_worker(std::string& message);
+
+    static bool serialize(
+        lua_State* l,
+        int index,
+        std::string& message,
+        std::string& error_message
+    );
+    static void deserialize(lua_State* l, const std::string& message);
+
+    virtual const std::string& get_lua_type_name() const override;
+
+  private:
+
+    void run();
+
+    static LuaThread& get_thread(lua_State* l);
+    static int l_post(lua_State* l);
+    static int l_receive(lua_State* l);
+    static void l_hook(lua_State* l, lua_Debug* ar);
+
+    const std::string script_name;        /**< Name of the worker script. */
+    const std::string source;             /**< Code of the worker script. */
+    std::thread thread;                   /**< The worker thread. */
+    std::atomic<bool> stop_requested;     /**< Whether the worker should stop. */
+    std::atomic<bool> finished;           /**< Whether the worker script has
+                                           * returned. */
+
+    mutable std::mutex mutex;             /**< Protects the fields below. */
+    std::condition_variable
+        messages_to_worker_changed;       /**< Wakes up a waiting worker. */
+    std::deque<std::string>
+        messages_to_worker;               /**< Messages not read yet by the worker. */
+    std::deque<std::string>
+        messages_from_worker;             /**< Messages not delivered yet to the
+                                           * main Lua state. */
+    std::string error;                    /**< Error of the worker script if any. */
+
+};
+
+}
+
+#endif
+
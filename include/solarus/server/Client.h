@@ -1,17 +1,60 @@
-#ifndef CLIENT_H
-#define CLIENT_H
-
-#include "Types.h"
-
-class Client {
-public:
-	Client();
-	~Client();
-	bool Connect(char* srv_addr,unsigned short int port);
-private:
-	sockaddr_in srv_addr;
-	int port;
-	int sock;
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_CLIENT_H
+#define SOLARUS_CLIENT_H
+
+#include "solarus/Common.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Solarus {
+
+/**
+ * \brief Connection to the game server.
+ *
+ * The socket is blocking: this class is meant for the game itself,
+ * not for handling many connections.
+ */
+class SOLARUS_API Client {
+
+  public:
+
+    Client();
+    ~Client();
+
+    Client(const Client& other) = delete;
+    Client& operator=(const Client& other) = delete;
+
+    bool connect(const std::string& host, uint16_t port);
+    void disconnect();
+    bool is_connected() const;
+    int get_socket() const;
+
+    bool send(const char* bytes, size_t size);
+    bool receive(char* bytes, size_t size);
+
+  private:
+
+    int socket;              /**< The connected socket, or -1. */
+
 };
 
+}
+
 #endif
+
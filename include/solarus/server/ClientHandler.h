@@ -1,15 +1,90 @@
-#ifndef SOLARUS_CLIENTHANDLER_H
-#define SOLARUS_CLIENTHANDLER_H
-
-#include "Types.h"
-
-class ClientHandler {
-	public:
-		ClientHandler(client_data* c);
-		~ClientHandler();
-		void Handle();
-	private:
-		client_data cl_d;
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_CLIENT_HANDLER_H
+#define SOLARUS_CLIENT_HANDLER_H
+
+#include "solarus/Common.h"
+#include "solarus/server/PacketReader.h"
+#include "solarus/server/RingBuffer.h"
+#include <cstdint>
+#include <netinet/in.h>
+#include <string>
+
+namespace Solarus {
+
+class GameSession;
+
+/**
+ * \brief State of a connection accepted by the server.
+ *
+ * The socket is non-blocking and owned by the handler.
+ * Incoming bytes are accumulated in an input buffer, decoded as packets
+ * of the Protocol, and the replies are queued in an output buffer sent when
+ * the socket is writable.
+ *
+ * Game command events already received are ignored, and the last one is
+ * acknowledged after each round of processing.
+ * If the server hosts a game, new events and snapshot acknowledgements are
+ * forwarded to the game session.
+ */
+class SOLARUS_API ClientHandler {
+
+  public:
+
+    ClientHandler(
+        int socket,
+        const sockaddr_in& address,
+        size_t buffer_size,
+        GameSession* session = nullptr
+    );
+    ~ClientHandler();
+
+    ClientHandler(const ClientHandler& other) = delete;
+    ClientHandler& operator=(const ClientHandler& other) = delete;
+
+    int get_socket() const;
+    std::string get_address() const;
+
+    bool wants_input() const;
+    bool has_output() const;
+    bool on_readable();
+    bool on_writable();
+    bool send(const std::string& packet);
+
+    uint64_t get_num_commands() const;
+    bool get_last_sequence(uint32_t& sequence) const;
+
+  private:
+
+    bool process_input();
+
+    int socket;                  /**< The connected socket. */
+    sockaddr_in address;         /**< Address of the client. */
+    RingBuffer input;            /**< Bytes received and not processed yet. */
+    RingBuffer output;           /**< Bytes to send. */
+    PacketReader reader;         /**< Splits the input into packets. */
+    GameSession* session;        /**< The game hosted by the server, if any. */
+    bool has_sequence;           /**< Whether a command event was received. */
+    uint32_t last_sequence;      /**< Sequence number of the last event. */
+    uint64_t num_commands;       /**< Number of command events received. */
+
 };
 
+}
+
 #endif
+
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_GAME_SESSION_H
+#define SOLARUS_GAME_SESSION_H
+
+#include "solarus/Common.h"
+#include "solarus/GameCommand.h"
+#include "solarus/server/Protocol.h"
+#include "solarus/server/SnapshotCodec.h"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Solarus {
+
+class ClientHandler;
+class Entity;
+class Game;
+class MainLoop;
+
+/**
+ * \brief A game simulated by the server on behalf of its clients.
+ *
+ * The session advances the main loop one fixed step at each tick, without
+ * drawing anything.
+ * Game command events received from all clients are applied to the game
+ * at the beginning of the next tick: a command is pressed as long as at
+ * least one client holds it.
+ * After each tick, every client receives a snapshot of the entities of the
+ * current map, encoded against the last snapshot it acknowledged.
+ *
+ * The engine uses global state, so there is only one session per process
+ * and all its functions must be called from the same thread:
+ * the event loop of the server.
+ */
+class SOLARUS_API GameSession {
+
+  public:
+
+    explicit GameSession(MainLoop& main_loop);
+
+    GameSession(const GameSession& other) = delete;
+    GameSession& operator=(const GameSession& other) = delete;
+
+    void start_game(const std::string& savegame_file, const std::string& map_id);
+
+    void add_client(ClientHandler& client);
+    void remove_client(ClientHandler& client);
+    void on_command(ClientHandler& client, const Protocol::GameCommandEvent& event);
+    void on_snapshot_ack(ClientHandler& client, uint32_t tick);
+
+    void tick();
+
+    uint32_t get_tick() const;
+    int get_num_clients() const;
+    uint64_t get_total_tick_time() const;
+    uint64_t get_num_bytes_sent() const;
+    uint64_t get_num_snapshots_sent() const;
+
+  private:
+
+    /**
+     * \brief What the session knows about a client.
+     */
+    struct ClientState {
+      uint16_t commands_pressed = 0;   /**< Commands held by this client (one bit each). */
+      bool has_ack = false;            /**< Whether a snapshot was acknowledged. */
+      uint32_t acked_tick = 0;         /**< Tick of the last snapshot acknowledged. */
+      std::deque<Snapshot> sent;       /**< Snapshots sent and not acknowledged yet,
+                                        * plus the last one acknowledged. */
+    };
+
+    /**
+     * \brief Identifier given to a map entity.
+     */
+    struct EntityId {
+      std::weak_ptr<Entity> entity;    /**< The entity. */
+      uint32_t id;                     /**< Its id in snapshots. */
+    };
+
+    void apply_commands();
+    void check_game_changed();
+    void set_command_pressed(ClientState& client, GameCommand command, bool pressed);
+    void capture_snapshot();
+    void add_entity(const std::shared_ptr<Entity>& entity);
+    uint16_t get_string_index(const std::string& string);
+    void send_snapshot(ClientHandler& client, ClientState& state);
+
+    MainLoop& main_loop;             /**< The main loop simulated. */
+    Game* game;                      /**< The game that knows the commands held,
+                                      * or nullptr. */
+    uint32_t current_tick;           /**< Number of ticks simulated. */
+
+    std::unordered_map<ClientHandler*, ClientState>
+        clients;                     /**< Clients connected. */
+    std::vector<std::pair<ClientHandler*, Protocol::GameCommandEvent>>
+        pending_commands;            /**< Commands received since the last tick. */
+    int num_holders[static_cast<int>(GameCommand::DOWN) + 1];
+                                     /**< Number of clients holding each command. */
+
+    Snapshot snapshot;               /**< State of entities at the current tick. */
+    std::unordered_map<const Entity*, EntityId>
+        entity_ids;                  /**< Ids of entities of the current snapshot. */
+    std::unordered_map<const Entity*, EntityId>
+        previous_entity_ids;         /**< Ids of entities of the previous snapshot. */
+    uint32_t next_entity_id;         /**< Id of the next new entity. */
+    std::vector<std::string> strings;    /**< Sprite and animation names. */
+    std::unordered_map<std::string, uint16_t>
+        string_indexes;              /**< Index of each string in the table. */
+
+    std::string packet;              /**< Buffer reused to encode snapshots. */
+    uint64_t total_tick_time;        /**< Time spent in ticks in microseconds. */
+    uint64_t num_bytes_sent;         /**< Size of all snapshots sent. */
+    uint64_t num_snapshots_sent;     /**< Number of snapshots sent. */
+
+};
+
+}
+
+#endif
+
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_PACKET_READER_H
+#define SOLARUS_PACKET_READER_H
+
+#include "solarus/Common.h"
+#include "solarus/server/Protocol.h"
+#include <vector>
+
+namespace Solarus {
+
+class RingBuffer;
+
+/**
+ * \brief Splits the bytes received on a connection into packets.
+ *
+ * Packets are returned in place when they are contiguous in the ring buffer.
+ * Only packets that wrap around the end of the ring are copied, into a
+ * receive buffer allocated once for the whole connection.
+ */
+class SOLARUS_API PacketReader {
+
+  public:
+
+    /**
+     * \brief Result of an attempt to read a packet.
+     */
+    enum class Result {
+      PACKET,           /**< A complete packet was read. */
+      INCOMPLETE,       /**< More bytes are needed. */
+      INVALID           /**< The stream is corrupted. */
+    };
+
+    explicit PacketReader(RingBuffer& input);
+
+    Result next(Protocol::Packet& packet);
+    void release();
+
+  private:
+
+    RingBuffer& input;              /**< The bytes received. */
+    std::vector<char> scratch;      /**< Receive buffer for packets that wrap. */
+    size_t packet_size;             /**< Size of the packet returned last,
+                                     * still in the ring buffer. */
+
+};
+
+}
+
+#endif
+
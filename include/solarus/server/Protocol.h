@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_SERVER_PROTOCOL_H
+#define SOLARUS_SERVER_PROTOCOL_H
+
+#include "solarus/Common.h"
+#include "solarus/GameCommand.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Solarus {
+
+/**
+ * \brief Binary protocol between the game server and its clients.
+ *
+ * The stream of a connection is a sequence of packets.
+ * Each packet starts with a 3-byte header: the size of its payload
+ * (16 bits) and its message type (8 bits), followed by the payload.
+ * All integers are little-endian.
+ *
+ * A COMMANDS packet carries a batch of game command events:
+ * - the sequence number of the first event (32 bits),
+ * - the timestamp of the first event in milliseconds (32 bits),
+ * - then 3 bytes per event: the command with the highest bit set if it is
+ *   pressed (8 bits), and its timestamp relative to the first event
+ *   (16 bits).
+ * Events of a batch have consecutive sequence numbers.
+ *
+ * An ACK packet contains the sequence number of the last event processed
+ * by the server (32 bits).
+ *
+ * When the server hosts a game, it also sends SNAPSHOT packets with the
+ * state of map entities (see SnapshotCodec), and clients answer with
+ * SNAPSHOT_ACK packets containing the tick of the last snapshot they
+ * received (32 bits).
+ * Snapshots can be bigger than other packets, up to the maximum size
+ * allowed by the header.
+ */
+class SOLARUS_API Protocol {
+
+  public:
+
+    /**
+     * \brief Types of packets.
+     */
+    enum class MessageType : uint8_t {
+      COMMANDS = 1,     /**< Game command events sent by a client. */
+      ACK = 2,          /**< Last command event processed by the server. */
+      SNAPSHOT = 3,     /**< State of the game sent by the server. */
+      SNAPSHOT_ACK = 4  /**< Last snapshot received by a client. */
+    };
+
+    /**
+     * \brief A game command pressed or released by a player.
+     */
+    struct GameCommandEvent {
+      uint32_t sequence;        /**< Sequence number of the event. */
+      uint32_t timestamp;       /**< Date of the event on the client in milliseconds. */
+      GameCommand command;      /**< The command. */
+      bool pressed;             /**< \c true if pressed, \c false if released. */
+    };
+
+    /**
+     * \brief A packet received, pointing to bytes it does not own.
+     */
+    struct Packet {
+      MessageType type;         /**< Type of message. */
+      const char* payload;      /**< Content after the header. */
+      size_t size;              /**< Size of the payload in bytes. */
+    };
+
+    /**
+     * \brief Read-only view of the events of a COMMANDS packet.
+     *
+     * Events are decoded on demand from the payload, without any copy.
+     */
+    class SOLARUS_API CommandBatch {
+
+      public:
+
+        explicit CommandBatch(const Packet& packet);
+
+        bool is_valid() const;
+        size_t get_num_events() const;
+        GameCommandEvent get_event(size_t index) const;
+
+      private:
+
+        const char* payload;      /**< The payload of the packet. */
+        size_t num_events;        /**< Number of events in the batch. */
+        bool valid;               /**< Whether the payload is well-formed. */
+
+    };
+
+    static const size_t header_size = 3;
+    static const size_t max_packet_size = 4096;
+    static const size_t commands_header_size = 8;
+    static const size_t command_event_size = 3;
+    static const size_t max_commands_per_packet =
+        (max_packet_size - header_size - commands_header_size) / command_event_size;
+    static const size_t ack_packet_size = header_size + 4;
+    static const size_t max_snapshot_packet_size = header_size + 0xFFFF;
+
+    static bool read_header(const char* header, MessageType& type, size_t& payload_size);
+
+    static size_t encode_commands(
+        const GameCommandEvent* events,
+        size_t num_events,
+        std::string& buffer
+    );
+    static void encode_ack(uint32_t sequence, std::string& buffer);
+    static void encode_ack(uint32_t sequence, char* packet);
+    static bool decode_ack(const Packet& packet, uint32_t& sequence);
+    static void encode_snapshot_ack(uint32_t tick, std::string& buffer);
+    static bool decode_snapshot_ack(const Packet& packet, uint32_t& tick);
+
+    static bool is_sequence_newer(uint32_t sequence, uint32_t reference);
+
+    static void write_header(char* bytes, MessageType type, size_t payload_size);
+    static uint16_t read_uint16(const char* bytes);
+    static uint32_t read_uint32(const char* bytes);
+    static void write_uint16(char* bytes, uint16_t value);
+    static void write_uint32(char* bytes, uint32_t value);
+
+};
+
+}
+
+#endif
+
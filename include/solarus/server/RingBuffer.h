@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_RING_BUFFER_H
+#define SOLARUS_RING_BUFFER_H
+
+#include "solarus/Common.h"
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+namespace Solarus {
+
+/**
+ * \brief Fixed-size circular byte buffer for non-blocking sockets.
+ *
+ * Each connection of the server has one buffer for incoming bytes and one
+ * for outgoing bytes.
+ * Their memory is allocated once: reading from or writing to a socket
+ * uses readv() and writev() directly on the free or used parts of the ring,
+ * without intermediate copies or allocations.
+ */
+class SOLARUS_API RingBuffer {
+
+  public:
+
+    explicit RingBuffer(size_t capacity);
+
+    size_t get_capacity() const;
+    size_t get_size() const;
+    size_t get_free_space() const;
+    bool is_empty() const;
+    bool is_full() const;
+    void clear();
+
+    size_t push(const char* bytes, size_t size);
+    size_t peek(char* bytes, size_t size) const;
+    size_t peek(char* bytes, size_t offset, size_t size) const;
+    const char* get_contiguous_data(size_t& size) const;
+    void consume(size_t size);
+    size_t move_to(RingBuffer& other);
+
+    ssize_t read_from(int fd);
+    ssize_t write_to(int fd);
+
+  private:
+
+    std::vector<char> bytes;     /**< Storage. Its size is a power of two. */
+    size_t mask;                 /**< Capacity minus one. */
+    uint64_t read_position;      /**< Total number of bytes consumed. */
+    uint64_t write_position;     /**< Total number of bytes pushed. */
+
+};
+
+}
+
+#endif
+
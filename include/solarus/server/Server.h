@@ -1,17 +1,127 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
 #ifndef SOLARUS_SERVER_H
 #define SOLARUS_SERVER_H
 
-#include "Types.h"
-#include "ClientHandler.h"
-
-class Server {
-	public:
-		Server(unsigned short int port,unsigned short int maxpending);
-		~Server();
-		bool Connect();
-		void Run();
-	private:
-		server_data* srv_d;
+#include "solarus/Common.h"
+#include "solarus/server/ClientHandler.h"
+#include "solarus/server/Types.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace Solarus {
+
+class GameSession;
+
+/**
+ * \brief Event-driven TCP server.
+ *
+ * The server runs in a single process.
+ * Each worker thread has its own listening socket bound to the same port
+ * with SO_REUSEPORT, so that the kernel spreads new connections between
+ * workers, and its own epoll instance watching all its connections.
+ * Sockets are non-blocking and each connection only costs a ClientHandler
+ * with its two ring buffers.
+ *
+ * The server can host a game session.
+ * It then uses a single worker, whose event loop also ticks the game at
+ * a fixed timestep with a timerfd: the game and its clients are only
+ * accessed from this thread.
+ */
+class SOLARUS_API Server {
+
+  public:
+
+    Server(
+        uint16_t port,
+        int num_workers = 1,
+        int max_pending = default_max_pending,
+        size_t buffer_size = default_buffer_size
+    );
+    ~Server();
+
+    Server(const Server& other) = delete;
+    Server& operator=(const Server& other) = delete;
+
+    void set_session(GameSession* session);
+
+    bool start();
+    void stop();
+    bool is_running() const;
+
+    uint16_t get_port() const;
+    int get_num_workers() const;
+    int get_num_clients() const;
+    uint64_t get_num_accepted() const;
+
+  private:
+
+    /**
+     * \brief A connection of a worker.
+     */
+    struct Connection {
+      std::unique_ptr<ClientHandler> handler;  /**< State of the connection. */
+      uint32_t events;           /**< Events currently watched by epoll. */
+      uint32_t generation;       /**< Distinguishes this connection from previous
+                                  * ones that used the same socket. */
+    };
+
+    /**
+     * \brief A thread with its own listening socket and event loop.
+     */
+    struct Worker {
+      int listen_socket = -1;    /**< Listening socket of this worker. */
+      int epoll_fd = -1;         /**< Events of all sockets of this worker. */
+      int stop_fd = -1;          /**< eventfd signaled to stop the worker. */
+      int timer_fd = -1;         /**< timerfd that ticks the game session, if any. */
+      std::thread thread;        /**< The thread running the event loop. */
+      std::unordered_map<int, Connection>
+          clients;               /**< Connections indexed by socket. */
+      uint32_t last_generation = 0;  /**< Generation of the last connection accepted. */
+    };
+
+    bool open_worker(Worker& worker);
+    void close_worker(Worker& worker);
+    void run_worker(Worker& worker);
+    void accept_clients(Worker& worker);
+    void update_events(Worker& worker, Connection& connection);
+    void remove_client(Worker& worker, int socket);
+    void tick_session(Worker& worker);
+
+    uint16_t port;               /**< Port to listen to (0 means any free port
+                                  * until the server is started). */
+    int num_workers;             /**< Number of worker threads. */
+    int max_pending;             /**< Maximum length of the queue of pending
+                                  * connections of each listening socket. */
+    size_t buffer_size;          /**< Size of each buffer of connections. */
+    bool running;                /**< Whether workers are started. */
+    GameSession* session;        /**< The game hosted, or nullptr. */
+    std::vector<std::unique_ptr<Worker>>
+        workers;                 /**< The worker threads. */
+    std::atomic<int> num_clients;          /**< Connections currently open. */
+    std::atomic<uint64_t> num_accepted;    /**< Connections accepted so far. */
+
 };
 
+}
+
 #endif
+
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_SNAPSHOT_CODEC_H
+#define SOLARUS_SNAPSHOT_CODEC_H
+
+#include "solarus/Common.h"
+#include "solarus/server/Protocol.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Solarus {
+
+/**
+ * \brief What clients need to know about a map entity to display it.
+ *
+ * Strings like sprite and animation names are sent once and then
+ * identified by their index in a string table shared by the server and
+ * each client.
+ */
+struct EntityState {
+  uint32_t id;              /**< Identifies the entity during the game. */
+  int32_t x;                /**< X coordinate of the origin point. */
+  int32_t y;                /**< Y coordinate of the origin point. */
+  uint8_t layer;            /**< Layer of the entity. */
+  uint16_t sprite;          /**< Animation set of its sprite (string index). */
+  uint16_t animation;       /**< Current animation (string index). */
+  uint8_t direction;        /**< Current direction of the sprite. */
+  uint16_t frame;           /**< Current frame of the sprite. */
+};
+
+/**
+ * \brief State of all entities at a tick of the simulation.
+ */
+struct Snapshot {
+  uint32_t tick = 0;                  /**< Tick of the simulation. */
+  size_t num_strings = 0;             /**< Size of the string table at this tick. */
+  std::vector<EntityState> entities;  /**< Entities sorted by id. */
+};
+
+/**
+ * \brief Encodes and decodes snapshots as differences with a previous one.
+ *
+ * The server encodes each snapshot against the last one acknowledged by
+ * the client, so that the size of a SNAPSHOT packet depends on what changed
+ * rather than on the number of entities.
+ *
+ * The payload of a SNAPSHOT packet contains:
+ * - the tick of the snapshot and the tick of its baseline (32 bits each),
+ *   no_baseline if it is a full snapshot,
+ * - the index of the first new string and the number of new strings
+ *   (16 bits each), then each string as a length (8 bits) and its bytes:
+ *   strings longer than max_string_length cannot be sent,
+ * - the number of removed entities (16 bits), then their ids (32 bits),
+ * - the number of new or changed entities (16 bits), then for each one its
+ *   id (32 bits), a bit mask of the fields present (8 bits) and these fields.
+ *   New entities have all fields.
+ *
+ * When everything does not fit in a packet, some changes are left for the
+ * next snapshot: the snapshot actually received by the client is returned
+ * to the encoder so that it can be used as a baseline later.
+ */
+class SOLARUS_API SnapshotCodec {
+
+  public:
+
+    static const uint32_t no_baseline = 0xFFFFFFFF;
+    static const size_t max_string_length = 0xFF;
+
+    static void encode(
+        const Snapshot* baseline,
+        const Snapshot& current,
+        const std::vector<std::string>& strings,
+        std::string& buffer,
+        Snapshot& sent
+    );
+    static bool read_ticks(
+        const Protocol::Packet& packet,
+        uint32_t& tick,
+        uint32_t& baseline_tick
+    );
+    static bool decode(
+        const Protocol::Packet& packet,
+        const Snapshot* baseline,
+        std::vector<std::string>& strings,
+        Snapshot& snapshot
+    );
+
+};
+
+}
+
+#endif
+
@@ -1,30 +1,44 @@
-#ifndef TYPES_H
-#define TYPES_H
-
-#define SERVER_PORT 14000
-#define MAXPENDING 4
-
-#include <unistd.h> 
-#include <sys/types.h> 
-#include <sys/socket.h> 
-#include <netinet/in.h> 
-#include <arpa/inet.h> 
-#include <string.h> 
-#include <iostream>
-
-typedef struct server_data {
-        struct sockaddr_in server_addr;
-        int port;
-        int socket;
-        int maxpending;
-        bool ready;
-} server_data;
-
-
-typedef struct client_data {
-        struct sockaddr_in client_addr;
-        int socket;
-} client_data;
-
-using namespace std;
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SOLARUS_SERVER_TYPES_H
+#define SOLARUS_SERVER_TYPES_H
+
+#include "solarus/Common.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace Solarus {
+
+/**
+ * \brief Port of the game server when none is specified.
+ */
+const uint16_t default_server_port = 14000;
+
+/**
+ * \brief Default maximum length of the queue of pending connections.
+ */
+const int default_max_pending = 1024;
+
+/**
+ * \brief Default size in bytes of each buffer of a server connection.
+ */
+const size_t default_buffer_size = 16384;
+
+}
+
 #endif
+
@@ -0,0 +1,418 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/EntityType.h"
+#include "solarus/entities/MapEntities.h"
+#include "solarus/entities/NonAnimatedRegions.h"
+#include "solarus/entities/TilesetData.h"
+#include "solarus/lowlevel/BinaryData.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/BakedMapData.h"
+#include "solarus/MapData.h"
+#include <sstream>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Adds an integer to a 64-bit FNV-1a hash.
+ *
+ * The value is hashed byte by byte in little-endian order so that the
+ * result does not depend on the platform.
+ *
+ * \param[in,out] hash The hash to update.
+ * \param value The value to add.
+ */
+void hash_integer(uint64_t& hash, int64_t value) {
+
+  const uint64_t bits = static_cast<uint64_t>(value);
+  for (int i = 0; i < 8; ++i) {
+    hash ^= (bits >> (i * 8)) & 0xFF;
+    hash *= 1099511628211ULL;
+  }
+}
+
+/**
+ * \brief Adds a string to a 64-bit FNV-1a hash.
+ * \param[in,out] hash The hash to update.
+ * \param value The string to add.
+ */
+void hash_string(uint64_t& hash, const std::string& value) {
+
+  hash_integer(hash, value.size());
+  for (char c : value) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ULL;
+  }
+}
+
+}
+
+/**
+ * \brief Creates empty baked map data.
+ */
+BakedMapData::BakedMapData():
+  hash(0),
+  width8(0),
+  height8(0),
+  layers() {
+
+}
+
+/**
+ * \brief Returns the name of the baked file of a map.
+ * \param map_id Id of a map.
+ * \return The baked file name, relative to the quest data directory.
+ */
+std::string BakedMapData::get_file_name(const std::string& map_id) {
+  return "maps/" + map_id + ".baked";
+}
+
+/**
+ * \brief Computes a hash of everything baked data depends on.
+ *
+ * This includes the size of the map, its tiles and the tile patterns of
+ * its tileset.
+ *
+ * \param map_data A map.
+ * \param tileset_data The tileset of this map.
+ * \return The hash.
+ */
+uint64_t BakedMapData::compute_hash(
+    const MapData& map_data,
+    const TilesetData& tileset_data
+) {
+  uint64_t hash = 14695981039346656037ULL;
+
+  hash_integer(hash, map_data.get_size().width);
+  hash_integer(hash, map_data.get_size().height);
+  for (int layer = LAYER_LOW; layer < LAYER_NB; ++layer) {
+    for (int i = 0; i < map_data.get_num_entities(Layer(layer)); ++i) {
+      const EntityData& entity_data = map_data.get_entity({ Layer(layer), i });
+      if (entity_data.get_type() != EntityType::TILE) {
+        continue;
+      }
+      hash_integer(hash, layer);
+      hash_integer(hash, entity_data.get_xy().x);
+      hash_integer(hash, entity_data.get_xy().y);
+      hash_integer(hash, entity_data.get_integer("width"));
+      hash_integer(hash, entity_data.get_integer("height"));
+      hash_string(hash, entity_data.get_string("pattern"));
+    }
+  }
+
+  for (const auto& kvp : tileset_data.get_patterns()) {
+    const TilePatternData& pattern_data = kvp.second;
+    hash_string(hash, kvp.first);
+    hash_integer(hash, static_cast<int>(pattern_data.get_ground()));
+    hash_integer(hash, static_cast<int>(pattern_data.get_scrolling()));
+    hash_integer(hash, pattern_data.get_num_frames());
+    hash_integer(hash, pattern_data.get_frame().get_width());
+    hash_integer(hash, pattern_data.get_frame().get_height());
+  }
+
+  return hash;
+}
+
+/**
+ * \brief Loads the baked data of a map if it is up to date.
+ *
+ * This function can be called from any thread.
+ *
+ * \param map_id Id of the map.
+ * \param map_data The map data file parsed.
+ * \param tileset_data The tileset data file parsed.
+ * \return The baked data, or nullptr if there is no baked file or if the map
+ * or its tileset have changed since it was generated.
+ */
+std::shared_ptr<const BakedMapData> BakedMapData::load(
+    const std::string& map_id,
+    const MapData& map_data,
+    const TilesetData& tileset_data
+) {
+  const std::string& file_name = get_file_name(map_id);
+  if (!QuestFiles::data_file_exists(file_name)) {
+    return nullptr;
+  }
+
+  const DataFileViewPtr& buffer = QuestFiles::data_file_read_view(file_name);
+  std::shared_ptr<BakedMapData> baked_data = std::make_shared<BakedMapData>();
+  if (!baked_data->import_from_binary(buffer->data(), buffer->size())) {
+    Debug::warning("Ignoring invalid baked map file '" + file_name + "'");
+    return nullptr;
+  }
+
+  if (baked_data->get_hash() != compute_hash(map_data, tileset_data) ||
+      baked_data->get_width8() != map_data.get_size().width / 8 ||
+      baked_data->get_height8() != map_data.get_size().height / 8) {
+    // The map or its tileset were modified after solarus_compile was run.
+    return nullptr;
+  }
+
+  return baked_data;
+}
+
+/**
+ * \brief Computes the ground and the tile regions of a map.
+ *
+ * This gives the same result as loading the map in the engine.
+ *
+ * \param map_data A map.
+ * \param tileset_data The tileset of this map.
+ * \return \c true in case of success, \c false if the map has invalid tiles.
+ */
+bool BakedMapData::build(const MapData& map_data, const TilesetData& tileset_data) {
+
+  const std::string& tileset_id = map_data.get_tileset_id();
+  width8 = map_data.get_size().width / 8;
+  height8 = map_data.get_size().height / 8;
+  const int num_squares = width8 * height8;
+
+  for (int layer = LAYER_LOW; layer < LAYER_NB; ++layer) {
+
+    LayerData& layer_data = layers[layer];
+    const Ground initial_ground = (layer == LAYER_LOW) ? Ground::TRAVERSABLE : Ground::EMPTY;
+    layer_data.tiles_ground.assign(num_squares, initial_ground);
+    layer_data.animated_squares.assign(num_squares, false);
+    layer_data.rejected_tiles.clear();
+
+    // Split tiles into tile patterns like MapEntities::add_tiles() does.
+    std::vector<Rectangle> tile_boxes;
+    std::vector<bool> are_tiles_animated;
+    for (int i = 0; i < map_data.get_num_entities(Layer(layer)); ++i) {
+      const EntityData& entity_data = map_data.get_entity({ Layer(layer), i });
+      if (entity_data.get_type() != EntityType::TILE) {
+        continue;
+      }
+
+      const std::string& pattern_id = entity_data.get_string("pattern");
+      if (!tileset_data.exists(pattern_id)) {
+        Debug::error("No such tile pattern in tileset '" + tileset_id +
+            "': '" + pattern_id + "'");
+        return false;
+      }
+      const TilePatternData& pattern_data = tileset_data.get_pattern(pattern_id);
+      const Size& pattern_size = pattern_data.get_frame().get_size();
+      const bool animated = pattern_data.is_multi_frame() ||
+          pattern_data.get_scrolling() != TileScrolling::NONE;
+
+      const Rectangle area(
+          entity_data.get_xy(),
+          Size(entity_data.get_integer("width"), entity_data.get_integer("height"))
+      );
+      if (area.get_width() < 0 || area.get_width() % 8 != 0 ||
+          area.get_height() < 0 || area.get_height() % 8 != 0 ||
+          pattern_size.width <= 0 || pattern_size.height <= 0) {
+        std::ostringstream oss;
+        oss << "Invalid tile size " << area.get_width() << "x" << area.get_height()
+            << " with pattern '" << pattern_id << "' in tileset '" << tileset_id << "'";
+        Debug::error(oss.str());
+        return false;
+      }
+
+      for (int y = area.get_y(); y < area.get_y() + area.get_height(); y += pattern_size.height) {
+        for (int x = area.get_x(); x < area.get_x() + area.get_width(); x += pattern_size.width) {
+          const Rectangle tile_box(Point(x, y), pattern_size);
+          tile_boxes.push_back(tile_box);
+          are_tiles_animated.push_back(animated);
+          MapEntities::add_tile_ground(
+              layer_data.tiles_ground, width8, height8, tile_box, pattern_data.get_ground()
+          );
+          if (animated) {
+            NonAnimatedRegions::mark_animated_squares(
+                layer_data.animated_squares, width8, height8, tile_box
+            );
+          }
+        }
+      }
+    }
+
+    // Same classification as NonAnimatedRegions::build().
+    for (uint32_t i = 0; i < tile_boxes.size(); ++i) {
+      if (are_tiles_animated[i] ||
+          NonAnimatedRegions::overlaps_animated_squares(
+              layer_data.animated_squares, width8, height8, tile_boxes[i])) {
+        layer_data.rejected_tiles.push_back(i);
+      }
+    }
+    layer_data.num_tiles = tile_boxes.size();
+  }
+
+  hash = compute_hash(map_data, tileset_data);
+  return true;
+}
+
+/**
+ * \brief Returns the hash of the data this was computed from.
+ * \return The hash.
+ */
+uint64_t BakedMapData::get_hash() const {
+  return hash;
+}
+
+/**
+ * \brief Returns the number of 8x8 squares on a row of the map.
+ * \return The width of the map divided by 8.
+ */
+int BakedMapData::get_width8() const {
+  return width8;
+}
+
+/**
+ * \brief Returns the number of 8x8 squares on a column of the map.
+ * \return The height of the map divided by 8.
+ */
+int BakedMapData::get_height8() const {
+  return height8;
+}
+
+/**
+ * \brief Returns the ground of each 8x8 square of a layer.
+ * \param layer A layer.
+ * \return The ground of static tiles, row by row.
+ */
+const std::vector<Ground>& BakedMapData::get_tiles_ground(Layer layer) const {
+  return layers[layer].tiles_ground;
+}
+
+/**
+ * \brief Returns whether each 8x8 square of a layer has animated tiles.
+ * \param layer A layer.
+ * \return The animated squares, row by row.
+ */
+const std::vector<bool>& BakedMapData::get_animated_squares(Layer layer) const {
+  return layers[layer].animated_squares;
+}
+
+/**
+ * \brief Returns the tiles of a layer that are in animated regions.
+ * \param layer A layer.
+ * \return Indexes of these tiles in the order they are created,
+ * in increasing order.
+ */
+const std::vector<uint32_t>& BakedMapData::get_rejected_tiles(Layer layer) const {
+  return layers[layer].rejected_tiles;
+}
+
+/**
+ * \brief Returns the number of tiles created on a layer.
+ * \param layer A layer.
+ * \return The number of tiles.
+ */
+uint32_t BakedMapData::get_num_tiles(Layer layer) const {
+  return layers[layer].num_tiles;
+}
+
+/**
+ * \brief Loads baked data from memory.
+ * \param buffer The content of a baked file.
+ * \param size Size of the buffer in bytes.
+ * \return \c true in case of success.
+ */
+bool BakedMapData::import_from_binary(const char* buffer, size_t size) {
+
+  BinaryData::Reader reader(buffer, size, "bake");
+
+  BakedMapData data;
+  const uint64_t hash_low = reader.read_uint32();
+  const uint64_t hash_high = reader.read_uint32();
+  data.hash = hash_low | (hash_high << 32);
+  data.width8 = reader.read_int32();
+  data.height8 = reader.read_int32();
+  if (!reader.is_valid() ||
+      data.width8 < 0 || data.height8 < 0 ||
+      static_cast<uint64_t>(data.width8) * data.height8 > size) {
+    return false;
+  }
+
+  const int num_squares = data.width8 * data.height8;
+  for (int layer = LAYER_LOW; layer < LAYER_NB; ++layer) {
+    LayerData& layer_data = data.layers[layer];
+    layer_data.num_tiles = reader.read_uint32();
+
+    layer_data.tiles_ground.reserve(num_squares);
+    for (int i = 0; i < num_squares && reader.is_valid(); ++i) {
+      const uint8_t ground = reader.read_uint8();
+      if (ground > static_cast<uint8_t>(Ground::LAVA)) {
+        return false;
+      }
+      layer_data.tiles_ground.push_back(static_cast<Ground>(ground));
+    }
+
+    layer_data.animated_squares.reserve(num_squares);
+    for (int i = 0; i < num_squares && reader.is_valid(); ++i) {
+      layer_data.animated_squares.push_back(reader.read_uint8() != 0);
+    }
+
+    const uint32_t num_rejected_tiles = reader.read_uint32();
+    if (num_rejected_tiles > layer_data.num_tiles) {
+      return false;
+    }
+    for (uint32_t i = 0; i < num_rejected_tiles && reader.is_valid(); ++i) {
+      const uint32_t index = reader.read_uint32();
+      if (index >= layer_data.num_tiles ||
+          (!layer_data.rejected_tiles.empty() && index <= layer_data.rejected_tiles.back())) {
+        return false;
+      }
+      layer_data.rejected_tiles.push_back(index);
+    }
+  }
+
+  if (!reader.is_valid() || !reader.is_finished()) {
+    return false;
+  }
+
+  *this = std::move(data);
+  return true;
+}
+
+/**
+ * \brief Saves baked data to memory.
+ * \param[out] buffer The content of the baked file.
+ * \return \c true in case of success.
+ */
+bool BakedMapData::export_to_binary(std::string& buffer) const {
+
+  BinaryData::Writer writer("bake");
+
+  writer.write_uint32(static_cast<uint32_t>(hash));
+  writer.write_uint32(static_cast<uint32_t>(hash >> 32));
+  writer.write_int32(width8);
+  writer.write_int32(height8);
+
+  for (int layer = LAYER_LOW; layer < LAYER_NB; ++layer) {
+    const LayerData& layer_data = layers[layer];
+    writer.write_uint32(layer_data.num_tiles);
+    for (Ground ground : layer_data.tiles_ground) {
+      writer.write_uint8(static_cast<uint8_t>(ground));
+    }
+    for (bool animated : layer_data.animated_squares) {
+      writer.write_uint8(animated ? 1 : 0);
+    }
+    writer.write_uint32(layer_data.rejected_tiles.size());
+    for (uint32_t index : layer_data.rejected_tiles) {
+      writer.write_uint32(index);
+    }
+  }
+
+  buffer = writer.get_buffer();
+  return true;
+}
+
+}
+
@@ -938,5 +938,96 @@ bool EntityData::export_to_lua(std::ostream& out) const {
   return true;
 }
 
+/**
+ * \brief Reads this entity from a record of a binary data file.
+ *
+ * Fields are stored in the order of the description of the entity type,
+ * without their name.
+ *
+ * \param reader The binary data file being read.
+ * \return \c true in case of success.
+ */
+bool EntityData::read_binary(BinaryData::Reader& reader) {
+
+  const EntityType type = static_cast<EntityType>(reader.read_uint8());
+  const auto& it = entity_type_descriptions.find(type);
+  if (it == entity_type_descriptions.end() ||
+      !EntityTypeInfo::can_be_stored_in_map_file(type)) {
+    return false;
+  }
+  const int layer = reader.read_uint8();
+  if (layer >= LAYER_NB) {
+    return false;
+  }
+
+  set_type(type);
+  set_layer(static_cast<Layer>(layer));
+  set_name(reader.read_string());
+  const int x = reader.read_int32();
+  const int y = reader.read_int32();
+  set_xy({ x, y });
+
+  for (const EntityFieldDescription& field_description : it->second) {
+
+    FieldValue& value = fields[field_description.key];
+    switch (value.value_type) {
+
+      case EntityFieldType::STRING:
+        value.string_value = reader.read_string();
+        break;
+
+      case EntityFieldType::INTEGER:
+        value.int_value = reader.read_int32();
+        break;
+
+      case EntityFieldType::BOOLEAN:
+        value.int_value = reader.read_uint8() != 0;
+        break;
+
+      case EntityFieldType::NIL:
+        return false;
+    }
+  }
+
+  return reader.is_valid();
+}
+
+/**
+ * \brief Writes this entity as a record of a binary data file.
+ * \param writer The binary data file being written.
+ */
+void EntityData::write_binary(BinaryData::Writer& writer) const {
+
+  writer.write_uint8(static_cast<uint8_t>(get_type()));
+  writer.write_uint8(static_cast<uint8_t>(get_layer()));
+  writer.write_string(get_name());
+  writer.write_int32(get_xy().x);
+  writer.write_int32(get_xy().y);
+
+  const EntityTypeDescription& type_description = entity_type_descriptions.at(get_type());
+  for (const EntityFieldDescription& field_description : type_description) {
+
+    const FieldValue& value = fields.at(field_description.key);
+    switch (value.value_type) {
+
+      case EntityFieldType::STRING:
+        writer.write_string(value.string_value);
+        break;
+
+      case EntityFieldType::INTEGER:
+        writer.write_int32(value.int_value);
+        break;
+
+      case EntityFieldType::BOOLEAN:
+        writer.write_uint8(value.int_value != 0);
+        break;
+
+      case EntityFieldType::NIL:
+        Debug::die("Nil entity field");
+        break;
+    }
+  }
+}
+
 }  // namespace Solarus
 
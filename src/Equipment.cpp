@@ -26,10 +26,60 @@
 #include "solarus/lowlevel/Debug.h"
 #include "solarus/lowlevel/Random.h"
 #include <algorithm>
-#include <sstream>
 
 namespace Solarus {
 
+namespace {
+
+/**
+ * \brief Returns the savegame variable that stores the item of a slot.
+ * \param slot Slot of the item (1 or 2).
+ * \return Key of the string savegame variable that stores this slot.
+ */
+const Savegame::Key& get_item_slot_key(int slot) {
+  return slot == 1 ? Savegame::KEY_ITEM_SLOT_1 : Savegame::KEY_ITEM_SLOT_2;
+}
+
+/**
+ * \brief Returns the savegame variable that stores the specified ability.
+ * \param ability An ability.
+ * \return Key of the integer savegame variable that stores this ability.
+ */
+const Savegame::Key& get_ability_key(Ability ability) {
+
+  switch (ability) {
+
+    case Ability::TUNIC:
+      return Savegame::KEY_ABILITY_TUNIC;
+
+    case Ability::SWORD:
+      return Savegame::KEY_ABILITY_SWORD;
+
+    case Ability::SWORD_KNOWLEDGE:
+      return Savegame::KEY_ABILITY_SWORD_KNOWLEDGE;
+
+    case Ability::SHIELD:
+      return Savegame::KEY_ABILITY_SHIELD;
+
+    case Ability::LIFT:
+      return Savegame::KEY_ABILITY_LIFT;
+
+    case Ability::SWIM:
+      return Savegame::KEY_ABILITY_SWIM;
+
+    case Ability::RUN:
+      return Savegame::KEY_ABILITY_RUN;
+
+    case Ability::DETECT_WEAK_WALLS:
+      return Savegame::KEY_ABILITY_DETECT_WEAK_WALLS;
+  }
+
+  Debug::die("Invalid ability");
+  return Savegame::KEY_ABILITY_TUNIC;
+}
+
+}
+
 /**
  * \brief Constructor.
  * \param savegame The savegame to encapsulate.
@@ -464,9 +514,7 @@ EquipmentItem* Equipment::get_item_assigned(int slot) {
   Debug::check_assertion(slot >= 1 && slot <= 2,
       "Invalid item slot");
 
-  char savegame_variable[] = "_item_slot_0";
-  savegame_variable[11] = '0' + slot;
-  const std::string& item_name = savegame.get_string(savegame_variable);
+  const std::string& item_name = savegame.get_string(get_item_slot_key(slot));
 
   EquipmentItem* item = nullptr;
   if (!item_name.empty()) {
@@ -485,9 +533,7 @@ const EquipmentItem* Equipment::get_item_assigned(int slot) const {
   Debug::check_assertion(slot >= 1 && slot <= 2,
       "Invalid item slot");
 
-  std::ostringstream oss;
-  oss << "_item_slot_" << slot;
-  const std::string& item_name = savegame.get_string(oss.str());
+  const std::string& item_name = savegame.get_string(get_item_slot_key(slot));
 
   const EquipmentItem* item = nullptr;
   if (!item_name.empty()) {
@@ -510,9 +556,6 @@ void Equipment::set_item_assigned(int slot, EquipmentItem* item) {
   Debug::check_assertion(slot >= 1 && slot <= 2,
       "Invalid item slot");
 
-  std::ostringstream oss;
-  oss << "_item_slot_" << slot;
-
   if (item != nullptr) {
     Debug::check_assertion(item->get_variant() > 0,
         std::string("Cannot assign item '") + item->get_name()
@@ -520,10 +563,10 @@ void Equipment::set_item_assigned(int slot, EquipmentItem* item) {
     Debug::check_assertion(item->is_assignable(),
         std::string("The item '") + item->get_name()
         + "' cannot be assigned");
-    savegame.set_string(oss.str(), item->get_name());
+    savegame.set_string(get_item_slot_key(slot), item->get_name());
   }
   else {
-    savegame.set_string(oss.str(), "");
+    savegame.set_string(get_item_slot_key(slot), "");
   }
 }
 
@@ -546,44 +589,6 @@ int Equipment::get_item_slot(const EquipmentItem& item) const {
 
 // abilities
 
-/**
- * \brief Returns the index of the savegame variable that stores the specified ability.
- * \param ability An ability.
- * \return Name of the boolean savegame variable that stores this ability.
- */
-std::string Equipment::get_ability_savegame_variable(Ability ability) const {
-
-  switch (ability) {
-
-    case Ability::TUNIC:
-      return Savegame::KEY_ABILITY_TUNIC;
-
-    case Ability::SWORD:
-      return Savegame::KEY_ABILITY_SWORD;
-
-    case Ability::SWORD_KNOWLEDGE:
-      return Savegame::KEY_ABILITY_SWORD_KNOWLEDGE;
-
-    case Ability::SHIELD:
-      return Savegame::KEY_ABILITY_SHIELD;
-
-    case Ability::LIFT:
-      return Savegame::KEY_ABILITY_LIFT;
-
-    case Ability::SWIM:
-      return Savegame::KEY_ABILITY_SWIM;
-
-    case Ability::RUN:
-      return Savegame::KEY_ABILITY_RUN;
-
-    case Ability::DETECT_WEAK_WALLS:
-      return Savegame::KEY_ABILITY_DETECT_WEAK_WALLS;
-  }
-
-  Debug::die("Invalid ability");
-  return "";
-}
-
 /**
  * \brief Returns whether the player has at least the specified level of an ability.
  * \param ability The ability to get.
@@ -600,7 +605,7 @@ bool Equipment::has_ability(Ability ability, int level) const {
  * \return The level of this ability.
  */
 int Equipment::get_ability(Ability ability) const {
-  return savegame.get_integer(get_ability_savegame_variable(ability));
+  return savegame.get_integer(get_ability_key(ability));
 }
 
 /**
@@ -610,7 +615,7 @@ int Equipment::get_ability(Ability ability) const {
  */
 void Equipment::set_ability(Ability ability, int level) {
 
-  savegame.set_integer(get_ability_savegame_variable(ability), level);
+  savegame.set_integer(get_ability_key(ability), level);
 
   Game* game = get_game();
   if (game != nullptr) {
@@ -124,7 +124,10 @@ const std::string& EquipmentItem::get_savegame_variable() const {
  * possession state, or an empty string.
  */
 void EquipmentItem::set_savegame_variable(const std::string& savegame_variable) {
+
   this->savegame_variable = savegame_variable;
+  savegame_key = savegame_variable.empty() ?
+      Savegame::Key() : Savegame::Key(savegame_variable);
 }
 
 /**
@@ -153,7 +156,10 @@ const std::string& EquipmentItem::get_amount_savegame_variable() const {
  */
 void EquipmentItem::set_amount_savegame_variable(
     const std::string& amount_savegame_variable) {
+
   this->amount_savegame_variable = amount_savegame_variable;
+  amount_savegame_key = amount_savegame_variable.empty() ?
+      Savegame::Key() : Savegame::Key(amount_savegame_variable);
 }
 
 /**
@@ -391,7 +397,7 @@ int EquipmentItem::get_variant() const {
   Debug::check_assertion(is_saved(),
       std::string("The item '") + get_name() + "' is not saved");
 
-  return get_savegame().get_integer(get_savegame_variable());
+  return get_savegame().get_integer(savegame_key);
 }
 
 /**
@@ -407,7 +413,7 @@ void EquipmentItem::set_variant(int variant) {
       std::string("The item '") + get_name() + "' is not saved");
 
   // Set the possession state in the savegame.
-  get_savegame().set_integer(get_savegame_variable(), variant);
+  get_savegame().set_integer(savegame_key, variant);
 
   // If we are removing the item, unassign it.
   if (variant == 0) {
@@ -430,7 +436,7 @@ int EquipmentItem::get_amount() const {
   Debug::check_assertion(has_amount(),
       std::string("The item '") + get_name() + "' has no amount");
 
-  return get_savegame().get_integer(get_amount_savegame_variable());
+  return get_savegame().get_integer(amount_savegame_key);
 }
 
 /**
@@ -443,7 +449,7 @@ void EquipmentItem::set_amount(int amount) {
       std::string("The item '") + get_name() + "' has no amount");
 
   amount = std::max(0, std::min(get_max_amount(), amount));
-  get_savegame().set_integer(get_amount_savegame_variable(), amount);
+  get_savegame().set_integer(amount_savegame_key, amount);
 
   notify_amount_changed(amount);
 }
@@ -377,6 +377,11 @@ void Game::update_transitions() {
     transition->update();
   }
 
+  // load the next map as soon as its files are ready, while the transition plays
+  if (next_map != nullptr && !next_map->is_loaded() && next_map->is_prepared()) {
+    load_next_map();
+  }
+
   // if the map has just changed, close the current map if any and play an out transition
   if (next_map != nullptr && transition == nullptr) { // the map has changed (i.e. set_current_map has been called)
 
@@ -429,6 +434,10 @@ void Game::update_transitions() {
       else {
 
         // change the map
+        if (!next_map->is_loaded()) {
+          // its files are not ready yet: wait for them
+          load_next_map();
+        }
         current_map->leave();
 
         // special treatments for a transition between two different worlds
@@ -585,11 +594,15 @@ void Game::set_current_map(
   }
 
   // prepare the next map
-  if (current_map == nullptr || map_id != current_map->get_id()) {
-    // another map
+  if (current_map == nullptr) {
+    // first map: nothing to display while loading
+    next_map = std::make_shared<Map>(map_id);
+    load_next_map();
+  }
+  else if (map_id != current_map->get_id()) {
+    // another map: read its files during the closing transition
     next_map = std::make_shared<Map>(map_id);
-    next_map->load(*this);
-    next_map->check_suspended();
+    next_map->start_preparing();
   }
   else {
     // same map
@@ -604,6 +617,20 @@ void Game::set_current_map(
   this->transition_style = transition_style;
 }
 
+/**
+ * \brief Loads the map that is going to become the current map.
+ *
+ * This waits for its files if they are still being read.
+ */
+void Game::load_next_map() {
+
+  next_map->load(*this);
+  next_map->check_suspended();
+
+  // Decode the first buffers of its music during the transition.
+  Music::preload(next_map->get_music_id(), true);
+}
+
 /**
  * \brief Notifies the game objects that the another map has just become active.
  */
@@ -867,4 +894,23 @@ void Game::simulate_command_released(GameCommand command){
   commands->game_command_released(command);
 }
 
+/**
+ * \brief Presses a game command and keeps it pressed until
+ * release_held_command() is called.
+ *
+ * Unlike simulate_command_pressed(), is_command_pressed() returns true for
+ * this command in the meantime, so the hero can walk.
+ * This is used by the game server to apply the commands of its clients.
+ */
+void Game::hold_command(GameCommand command) {
+  commands->hold_command(command);
+}
+
+/**
+ * \brief Releases a game command pressed by hold_command().
+ */
+void Game::release_held_command(GameCommand command) {
+  commands->release_held_command(command);
+}
+
 }
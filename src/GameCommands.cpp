@@ -83,7 +83,8 @@ GameCommands::GameCommands(Game& game):
   game(game),
   customizing(false),
   command_to_customize(GameCommand::NONE),
-  customize_callback_ref() {
+  customize_callback_ref(),
+  held_commands() {
 
   // Load the commands from the savegame.
   for (const auto& kvp : command_names) {
@@ -122,13 +123,18 @@ const Savegame& GameCommands::get_savegame() const {
 /**
  * \brief Returns whether the specified game command is pressed.
  *
- * The command can be activated from the keyboard or the joypad.
+ * The command can be activated from the keyboard, the joypad or
+ * hold_command().
  *
  * \param command A game command.
  * \return true if this game command is currently pressed.
  */
 bool GameCommands::is_command_pressed(GameCommand command) const {
 
+  if (held_commands.find(command) != held_commands.end()) {
+    return true;
+  }
+
   // We could store the command pressed information from events,
   // but this is problematic because of possible missed events.
   // So we compute accurate information instead.
@@ -563,6 +569,31 @@ void GameCommands::game_command_released(GameCommand command) {
   game.notify_command_released(command);
 }
 
+/**
+ * \brief Presses a game command without any keyboard or joypad event.
+ *
+ * Unlike game_command_pressed(), the command stays pressed until
+ * release_held_command() is called, so that continuous actions like walking
+ * work as with a real input.
+ *
+ * \param command The game command to press.
+ */
+void GameCommands::hold_command(GameCommand command) {
+
+  held_commands.insert(command);
+  game_command_pressed(command);
+}
+
+/**
+ * \brief Releases a game command pressed by hold_command().
+ * \param command The game command to release.
+ */
+void GameCommands::release_held_command(GameCommand command) {
+
+  held_commands.erase(command);
+  game_command_released(command);
+}
+
 /**
  * \brief Returns the low-level keyboard key where the specified game command
  * is currently mapped.
@@ -680,15 +711,15 @@ const std::string& GameCommands::get_keyboard_binding_savegame_variable(
 
   static const std::map<GameCommand, std::string> savegame_variables = {
       { GameCommand::NONE, "" },
-      { GameCommand::ACTION, Savegame::KEY_KEYBOARD_ACTION },
-      { GameCommand::ATTACK, Savegame::KEY_KEYBOARD_ATTACK },
-      { GameCommand::ITEM_1, Savegame::KEY_KEYBOARD_ITEM_1 },
-      { GameCommand::ITEM_2, Savegame::KEY_KEYBOARD_ITEM_2 },
-      { GameCommand::PAUSE, Savegame::KEY_KEYBOARD_PAUSE },
-      { GameCommand::RIGHT, Savegame::KEY_KEYBOARD_RIGHT },
-      { GameCommand::UP, Savegame::KEY_KEYBOARD_UP },
-      { GameCommand::LEFT, Savegame::KEY_KEYBOARD_LEFT },
-      { GameCommand::DOWN, Savegame::KEY_KEYBOARD_DOWN }
+      { GameCommand::ACTION, Savegame::KEY_KEYBOARD_ACTION.get_name() },
+      { GameCommand::ATTACK, Savegame::KEY_KEYBOARD_ATTACK.get_name() },
+      { GameCommand::ITEM_1, Savegame::KEY_KEYBOARD_ITEM_1.get_name() },
+      { GameCommand::ITEM_2, Savegame::KEY_KEYBOARD_ITEM_2.get_name() },
+      { GameCommand::PAUSE, Savegame::KEY_KEYBOARD_PAUSE.get_name() },
+      { GameCommand::RIGHT, Savegame::KEY_KEYBOARD_RIGHT.get_name() },
+      { GameCommand::UP, Savegame::KEY_KEYBOARD_UP.get_name() },
+      { GameCommand::LEFT, Savegame::KEY_KEYBOARD_LEFT.get_name() },
+      { GameCommand::DOWN, Savegame::KEY_KEYBOARD_DOWN.get_name() }
   };
 
   return savegame_variables.find(command)->second;
@@ -706,15 +737,15 @@ const std::string& GameCommands::get_joypad_binding_savegame_variable(
 
   static const std::map<GameCommand, std::string> savegame_variables = {
       { GameCommand::NONE, "" },
-      { GameCommand::ACTION, Savegame::KEY_JOYPAD_ACTION },
-      { GameCommand::ATTACK, Savegame::KEY_JOYPAD_ATTACK },
-      { GameCommand::ITEM_1, Savegame::KEY_JOYPAD_ITEM_1 },
-      { GameCommand::ITEM_2, Savegame::KEY_JOYPAD_ITEM_2 },
-      { GameCommand::PAUSE, Savegame::KEY_JOYPAD_PAUSE },
-      { GameCommand::RIGHT, Savegame::KEY_JOYPAD_RIGHT },
-      { GameCommand::UP, Savegame::KEY_JOYPAD_UP },
-      { GameCommand::LEFT, Savegame::KEY_JOYPAD_LEFT },
-      { GameCommand::DOWN, Savegame::KEY_JOYPAD_DOWN }
+      { GameCommand::ACTION, Savegame::KEY_JOYPAD_ACTION.get_name() },
+      { GameCommand::ATTACK, Savegame::KEY_JOYPAD_ATTACK.get_name() },
+      { GameCommand::ITEM_1, Savegame::KEY_JOYPAD_ITEM_1.get_name() },
+      { GameCommand::ITEM_2, Savegame::KEY_JOYPAD_ITEM_2.get_name() },
+      { GameCommand::PAUSE, Savegame::KEY_JOYPAD_PAUSE.get_name() },
+      { GameCommand::RIGHT, Savegame::KEY_JOYPAD_RIGHT.get_name() },
+      { GameCommand::UP, Savegame::KEY_JOYPAD_UP.get_name() },
+      { GameCommand::LEFT, Savegame::KEY_JOYPAD_LEFT.get_name() },
+      { GameCommand::DOWN, Savegame::KEY_JOYPAD_DOWN.get_name() }
   };
 
   return savegame_variables.find(command)->second;
@@ -28,6 +28,7 @@
 #include "solarus/Game.h"
 #include "solarus/QuestProperties.h"
 #include "solarus/MainLoop.h"
+#include "solarus/MapCache.h"
 #include "solarus/Savegame.h"
 #include "solarus/Settings.h"
 #include <lua.hpp>
@@ -104,6 +105,7 @@ MainLoop::MainLoop(const Arguments& args):
   // Read the quest resource list from data.
   CurrentQuest::initialize();
   TilePattern::initialize();
+  MapCache::initialize(args);
 
   // Create the quest surface.
   root_surface = Surface::create(
@@ -136,6 +138,7 @@ MainLoop::~MainLoop() {
   root_surface = nullptr;
 
   lua_context->exit();
+  MapCache::quit();
   TilePattern::quit();
   CurrentQuest::quit();
   System::quit();
@@ -336,6 +339,7 @@ void MainLoop::update() {
   }
   lua_context->update();
   System::update();
+  MapCache::update();
 
   // go to another game?
   if (next_game != game.get()) {
@@ -45,6 +45,7 @@ MapLoader Map::map_loader;
  * and the script file of the map. The data file must exist.
  */
 Map::Map(const std::string& id):
+  preparation(nullptr),
   game(nullptr),
   id(id),
   width8(0),
@@ -256,20 +257,51 @@ void Map::unload() {
     foreground_surface = nullptr;
     entities = nullptr;
     camera = nullptr;
+    preparation = nullptr;
 
     loaded = false;
   }
 }
 
+/**
+ * \brief Starts reading the files of this map in a separate thread.
+ *
+ * This is optional: load() does it if it was not done before.
+ * Call it early, like at the beginning of a transition, so that load()
+ * is fast.
+ */
+void Map::start_preparing() {
+
+  if (preparation == nullptr && !is_loaded()) {
+    preparation = std::unique_ptr<MapLoader::Preparation>(
+        new MapLoader::Preparation(id)
+    );
+  }
+}
+
+/**
+ * \brief Returns whether the files of this map are ready to be loaded.
+ *
+ * When this returns \c true, load() does not have to wait.
+ *
+ * \return \c true if start_preparing() was called and has finished.
+ */
+bool Map::is_prepared() const {
+  return preparation != nullptr && preparation->is_done();
+}
+
 /**
  * \brief Loads the map into a game.
  *
- * Reads the description file of the map.
+ * Reads the description file of the map, or uses the one already
+ * read by start_preparing().
  *
  * \param game the game
  */
 void Map::load(Game& game) {
 
+  start_preparing();
+
   visible_surface = Surface::create(
       Video::get_quest_size()
   );
@@ -283,7 +315,7 @@ void Map::load(Game& game) {
   entities = std::unique_ptr<MapEntities>(new MapEntities(game, *this));
 
   // read the map file
-  map_loader.load_map(game, *this);
+  map_loader.load_map(game, *this, *preparation);
 
   build_background_surface();
   build_foreground_surface();
@@ -710,6 +742,7 @@ void Map::start() {
   Music::play(music_id, true);
   this->entities->notify_map_started();
   get_lua_context().run_map(*this, get_destination());
+  preparation = nullptr;
 }
 
 /**
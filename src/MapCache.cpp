@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/TilesetData.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/lowlevel/Surface.h"
+#include "solarus/Arguments.h"
+#include "solarus/MapCache.h"
+#include "solarus/MapData.h"
+#include <sstream>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Default memory budget in megabytes.
+ */
+const int default_max_memory_mb = 32;
+
+/**
+ * \brief Approximate memory used by an entity of a map data file.
+ */
+const size_t entity_data_size = 256;
+
+/**
+ * \brief Approximate memory used by a pattern of a tileset data file.
+ */
+const size_t pattern_data_size = 128;
+
+}
+
+size_t MapCache::max_memory = 0;
+size_t MapCache::memory_used = 0;
+std::map<std::string, MapCache::Entry> MapCache::entries;
+std::list<std::string> MapCache::entries_order;
+std::vector<std::shared_ptr<const void>> MapCache::elements_to_release;
+int MapCache::num_hits = 0;
+int MapCache::num_misses = 0;
+std::mutex MapCache::mutex;
+
+/**
+ * \brief Initializes the map cache.
+ *
+ * The option -map-cache-size=<megabytes> sets the memory budget
+ * (default 32). 0 disables the cache.
+ *
+ * \param args Command-line arguments.
+ */
+void MapCache::initialize(const Arguments& args) {
+
+  int max_memory_mb = default_max_memory_mb;
+  const std::string& value_string = args.get_argument_value("-map-cache-size");
+  if (!value_string.empty()) {
+    std::istringstream iss(value_string);
+    if (!(iss >> max_memory_mb) || max_memory_mb < 0) {
+      Debug::error("Invalid value for -map-cache-size: '" + value_string + "'");
+      max_memory_mb = default_max_memory_mb;
+    }
+  }
+  max_memory = static_cast<size_t>(max_memory_mb) * 1024 * 1024;
+}
+
+/**
+ * \brief Forgets all elements.
+ *
+ * Must be called before the video system is closed because the cache
+ * may contain images.
+ */
+void MapCache::quit() {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  entries_order.clear();
+  elements_to_release.clear();
+  memory_used = 0;
+  num_hits = 0;
+  num_misses = 0;
+}
+
+/**
+ * \brief Releases the elements removed from the cache.
+ *
+ * This function is called by the main thread at each cycle.
+ * Elements still used elsewhere stay valid.
+ */
+void MapCache::update() {
+
+  std::vector<std::shared_ptr<const void>> elements;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (elements_to_release.empty()) {
+      return;
+    }
+    elements.swap(elements_to_release);
+  }
+  // Destroyed here, without the lock.
+}
+
+/**
+ * \brief Returns the parsed data file of a map.
+ * \param map_id Id of the map.
+ * \return The map data, or nullptr if the file could not be loaded.
+ */
+std::shared_ptr<const MapData> MapCache::get_map_data(const std::string& map_id) {
+
+  const std::string& file_name = "maps/" + map_id + ".dat";
+  int64_t modification_date = 0;
+  const std::shared_ptr<const void>& element = get_element(file_name, modification_date);
+  if (element != nullptr) {
+    return std::static_pointer_cast<const MapData>(element);
+  }
+
+  std::shared_ptr<MapData> data = std::make_shared<MapData>();
+  if (!data->import_from_quest_file(file_name)) {
+    return nullptr;
+  }
+
+  add_element(file_name, modification_date, data,
+      sizeof(MapData) + data->get_num_entities() * entity_data_size);
+  return data;
+}
+
+/**
+ * \brief Returns the parsed data file of a tileset.
+ * \param tileset_id Id of the tileset.
+ * \return The tileset data. If the file could not be loaded, an empty
+ * tileset data is returned and an error is printed.
+ */
+std::shared_ptr<const TilesetData> MapCache::get_tileset_data(const std::string& tileset_id) {
+
+  const std::string& file_name = "tilesets/" + tileset_id + ".dat";
+  int64_t modification_date = 0;
+  const std::shared_ptr<const void>& element = get_element(file_name, modification_date);
+  if (element != nullptr) {
+    return std::static_pointer_cast<const TilesetData>(element);
+  }
+
+  std::shared_ptr<TilesetData> data = std::make_shared<TilesetData>();
+  if (!data->import_from_quest_file(file_name)) {
+    return data;
+  }
+
+  add_element(file_name, modification_date, data,
+      sizeof(TilesetData) + data->get_patterns().size() * pattern_data_size);
+  return data;
+}
+
+/**
+ * \brief Returns a decoded image of a tileset.
+ *
+ * The surface is shared by all maps that use the tileset:
+ * it must not be modified.
+ *
+ * \param file_name Name of the image file, relative to the data directory.
+ * \return The image, or nullptr if the file could not be loaded.
+ */
+SurfacePtr MapCache::get_tileset_image(const std::string& file_name) {
+
+  int64_t modification_date = 0;
+  const std::shared_ptr<const void>& element = get_element(file_name, modification_date);
+  if (element != nullptr) {
+    return std::const_pointer_cast<Surface>(
+        std::static_pointer_cast<const Surface>(element)
+    );
+  }
+
+  const SurfacePtr& image = Surface::create(file_name, Surface::DIR_DATA);
+  if (image == nullptr) {
+    return nullptr;
+  }
+
+  add_element(file_name, modification_date, image,
+      sizeof(Surface) + image->get_width() * image->get_height() * 4);
+  return image;
+}
+
+/**
+ * \brief Returns the number of elements found in the cache.
+ * \return The number of cache hits since the initialization.
+ */
+int MapCache::get_num_hits() {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return num_hits;
+}
+
+/**
+ * \brief Returns the number of elements that had to be loaded.
+ * \return The number of cache misses since the initialization.
+ */
+int MapCache::get_num_misses() {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return num_misses;
+}
+
+/**
+ * \brief Returns the approximate memory used by the cache.
+ * \return The memory used in bytes.
+ */
+size_t MapCache::get_memory_used() {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return memory_used;
+}
+
+/**
+ * \brief Looks for an up-to-date element in the cache.
+ *
+ * An element whose file has changed since it was loaded is removed.
+ *
+ * \param[in] file_name Name of the file the element comes from.
+ * \param[out] modification_date Current modification date of the file.
+ * \return The element, or nullptr if it has to be loaded.
+ */
+std::shared_ptr<const void> MapCache::get_element(
+    const std::string& file_name,
+    int64_t& modification_date
+) {
+  modification_date = QuestFiles::data_file_get_modification_date(file_name);
+
+  std::lock_guard<std::mutex> lock(mutex);
+  const auto& it = entries.find(file_name);
+  if (it != entries.end()) {
+    if (it->second.modification_date == modification_date) {
+      ++num_hits;
+      entries_order.remove(file_name);
+      entries_order.push_front(file_name);
+      return it->second.element;
+    }
+
+    // The file has changed.
+    memory_used -= it->second.size;
+    elements_to_release.push_back(std::move(it->second.element));
+    entries.erase(it);
+    entries_order.remove(file_name);
+  }
+
+  ++num_misses;
+  return nullptr;
+}
+
+/**
+ * \brief Stores an element that was just loaded.
+ *
+ * Least recently used elements are removed until the memory budget is
+ * respected.
+ * Elements removed are still valid for users that keep a pointer to them.
+ * Otherwise, they are released by the next call to update().
+ *
+ * \param file_name Name of the file the element comes from.
+ * \param modification_date Modification date of the file.
+ * \param element The element to store.
+ * \param size Approximate memory used by the element in bytes.
+ */
+void MapCache::add_element(
+    const std::string& file_name,
+    int64_t modification_date,
+    const std::shared_ptr<const void>& element,
+    size_t size
+) {
+  if (modification_date < 0 || size > max_memory) {
+    // Cannot check if the file changes, or too big.
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  const auto& it = entries.find(file_name);
+  if (it != entries.end()) {
+    // Also loaded by another thread in the meantime.
+    return;
+  }
+
+  Entry& entry = entries[file_name];
+  entry.modification_date = modification_date;
+  entry.element = element;
+  entry.size = size;
+  entries_order.push_front(file_name);
+  memory_used += size;
+
+  while (memory_used > max_memory) {
+    const auto& lru_it = entries.find(entries_order.back());
+    memory_used -= lru_it->second.size;
+    elements_to_release.push_back(std::move(lru_it->second.element));
+    entries.erase(lru_it);
+    entries_order.pop_back();
+  }
+}
+
+}
+
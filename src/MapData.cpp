@@ -795,5 +795,74 @@ bool MapData::export_to_lua(std::ostream& out) const {
   return true;
 }
 
+/**
+ * \copydoc LuaData::import_from_binary
+ */
+bool MapData::import_from_binary(const char* buffer, size_t size) {
+
+  BinaryData::Reader reader(buffer, size, "map ");
+
+  // Read map properties.
+  MapData data;
+  const int x = reader.read_int32();
+  const int y = reader.read_int32();
+  data.set_location({ x, y });
+  const int width = reader.read_int32();
+  const int height = reader.read_int32();
+  data.set_size({ width, height });
+  data.set_world(reader.read_string());
+  data.set_floor(reader.read_int32());
+  data.set_tileset_id(reader.read_string());
+  data.set_music_id(reader.read_string());
+
+  // Read entities, tiles first on each layer.
+  for (int layer = LAYER_LOW; layer < LAYER_NB; ++layer) {
+    const uint32_t num_entities = reader.read_uint32();
+    for (uint32_t i = 0; i < num_entities && reader.is_valid(); ++i) {
+      EntityData entity;
+      if (!entity.read_binary(reader) ||
+          entity.get_layer() != layer ||
+          !data.add_entity(entity).is_valid()) {
+        return false;
+      }
+    }
+  }
+
+  if (!reader.is_valid() || !reader.is_finished()) {
+    return false;
+  }
+
+  *this = std::move(data);
+  return true;
+}
+
+/**
+ * \copydoc LuaData::export_to_binary
+ */
+bool MapData::export_to_binary(std::string& buffer) const {
+
+  BinaryData::Writer writer("map ");
+
+  // Write map properties.
+  writer.write_int32(get_location().x);
+  writer.write_int32(get_location().y);
+  writer.write_int32(get_size().width);
+  writer.write_int32(get_size().height);
+  writer.write_string(get_world());
+  writer.write_int32(get_floor());
+  writer.write_string(get_tileset_id());
+  writer.write_string(get_music_id());
+
+  for (const EntityList& layer_entities : entities) {
+    writer.write_uint32(static_cast<uint32_t>(layer_entities.entities.size()));
+    for (const EntityData& entity_data : layer_entities.entities) {
+      entity_data.write_binary(writer);
+    }
+  }
+
+  buffer = writer.get_buffer();
+  return true;
+}
+
 }  // namespace Solarus
 
@@ -26,17 +26,153 @@
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lowlevel/Music.h"
 #include "solarus/lowlevel/Surface.h"
+#include "solarus/lua/LuaBytecodeCache.h"
 #include "solarus/lua/LuaContext.h"
 #include "solarus/lua/LuaTools.h"
+#include "solarus/BakedMapData.h"
+#include "solarus/MapCache.h"
 #include "solarus/MapLoader.h"
 #include "solarus/Map.h"
 #include "solarus/Game.h"
 #include "solarus/Camera.h"
+#include "solarus/Sprite.h"
+#include "solarus/SpriteAnimation.h"
+#include "solarus/SpriteAnimationSet.h"
+#include <lua.hpp>
+#include <algorithm>
 #include <memory>
+#include <set>
+#include <sstream>
 #include <string>
 
 namespace Solarus {
 
+namespace {
+
+/**
+ * \brief Maximum number of threads that load the assets of a map.
+ */
+const unsigned max_asset_workers = 4;
+
+/**
+ * \brief Adds a sprite to a set if it exists in the quest.
+ * \param[in,out] sprite_ids The set of sprites.
+ * \param sprite_id Id of the sprite to add.
+ */
+void add_sprite_id(std::set<std::string>& sprite_ids, const std::string& sprite_id) {
+
+  if (!sprite_id.empty() &&
+      QuestFiles::data_file_exists("sprites/" + sprite_id + ".dat")) {
+    sprite_ids.insert(sprite_id);
+  }
+}
+
+/**
+ * \brief Adds a script to a set if it exists in the quest.
+ * \param[in,out] script_file_names The set of scripts.
+ * \param file_name File name of the script to add.
+ */
+void add_script_file_name(std::set<std::string>& script_file_names, const std::string& file_name) {
+
+  if (QuestFiles::data_file_exists(file_name)) {
+    script_file_names.insert(file_name);
+  }
+}
+
+/**
+ * \brief Returns the sprites and the scripts that entities of a map are
+ * going to need.
+ *
+ * This includes sprites declared in the map file, sprites the engine
+ * creates for some types of entities, sprites of enemy breeds named like
+ * the breed, and the scripts of enemies and custom entities.
+ * Sprites created by other scripts are not known in advance.
+ *
+ * \param[in] data A map data file.
+ * \param[out] sprite_ids Ids of the sprites that exist in the quest.
+ * \param[out] script_file_names Scripts that exist in the quest.
+ */
+void get_map_assets(
+    const MapData& data,
+    std::set<std::string>& sprite_ids,
+    std::set<std::string>& script_file_names
+) {
+  for (int layer = LAYER_LOW; layer < LAYER_NB; ++layer) {
+    for (int i = 0; i < data.get_num_entities(Layer(layer)); ++i) {
+      const EntityData& entity_data = data.get_entity({ Layer(layer), i });
+
+      if (entity_data.is_string("sprite")) {
+        add_sprite_id(sprite_ids, entity_data.get_string("sprite"));
+      }
+
+      if (entity_data.is_string("treasure_name") &&
+          !entity_data.get_string("treasure_name").empty()) {
+        add_sprite_id(sprite_ids, "entities/items");
+        add_sprite_id(sprite_ids, "entities/shadow");
+      }
+
+      switch (entity_data.get_type()) {
+
+      case EntityType::PICKABLE:
+        add_sprite_id(sprite_ids, "entities/items");
+        add_sprite_id(sprite_ids, "entities/shadow");
+        break;
+
+      case EntityType::ENEMY:
+      {
+        const std::string& breed = entity_data.get_string("breed");
+        add_sprite_id(sprite_ids, "enemies/" + breed);
+        add_sprite_id(sprite_ids, "enemies/enemy_killed");
+        add_script_file_name(script_file_names, "enemies/" + breed + ".lua");
+        break;
+      }
+
+      case EntityType::CRYSTAL:
+        add_sprite_id(sprite_ids, "entities/crystal");
+        add_sprite_id(sprite_ids, "entities/star");
+        break;
+
+      case EntityType::CRYSTAL_BLOCK:
+        add_sprite_id(sprite_ids, "entities/crystal_block");
+        break;
+
+      case EntityType::SHOP_TREASURE:
+        add_sprite_id(sprite_ids, "entities/rupee_icon");
+        break;
+
+      case EntityType::CUSTOM:
+      {
+        const std::string& model = entity_data.get_string("model");
+        if (!model.empty()) {
+          add_script_file_name(script_file_names, "entities/" + model + ".lua");
+        }
+        break;
+      }
+
+      default:
+        break;
+      }
+    }
+  }
+}
+
+/**
+ * \brief Compiles a script into the bytecode cache.
+ *
+ * The chunk name is the file name, like when the engine loads the script.
+ *
+ * \param file_name The script to compile.
+ */
+void compile_script(const std::string& file_name) {
+
+  const DataFileViewPtr& buffer = QuestFiles::data_file_read_view(file_name);
+  lua_State* l = luaL_newstate();
+  LuaBytecodeCache::load_buffer(l, buffer->data(), buffer->size(), file_name);
+  lua_close(l);
+}
+
+}
+
 /**
  * \brief Creates a map loader.
  */
@@ -44,21 +180,194 @@ MapLoader::MapLoader() {
 
 }
 
+/**
+ * \brief Starts preparing a map in a separate thread.
+ * \param map_id Id of the map to prepare.
+ */
+MapLoader::Preparation::Preparation(const std::string& map_id):
+  map_id(map_id),
+  done(false) {
+
+  worker = std::thread(&Preparation::run, this);
+}
+
+/**
+ * \brief Destructor.
+ *
+ * Waits for the worker thread if it is still running.
+ */
+MapLoader::Preparation::~Preparation() {
+
+  if (worker.joinable()) {
+    worker.join();
+  }
+}
+
+/**
+ * \brief Returns whether the preparation is finished.
+ *
+ * When this returns \c true, wait() does not block.
+ *
+ * \return \c true if the worker thread has finished.
+ */
+bool MapLoader::Preparation::is_done() const {
+  return done;
+}
+
+/**
+ * \brief Waits until the preparation is finished.
+ *
+ * Errors that happened in the worker thread are thrown again here,
+ * in the calling thread.
+ */
+void MapLoader::Preparation::wait() {
+
+  if (worker.joinable()) {
+    worker.join();
+  }
+
+  if (error != nullptr) {
+    std::exception_ptr error = this->error;
+    this->error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+/**
+ * \brief Reads the files of the map and decodes its tileset.
+ *
+ * This function runs in the worker thread: it only accesses quest files
+ * and its own fields.
+ */
+void MapLoader::Preparation::run() {
+
+  try {
+    // Read the map data file, unless it is still in the cache.
+    data = MapCache::get_map_data(map_id);
+
+    if (data == nullptr) {
+      Debug::die("Failed to load map data file 'maps/" + map_id + ".dat'");
+    }
+
+    // Find the assets that entities of the map are going to need.
+    std::set<std::string> sprite_ids;
+    std::set<std::string> script_file_names;
+    get_map_assets(*data, sprite_ids, script_file_names);
+
+    // Let the files needed next be decompressed in parallel.
+    const std::string& tileset_prefix = "tilesets/" + data->get_tileset_id();
+    const std::string& script_file_name = "maps/" + map_id + ".lua";
+    std::vector<std::string> file_names = {
+        tileset_prefix + ".dat",
+        tileset_prefix + ".tiles.png",
+        tileset_prefix + ".entities.png",
+        BakedMapData::get_file_name(map_id),
+        script_file_name
+    };
+    std::vector<std::string> sprite_ids_to_load;
+    for (const std::string& sprite_id : sprite_ids) {
+      if (!Sprite::has_animation_set(sprite_id)) {
+        sprite_ids_to_load.push_back(sprite_id);
+        file_names.push_back("sprites/" + sprite_id + ".dat");
+      }
+    }
+    file_names.insert(file_names.end(), script_file_names.begin(), script_file_names.end());
+    QuestFiles::data_files_prefetch(file_names);
+
+    // Load sprites (data and images) and compile entity scripts in parallel
+    // while this thread reads the tileset.
+    const std::vector<std::string> scripts_to_compile(
+        script_file_names.begin(), script_file_names.end()
+    );
+    const size_t num_jobs = sprite_ids_to_load.size() + scripts_to_compile.size();
+    sprite_animation_sets.resize(sprite_ids_to_load.size());
+    std::atomic<size_t> next_job(0);
+    const auto& run_jobs = [&]() {
+      for (size_t job = next_job++; job < num_jobs; job = next_job++) {
+        try {
+          if (job < sprite_ids_to_load.size()) {
+            sprite_animation_sets[job] =
+                std::make_shared<SpriteAnimationSet>(sprite_ids_to_load[job]);
+          }
+          else {
+            compile_script(scripts_to_compile[job - sprite_ids_to_load.size()]);
+          }
+        }
+        catch (...) {
+          // Only a hint: the error will be reported if the asset is really used.
+        }
+      }
+    };
+
+    // Keep a core for the main thread and one for this thread.
+    const unsigned nb_cores = std::thread::hardware_concurrency();
+    const size_t nb_workers = std::min<size_t>(
+        num_jobs, nb_cores > 2 ? std::min(max_asset_workers, nb_cores - 2) : 1
+    );
+    std::vector<std::thread> asset_workers;
+    for (size_t i = 0; i < nb_workers; ++i) {
+      asset_workers.emplace_back(run_jobs);
+    }
+
+    std::exception_ptr tileset_error;
+    try {
+      // Read the tileset.
+      tileset_data = MapCache::get_tileset_data(data->get_tileset_id());
+      tiles_image = MapCache::get_tileset_image(tileset_prefix + ".tiles.png");
+      entities_image = MapCache::get_tileset_image(tileset_prefix + ".entities.png");
+
+      // Use the ground and tile regions computed by solarus_compile if they
+      // are up to date.
+      baked_data = BakedMapData::load(map_id, *data, *tileset_data);
+
+      // Compile the map script so that starting the map hits the bytecode cache.
+      if (QuestFiles::data_file_exists(script_file_name)) {
+        script = QuestFiles::data_file_read_view(script_file_name);
+        lua_State* l = luaL_newstate();
+        LuaBytecodeCache::load_buffer(l, script->data(), script->size(), script_file_name);
+        lua_close(l);
+      }
+
+      // Help the workers with the remaining assets.
+      run_jobs();
+    }
+    catch (...) {
+      // Workers must be joined first.
+      tileset_error = std::current_exception();
+    }
+
+    for (std::thread& asset_worker : asset_workers) {
+      asset_worker.join();
+    }
+    if (tileset_error != nullptr) {
+      std::rethrow_exception(tileset_error);
+    }
+    sprite_animation_sets.erase(
+        std::remove(sprite_animation_sets.begin(), sprite_animation_sets.end(), nullptr),
+        sprite_animation_sets.end()
+    );
+  }
+  catch (...) {
+    error = std::current_exception();
+  }
+
+  done = true;
+}
+
 /**
  * \brief Loads a map into the game.
+ *
+ * Waits for the preparation of the map if it is not finished yet.
+ *
  * \param game The game.
  * \param map The map to load.
+ * \param preparation The preparation of this map.
  */
-void MapLoader::load_map(Game& game, Map& map) {
+void MapLoader::load_map(Game& game, Map& map, Preparation& preparation) {
 
-  // Read the map data file.
-  MapData data;
-  const std::string& file_name = std::string("maps/") + map.get_id() + ".dat";
-  bool success = data.import_from_quest_file(file_name);
-
-  if (!success) {
-    Debug::die("Failed to load map data file '" + file_name + "'");
-  }
+  preparation.wait();
+  const MapData& data = *preparation.data;
+  const BakedMapData* baked_data = preparation.baked_data.get();
 
   // Initialize the map from the data just read.
   // TODO make a method in Map instead of changing directly the fields.
@@ -72,7 +381,15 @@ void MapLoader::load_map(Game& game, Map& map) {
   map.set_floor(data.get_floor());
   map.tileset_id = data.get_tileset_id();
   map.tileset = std::unique_ptr<Tileset>(new Tileset(data.get_tileset_id()));
-  map.tileset->load();
+  map.tileset->load(
+      *preparation.tileset_data,
+      preparation.tiles_image,
+      preparation.entities_image
+  );
+
+  // Let entities find the sprites loaded in advance.
+  Sprite::add_animation_sets(preparation.sprite_animation_sets);
+  preparation.sprite_animation_sets.clear();
 
   MapEntities& entities = map.get_entities();
   entities.map_width8 = map.width8;
@@ -80,19 +397,29 @@ void MapLoader::load_map(Game& game, Map& map) {
   entities.tiles_grid_size = map.width8 * map.height8;
   for (int layer = 0; layer < LAYER_NB; ++layer) {
 
-    Ground initial_ground = (layer == LAYER_LOW) ? Ground::TRAVERSABLE : Ground::EMPTY;
-    for (int i = 0; i < entities.tiles_grid_size; ++i) {
-      entities.tiles_ground[layer].push_back(initial_ground);
-    }
-
     entities.non_animated_regions[layer] = std::unique_ptr<NonAnimatedRegions>(
         new NonAnimatedRegions(map, Layer(layer))
     );
+    entities.non_animated_regions[layer]->reserve_tiles(data.get_num_entities(Layer(layer)));
+
+    if (baked_data != nullptr) {
+      // The ground and the tile regions are already known.
+      entities.tiles_ground[layer] = baked_data->get_tiles_ground(Layer(layer));
+      entities.non_animated_regions[layer]->set_baked_partition(
+          baked_data->get_animated_squares(Layer(layer)),
+          baked_data->get_rejected_tiles(Layer(layer)),
+          baked_data->get_num_tiles(Layer(layer))
+      );
+    }
+    else {
+      Ground initial_ground = (layer == LAYER_LOW) ? Ground::TRAVERSABLE : Ground::EMPTY;
+      entities.tiles_ground[layer].assign(entities.tiles_grid_size, initial_ground);
+    }
   }
   entities.boomerang = nullptr;
   map.camera = std::unique_ptr<Camera>(new Camera(map));
 
-  // Create entities by calling the Lua API functions.
+  // Create entities.
   LuaContext& lua_context = map.get_lua_context();
   for (int k = LAYER_LOW; k < LAYER_NB; ++k) {
     Layer layer = (Layer) k;
@@ -102,12 +429,61 @@ void MapLoader::load_map(Game& game, Map& map) {
       if (!EntityTypeInfo::can_be_stored_in_map_file(type)) {
         Debug::error("Illegal entity type in map file: " + EntityTypeInfo::get_entity_type_name(type));
       }
-      if (lua_context.create_map_entity_from_data(map, entity_data)) {
+
+      if (type == EntityType::TILE) {
+        // Static tiles are the vast majority of entities and Lua never sees
+        // them: create them directly.
+        create_tiles(map, entity_data, baked_data == nullptr);
+      }
+      else if (lua_context.create_map_entity_from_data(map, entity_data)) {
+        // Other entities may be accessed by scripts:
+        // create them by calling the Lua API functions.
         lua_pop(lua_context.get_internal_state(), 1);  // Discard the created entity on the stack.
       }
     }
   }
 }
 
+/**
+ * \brief Creates the static tiles described by a tile of a map data file.
+ *
+ * This does the same as the Lua function map:create_tile(),
+ * without going through Lua.
+ *
+ * \param map The map being loaded.
+ * \param entity_data Description of the tile.
+ * \param update_ground \c false if the ground of the map was baked.
+ */
+void MapLoader::create_tiles(Map& map, const EntityData& entity_data, bool update_ground) {
+
+  const Size size = {
+      entity_data.get_integer("width"),
+      entity_data.get_integer("height")
+  };
+
+  if (size.width < 0 || size.width % 8 != 0 ||
+      size.height < 0 || size.height % 8 != 0) {
+    std::ostringstream oss;
+    oss << "Invalid tile size " << size.width << "x" << size.height
+        << " in map '" << map.get_id() << "': should be a positive multiple of 8";
+    Debug::error(oss.str());
+    return;
+  }
+
+  const std::string& pattern_id = entity_data.get_string("pattern");
+  if (!map.get_tileset().has_tile_pattern(pattern_id)) {
+    Debug::error("No such tile pattern in tileset '" + map.get_tileset_id() +
+        "' for map '" + map.get_id() + "': '" + pattern_id + "'");
+    return;
+  }
+
+  map.get_entities().add_tiles(
+      entity_data.get_layer(),
+      Rectangle(entity_data.get_xy(), size),
+      pattern_id,
+      update_ground
+  );
+}
+
 }
 
@@ -23,53 +23,159 @@
 #include "solarus/lua/LuaContext.h"
 #include "solarus/lua/LuaTools.h"
 #include <lua.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <memory>
 #include <sstream>
+#include <unordered_map>
 
 namespace Solarus {
 
+namespace {
+
+/**
+ * \brief Names of all keys created, indexed by key index.
+ *
+ * A deque keeps references to the names valid when new keys are added.
+ */
+std::deque<std::string>& get_key_names() {
+  static std::deque<std::string> key_names;
+  return key_names;
+}
+
+/**
+ * \brief Index of each key name.
+ */
+std::unordered_map<std::string, int>& get_key_indexes() {
+  static std::unordered_map<std::string, int> key_indexes;
+  return key_indexes;
+}
+
+/**
+ * \brief Minimum number of slots of the hash table of values.
+ */
+const size_t min_num_slots = 64;
+
+}
+
+/**
+ * \brief Creates an invalid key.
+ */
+Savegame::Key::Key():
+  index(-1) {
+
+}
+
+/**
+ * \brief Returns the key of a savegame variable name.
+ *
+ * The name is interned the first time.
+ *
+ * \param name Name of a savegame variable. It must be a valid Lua
+ * identifier.
+ */
+Savegame::Key::Key(const std::string& name):
+  index(-1) {
+
+  std::unordered_map<std::string, int>& key_indexes = get_key_indexes();
+  const auto& it = key_indexes.find(name);
+  if (it != key_indexes.end()) {
+    index = it->second;
+    return;
+  }
+
+  Debug::check_assertion(LuaTools::is_valid_lua_identifier(name),
+      std::string("Savegame variable '") + name + "' is not a valid key");
+
+  std::deque<std::string>& key_names = get_key_names();
+  index = static_cast<int>(key_names.size());
+  key_names.push_back(name);
+  key_indexes.emplace(name, index);
+}
+
+/**
+ * \brief Returns the index of this key.
+ * \return The index, or -1 for an invalid key.
+ */
+int Savegame::Key::get_index() const {
+  return index;
+}
+
+/**
+ * \brief Returns the savegame variable name of this key.
+ * \return The name.
+ */
+const std::string& Savegame::Key::get_name() const {
+
+  SOLARUS_ASSERT(index >= 0, "Invalid savegame key");
+  return get_key_names()[index];
+}
+
+/**
+ * \brief Returns the key that has the given index.
+ * \param index Index of an existing key, as returned by get_index().
+ * \return The key.
+ */
+Savegame::Key Savegame::Key::from_index(int index) {
+
+  SOLARUS_ASSERT(index >= 0 && index < get_num_keys(), "Invalid savegame key index");
+  Key key;
+  key.index = index;
+  return key;
+}
+
+/**
+ * \brief Returns the number of distinct key names created so far.
+ * \return The number of keys.
+ */
+int Savegame::Key::get_num_keys() {
+  return static_cast<int>(get_key_names().size());
+}
+
 const int Savegame::SAVEGAME_VERSION = 2;
 
-const std::string Savegame::KEY_SAVEGAME_VERSION = "_version";         /**< Format of this savegame file. */
-const std::string Savegame::KEY_STARTING_MAP = "_starting_map";        /**< Map id where to start the savegame. */
-const std::string Savegame::KEY_STARTING_POINT = "_starting_point";    /**< Destination name on the starting map. */
-const std::string Savegame::KEY_KEYBOARD_ACTION = "_keyboard_action";  /**< Keyboard key mapped to the action command. */
-const std::string Savegame::KEY_KEYBOARD_ATTACK = "_keyboard_attack";  /**< Keyboard key mapped to the attack command. */
-const std::string Savegame::KEY_KEYBOARD_ITEM_1 = "_keyboard_item_1";  /**< Keyboard key mapped to the item 1 command. */
-const std::string Savegame::KEY_KEYBOARD_ITEM_2 = "_keyboard_item_2";  /**< Keyboard key mapped to the item 2 command. */
-const std::string Savegame::KEY_KEYBOARD_PAUSE = "_keyboard_pause";    /**< Keyboard key mapped to the pause command. */
-const std::string Savegame::KEY_KEYBOARD_RIGHT = "_keyboard_right";    /**< Keyboard key mapped to the right command. */
-const std::string Savegame::KEY_KEYBOARD_UP = "_keyboard_up";          /**< Keyboard key mapped to the up command. */
-const std::string Savegame::KEY_KEYBOARD_LEFT = "_keyboard_left";      /**< Keyboard key mapped to the left command. */
-const std::string Savegame::KEY_KEYBOARD_DOWN = "_keyboard_down";      /**< Keyboard key mapped to the down command. */
-const std::string Savegame::KEY_JOYPAD_ACTION = "_joypad_action";      /**< Joypad string mapped to the action command. */
-const std::string Savegame::KEY_JOYPAD_ATTACK = "_joypad_attack";      /**< Joypad string mapped to the attack command. */
-const std::string Savegame::KEY_JOYPAD_ITEM_1 = "_joypad_item_1";      /**< Joypad string mapped to the item 1 command. */
-const std::string Savegame::KEY_JOYPAD_ITEM_2 = "_joypad_item_2";      /**< Joypad string mapped to the item 2 command. */
-const std::string Savegame::KEY_JOYPAD_PAUSE = "_joypad_pause";        /**< Joypad string mapped to the pause command. */
-const std::string Savegame::KEY_JOYPAD_RIGHT = "_joypad_right";        /**< Joypad string mapped to the right command. */
-const std::string Savegame::KEY_JOYPAD_UP = "_joypad_up_key";          /**< Joypad string mapped to the up command. */
-const std::string Savegame::KEY_JOYPAD_LEFT = "_joypad_left_key";      /**< Joypad string mapped to the left command. */
-const std::string Savegame::KEY_JOYPAD_DOWN = "_joypad_down_key";      /**< Joypad string mapped to the down command. */
-const std::string Savegame::KEY_CURRENT_LIFE = "_current_life";        /**< Number of life points. */
-const std::string Savegame::KEY_CURRENT_MONEY = "_current_money";      /**< Amount of money. */
-const std::string Savegame::KEY_CURRENT_MAGIC = "_current_magic";      /**< Number of magic points. */
-const std::string Savegame::KEY_MAX_LIFE = "_max_life";                /**< Maximum allowed life points. */
-const std::string Savegame::KEY_MAX_MONEY = "_max_money";              /**< Maximum allowed money. */
-const std::string Savegame::KEY_MAX_MAGIC = "_max_magic";              /**< Maximum allowed magic points. */
-const std::string Savegame::KEY_ITEM_SLOT_1 = "_item_slot_1";          /**< Name of the equipment item in slot 1. */
-const std::string Savegame::KEY_ITEM_SLOT_2 = "_item_slot_2";          /**< Name of the equipment item in slot 2. */
-const std::string Savegame::KEY_ABILITY_TUNIC = "_ability_tunic"; /**< Resistance level. */
-const std::string Savegame::KEY_ABILITY_SWORD = "_ability_sword";      /**< Attack level. */
-const std::string Savegame::KEY_ABILITY_SWORD_KNOWLEDGE =
-    "_ability_sword_knowledge";                                        /**< Super spin attack ability level. */
-const std::string Savegame::KEY_ABILITY_SHIELD = "_ability_shield";    /**< Protection level. */
-const std::string Savegame::KEY_ABILITY_LIFT = "_ability_lift";        /**< Lift level. */
-const std::string Savegame::KEY_ABILITY_SWIM = "_ability_swim";        /**< Swim level. */
-const std::string Savegame::KEY_ABILITY_RUN = "_ability_run";          /**< Run level. */
-const std::string Savegame::KEY_ABILITY_DETECT_WEAK_WALLS =
-    "_ability_detect_weak_walls";                                      /**< Weak walls detection level. */
-const std::string Savegame::KEY_ABILITY_GET_BACK_FROM_DEATH =
-    "_ability_get_back_from_death";                                    /**< Resurrection ability level. */
+const Savegame::Key Savegame::KEY_SAVEGAME_VERSION("_version");         /**< Format of this savegame file. */
+const Savegame::Key Savegame::KEY_STARTING_MAP("_starting_map");        /**< Map id where to start the savegame. */
+const Savegame::Key Savegame::KEY_STARTING_POINT("_starting_point");    /**< Destination name on the starting map. */
+const Savegame::Key Savegame::KEY_KEYBOARD_ACTION("_keyboard_action");  /**< Keyboard key mapped to the action command. */
+const Savegame::Key Savegame::KEY_KEYBOARD_ATTACK("_keyboard_attack");  /**< Keyboard key mapped to the attack command. */
+const Savegame::Key Savegame::KEY_KEYBOARD_ITEM_1("_keyboard_item_1");  /**< Keyboard key mapped to the item 1 command. */
+const Savegame::Key Savegame::KEY_KEYBOARD_ITEM_2("_keyboard_item_2");  /**< Keyboard key mapped to the item 2 command. */
+const Savegame::Key Savegame::KEY_KEYBOARD_PAUSE("_keyboard_pause");    /**< Keyboard key mapped to the pause command. */
+const Savegame::Key Savegame::KEY_KEYBOARD_RIGHT("_keyboard_right");    /**< Keyboard key mapped to the right command. */
+const Savegame::Key Savegame::KEY_KEYBOARD_UP("_keyboard_up");          /**< Keyboard key mapped to the up command. */
+const Savegame::Key Savegame::KEY_KEYBOARD_LEFT("_keyboard_left");      /**< Keyboard key mapped to the left command. */
+const Savegame::Key Savegame::KEY_KEYBOARD_DOWN("_keyboard_down");      /**< Keyboard key mapped to the down command. */
+const Savegame::Key Savegame::KEY_JOYPAD_ACTION("_joypad_action");      /**< Joypad string mapped to the action command. */
+const Savegame::Key Savegame::KEY_JOYPAD_ATTACK("_joypad_attack");      /**< Joypad string mapped to the attack command. */
+const Savegame::Key Savegame::KEY_JOYPAD_ITEM_1("_joypad_item_1");      /**< Joypad string mapped to the item 1 command. */
+const Savegame::Key Savegame::KEY_JOYPAD_ITEM_2("_joypad_item_2");      /**< Joypad string mapped to the item 2 command. */
+const Savegame::Key Savegame::KEY_JOYPAD_PAUSE("_joypad_pause");        /**< Joypad string mapped to the pause command. */
+const Savegame::Key Savegame::KEY_JOYPAD_RIGHT("_joypad_right");        /**< Joypad string mapped to the right command. */
+const Savegame::Key Savegame::KEY_JOYPAD_UP("_joypad_up_key");          /**< Joypad string mapped to the up command. */
+const Savegame::Key Savegame::KEY_JOYPAD_LEFT("_joypad_left_key");      /**< Joypad string mapped to the left command. */
+const Savegame::Key Savegame::KEY_JOYPAD_DOWN("_joypad_down_key");      /**< Joypad string mapped to the down command. */
+const Savegame::Key Savegame::KEY_CURRENT_LIFE("_current_life");        /**< Number of life points. */
+const Savegame::Key Savegame::KEY_CURRENT_MONEY("_current_money");      /**< Amount of money. */
+const Savegame::Key Savegame::KEY_CURRENT_MAGIC("_current_magic");      /**< Number of magic points. */
+const Savegame::Key Savegame::KEY_MAX_LIFE("_max_life");                /**< Maximum allowed life points. */
+const Savegame::Key Savegame::KEY_MAX_MONEY("_max_money");              /**< Maximum allowed money. */
+const Savegame::Key Savegame::KEY_MAX_MAGIC("_max_magic");              /**< Maximum allowed magic points. */
+const Savegame::Key Savegame::KEY_ITEM_SLOT_1("_item_slot_1");          /**< Name of the equipment item in slot 1. */
+const Savegame::Key Savegame::KEY_ITEM_SLOT_2("_item_slot_2");          /**< Name of the equipment item in slot 2. */
+const Savegame::Key Savegame::KEY_ABILITY_TUNIC("_ability_tunic");    /**< Resistance level. */
+const Savegame::Key Savegame::KEY_ABILITY_SWORD("_ability_sword");      /**< Attack level. */
+const Savegame::Key Savegame::KEY_ABILITY_SWORD_KNOWLEDGE(
+    "_ability_sword_knowledge");                                        /**< Super spin attack ability level. */
+const Savegame::Key Savegame::KEY_ABILITY_SHIELD("_ability_shield");    /**< Protection level. */
+const Savegame::Key Savegame::KEY_ABILITY_LIFT("_ability_lift");        /**< Lift level. */
+const Savegame::Key Savegame::KEY_ABILITY_SWIM("_ability_swim");        /**< Swim level. */
+const Savegame::Key Savegame::KEY_ABILITY_RUN("_ability_run");          /**< Run level. */
+const Savegame::Key Savegame::KEY_ABILITY_DETECT_WEAK_WALLS(
+    "_ability_detect_weak_walls");                                      /**< Weak walls detection level. */
+const Savegame::Key Savegame::KEY_ABILITY_GET_BACK_FROM_DEATH(
+    "_ability_get_back_from_death");                                    /**< Resurrection ability level. */
 
 /**
  * \brief Creates a savegame with a specified file name, existing or not.
@@ -79,6 +185,8 @@ const std::string Savegame::KEY_ABILITY_GET_BACK_FROM_DEATH =
  */
 Savegame::Savegame(MainLoop& main_loop, const std::string& file_name):
   ExportableToLua(),
+  slots(min_num_slots),
+  num_values(0),
   empty(true),
   file_name(file_name),
   main_loop(main_loop),
@@ -103,6 +211,9 @@ void Savegame::initialize() {
   Debug::check_assertion(!quest_write_dir.empty(),
       "The quest write directory for savegames was not set in quest.dat");
 
+  // This savegame may still be being written.
+  FileWriter::flush();
+
   if (!QuestFiles::data_file_exists(file_name)) {
     // This save does not exist yet.
     empty = true;
@@ -279,8 +390,48 @@ int Savegame::l_newindex(lua_State* l) {
 
 /**
  * \brief Saves the data into a file.
+ *
+ * The values are copied and the file is written later
+ * on the I/O thread of FileWriter.
+ *
+ * \param callback Function to call from the main thread when the file is
+ * written, or an empty function.
  */
-void Savegame::save() {
+void Savegame::save(const FileWriter::Callback& callback) {
+
+  const std::shared_ptr<SavedValueList> values = std::make_shared<SavedValueList>();
+  values->reserve(num_values);
+  for (const Slot& slot: slots) {
+    if (slot.key_index != -1) {
+      values->emplace_back(get_key_names()[slot.key_index], slot.value);
+    }
+  }
+
+  FileWriter::write_async(
+      QuestFiles::get_full_quest_write_dir() + "/" + file_name,
+      [values]() { return serialize(*values); },
+      callback
+  );
+  empty = false;
+}
+
+/**
+ * \brief Converts saved values to the text of a savegame file.
+ *
+ * Values are sorted by name so that the file does not depend on the
+ * order of the hash table.
+ *
+ * \param saved_values The values to convert. They are sorted.
+ * \return The content of the savegame file.
+ */
+std::string Savegame::serialize(SavedValueList& saved_values) {
+
+  std::sort(saved_values.begin(), saved_values.end(), [](
+      const std::pair<std::string, SavedValue>& value_1,
+      const std::pair<std::string, SavedValue>& value_2
+  ) {
+    return value_1.first < value_2.first;
+  });
 
   std::ostringstream oss;
   for (const auto& kvp: saved_values) {
@@ -299,9 +450,7 @@ void Savegame::save() {
     oss << "\n";
   }
 
-  const std::string& text = oss.str();
-  QuestFiles::data_file_save(file_name, text);
-  empty = false;
+  return oss.str();
 }
 
 /**
@@ -382,17 +531,18 @@ void Savegame::notify_game_finished() {
  * \return true if this value exists and is a string.
  */
 bool Savegame::is_string(const std::string& key) const {
+  return is_string(Key(key));
+}
 
-  SOLARUS_ASSERT(LuaTools::is_valid_lua_identifier(key),
-      std::string("Savegame variable '") + key + "' is not a valid key");
+/**
+ * \brief Returns whether a saved value is a string.
+ * \param key Key of the value to get.
+ * \return true if this value exists and is a string.
+ */
+bool Savegame::is_string(Key key) const {
 
-  bool result = false;
-  const auto& it = saved_values.find(key);
-  if (it != saved_values.end()) {
-    const SavedValue& value = it->second;
-    result = (value.type == SavedValue::VALUE_STRING);
-  }
-  return result;
+  const SavedValue* value = find_value(key);
+  return value != nullptr && value->type == SavedValue::VALUE_STRING;
 }
 
 /**
@@ -401,16 +551,21 @@ bool Savegame::is_string(const std::string& key) const {
  * \return The string value associated with this key or an empty string.
  */
 const std::string& Savegame::get_string(const std::string& key) const {
+  return get_string(Key(key));
+}
 
-  SOLARUS_ASSERT(LuaTools::is_valid_lua_identifier(key),
-      std::string("Savegame variable '") + key + "' is not a valid key");
+/**
+ * \brief Returns a string value saved.
+ * \param key Key of the value to get.
+ * \return The string value associated with this key or an empty string.
+ */
+const std::string& Savegame::get_string(Key key) const {
 
-  const auto& it = saved_values.find(key);
-  if (it != saved_values.end()) {
-    const SavedValue& value = it->second;
-    SOLARUS_ASSERT(value.type == SavedValue::VALUE_STRING,
-        std::string("Value '") + key + "' is not a string");
-    return value.string_data;
+  const SavedValue* value = find_value(key);
+  if (value != nullptr) {
+    SOLARUS_ASSERT(value->type == SavedValue::VALUE_STRING,
+        std::string("Value '") + key.get_name() + "' is not a string");
+    return value->string_data;
   }
 
   static const std::string empty_string = "";
@@ -423,12 +578,19 @@ const std::string& Savegame::get_string(const std::string& key) const {
  * \param value The string value to associate with this key.
  */
 void Savegame::set_string(const std::string& key, const std::string& value) {
+  set_string(Key(key), value);
+}
 
-  Debug::check_assertion(LuaTools::is_valid_lua_identifier(key),
-      std::string("Savegame variable '") + key + "' is not a valid key");
+/**
+ * \brief Sets a string value saved.
+ * \param key Key of the value to set.
+ * \param value The string value to associate with this key.
+ */
+void Savegame::set_string(Key key, const std::string& value) {
 
-  saved_values[key].type = SavedValue::VALUE_STRING;
-  saved_values[key].string_data = value;
+  SavedValue& saved_value = get_or_add_value(key);
+  saved_value.type = SavedValue::VALUE_STRING;
+  saved_value.string_data = value;
 }
 
 /**
@@ -437,17 +599,18 @@ void Savegame::set_string(const std::string& key, const std::string& value) {
  * \return true if this value exists and is an integer.
  */
 bool Savegame::is_integer(const std::string& key) const {
+  return is_integer(Key(key));
+}
 
-  SOLARUS_ASSERT(LuaTools::is_valid_lua_identifier(key),
-      std::string("Savegame variable '") + key + "' is not a valid key");
+/**
+ * \brief Returns whether a saved value is an integer.
+ * \param key Key of the value to get.
+ * \return true if this value exists and is an integer.
+ */
+bool Savegame::is_integer(Key key) const {
 
-  bool result = false;
-  const auto& it = saved_values.find(key);
-  if (it != saved_values.end()) {
-    const SavedValue& value = it->second;
-    result = (value.type == SavedValue::VALUE_INTEGER);
-  }
-  return result;
+  const SavedValue* value = find_value(key);
+  return value != nullptr && value->type == SavedValue::VALUE_INTEGER;
 }
 
 /**
@@ -456,19 +619,24 @@ bool Savegame::is_integer(const std::string& key) const {
  * \return The integer value associated with this key or 0.
  */
 int Savegame::get_integer(const std::string& key) const {
+  return get_integer(Key(key));
+}
 
-  SOLARUS_ASSERT(LuaTools::is_valid_lua_identifier(key),
-      std::string("Savegame variable '") + key + "' is not a valid key");
+/**
+ * \brief Returns a integer value saved.
+ * \param key Key of the value to get.
+ * \return The integer value associated with this key or 0.
+ */
+int Savegame::get_integer(Key key) const {
 
-  int result = 0;
-  const auto& it = saved_values.find(key);
-  if (it != saved_values.end()) {
-    const SavedValue& value = it->second;
-    SOLARUS_ASSERT(value.type == SavedValue::VALUE_INTEGER,
-        std::string("Value '") + key + "' is not an integer");
-    result = value.int_data;
+  const SavedValue* value = find_value(key);
+  if (value != nullptr) {
+    SOLARUS_ASSERT(value->type == SavedValue::VALUE_INTEGER,
+        std::string("Value '") + key.get_name() + "' is not an integer");
+    return value->int_data;
   }
-  return result;
+
+  return 0;
 }
 
 /**
@@ -477,12 +645,19 @@ int Savegame::get_integer(const std::string& key) const {
  * \param value The integer value to associate with this key.
  */
 void Savegame::set_integer(const std::string& key, int value) {
+  set_integer(Key(key), value);
+}
 
-  Debug::check_assertion(LuaTools::is_valid_lua_identifier(key),
-      std::string("Savegame variable '") + key + "' is not a valid key");
+/**
+ * \brief Sets an integer value saved.
+ * \param key Key of the value to set.
+ * \param value The integer value to associate with this key.
+ */
+void Savegame::set_integer(Key key, int value) {
 
-  saved_values[key].type = SavedValue::VALUE_INTEGER;
-  saved_values[key].int_data = value;
+  SavedValue& saved_value = get_or_add_value(key);
+  saved_value.type = SavedValue::VALUE_INTEGER;
+  saved_value.int_data = value;
 }
 
 /**
@@ -491,17 +666,18 @@ void Savegame::set_integer(const std::string& key, int value) {
  * \return true if this value exists and is a boolean.
  */
 bool Savegame::is_boolean(const std::string& key) const {
+  return is_boolean(Key(key));
+}
 
-  SOLARUS_ASSERT(LuaTools::is_valid_lua_identifier(key),
-      std::string("Savegame variable '") + key + "' is not a valid key");
+/**
+ * \brief Returns whether a saved value is a boolean.
+ * \param key Key of the value to get.
+ * \return true if this value exists and is a boolean.
+ */
+bool Savegame::is_boolean(Key key) const {
 
-  bool result = false;
-  const auto& it = saved_values.find(key);
-  if (it != saved_values.end()) {
-    const SavedValue& value = it->second;
-    result = (value.type == SavedValue::VALUE_BOOLEAN);
-  }
-  return result;
+  const SavedValue* value = find_value(key);
+  return value != nullptr && value->type == SavedValue::VALUE_BOOLEAN;
 }
 
 /**
@@ -510,19 +686,24 @@ bool Savegame::is_boolean(const std::string& key) const {
  * \return The boolean value associated with this key or false.
  */
 bool Savegame::get_boolean(const std::string& key) const {
+  return get_boolean(Key(key));
+}
 
-  SOLARUS_ASSERT(LuaTools::is_valid_lua_identifier(key),
-      std::string("Savegame variable '") + key + "' is not a valid key");
+/**
+ * \brief Returns a boolean value saved.
+ * \param key Key of the value to get.
+ * \return The boolean value associated with this key or false.
+ */
+bool Savegame::get_boolean(Key key) const {
 
-  bool result = false;
-  const auto& it = saved_values.find(key);
-  if (it != saved_values.end()) {
-    const SavedValue& value = it->second;
-    SOLARUS_ASSERT(value.type == SavedValue::VALUE_BOOLEAN,
-        std::string("Value '") + key + "' is not a boolean");
-    result = value.int_data != 0;
+  const SavedValue* value = find_value(key);
+  if (value != nullptr) {
+    SOLARUS_ASSERT(value->type == SavedValue::VALUE_BOOLEAN,
+        std::string("Value '") + key.get_name() + "' is not a boolean");
+    return value->int_data != 0;
   }
-  return result;
+
+  return false;
 }
 
 /**
@@ -531,12 +712,19 @@ bool Savegame::get_boolean(const std::string& key) const {
  * \param value The boolean value to associate with this key.
  */
 void Savegame::set_boolean(const std::string& key, bool value) {
+  set_boolean(Key(key), value);
+}
 
-  Debug::check_assertion(LuaTools::is_valid_lua_identifier(key),
-      std::string("Savegame variable '") + key + "' is not a valid key");
+/**
+ * \brief Sets a boolean value saved.
+ * \param key Key of the value to set.
+ * \param value The boolean value to associate with this key.
+ */
+void Savegame::set_boolean(Key key, bool value) {
 
-  saved_values[key].type = SavedValue::VALUE_BOOLEAN;
-  saved_values[key].int_data = value;
+  SavedValue& saved_value = get_or_add_value(key);
+  saved_value.type = SavedValue::VALUE_BOOLEAN;
+  saved_value.int_data = value;
 }
 
 /**
@@ -544,11 +732,145 @@ void Savegame::set_boolean(const std::string& key, bool value) {
  * \param key Name of the value to unset.
  */
 void Savegame::unset(const std::string& key) {
+  unset(Key(key));
+}
+
+/**
+ * \brief Unsets a value saved.
+ *
+ * The following entries of the same cluster are shifted back so that
+ * lookups never need tombstones.
+ *
+ * \param key Key of the value to unset.
+ */
+void Savegame::unset(Key key) {
+
+  const size_t mask = slots.size() - 1;
+  size_t i = get_home_slot(key.get_index());
+  while (slots[i].key_index != key.get_index()) {
+    if (slots[i].key_index == -1) {
+      // Not set.
+      return;
+    }
+    i = (i + 1) & mask;
+  }
+
+  size_t j = i;
+  while (true) {
+    j = (j + 1) & mask;
+    if (slots[j].key_index == -1) {
+      break;
+    }
+    // Move the entry at j to the hole at i unless its home slot is
+    // cyclically between i (excluded) and j (included).
+    const size_t home = get_home_slot(slots[j].key_index);
+    const bool stays = (i < j) ?
+        (home > i && home <= j) :
+        (home > i || home <= j);
+    if (!stays) {
+      slots[i] = std::move(slots[j]);
+      i = j;
+    }
+  }
 
-  Debug::check_assertion(LuaTools::is_valid_lua_identifier(key),
-      std::string("Savegame variable '") + key + "' is not a valid key");
+  slots[i].key_index = -1;
+  slots[i].value.string_data.clear();
+  --num_values;
+}
 
-  saved_values.erase(key);
+/**
+ * \brief Returns the number of values currently saved.
+ * \return The number of values.
+ */
+int Savegame::get_num_values() const {
+  return num_values;
+}
+
+/**
+ * \brief Returns the slot where the search of a key starts.
+ * \param key_index Index of a valid key.
+ * \return The home slot of this key.
+ */
+size_t Savegame::get_home_slot(int key_index) const {
+
+  // Fibonacci hashing: consecutive indexes are spread over the table.
+  const uint32_t hash = static_cast<uint32_t>(key_index) * 2654435769u;
+  return (hash ^ (hash >> 16)) & (slots.size() - 1);
+}
+
+/**
+ * \brief Returns the value of a key.
+ * \param key A key.
+ * \return The value stored for this key, or nullptr if there is none.
+ */
+const Savegame::SavedValue* Savegame::find_value(Key key) const {
+
+  SOLARUS_ASSERT(key.get_index() >= 0, "Invalid savegame key");
+
+  const size_t mask = slots.size() - 1;
+  size_t i = get_home_slot(key.get_index());
+  while (true) {
+    const Slot& slot = slots[i];
+    if (slot.key_index == key.get_index()) {
+      return &slot.value;
+    }
+    if (slot.key_index == -1) {
+      return nullptr;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+/**
+ * \brief Returns the value of a key, adding it if it does not exist.
+ * \param key A key.
+ * \return The value stored for this key.
+ */
+Savegame::SavedValue& Savegame::get_or_add_value(Key key) {
+
+  SOLARUS_ASSERT(key.get_index() >= 0, "Invalid savegame key");
+
+  // Keep the load factor under 1/2 so that clusters stay short.
+  if (static_cast<size_t>(num_values + 1) * 2 > slots.size()) {
+    grow_slots();
+  }
+
+  const size_t mask = slots.size() - 1;
+  size_t i = get_home_slot(key.get_index());
+  while (true) {
+    Slot& slot = slots[i];
+    if (slot.key_index == key.get_index()) {
+      return slot.value;
+    }
+    if (slot.key_index == -1) {
+      slot.key_index = key.get_index();
+      ++num_values;
+      return slot.value;
+    }
+    i = (i + 1) & mask;
+  }
+}
+
+/**
+ * \brief Doubles the size of the hash table of values.
+ */
+void Savegame::grow_slots() {
+
+  std::vector<Slot> old_slots;
+  old_slots.swap(slots);
+  slots.resize(old_slots.size() * 2);
+
+  const size_t mask = slots.size() - 1;
+  for (Slot& old_slot: old_slots) {
+    if (old_slot.key_index == -1) {
+      continue;
+    }
+    size_t i = get_home_slot(old_slot.key_index);
+    while (slots[i].key_index != -1) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = std::move(old_slot);
+  }
 }
 
 /**
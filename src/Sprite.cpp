@@ -28,17 +28,49 @@
 #include "solarus/lowlevel/Surface.h"
 #include "solarus/lowlevel/Debug.h"
 #include "solarus/lowlevel/Size.h"
+#include "solarus/Arguments.h"
+#include <algorithm>
 #include <memory>
 #include <sstream>
 
 namespace Solarus {
 
-std::map<std::string, SpriteAnimationSet*> Sprite::all_animation_sets;
+namespace {
+
+/**
+ * \brief Default memory budget of unused animation sets in megabytes.
+ */
+const int default_max_unused_memory_mb = 16;
+
+}
+
+std::map<std::string, Sprite::AnimationSetInfo> Sprite::all_animation_sets;
+std::list<std::string> Sprite::unused_animation_sets;
+size_t Sprite::unused_memory = 0;
+size_t Sprite::max_unused_memory = 0;
+std::mutex Sprite::animation_sets_mutex;
 
 /**
  * \brief Initializes the sprites system.
+ *
+ * The option -sprite-cache-size=<megabytes> sets the memory budget of
+ * animation sets that are no longer used by any sprite (default 16).
+ * 0 frees them as soon as they are unused.
+ *
+ * \param args Command-line arguments.
  */
-void Sprite::initialize() {
+void Sprite::initialize(const Arguments& args) {
+
+  int max_unused_memory_mb = default_max_unused_memory_mb;
+  const std::string& value_string = args.get_argument_value("-sprite-cache-size");
+  if (!value_string.empty()) {
+    std::istringstream iss(value_string);
+    if (!(iss >> max_unused_memory_mb) || max_unused_memory_mb < 0) {
+      Debug::error("Invalid value for -sprite-cache-size: '" + value_string + "'");
+      max_unused_memory_mb = default_max_unused_memory_mb;
+    }
+  }
+  max_unused_memory = static_cast<size_t>(max_unused_memory_mb) * 1024 * 1024;
 }
 
 /**
@@ -46,11 +78,72 @@ void Sprite::initialize() {
  */
 void Sprite::quit() {
 
-  // delete the animations loaded
-  for (auto kvp: all_animation_sets) {
-    delete kvp.second;
-  }
+  // Delete the animations loaded.
+  std::lock_guard<std::mutex> lock(animation_sets_mutex);
   all_animation_sets.clear();
+  unused_animation_sets.clear();
+  unused_memory = 0;
+}
+
+/**
+ * \brief Returns whether an animation set is currently in memory.
+ *
+ * This function can be called from any thread.
+ *
+ * \param id Id of an animation set.
+ * \return \c true if it is loaded, used or not.
+ */
+bool Sprite::has_animation_set(const std::string& id) {
+
+  std::lock_guard<std::mutex> lock(animation_sets_mutex);
+  return all_animation_sets.find(id) != all_animation_sets.end();
+}
+
+/**
+ * \brief Adds animation sets loaded in advance.
+ *
+ * This is a hint that these animation sets are going to be used soon,
+ * for example by the next map.
+ * They are kept like recently released animation sets: sets not used
+ * for the longest time are freed if the budget is exceeded.
+ * Animation sets already in memory are ignored.
+ *
+ * \param animation_sets The animation sets to add.
+ */
+void Sprite::add_animation_sets(
+    const std::vector<std::shared_ptr<SpriteAnimationSet>>& animation_sets
+) {
+  std::lock_guard<std::mutex> lock(animation_sets_mutex);
+  for (const std::shared_ptr<SpriteAnimationSet>& animation_set : animation_sets) {
+    const std::string& id = animation_set->get_id();
+    if (all_animation_sets.find(id) != all_animation_sets.end()) {
+      continue;
+    }
+    all_animation_sets[id] = { animation_set, 0 };
+    unused_animation_sets.push_front(id);
+    unused_memory += animation_set->get_memory_used();
+  }
+  remove_unused_animation_sets();
+}
+
+/**
+ * \brief Returns the number of animation sets in memory.
+ * \return The number of animation sets, used or not.
+ */
+int Sprite::get_num_animation_sets() {
+
+  std::lock_guard<std::mutex> lock(animation_sets_mutex);
+  return all_animation_sets.size();
+}
+
+/**
+ * \brief Returns the memory used by animation sets that no sprite uses.
+ * \return The approximate memory used in bytes.
+ */
+size_t Sprite::get_unused_animation_sets_memory() {
+
+  std::lock_guard<std::mutex> lock(animation_sets_mutex);
+  return unused_memory;
 }
 
 /**
@@ -58,25 +151,89 @@ void Sprite::quit() {
  *
  * The animation set may be created if it is new, or just retrieved from
  * memory if it way already used before.
+ * The caller is counted as a user of the animation set until it calls
+ * release_animation_set().
+ * Other references to the animation set, like the ones held by map
+ * preparation threads, do not count.
  *
  * \param id id of the animation set
  * \return the corresponding animation set
  */
-SpriteAnimationSet& Sprite::get_animation_set(const std::string& id) {
+std::shared_ptr<SpriteAnimationSet> Sprite::get_animation_set(const std::string& id) {
 
-  SpriteAnimationSet* animation_set = nullptr;
+  std::lock_guard<std::mutex> lock(animation_sets_mutex);
+  std::shared_ptr<SpriteAnimationSet> animation_set = nullptr;
   auto it = all_animation_sets.find(id);
   if (it != all_animation_sets.end()) {
-    animation_set = it->second;
+    AnimationSetInfo& info = it->second;
+    animation_set = info.animation_set;
+    if (info.num_sprites == 0) {
+      // Nobody else was using it.
+      auto unused_it = std::find(unused_animation_sets.begin(), unused_animation_sets.end(), id);
+      if (unused_it != unused_animation_sets.end()) {
+        unused_animation_sets.erase(unused_it);
+        unused_memory -= animation_set->get_memory_used();
+      }
+    }
+    ++info.num_sprites;
   }
   else {
-    animation_set = new SpriteAnimationSet(id);
-    all_animation_sets[id] = animation_set;
+    animation_set = std::make_shared<SpriteAnimationSet>(id);
+    all_animation_sets[id] = { animation_set, 1 };
   }
 
   Debug::check_assertion(animation_set != nullptr, "No animation set");
 
-  return *animation_set;
+  return animation_set;
+}
+
+/**
+ * \brief Stops using an animation set.
+ *
+ * If no other sprite uses it, it is kept in memory as long as the budget of
+ * unused animation sets allows it.
+ *
+ * \param animation_set The animation set to release. It is reset.
+ */
+void Sprite::release_animation_set(std::shared_ptr<SpriteAnimationSet>& animation_set) {
+
+  std::lock_guard<std::mutex> lock(animation_sets_mutex);
+  const std::string id = animation_set->get_id();
+  animation_set = nullptr;
+
+  auto it = all_animation_sets.find(id);
+  if (it == all_animation_sets.end()) {
+    // Already freed.
+    return;
+  }
+
+  AnimationSetInfo& info = it->second;
+  --info.num_sprites;
+  if (info.num_sprites > 0) {
+    // Still used by other sprites.
+    return;
+  }
+
+  unused_animation_sets.push_front(id);
+  unused_memory += info.animation_set->get_memory_used();
+  remove_unused_animation_sets();
+}
+
+/**
+ * \brief Frees the least recently used animation sets until the memory
+ * they use fits the budget.
+ *
+ * The lock must be held by the caller.
+ */
+void Sprite::remove_unused_animation_sets() {
+
+  while (unused_memory > max_unused_memory && !unused_animation_sets.empty()) {
+    const std::string& id = unused_animation_sets.back();
+    auto it = all_animation_sets.find(id);
+    unused_memory -= it->second.animation_set->get_memory_used();
+    all_animation_sets.erase(it);
+    unused_animation_sets.pop_back();
+  }
 }
 
 /**
@@ -98,7 +255,15 @@ Sprite::Sprite(const std::string& id):
   intermediate_surface(nullptr),
   blink_delay(0) {
 
-  set_current_animation(animation_set.get_default_animation());
+  set_current_animation(animation_set->get_default_animation());
+}
+
+/**
+ * \brief Destructor.
+ */
+Sprite::~Sprite() {
+
+  release_animation_set(animation_set);
 }
 
 /**
@@ -118,7 +283,7 @@ const std::string& Sprite::get_animation_set_id() const {
  * \return the animation set of this sprite
  */
 const SpriteAnimationSet& Sprite::get_animation_set() const {
-  return animation_set;
+  return *animation_set;
 }
 
 /**
@@ -129,7 +294,7 @@ const SpriteAnimationSet& Sprite::get_animation_set() const {
  * \param tileset The tileset.
  */
 void Sprite::set_tileset(Tileset& tileset) {
-  animation_set.set_tileset(tileset);
+  animation_set->set_tileset(tileset);
 }
 
 /**
@@ -138,7 +303,7 @@ void Sprite::set_tileset(Tileset& tileset) {
  * All sprites that use the same animation set as this one will be affected.
  */
 void Sprite::enable_pixel_collisions() {
-  animation_set.enable_pixel_collisions();
+  animation_set->enable_pixel_collisions();
 }
 
 /**
@@ -146,7 +311,7 @@ void Sprite::enable_pixel_collisions() {
  * \return true if the pixel-perfect collisions are enabled
  */
 bool Sprite::are_pixel_collisions_enabled() const {
-  return animation_set.are_pixel_collisions_enabled();
+  return animation_set->are_pixel_collisions_enabled();
 }
 
 /**
@@ -166,7 +331,7 @@ Size Sprite::get_size() const {
  * \return The maximum frame size.
  */
 const Size& Sprite::get_max_size() const {
-  return animation_set.get_max_size();
+  return animation_set->get_max_size();
 }
 
 /**
@@ -245,8 +410,8 @@ void Sprite::set_current_animation(const std::string& animation_name) {
   if (animation_name != this->current_animation_name || !is_animation_started()) {
 
     this->current_animation_name = animation_name;
-    if (animation_set.has_animation(animation_name)) {
-      this->current_animation = &animation_set.get_animation(animation_name);
+    if (animation_set->has_animation(animation_name)) {
+      this->current_animation = &animation_set->get_animation(animation_name);
       set_frame_delay(current_animation->get_frame_delay());
     }
     else {
@@ -268,7 +433,7 @@ void Sprite::set_current_animation(const std::string& animation_name) {
  * \return true if this animation exists
  */
 bool Sprite::has_animation(const std::string& animation_name) const {
-  return animation_set.has_animation(animation_name);
+  return animation_set->has_animation(animation_name);
 }
 
 /**
@@ -199,5 +199,24 @@ bool SpriteAnimation::are_pixel_collisions_enabled() const {
   return directions[0].are_pixel_collisions_enabled() || should_enable_pixel_collisions;
 }
 
+/**
+ * \brief Returns the approximate memory used by this animation.
+ *
+ * The source image is included unless it belongs to the tileset.
+ *
+ * \return The memory used in bytes.
+ */
+size_t SpriteAnimation::get_memory_used() const {
+
+  size_t memory = sizeof(SpriteAnimation);
+  if (!src_image_is_tileset && src_image != nullptr) {
+    memory += src_image->get_width() * src_image->get_height() * 4;
+  }
+  for (const SpriteAnimationDirection& direction : directions) {
+    memory += direction.get_memory_used();
+  }
+  return memory;
+}
+
 }
 
@@ -130,5 +130,18 @@ bool SpriteAnimationDirection::are_pixel_collisions_enabled() const {
   return !pixel_bits.empty();
 }
 
+/**
+ * \brief Returns the approximate memory used by this direction.
+ * \return The memory used in bytes, including pixel collision masks.
+ */
+size_t SpriteAnimationDirection::get_memory_used() const {
+
+  size_t memory = sizeof(SpriteAnimationDirection) + frames.size() * sizeof(Rectangle);
+  for (const PixelBits& frame_bits : pixel_bits) {
+    memory += frame_bits.get_memory_used();
+  }
+  return memory;
+}
+
 }
 
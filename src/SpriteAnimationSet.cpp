@@ -39,6 +39,14 @@ SpriteAnimationSet::SpriteAnimationSet(const std::string& id):
   load();
 }
 
+/**
+ * \brief Returns the id of this animation set.
+ * \return The id of the sprite data file.
+ */
+const std::string& SpriteAnimationSet::get_id() const {
+  return id;
+}
+
 /**
  * \brief Attempts to load this animation set from its file.
  */
@@ -191,5 +199,21 @@ const Size& SpriteAnimationSet::get_max_size() const {
   return max_size;
 }
 
+/**
+ * \brief Returns the approximate memory used by this animation set.
+ *
+ * This includes the images of animations and pixel collision masks.
+ *
+ * \return The memory used in bytes.
+ */
+size_t SpriteAnimationSet::get_memory_used() const {
+
+  size_t memory = sizeof(SpriteAnimationSet);
+  for (const auto& kvp : animations) {
+    memory += kvp.first.size() + kvp.second.get_memory_used();
+  }
+  return memory;
+}
+
 }
 
@@ -15,6 +15,7 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "solarus/SpriteData.h"
+#include "solarus/lowlevel/BinaryData.h"
 #include "solarus/lowlevel/Debug.h"
 #include "solarus/lua/LuaTools.h"
 #include <algorithm>
@@ -746,4 +747,87 @@ void SpriteData::export_animation_to_lua(
   out << "}\n";
 }
 
+/**
+ * \copydoc LuaData::import_from_binary
+ */
+bool SpriteData::import_from_binary(const char* buffer, size_t size) {
+
+  BinaryData::Reader reader(buffer, size, "sprt");
+
+  SpriteData data;
+  data.default_animation_name = reader.read_string();
+  const uint32_t num_animations = reader.read_uint32();
+  for (uint32_t i = 0; i < num_animations && reader.is_valid(); ++i) {
+    const std::string& animation_name = reader.read_string();
+    const std::string& src_image = reader.read_string();
+    const uint32_t frame_delay = reader.read_uint32();
+    const int loop_on_frame = reader.read_int32();
+
+    std::deque<SpriteAnimationDirectionData> directions;
+    const uint32_t num_directions = reader.read_uint32();
+    for (uint32_t j = 0; j < num_directions && reader.is_valid(); ++j) {
+      const int x = reader.read_int32();
+      const int y = reader.read_int32();
+      const int frame_width = reader.read_int32();
+      const int frame_height = reader.read_int32();
+      const int origin_x = reader.read_int32();
+      const int origin_y = reader.read_int32();
+      const int num_frames = reader.read_int32();
+      const int num_columns = reader.read_int32();
+      if (num_columns < 1 || num_columns > num_frames) {
+        return false;
+      }
+      directions.emplace_back(
+          Point(x, y), Size(frame_width, frame_height),
+          Point(origin_x, origin_y), num_frames, num_columns);
+    }
+
+    if (!data.animations.emplace(animation_name,
+        SpriteAnimationData(src_image, directions, frame_delay, loop_on_frame)).second) {
+      return false;
+    }
+  }
+
+  if (!reader.is_valid() || !reader.is_finished() ||
+      (!data.animations.empty() && !data.has_animation(data.default_animation_name))) {
+    return false;
+  }
+
+  *this = std::move(data);
+  return true;
+}
+
+/**
+ * \copydoc LuaData::export_to_binary
+ */
+bool SpriteData::export_to_binary(std::string& buffer) const {
+
+  BinaryData::Writer writer("sprt");
+
+  writer.write_string(default_animation_name);
+  writer.write_uint32(static_cast<uint32_t>(animations.size()));
+  for (const auto& kvp : animations) {
+    const SpriteAnimationData& animation = kvp.second;
+    writer.write_string(kvp.first);
+    writer.write_string(animation.get_src_image());
+    writer.write_uint32(animation.get_frame_delay());
+    writer.write_int32(animation.get_loop_on_frame());
+
+    writer.write_uint32(static_cast<uint32_t>(animation.get_num_directions()));
+    for (const SpriteAnimationDirectionData& direction : animation.get_directions()) {
+      writer.write_int32(direction.get_xy().x);
+      writer.write_int32(direction.get_xy().y);
+      writer.write_int32(direction.get_size().width);
+      writer.write_int32(direction.get_size().height);
+      writer.write_int32(direction.get_origin().x);
+      writer.write_int32(direction.get_origin().y);
+      writer.write_int32(direction.get_num_frames());
+      writer.write_int32(direction.get_num_columns());
+    }
+  }
+
+  buffer = writer.get_buffer();
+  return true;
+}
+
 }
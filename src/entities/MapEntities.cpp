@@ -155,25 +155,6 @@ const std::list<const Separator*>& MapEntities::get_separators() const {
   return separators;
 }
 
-/**
- * \brief Sets the tile ground property of an 8*8 square of the map.
- *
- * Coordinates outside the range of the map are not an error:
- * in this case, this function does nothing.
- *
- * \param layer Layer of the square.
- * \param x8 X coordinate of the square (divided by 8).
- * \param y8 Y coordinate of the square (divided by 8).
- * \param ground The ground property to set.
- */
-void MapEntities::set_tile_ground(Layer layer, int x8, int y8, Ground ground) {
-
-  if (x8 >= 0 && x8 < map_width8 && y8 >= 0 && y8 < map_height8) {
-    int index = y8 * map_width8 + x8;
-    tiles_ground[layer][index] = ground;
-  }
-}
-
 /**
  * \brief Returns the entity with the specified name.
  *
@@ -396,8 +377,10 @@ void MapEntities::notify_map_finished() {
  * The tiles cannot change during the game.
  *
  * \param tile The tile to add.
+ * \param update_ground \c false if the ground of the map already takes
+ * this tile into account, because it was baked by solarus_compile.
  */
-void MapEntities::add_tile(const TilePtr& tile) {
+void MapEntities::add_tile(const TilePtr& tile, bool update_ground) {
 
   const Layer layer = tile->get_layer();
 
@@ -410,13 +393,49 @@ void MapEntities::add_tile(const TilePtr& tile) {
       && tile->get_height() == pattern.get_height(),
       "Static tile size must match tile pattern size");
 
-  // Update the ground list.
-  const Ground ground = tile->get_tile_pattern().get_ground();
+  if (update_ground) {
+    add_tile_ground(
+        tiles_ground[layer],
+        map_width8,
+        map_height8,
+        tile->get_bounding_box(),
+        pattern.get_ground()
+    );
+  }
+}
+
+/**
+ * \brief Applies the ground of a tile to a ground grid.
+ *
+ * This is where the ground of each 8x8 square of the map is determined
+ * from the tiles placed there.
+ * It is used when loading a map and by solarus_compile to bake the ground
+ * of maps in advance.
+ *
+ * \param[in,out] grid The ground of each 8x8 square of a map layer.
+ * \param grid_width8 Number of 8x8 squares on a row of the grid.
+ * \param grid_height8 Number of 8x8 squares on a column of the grid.
+ * \param tile_box Position and size of the tile on the map.
+ * \param ground Ground of the tile pattern.
+ */
+void MapEntities::add_tile_ground(
+    std::vector<Ground>& grid,
+    int grid_width8,
+    int grid_height8,
+    const Rectangle& tile_box,
+    Ground ground
+) {
+  // Sets the ground of an 8x8 square, ignoring squares outside the map.
+  const auto& set_tile_ground = [&](int x8, int y8, Ground square_ground) {
+    if (x8 >= 0 && x8 < grid_width8 && y8 >= 0 && y8 < grid_height8) {
+      grid[y8 * grid_width8 + x8] = square_ground;
+    }
+  };
 
-  const int tile_x8 = tile->get_x() / 8;
-  const int tile_y8 = tile->get_y() / 8;
-  const int tile_width8 = tile->get_width() / 8;
-  const int tile_height8 = tile->get_height() / 8;
+  const int tile_x8 = tile_box.get_x() / 8;
+  const int tile_y8 = tile_box.get_y() / 8;
+  const int tile_width8 = tile_box.get_width() / 8;
+  const int tile_height8 = tile_box.get_height() / 8;
 
   int i, j;
   Ground non_obstacle_triangle;
@@ -439,7 +458,7 @@ void MapEntities::add_tile(const TilePtr& tile) {
   case Ground::WALL:
     for (i = 0; i < tile_height8; i++) {
       for (j = 0; j < tile_width8; j++) {
-        set_tile_ground(layer, tile_x8 + j, tile_y8 + i, ground);
+        set_tile_ground(tile_x8 + j, tile_y8 + i, ground);
       }
     }
     break;
@@ -458,16 +477,16 @@ void MapEntities::add_tile(const TilePtr& tile) {
     for (i = 0; i < tile_height8; i++) {
 
       // 8x8 square on the diagonal.
-      set_tile_ground(layer, tile_x8 + i, tile_y8 + i, Ground::WALL_TOP_RIGHT);
+      set_tile_ground(tile_x8 + i, tile_y8 + i, Ground::WALL_TOP_RIGHT);
 
       // Left part of the row: we are in the bottom-left corner.
       for (j = 0; j < i; j++) {
-        set_tile_ground(layer, tile_x8 + j, tile_y8 + i, non_obstacle_triangle);
+        set_tile_ground(tile_x8 + j, tile_y8 + i, non_obstacle_triangle);
       }
 
       // Right part of the row: we are in the top-right corner.
       for (j = i + 1; j < tile_width8; j++) {
-        set_tile_ground(layer, tile_x8 + j, tile_y8 + i, Ground::WALL);
+        set_tile_ground(tile_x8 + j, tile_y8 + i, Ground::WALL);
       }
     }
     break;
@@ -483,16 +502,16 @@ void MapEntities::add_tile(const TilePtr& tile) {
 
       // Right part of the row: we are in the bottom-right corner.
       for (j = tile_width8 - i; j < tile_width8; j++) {
-        set_tile_ground(layer, tile_x8 + j, tile_y8 + i, non_obstacle_triangle);
+        set_tile_ground(tile_x8 + j, tile_y8 + i, non_obstacle_triangle);
       }
 
       // Left part of the row: we are in the top-left corner.
       for (j = 0; j < tile_width8 - i - 1; j++) {
-        set_tile_ground(layer, tile_x8 + j, tile_y8 + i, Ground::WALL);
+        set_tile_ground(tile_x8 + j, tile_y8 + i, Ground::WALL);
       }
 
       // 8x8 square on the diagonal.
-      set_tile_ground(layer, tile_x8 + j, tile_y8 + i, Ground::WALL_TOP_LEFT);
+      set_tile_ground(tile_x8 + j, tile_y8 + i, Ground::WALL_TOP_LEFT);
     }
     break;
 
@@ -507,15 +526,15 @@ void MapEntities::add_tile(const TilePtr& tile) {
 
       // Right part of the row: we are in the top-right corner.
       for (j = i + 1; j < tile_width8; j++) {
-        set_tile_ground(layer, tile_x8 + j, tile_y8 + i, non_obstacle_triangle);
+        set_tile_ground(tile_x8 + j, tile_y8 + i, non_obstacle_triangle);
       }
       // Left part of the row: we are in the bottom-left corner.
       for (j = 0; j < i; j++) {
-        set_tile_ground(layer, tile_x8 + j, tile_y8 + i, Ground::WALL);
+        set_tile_ground(tile_x8 + j, tile_y8 + i, Ground::WALL);
       }
 
       // 8x8 square on the diagonal.
-      set_tile_ground(layer, tile_x8 + j, tile_y8 + i, Ground::WALL_BOTTOM_LEFT);
+      set_tile_ground(tile_x8 + j, tile_y8 + i, Ground::WALL_BOTTOM_LEFT);
     }
     break;
 
@@ -529,16 +548,16 @@ void MapEntities::add_tile(const TilePtr& tile) {
     for (i = 0; i < tile_height8; i++) {
 
       // 8x8 square on the diagonal
-      set_tile_ground(layer, tile_x8 + tile_width8 - i - 1, tile_y8 + i, Ground::WALL_BOTTOM_RIGHT);
+      set_tile_ground(tile_x8 + tile_width8 - i - 1, tile_y8 + i, Ground::WALL_BOTTOM_RIGHT);
 
       // Left part of the row: we are in the top-left corner.
       for (j = 0; j < tile_width8 - i - 1; j++) {
-        set_tile_ground(layer, tile_x8 + j, tile_y8 + i, non_obstacle_triangle);
+        set_tile_ground(tile_x8 + j, tile_y8 + i, non_obstacle_triangle);
       }
 
       // Right part of the row: we are in the bottom-right corner.
       for (j = tile_width8 - i; j < tile_width8; j++) {
-        set_tile_ground(layer, tile_x8 + j, tile_y8 + i, Ground::WALL);
+        set_tile_ground(tile_x8 + j, tile_y8 + i, Ground::WALL);
       }
     }
     break;
@@ -566,7 +585,7 @@ void MapEntities::add_entity(const EntityPtr& entity) {
 
   if (entity->get_type() == EntityType::TILE) {
     // Tiles are optimized specifically for obstacle checks and rendering.
-    add_tile(std::static_pointer_cast<Tile>(entity));
+    add_tile(std::static_pointer_cast<Tile>(entity), true);
   }
   else {
     Layer layer = entity->get_layer();
@@ -685,6 +704,41 @@ void MapEntities::add_entity(const EntityPtr& entity) {
   entity->set_map(map);
 }
 
+/**
+ * \brief Creates static tiles that repeat a pattern to fill a rectangle.
+ *
+ * The pattern must exist in the tileset of the map.
+ *
+ * \param layer Layer of the tiles.
+ * \param area Rectangle to fill. Its size should be a multiple of the
+ * pattern size.
+ * \param tile_pattern_id Id of the tile pattern.
+ * \param update_ground \c false if the ground of the map already takes
+ * these tiles into account.
+ */
+void MapEntities::add_tiles(
+    Layer layer,
+    const Rectangle& area,
+    const std::string& tile_pattern_id,
+    bool update_ground
+) {
+  Tileset& tileset = map.get_tileset();
+  const TilePattern& pattern = tileset.get_tile_pattern(tile_pattern_id);
+  const Size& pattern_size = pattern.get_size();
+
+  for (int y = area.get_y(); y < area.get_y() + area.get_height(); y += pattern_size.height) {
+    for (int x = area.get_x(); x < area.get_x() + area.get_width(); x += pattern_size.width) {
+      add_tile(std::make_shared<Tile>(
+          layer,
+          Point(x, y),
+          pattern_size,
+          tileset,
+          tile_pattern_id
+      ), update_ground);
+    }
+  }
+}
+
 /**
  * \brief Removes an entity from the map and schedules it to be destroyed.
  * \param entity the entity to remove
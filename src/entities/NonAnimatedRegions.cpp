@@ -31,10 +31,21 @@ namespace Solarus {
 NonAnimatedRegions::NonAnimatedRegions(Map& map, Layer layer):
   map(map),
   layer(layer),
+  has_baked_partition(false),
+  baked_num_tiles(0),
   non_animated_tiles(map.get_size(), Size(512, 256)) {
 
 }
 
+/**
+ * \brief Allocates memory for tiles that are going to be added.
+ * \param nb_tiles Number of tiles expected.
+ */
+void NonAnimatedRegions::reserve_tiles(int nb_tiles) {
+
+  tiles.reserve(tiles.size() + nb_tiles);
+}
+
 /**
  * \brief Adds a tile to the list of tiles.
  */
@@ -48,6 +59,32 @@ void NonAnimatedRegions::add_tile(const TilePtr& tile) {
   tiles.push_back(tile);
 }
 
+/**
+ * \brief Sets the result of build() computed in advance by solarus_compile.
+ *
+ * build() then uses it instead of classifying tiles again, unless other
+ * tiles than the ones of the map data file were added in the meantime.
+ *
+ * \param animated_squares Whether each 8x8 square of the map has animated
+ * tiles.
+ * \param rejected_tiles Indexes of the tiles in animated regions, in the
+ * order they are added.
+ * \param num_tiles Number of tiles of the map data file on this layer.
+ */
+void NonAnimatedRegions::set_baked_partition(
+    const std::vector<bool>& animated_squares,
+    const std::vector<uint32_t>& rejected_tiles,
+    uint32_t num_tiles
+) {
+  Debug::check_assertion(optimized_tiles_surfaces.empty(),
+      "Tile regions are already built");
+
+  are_squares_animated = animated_squares;
+  baked_rejected_tiles = rejected_tiles;
+  baked_num_tiles = num_tiles;
+  has_baked_partition = true;
+}
+
 /**
  * \brief Determines which rectangles are animated to allow drawing all non-animated
  * rectangles of tiles only once.
@@ -63,56 +100,59 @@ void NonAnimatedRegions::build(std::vector<TilePtr>& rejected_tiles) {
   const int map_width8 = map.get_width8();
   const int map_height8 = map.get_height8();
 
-  // Initialize the are_squares_animated booleans to false.
-  for (int i = 0; i < map_width8 * map_height8; ++i) {
-    are_squares_animated.push_back(false);
-  }
-
   // Create the surfaces where all non-animated tiles will be drawn.
   optimized_tiles_surfaces.resize(non_animated_tiles.get_num_cells());
 
-  // Mark animated 8x8 squares of the map.
-  for (unsigned i = 0; i < tiles.size(); ++i) {
-    Tile& tile = *tiles[i];
-    if (tile.is_animated()) {
-      // Animated tile: mark its region as non-optimizable
-      // (otherwise, a non-animated tile above an animated one would screw us).
-
-      int tile_x8 = tile.get_x() / 8;
-      int tile_y8 = tile.get_y() / 8;
-      int tile_width8 = tile.get_width() / 8;
-      int tile_height8 = tile.get_height() / 8;
-
-      for (int i = 0; i < tile_height8; i++) {
-        for (int j = 0; j < tile_width8; j++) {
-
-          int x8 = tile_x8 + j;
-          int y8 = tile_y8 + i;
-          if (x8 >= 0 && x8 < map_width8 && y8 >= 0 && y8 < map_height8) {
-            int index = y8 * map_width8 + x8;
-            are_squares_animated[index] = true;
-          }
-        }
+  if (has_baked_partition &&
+      tiles.size() == baked_num_tiles &&
+      are_squares_animated.size() == (size_t) (map_width8 * map_height8)) {
+    // The partition was computed by solarus_compile.
+    auto next_rejected = baked_rejected_tiles.begin();
+    for (uint32_t i = 0; i < tiles.size(); ++i) {
+      const TilePtr& tile = tiles[i];
+      if (!tile->is_animated()) {
+        non_animated_tiles.add(tile);
+      }
+      if (next_rejected != baked_rejected_tiles.end() && *next_rejected == i) {
+        rejected_tiles.push_back(tile);
+        ++next_rejected;
       }
     }
   }
+  else {
+    // Initialize the are_squares_animated booleans to false.
+    are_squares_animated.assign(map_width8 * map_height8, false);
+
+    // Mark animated 8x8 squares of the map.
+    for (const TilePtr& tile: tiles) {
+      if (tile->is_animated()) {
+        // Animated tile: mark its region as non-optimizable
+        // (otherwise, a non-animated tile above an animated one would screw us).
+        mark_animated_squares(are_squares_animated, map_width8, map_height8,
+            tile->get_bounding_box());
+      }
+    }
 
-  // Build the list of animated tiles and tiles overlapping them.
-  for (const TilePtr& tile: tiles) {
-    if (!tile->is_animated()) {
-      non_animated_tiles.add(tile);
-      if (overlaps_animated_tile(*tile)) {
+    // Build the list of animated tiles and tiles overlapping them.
+    for (const TilePtr& tile: tiles) {
+      if (!tile->is_animated()) {
+        non_animated_tiles.add(tile);
+        if (overlaps_animated_squares(are_squares_animated, map_width8, map_height8,
+            tile->get_bounding_box())) {
+          rejected_tiles.push_back(tile);
+        }
+      }
+      else {
         rejected_tiles.push_back(tile);
       }
     }
-    else {
-      rejected_tiles.push_back(tile);
-    }
   }
 
   // No need to keep all tiles at this point.
   // Just keep the non-animated ones to draw them lazily.
   tiles.clear();
+  baked_rejected_tiles.clear();
+  has_baked_partition = false;
 }
 
 /**
@@ -127,30 +167,69 @@ void NonAnimatedRegions::notify_tileset_changed() {
 }
 
 /**
- * \brief Returns whether a tile is overlapping an animated other tile.
- * \param tile The tile to check.
- * \return \c true if this tile is overlapping an animated tile.
+ * \brief Marks the 8x8 squares covered by an animated tile.
+ *
+ * Squares outside the map are ignored.
+ *
+ * \param[in,out] animated_squares Whether each 8x8 square of the map has
+ * animated tiles.
+ * \param map_width8 Number of 8x8 squares on a row of the map.
+ * \param map_height8 Number of 8x8 squares on a column of the map.
+ * \param tile_box Position and size of the animated tile.
  */
-bool NonAnimatedRegions::overlaps_animated_tile(Tile& tile) const {
+void NonAnimatedRegions::mark_animated_squares(
+    std::vector<bool>& animated_squares,
+    int map_width8,
+    int map_height8,
+    const Rectangle& tile_box
+) {
+  const int tile_x8 = tile_box.get_x() / 8;
+  const int tile_y8 = tile_box.get_y() / 8;
+  const int tile_width8 = tile_box.get_width() / 8;
+  const int tile_height8 = tile_box.get_height() / 8;
 
-  if (tile.get_layer() != layer) {
-    return false;
+  for (int i = 0; i < tile_height8; i++) {
+    for (int j = 0; j < tile_width8; j++) {
+
+      int x8 = tile_x8 + j;
+      int y8 = tile_y8 + i;
+      if (x8 >= 0 && x8 < map_width8 && y8 >= 0 && y8 < map_height8) {
+        int index = y8 * map_width8 + x8;
+        animated_squares[index] = true;
+      }
+    }
   }
+}
 
-  int tile_x8 = tile.get_x() / 8;
-  int tile_y8 = tile.get_y() / 8;
-  int tile_width8 = tile.get_width() / 8;
-  int tile_height8 = tile.get_height() / 8;
+/**
+ * \brief Returns whether a tile is overlapping an animated 8x8 square.
+ * \param animated_squares Whether each 8x8 square of the map has animated
+ * tiles.
+ * \param map_width8 Number of 8x8 squares on a row of the map.
+ * \param map_height8 Number of 8x8 squares on a column of the map.
+ * \param tile_box Position and size of the tile to check.
+ * \return \c true if this tile is overlapping an animated tile.
+ */
+bool NonAnimatedRegions::overlaps_animated_squares(
+    const std::vector<bool>& animated_squares,
+    int map_width8,
+    int map_height8,
+    const Rectangle& tile_box
+) {
+  const int tile_x8 = tile_box.get_x() / 8;
+  const int tile_y8 = tile_box.get_y() / 8;
+  const int tile_width8 = tile_box.get_width() / 8;
+  const int tile_height8 = tile_box.get_height() / 8;
 
   for (int i = 0; i < tile_height8; i++) {
     for (int j = 0; j < tile_width8; j++) {
 
       int x8 = tile_x8 + j;
       int y8 = tile_y8 + i;
-      if (x8 >= 0 && x8 < map.get_width8() && y8 >= 0 && y8 < map.get_height8()) {
+      if (x8 >= 0 && x8 < map_width8 && y8 >= 0 && y8 < map_height8) {
 
-        int index = y8 * map.get_width8() + x8;
-        if (are_squares_animated[index]) {
+        int index = y8 * map_width8 + x8;
+        if (animated_squares[index]) {
           return true;
         }
       }
@@ -26,6 +26,7 @@
 #include "solarus/lowlevel/Surface.h"
 #include "solarus/lua/LuaData.h"
 #include "solarus/lua/LuaTools.h"
+#include "solarus/MapCache.h"
 #include <lua.hpp>
 #include <sstream>
 #include <vector>
@@ -126,31 +127,45 @@ void Tileset::add_tile_pattern(
  */
 void Tileset::load() {
 
-  // Load the tileset data file.
-  std::string file_name = std::string("tilesets/") + id + ".dat";
-  TilesetData data;
-  bool success = data.import_from_quest_file(file_name);
-  if (success) {
-    // Get the imported data.
-    this->background_color = data.get_background_color();
-    for (const auto& kvp : data.get_patterns()) {
-      add_tile_pattern(kvp.first, kvp.second);
-    }
+  // Load the tileset data file and images, unless they are still in the cache.
+  const std::string& prefix = std::string("tilesets/") + id;
+  load(
+      *MapCache::get_tileset_data(id),
+      MapCache::get_tileset_image(prefix + ".tiles.png"),
+      MapCache::get_tileset_image(prefix + ".entities.png")
+  );
+}
+
+/**
+ * \brief Creates all tile patterns from data and images already read.
+ *
+ * This is used when the files were read and decoded in advance,
+ * for example in a separate thread.
+ *
+ * \param data The tileset data file parsed. Empty if it could not be read.
+ * \param tiles_image The tiles image, or nullptr if it could not be read.
+ * \param entities_image The entities image, or nullptr if it could not be read.
+ */
+void Tileset::load(
+    const TilesetData& data,
+    const SurfacePtr& tiles_image,
+    const SurfacePtr& entities_image
+) {
+  this->background_color = data.get_background_color();
+  for (const auto& kvp : data.get_patterns()) {
+    add_tile_pattern(kvp.first, kvp.second);
   }
 
-  // Load the tileset images.
-  file_name = std::string("tilesets/") + id + ".tiles.png";
-  tiles_image = Surface::create(file_name, Surface::DIR_DATA);
-  if (tiles_image == nullptr) {
-    Debug::error(std::string("Missing tiles image for tileset '") + id + "': " + file_name);
-    tiles_image = Surface::create(16, 16);
+  this->tiles_image = tiles_image;
+  if (this->tiles_image == nullptr) {
+    Debug::error(std::string("Missing tiles image for tileset '") + id + "': tilesets/" + id + ".tiles.png");
+    this->tiles_image = Surface::create(16, 16);
   }
 
-  file_name = std::string("tilesets/") + id + ".entities.png";
-  entities_image = Surface::create(file_name, Surface::DIR_DATA);
-  if (entities_image == nullptr) {
-    Debug::error(std::string("Missing entities image for tileset '") + id + "': " + file_name);
-    entities_image = Surface::create(16, 16);
+  this->entities_image = entities_image;
+  if (this->entities_image == nullptr) {
+    Debug::error(std::string("Missing entities image for tileset '") + id + "': tilesets/" + id + ".entities.png");
+    this->entities_image = Surface::create(16, 16);
   }
 }
 
@@ -197,6 +212,15 @@ const SurfacePtr& Tileset::get_entities_image() {
   return entities_image;
 }
 
+/**
+ * \brief Returns whether this tileset has a tile pattern with the given id.
+ * \param id id of the tile pattern to check
+ * \return \c true if such a tile pattern exists
+ */
+bool Tileset::has_tile_pattern(const std::string& id) const {
+  return tile_patterns.find(id) != tile_patterns.end();
+}
+
 /**
  * \brief Returns a tile pattern from this tileset.
  * \param id id of the tile pattern to get
@@ -16,6 +16,7 @@
  */
 #include "solarus/entities/GroundInfo.h"
 #include "solarus/entities/TilesetData.h"
+#include "solarus/lowlevel/BinaryData.h"
 #include "solarus/lowlevel/Debug.h"
 #include "solarus/lua/LuaTools.h"
 #include <ostream>
@@ -571,5 +572,102 @@ bool TilesetData::export_to_lua(std::ostream& out) const {
   return true;
 }
 
+/**
+ * \copydoc LuaData::import_from_binary
+ */
+bool TilesetData::import_from_binary(const char* buffer, size_t size) {
+
+  BinaryData::Reader reader(buffer, size, "tset");
+
+  // Background color.
+  const int r = reader.read_uint8();
+  const int g = reader.read_uint8();
+  const int b = reader.read_uint8();
+  const int a = reader.read_uint8();
+  TilesetData data;
+  data.set_background_color(Color(r, g, b, a));
+
+  // Tile patterns.
+  const uint32_t num_patterns = reader.read_uint32();
+  for (uint32_t i = 0; i < num_patterns && reader.is_valid(); ++i) {
+    const std::string& id = reader.read_string();
+    const Ground ground = static_cast<Ground>(reader.read_uint8());
+    const int default_layer = reader.read_uint8();
+    const int scrolling = reader.read_uint8();
+    const int repeat_mode = reader.read_uint8();
+    const int num_frames = reader.read_uint8();
+    if (GroundInfo::get_ground_names().find(ground) == GroundInfo::get_ground_names().end() ||
+        default_layer >= LAYER_NB ||
+        scrolling > static_cast<int>(TileScrolling::SELF) ||
+        repeat_mode > static_cast<int>(TilePatternRepeatMode::NONE) ||
+        (num_frames != 1 && num_frames != 3 && num_frames != 4)) {
+      return false;
+    }
+
+    std::vector<Rectangle> frames;
+    for (int j = 0; j < num_frames; ++j) {
+      const int x = reader.read_int32();
+      const int y = reader.read_int32();
+      const int width = reader.read_int32();
+      const int height = reader.read_int32();
+      frames.emplace_back(x, y, width, height);
+    }
+
+    TilePatternData pattern;
+    pattern.set_ground(ground);
+    pattern.set_default_layer(static_cast<Layer>(default_layer));
+    pattern.set_scrolling(static_cast<TileScrolling>(scrolling));
+    pattern.set_repeat_mode(static_cast<TilePatternRepeatMode>(repeat_mode));
+    pattern.set_frames(frames);
+    if (!data.add_pattern(id, pattern)) {
+      return false;
+    }
+  }
+
+  if (!reader.is_valid() || !reader.is_finished()) {
+    return false;
+  }
+
+  *this = std::move(data);
+  return true;
+}
+
+/**
+ * \copydoc LuaData::export_to_binary
+ */
+bool TilesetData::export_to_binary(std::string& buffer) const {
+
+  BinaryData::Writer writer("tset");
+
+  // Background color.
+  uint8_t r, g, b, a;
+  background_color.get_components(r, g, b, a);
+  writer.write_uint8(r);
+  writer.write_uint8(g);
+  writer.write_uint8(b);
+  writer.write_uint8(a);
+
+  // Tile patterns.
+  writer.write_uint32(static_cast<uint32_t>(patterns.size()));
+  for (const auto& kvp : patterns) {
+    const TilePatternData& pattern = kvp.second;
+    writer.write_string(kvp.first);
+    writer.write_uint8(static_cast<uint8_t>(pattern.get_ground()));
+    writer.write_uint8(static_cast<uint8_t>(pattern.get_default_layer()));
+    writer.write_uint8(static_cast<uint8_t>(pattern.get_scrolling()));
+    writer.write_uint8(static_cast<uint8_t>(pattern.get_repeat_mode()));
+    writer.write_uint8(static_cast<uint8_t>(pattern.get_num_frames()));
+    for (const Rectangle& frame : pattern.get_frames()) {
+      writer.write_int32(frame.get_x());
+      writer.write_int32(frame.get_y());
+      writer.write_int32(frame.get_width());
+      writer.write_int32(frame.get_height());
+    }
+  }
+
+  buffer = writer.get_buffer();
+  return true;
+}
+
 }
 
@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/BinaryData.h"
+#include "solarus/lowlevel/Debug.h"
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief First bytes of binary data files.
+ */
+const std::string magic = "SLDB";
+
+}
+
+constexpr uint32_t BinaryData::version;
+
+/**
+ * \brief Creates an empty binary data file.
+ * \param format Name of the format of the file, 4 characters.
+ * Readers check it to refuse files of another kind.
+ */
+BinaryData::Writer::Writer(const std::string& format):
+  format(format) {
+
+  Debug::check_assertion(format.size() == 4, "Binary data format must have 4 characters");
+}
+
+/**
+ * \brief Writes an unsigned 8-bit integer.
+ * \param value The value to write.
+ */
+void BinaryData::Writer::write_uint8(uint8_t value) {
+  records.push_back(static_cast<char>(value));
+}
+
+/**
+ * \brief Writes an unsigned 32-bit integer.
+ * \param value The value to write.
+ */
+void BinaryData::Writer::write_uint32(uint32_t value) {
+  append_uint32(records, value);
+}
+
+/**
+ * \brief Writes a signed 32-bit integer.
+ * \param value The value to write.
+ */
+void BinaryData::Writer::write_int32(int32_t value) {
+  append_uint32(records, static_cast<uint32_t>(value));
+}
+
+/**
+ * \brief Writes a string.
+ *
+ * Each distinct string is stored only once in the file.
+ *
+ * \param value The value to write.
+ */
+void BinaryData::Writer::write_string(const std::string& value) {
+
+  const auto& result = string_indexes.emplace(value, static_cast<uint32_t>(strings.size()));
+  if (result.second) {
+    // New string.
+    strings.push_back(value);
+  }
+  append_uint32(records, result.first->second);
+}
+
+/**
+ * \brief Returns the content of the binary file.
+ * \return The header, the string table and the records written.
+ */
+std::string BinaryData::Writer::get_buffer() const {
+
+  std::string buffer = magic + format;
+  append_uint32(buffer, version);
+  append_uint32(buffer, static_cast<uint32_t>(strings.size()));
+  for (const std::string& string : strings) {
+    append_uint32(buffer, static_cast<uint32_t>(string.size()));
+    buffer += string;
+  }
+  buffer += records;
+  return buffer;
+}
+
+/**
+ * \brief Appends a little-endian 32-bit integer to a buffer.
+ * \param buffer The buffer to write.
+ * \param value The value to append.
+ */
+void BinaryData::Writer::append_uint32(std::string& buffer, uint32_t value) {
+
+  buffer.push_back(static_cast<char>(value & 0xFF));
+  buffer.push_back(static_cast<char>((value >> 8) & 0xFF));
+  buffer.push_back(static_cast<char>((value >> 16) & 0xFF));
+  buffer.push_back(static_cast<char>((value >> 24) & 0xFF));
+}
+
+/**
+ * \brief Starts reading a binary data file.
+ *
+ * The header and the string table are read immediately.
+ *
+ * \param buffer Content of the file. It must remain valid while reading.
+ * \param size Size of the file in bytes.
+ * \param format Expected format of the file, 4 characters.
+ */
+BinaryData::Reader::Reader(const char* buffer, size_t size, const std::string& format):
+  buffer(buffer),
+  size(size),
+  position(0),
+  valid(true) {
+
+  const std::string& header = magic + format;
+  if (size < header.size() || header.compare(0, header.size(), buffer, header.size()) != 0) {
+    valid = false;
+    return;
+  }
+  position = header.size();
+
+  if (read_uint32() != version) {
+    // Compiled by another version of Solarus.
+    valid = false;
+    return;
+  }
+
+  const uint32_t num_strings = read_uint32();
+  if (!valid || num_strings > size - position) {
+    valid = false;
+    return;
+  }
+  strings.reserve(num_strings);
+  for (uint32_t i = 0; i < num_strings; ++i) {
+    const uint32_t string_size = read_uint32();
+    if (!check_remaining(string_size)) {
+      return;
+    }
+    strings.emplace_back(buffer + position, string_size);
+    position += string_size;
+  }
+}
+
+/**
+ * \brief Returns whether everything was read successfully so far.
+ * \return \c false if the file is not a binary data file of the expected
+ * format and version, or if it is truncated.
+ */
+bool BinaryData::Reader::is_valid() const {
+  return valid;
+}
+
+/**
+ * \brief Returns whether all records were read.
+ * \return \c true if the end of the file is reached.
+ */
+bool BinaryData::Reader::is_finished() const {
+  return position == size;
+}
+
+/**
+ * \brief Reads an unsigned 8-bit integer.
+ * \return The value read, or 0 in case of error.
+ */
+uint8_t BinaryData::Reader::read_uint8() {
+
+  if (!check_remaining(1)) {
+    return 0;
+  }
+  return static_cast<uint8_t>(buffer[position++]);
+}
+
+/**
+ * \brief Reads an unsigned 32-bit integer.
+ * \return The value read, or 0 in case of error.
+ */
+uint32_t BinaryData::Reader::read_uint32() {
+
+  if (!check_remaining(4)) {
+    return 0;
+  }
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(buffer + position);
+  position += 4;
+  return static_cast<uint32_t>(bytes[0])
+      | (static_cast<uint32_t>(bytes[1]) << 8)
+      | (static_cast<uint32_t>(bytes[2]) << 16)
+      | (static_cast<uint32_t>(bytes[3]) << 24);
+}
+
+/**
+ * \brief Reads a signed 32-bit integer.
+ * \return The value read, or 0 in case of error.
+ */
+int32_t BinaryData::Reader::read_int32() {
+  return static_cast<int32_t>(read_uint32());
+}
+
+/**
+ * \brief Reads a string.
+ * \return The string read, or an empty string in case of error.
+ */
+const std::string& BinaryData::Reader::read_string() {
+
+  static const std::string empty_string;
+
+  const uint32_t index = read_uint32();
+  if (index >= strings.size()) {
+    valid = false;
+    return empty_string;
+  }
+  return strings[index];
+}
+
+/**
+ * \brief Checks that some bytes can still be read.
+ *
+ * The reader becomes invalid if not.
+ *
+ * \param size Number of bytes to read.
+ * \return \c true if they can be read.
+ */
+bool BinaryData::Reader::check_remaining(size_t size) {
+
+  if (!valid || size > this->size - position) {
+    valid = false;
+    return false;
+  }
+  return true;
+}
+
+}
+
@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/DataFileView.h"
+#include "solarus/lowlevel/Debug.h"
+#ifdef HAVE_SYS_MMAN_H
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace Solarus {
+
+/**
+ * \brief Creates an empty view.
+ */
+DataFileView::DataFileView():
+  buffer(),
+  mapped_data(nullptr),
+  mapped_size(0),
+  parent(nullptr) {
+
+}
+
+/**
+ * \brief Destructor. Unmaps the file if it was mapped.
+ */
+DataFileView::~DataFileView() {
+
+#ifdef HAVE_SYS_MMAN_H
+  if (mapped_data != nullptr && parent == nullptr) {
+    munmap(const_cast<char*>(mapped_data), mapped_size);
+  }
+#endif
+}
+
+/**
+ * \brief Creates a view that owns the content of a file.
+ * \param buffer The content of the file. It is moved into the view.
+ * \return The view created.
+ */
+DataFileViewPtr DataFileView::create_from_buffer(std::string&& buffer) {
+
+  std::shared_ptr<DataFileView> view(new DataFileView());
+  view->buffer = std::move(buffer);
+  return view;
+}
+
+/**
+ * \brief Creates a view by mapping a regular file into memory.
+ *
+ * Mapped pages are loaded on demand by the system and are shared with its
+ * file cache, so large files are never copied.
+ * Small files are better read normally since mapping one uses at least one
+ * page and some system calls.
+ *
+ * \param path Path of the file on the filesystem.
+ * \param min_size Files smaller than this are not mapped.
+ * \return The view created, or nullptr if the file could not be mapped,
+ * if it is too small or if memory mapping is not supported on this system.
+ */
+DataFileViewPtr DataFileView::create_from_file(
+    const std::string& path,
+    size_t min_size
+) {
+#ifdef HAVE_SYS_MMAN_H
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return nullptr;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0 ||
+      !S_ISREG(info.st_mode) ||
+      info.st_size == 0 ||
+      size_t(info.st_size) < min_size) {
+    close(fd);
+    return nullptr;
+  }
+
+  const size_t size = size_t(info.st_size);
+  void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);  // The mapping stays valid.
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+
+  std::shared_ptr<DataFileView> view(new DataFileView());
+  view->mapped_data = static_cast<const char*>(data);
+  view->mapped_size = size;
+  return view;
+#else
+  (void) path;
+  (void) min_size;
+  return nullptr;
+#endif
+}
+
+/**
+ * \brief Creates a view of a part of another view.
+ *
+ * The parent view is kept alive as long as the new one exists.
+ *
+ * \param parent The view that contains the data.
+ * \param offset Position of the part in the parent view.
+ * \param size Size of the part in bytes.
+ * \return The view created.
+ */
+DataFileViewPtr DataFileView::create_from_part(
+    const DataFileViewPtr& parent,
+    size_t offset,
+    size_t size
+) {
+  Debug::check_assertion(offset + size <= parent->size(),
+      "Part of data file view out of bounds");
+
+  std::shared_ptr<DataFileView> view(new DataFileView());
+  view->mapped_data = parent->data() + offset;
+  view->mapped_size = size;
+  view->parent = parent;
+  return view;
+}
+
+/**
+ * \brief Returns the content of the file.
+ * \return The bytes of the file. They are not null-terminated.
+ */
+const char* DataFileView::data() const {
+
+  if (mapped_data != nullptr) {
+    return mapped_data;
+  }
+  return buffer.data();
+}
+
+/**
+ * \brief Returns the size of the file.
+ * \return The number of bytes.
+ */
+size_t DataFileView::size() const {
+
+  if (mapped_data != nullptr) {
+    return mapped_size;
+  }
+  return buffer.size();
+}
+
+/**
+ * \brief Returns whether the file is empty.
+ * \return \c true if the size is zero.
+ */
+bool DataFileView::empty() const {
+  return size() == 0;
+}
+
+/**
+ * \brief Returns whether the content is mapped from a file.
+ * \return \c true if the file or the archive that contains it is mapped,
+ * \c false if it is in a buffer.
+ */
+bool DataFileView::is_mapped() const {
+  return mapped_data != nullptr;
+}
+
+/**
+ * \brief Returns a copy of the content.
+ * \return The content of the file.
+ */
+std::string DataFileView::to_string() const {
+  return std::string(data(), size());
+}
+
+}
+
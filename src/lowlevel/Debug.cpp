@@ -19,6 +19,7 @@
 #include <cstdlib>  // std::abort
 #include <fstream>
 #include <iostream>
+#include <mutex>
 #include <SDL_messagebox.h>
 
 namespace Solarus {
@@ -31,6 +32,7 @@ namespace {
   bool abort_on_die = false;
   const std::string error_output_file_name = "error.txt";
   std::ofstream error_output_file;
+  std::mutex output_mutex;  // Messages can come from any thread.
 
 }
 
@@ -73,6 +75,7 @@ void SOLARUS_API set_abort_on_die(bool abort) {
  */
 void SOLARUS_API warning(const std::string& message) {
 
+  std::lock_guard<std::mutex> lock(output_mutex);
   if (!error_output_file.is_open()) {
     error_output_file.open(error_output_file_name.c_str());
   }
@@ -94,6 +97,7 @@ void SOLARUS_API error(const std::string& message) {
     die(message);
   }
 
+  std::lock_guard<std::mutex> lock(output_mutex);
   if (!error_output_file.is_open()) {
     error_output_file.open(error_output_file_name.c_str());
   }
@@ -136,11 +140,14 @@ void SOLARUS_API check_assertion(bool assertion, const std::string& error_messag
  */
 void SOLARUS_API die(const std::string& error_message) {
 
-  if (!error_output_file.is_open()) {
-    error_output_file.open(error_output_file_name.c_str());
+  {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    if (!error_output_file.is_open()) {
+      error_output_file.open(error_output_file_name.c_str());
+    }
+    error_output_file << "Fatal: " << error_message << std::endl;
+    std::cerr << "Fatal: " << error_message << std::endl;
   }
-  error_output_file << "Fatal: " << error_message << std::endl;
-  std::cerr << "Fatal: " << error_message << std::endl;
 
   if (show_popup_on_die) {
     SDL_ShowSimpleMessageBox(
@@ -0,0 +1,329 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/FileWriter.h"
+#include <cstdio>
+#include <utility>
+#ifdef _WIN32
+#  include <io.h>
+#  include <windows.h>
+#elif defined(HAVE_UNISTD_H)
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+namespace Solarus {
+
+std::thread FileWriter::thread;
+std::mutex FileWriter::mutex;
+std::condition_variable FileWriter::condition;
+bool FileWriter::running = false;
+std::deque<std::string> FileWriter::queue;
+std::map<std::string, FileWriter::Request> FileWriter::pending_requests;
+bool FileWriter::busy = false;
+std::vector<std::pair<FileWriter::Callback, bool>> FileWriter::finished_callbacks;
+
+/**
+ * \brief Starts the I/O thread.
+ */
+void FileWriter::initialize() {
+
+  if (running) {
+    return;
+  }
+
+  running = true;
+  thread = std::thread(run);
+}
+
+/**
+ * \brief Writes the remaining files and stops the I/O thread.
+ *
+ * Callbacks not called yet are dropped.
+ */
+void FileWriter::quit() {
+
+  if (!running) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    running = false;
+  }
+  condition.notify_all();
+  thread.join();
+  finished_callbacks.clear();
+}
+
+/**
+ * \brief Returns whether the I/O thread is running.
+ * \return \c true if files are written in the background.
+ */
+bool FileWriter::is_running() {
+  return running;
+}
+
+/**
+ * \brief Requests to write a file in the background.
+ *
+ * If this file is already waiting to be written, the previous request
+ * is replaced by this one.
+ *
+ * \param file_name Path of the file to write.
+ * \param serializer Produces the content of the file.
+ * It is called from the I/O thread, so it must not access data that
+ * can change in the meantime.
+ * \param callback Function to call from the main thread when the file is
+ * written, or an empty function.
+ */
+void FileWriter::write_async(
+    const std::string& file_name,
+    const Serializer& serializer,
+    const Callback& callback
+) {
+  if (!running) {
+    const bool success = write_atomically(file_name, serializer());
+    if (callback) {
+      finished_callbacks.emplace_back(callback, success);
+    }
+    return;
+  }
+
+  enqueue(file_name, serializer, callback, nullptr);
+}
+
+/**
+ * \brief Writes a file and waits for the result.
+ *
+ * The file is written after the previous requests, so that a file saved
+ * asynchronously just before is not overwritten with older content.
+ *
+ * \param file_name Path of the file to write.
+ * \param content Content of the file.
+ * \return \c true in case of success.
+ */
+bool FileWriter::write(
+    const std::string& file_name,
+    const std::string& content
+) {
+  if (!running) {
+    return write_atomically(file_name, content);
+  }
+
+  std::shared_ptr<Completion> completion = std::make_shared<Completion>();
+  enqueue(file_name, [content]() { return content; }, nullptr, completion);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  condition.wait(lock, [&completion]() { return completion->done; });
+  return completion->success;
+}
+
+/**
+ * \brief Waits until all files requested are written.
+ */
+void FileWriter::flush() {
+
+  std::unique_lock<std::mutex> lock(mutex);
+  condition.wait(lock, []() { return queue.empty() && !busy; });
+}
+
+/**
+ * \brief Waits until all files requested are written and calls their
+ * callbacks.
+ *
+ * Files requested by these callbacks are also written and their own
+ * callbacks called.
+ * Call this before closing the Lua context: callbacks may hold Lua refs.
+ *
+ * This function must be called from the main thread.
+ */
+void FileWriter::finish() {
+
+  while (true) {
+    flush();
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (finished_callbacks.empty()) {
+        return;
+      }
+    }
+    update();
+  }
+}
+
+/**
+ * \brief Calls the callbacks of files written since the last call.
+ *
+ * This function must be called from the main thread.
+ */
+void FileWriter::update() {
+
+  std::vector<std::pair<Callback, bool>> callbacks;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    callbacks.swap(finished_callbacks);
+  }
+
+  for (const std::pair<Callback, bool>& callback: callbacks) {
+    callback.first(callback.second);
+  }
+}
+
+/**
+ * \brief Adds a request to the queue of the I/O thread.
+ * \param file_name Path of the file to write.
+ * \param serializer Produces the content of the file.
+ * \param callback Function to call from the main thread, or an empty function.
+ * \param completion Result to fill for a caller that waits, or nullptr.
+ */
+void FileWriter::enqueue(
+    const std::string& file_name,
+    const Serializer& serializer,
+    const Callback& callback,
+    const std::shared_ptr<Completion>& completion
+) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto& it = pending_requests.find(file_name);
+    Request* request = nullptr;
+    if (it != pending_requests.end()) {
+      // Not started yet: only the most recent content is useful.
+      request = &it->second;
+    }
+    else {
+      request = &pending_requests[file_name];
+      queue.push_back(file_name);
+    }
+    request->serializer = serializer;
+    if (callback) {
+      request->callbacks.push_back(callback);
+    }
+    if (completion != nullptr) {
+      request->completions.push_back(completion);
+    }
+  }
+  condition.notify_all();
+}
+
+/**
+ * \brief Main function of the I/O thread.
+ *
+ * Writes the requested files until quit() is called and the queue is empty.
+ */
+void FileWriter::run() {
+
+  std::unique_lock<std::mutex> lock(mutex);
+  while (true) {
+    condition.wait(lock, []() { return !queue.empty() || !running; });
+    if (queue.empty()) {
+      // Stopped and nothing left to write.
+      return;
+    }
+
+    const std::string file_name = queue.front();
+    queue.pop_front();
+    const auto& it = pending_requests.find(file_name);
+    Request request = std::move(it->second);
+    pending_requests.erase(it);
+    busy = true;
+
+    lock.unlock();
+    const bool success = write_atomically(file_name, request.serializer());
+    lock.lock();
+
+    for (const Callback& callback: request.callbacks) {
+      finished_callbacks.emplace_back(callback, success);
+    }
+    for (const std::shared_ptr<Completion>& completion: request.completions) {
+      completion->done = true;
+      completion->success = success;
+    }
+    busy = false;
+    condition.notify_all();
+  }
+}
+
+/**
+ * \brief Writes a file so that it is never left partially written.
+ *
+ * The content is written to a temporary file next to the destination,
+ * flushed to the disk and renamed to replace the destination.
+ *
+ * \param file_name Path of the file to write.
+ * \param content Content of the file.
+ * \return \c true in case of success. In case of failure, the previous
+ * file is left intact.
+ */
+bool FileWriter::write_atomically(
+    const std::string& file_name,
+    const std::string& content
+) {
+  const std::string tmp_file_name = file_name + ".solarus_tmp";
+  std::FILE* file = std::fopen(tmp_file_name.c_str(), "wb");
+  if (file == nullptr) {
+    Debug::error(std::string("Cannot open file '") + tmp_file_name + "' for writing");
+    return false;
+  }
+
+  bool success = std::fwrite(content.data(), 1, content.size(), file) == content.size() &&
+      std::fflush(file) == 0;
+#ifdef _WIN32
+  success = success && _commit(_fileno(file)) == 0;
+#elif defined(HAVE_UNISTD_H)
+  success = success && fsync(fileno(file)) == 0;
+#endif
+  success = std::fclose(file) == 0 && success;
+
+  if (!success) {
+    Debug::error(std::string("Cannot write file '") + tmp_file_name + "'");
+    std::remove(tmp_file_name.c_str());
+    return false;
+  }
+
+#ifdef _WIN32
+  success = MoveFileExA(
+      tmp_file_name.c_str(),
+      file_name.c_str(),
+      MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH
+  ) != 0;
+#else
+  success = std::rename(tmp_file_name.c_str(), file_name.c_str()) == 0;
+#endif
+  if (!success) {
+    Debug::error(std::string("Cannot replace file '") + file_name + "'");
+    std::remove(tmp_file_name.c_str());
+    return false;
+  }
+
+#if !defined(_WIN32) && defined(HAVE_UNISTD_H)
+  // Also flush the directory so that the rename itself is durable.
+  const size_t last_slash = file_name.rfind('/');
+  const std::string dir_name = last_slash == std::string::npos ?
+      "." : file_name.substr(0, last_slash + 1);
+  const int dir_fd = open(dir_name.c_str(), O_RDONLY);
+  if (dir_fd != -1) {
+    fsync(dir_fd);
+    close(dir_fd);
+  }
+#endif
+
+  return true;
+}
+
+}
+
@@ -103,7 +103,7 @@ void FontResource::load_fonts() {
 
     else {
       // It's an outline font.
-      font.buffer = QuestFiles::data_file_read(font.file_name);
+      font.buffer = QuestFiles::data_file_read_view(font.file_name);
       font.bitmap_font = nullptr;
     }
 
@@ -204,9 +204,9 @@ TTF_Font& FontResource::get_outline_font(const std::string& font_id, int size) {
   }
 
   // First time we want this font with this particular size.
-  SDL_RWops_UniquePtr rw = SDL_RWops_UniquePtr(SDL_RWFromMem(
-      const_cast<char*>(font.buffer.data()),
-      (int) font.buffer.size()
+  SDL_RWops_UniquePtr rw = SDL_RWops_UniquePtr(SDL_RWFromConstMem(
+      font.buffer->data(),
+      (int) font.buffer->size()
   ));
   TTF_Font_UniquePtr outline_font(TTF_OpenFontRW(rw.get(), 0, size));
   Debug::check_assertion(outline_font != nullptr,
@@ -37,9 +37,10 @@ ItDecoder::ItDecoder():
 
 /**
  * \brief Loads an IT file from memory.
- * \param sound_buffer The memory area to read
+ * \param sound_data The memory area to read
+ * \param sound_size Size of the memory area in bytes
  */
-void ItDecoder::load(const std::string& sound_buffer) {
+void ItDecoder::load(const char* sound_data, size_t sound_size) {
 
   Debug::check_assertion(modplug_file == nullptr,
       "IT data is already loaded"
@@ -47,7 +48,7 @@ void ItDecoder::load(const std::string& sound_buffer) {
 
   // Load the IT data into the IT library.
   modplug_file = ModPlugFileUniquePtr(
-      ModPlug_Load((const void*) sound_buffer.data(), (int) sound_buffer.size())
+      ModPlug_Load((const void*) sound_data, (int) sound_size)
   );
 }
 
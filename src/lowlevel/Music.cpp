@@ -19,18 +19,64 @@
 #include "solarus/lowlevel/ItDecoder.h"
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/OfflineAudio.h"
 #include "solarus/lua/LuaContext.h"
+#include "solarus/Arguments.h"
 #include <lua.hpp>
 #include <algorithm>
+#include <chrono>
 #include <sstream>
 
 namespace Solarus {
 
-constexpr int Music::nb_buffers;
-std::unique_ptr<SpcDecoder> Music::spc_decoder = nullptr;
-std::unique_ptr<ItDecoder> Music::it_decoder = nullptr;
+namespace {
+
+/**
+ * \brief Delay between two checks of the streaming buffers.
+ */
+constexpr std::chrono::milliseconds streaming_delay(5);
+
+/**
+ * \brief Reads a positive integer option.
+ * \param args Command-line arguments.
+ * \param option_name Name of the option.
+ * \param default_value Value to return if the option is missing or invalid.
+ * \return The value of the option.
+ */
+int get_positive_int_option(
+    const Arguments& args,
+    const std::string& option_name,
+    int default_value
+) {
+  const std::string& value_string = args.get_argument_value(option_name);
+  if (value_string.empty()) {
+    return default_value;
+  }
+
+  std::istringstream iss(value_string);
+  int value = 0;
+  if (!(iss >> value) || value <= 0) {
+    Debug::error(std::string("Invalid value for ") + option_name + ": '"
+        + value_string + "'");
+    return default_value;
+  }
+  return value;
+}
+
+}
+
+bool Music::initialized = false;
 float Music::volume = 1.0;
-std::unique_ptr<Music> Music::current_music = nullptr;
+int Music::nb_buffers = 8;
+int Music::buffer_size = 4096;
+std::shared_ptr<Music> Music::current_music = nullptr;
+std::shared_ptr<Music> Music::preloaded_music = nullptr;
+std::string Music::music_to_preload;
+bool Music::music_to_preload_loop = true;
+std::string Music::preloading_error;
+std::thread Music::streaming_thread;
+std::atomic<bool> Music::streaming_stopped(false);
+std::mutex Music::mutex;
 
 const std::string Music::none = "none";
 const std::string Music::unchanged = "same";
@@ -53,11 +99,10 @@ Music::Music():
   format(NO_FORMAT),
   loop(false),
   callback_ref(),
-  source(AL_NONE) {
+  source(AL_NONE),
+  finished(false),
+  stopped(false) {
 
-  for (int i = 0; i < nb_buffers; i++) {
-    buffers[i] = AL_NONE;
-  }
 }
 
 /**
@@ -76,27 +121,52 @@ Music::Music(
   format(OGG),
   loop(loop),
   callback_ref(callback_ref),
-  source(AL_NONE) {
+  source(AL_NONE),
+  finished(false),
+  stopped(false) {
 
   Debug::check_assertion(!loop || callback_ref.is_empty(),
       "Attempt to set both a loop and a callback to music"
   );
+}
 
-  for (int i = 0; i < nb_buffers; i++) {
-    buffers[i] = AL_NONE;
-  }
+/**
+ * \brief Destroys this music.
+ *
+ * This can happen in the streaming thread if the music was stopped while
+ * being decoded.
+ */
+Music::~Music() {
+
+  release();
 }
 
 /**
  * \brief Initializes the music system.
+ *
+ * The options -music-buffer-count=<number> and
+ * -music-buffer-size=<samples> set the streaming buffers
+ * (default 8 buffers of 4096 samples).
+ *
+ * \param args Command-line arguments.
  */
-void Music::initialize() {
+void Music::initialize(const Arguments& args) {
+
+  nb_buffers = get_positive_int_option(args, "-music-buffer-count", 8);
+  buffer_size = get_positive_int_option(args, "-music-buffer-size", 4096);
 
-  // initialize the decoding features
-  spc_decoder = std::unique_ptr<SpcDecoder>(new SpcDecoder());
-  it_decoder = std::unique_ptr<ItDecoder>(new ItDecoder());
+  SpcCache::initialize(args);
+  initialized = true;
 
   set_volume(100);
+
+  // Start streaming.
+  // Offline audio is rendered by the main thread, so streaming is done
+  // by the main thread too to keep the buffers filled.
+  streaming_stopped = false;
+  if (!OfflineAudio::is_enabled()) {
+    streaming_thread = std::thread(stream);
+  }
 }
 
 /**
@@ -105,9 +175,20 @@ void Music::initialize() {
 void Music::quit() {
 
   if (is_initialized()) {
+    streaming_stopped = true;
+    if (streaming_thread.joinable()) {
+      streaming_thread.join();
+    }
+
+    if (current_music != nullptr) {
+      current_music->stop();
+    }
     current_music = nullptr;
-    spc_decoder = nullptr;
-    it_decoder = nullptr;
+    preloaded_music = nullptr;
+    music_to_preload.clear();
+    preloading_error.clear();
+    SpcCache::quit();
+    initialized = false;
   }
 }
 
@@ -116,7 +197,7 @@ void Music::quit() {
  * \return \c true if the music system is initialized.
  */
 bool Music::is_initialized() {
-  return spc_decoder != nullptr;
+  return initialized;
 }
 
 /**
@@ -167,7 +248,8 @@ int Music::get_num_channels() {
   Debug::check_assertion(get_format() == IT,
       "This function is only supported for .it musics");
 
-  return it_decoder->get_num_channels();
+  std::lock_guard<std::mutex> lock(current_music->decoder_mutex);
+  return current_music->it_decoder->get_num_channels();
 }
 
 /**
@@ -183,7 +265,8 @@ int Music::get_channel_volume(int channel) {
   Debug::check_assertion(get_format() == IT,
       "This function is only supported for .it musics");
 
-  return it_decoder->get_channel_volume(channel);
+  std::lock_guard<std::mutex> lock(current_music->decoder_mutex);
+  return current_music->it_decoder->get_channel_volume(channel);
 }
 
 /**
@@ -199,7 +282,8 @@ void Music::set_channel_volume(int channel, int volume) {
   Debug::check_assertion(get_format() == IT,
       "This function is only supported for .it musics");
 
-  it_decoder->set_channel_volume(channel, volume);
+  std::lock_guard<std::mutex> lock(current_music->decoder_mutex);
+  current_music->it_decoder->set_channel_volume(channel, volume);
 }
 
 /**
@@ -214,7 +298,8 @@ int Music::get_tempo() {
   Debug::check_assertion(get_format() == IT,
       "This function is only supported for .it musics");
 
-  return it_decoder->get_tempo();
+  std::lock_guard<std::mutex> lock(current_music->decoder_mutex);
+  return current_music->it_decoder->get_tempo();
 }
 
 /**
@@ -229,7 +314,8 @@ void Music::set_tempo(int tempo) {
   Debug::check_assertion(get_format() == IT,
       "This function is only supported for .it musics");
 
-  it_decoder->set_tempo(tempo);
+  std::lock_guard<std::mutex> lock(current_music->decoder_mutex);
+  current_music->it_decoder->set_tempo(tempo);
 }
 
 /**
@@ -320,23 +406,89 @@ void Music::play(
 ) {
   if (music_id != unchanged && music_id != get_current_music_id()) {
     // The music is changed.
-
     if (current_music != nullptr) {
       // Stop the music that was played.
       current_music->stop();
-      current_music = nullptr;
     }
 
-    if (music_id != none) {
+    std::shared_ptr<Music> music;
+    std::shared_ptr<Music> old_music;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (music_id != none && preloaded_music != nullptr &&
+          preloaded_music->id == music_id) {
+        if (preloaded_music->loop == loop) {
+          music = std::move(preloaded_music);
+        }
+        else {
+          // Its first buffers were decoded with another loop setting.
+          old_music = std::move(preloaded_music);
+        }
+      }
+      if (music_to_preload == music_id) {
+        music_to_preload.clear();
+      }
+    }
+
+    if (music != nullptr) {
+      // The music is ready: its first buffers are already queued.
+      music->set_callback(callback_ref);
+      alSourcef(music->source, AL_GAIN, volume);
+      alSourcePlay(music->source);
+    }
+    else if (music_id != none) {
       // Play another music.
-      current_music = std::unique_ptr<Music>(
-          new Music(music_id, loop, callback_ref)
-      );
-      if (!current_music->start()) {
+      music = std::shared_ptr<Music>(new Music(music_id, loop, callback_ref));
+      if (!music->start()) {
         // Could not play the music.
-        current_music = nullptr;
+        music = nullptr;
       }
     }
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      old_music = std::move(current_music);
+      current_music = std::move(music);
+    }
+    // The old music is released here, or by the streaming thread
+    // if it is decoding it.
+  }
+}
+
+/**
+ * \brief Prepares a music that will be played soon.
+ *
+ * The streaming thread opens the music and decodes its first buffers
+ * in the background, so that playing it later does not slow down
+ * the main loop.
+ * Only one music can be preloaded: preloading another one forgets it.
+ * The preloaded music is only used if it is then played with the same
+ * loop setting.
+ *
+ * \param music_id Id of the music to preload (file name without
+ * extension), or Music::none to forget the preloaded music.
+ * \param loop Whether the music will be played with a loop.
+ */
+void Music::preload(const std::string& music_id, bool loop) {
+
+  if (!is_initialized() || music_id == unchanged) {
+    return;
+  }
+
+  std::shared_ptr<Music> old_preloaded_music;
+  std::lock_guard<std::mutex> lock(mutex);
+
+  if (preloaded_music != nullptr &&
+      (preloaded_music->id != music_id || preloaded_music->loop != loop)) {
+    old_preloaded_music = std::move(preloaded_music);
+  }
+
+  if (music_id == none || music_id == get_current_music_id()) {
+    music_to_preload.clear();
+  }
+  else {
+    music_to_preload = music_id;
+    music_to_preload_loop = loop;
   }
 }
 
@@ -353,7 +505,9 @@ void Music::stop_playing() {
 /**
  * \brief Updates the music system.
  *
- * When a music is playing, this function continues the streaming.
+ * The streaming itself is done by another thread, unless the audio is
+ * rendered offline.
+ * This function calls the callback of the music when it is finished.
  */
 void Music::update() {
 
@@ -361,48 +515,168 @@ void Music::update() {
     return;
   }
 
-  if (current_music != nullptr) {
-    bool playing = current_music->update_playing();
-    if (!playing) {
-      // Music is finished.
-      ScopedLuaRef callback_ref = current_music->callback_ref;
-      current_music = nullptr;
-      callback_ref.call("music callback");
+  SpcCache::update();
+
+  if (!streaming_thread.joinable()) {
+    if (current_music != nullptr && !current_music->finished) {
+      current_music->finished = !current_music->update_playing();
     }
+    preload_next_music();
+  }
+
+  std::string error;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    error.swap(preloading_error);
+  }
+  if (!error.empty()) {
+    Debug::error(error);
+  }
+
+  if (current_music == nullptr || !current_music->finished) {
+    return;
+  }
+
+  // Music is finished.
+  ScopedLuaRef callback_ref = current_music->callback_ref;
+  current_music->stop();
+  std::shared_ptr<Music> old_music;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    old_music = std::move(current_music);
   }
+  callback_ref.call("music callback");
+}
+
+/**
+ * \brief Function executed by the streaming thread.
+ *
+ * Keeps the buffers of the current music filled until quit() is called.
+ */
+void Music::stream() {
+
+  while (!streaming_stopped) {
+    std::shared_ptr<Music> music;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      music = current_music;
+    }
+    // Decode without the lock: the main thread can stop the music meanwhile.
+    if (music != nullptr && !music->finished) {
+      music->finished = !music->update_playing();
+    }
+    music = nullptr;
+    preload_next_music();
+    std::this_thread::sleep_for(streaming_delay);
+  }
+}
+
+/**
+ * \brief Loads the music requested by preload() if any.
+ *
+ * This function is called by the streaming thread.
+ * The music is loaded and its buffers are filled without holding the
+ * mutex, so that the main thread is never blocked by the loading.
+ */
+void Music::preload_next_music() {
+
+  std::string music_id;
+  bool loop = true;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (music_to_preload.empty() ||
+        (preloaded_music != nullptr && preloaded_music->id == music_to_preload)) {
+      return;
+    }
+    music_id = music_to_preload;
+    loop = music_to_preload_loop;
+  }
+
+  std::shared_ptr<Music> music(new Music(music_id, loop, ScopedLuaRef()));
+  std::string error;
+  const bool success = music->load(error);
+  if (success) {
+    music->fill_buffers();
+  }
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (!success) {
+    preloading_error = error;
+    if (music_to_preload == music_id) {
+      music_to_preload.clear();
+    }
+    return;
+  }
+
+  if (music_to_preload != music_id || music_to_preload_loop != loop) {
+    // Another music was requested in the meantime.
+    return;
+  }
+
+  preloaded_music = std::move(music);
 }
 
 /**
  * \brief Updates this music when it is playing.
  *
- * This function handles the double buffering.
+ * This function handles the multiple buffering.
+ * It is called by the streaming thread.
  *
- * \return \c true if the music keeps playing, \c false if the end is reached.
+ * \return \c true if the music keeps playing, \c false if the end is reached
+ * or if the music was stopped.
  */
 bool Music::update_playing() {
 
+  std::lock_guard<std::mutex> lock(decoder_mutex);
+
   // Get the empty buffers.
   ALint nb_empty;
   alGetSourcei(source, AL_BUFFERS_PROCESSED, &nb_empty);
-
-  // Refill them.
   for (int i = 0; i < nb_empty; i++) {
     ALuint buffer;
     alSourceUnqueueBuffers(source, 1, &buffer);  // Unqueue the buffer.
+    free_buffers.push_back(buffer);
+  }
+
+  // Refill them.
+  fill_buffers();
+
+  // Check whether there is still something playing.
+  ALint status;
+  alGetSourcei(source, AL_SOURCE_STATE, &status);
+  if (status != AL_PLAYING) {
+    if (stopped) {
+      // Don't restart a music stopped during the decoding.
+      return false;
+    }
+    // The end of the file is reached, or we need to decode more data.
+    alSourcePlay(source);
+  }
+
+  alGetSourcei(source, AL_SOURCE_STATE, &status);
+  return status == AL_PLAYING;
+}
+
+/**
+ * \brief Decodes more data into the free buffers and queues them.
+ */
+void Music::fill_buffers() {
+
+  for (ALuint buffer: free_buffers) {
 
     // Fill it by decoding more data.
     switch (format) {
 
       case SPC:
-        decode_spc(buffer, 4096);
+        decode_spc(buffer, buffer_size);
         break;
 
       case IT:
-        decode_it(buffer, 4096);
+        decode_it(buffer, buffer_size);
         break;
 
       case OGG:
-        decode_ogg(buffer, 4096);
+        decode_ogg(buffer, buffer_size);
         break;
 
       case NO_FORMAT:
@@ -412,17 +686,7 @@ bool Music::update_playing() {
 
     alSourceQueueBuffers(source, 1, &buffer);  // Queue it again.
   }
-
-  // Check whether there is still something playing.
-  ALint status;
-  alGetSourcei(source, AL_SOURCE_STATE, &status);
-  if (status != AL_PLAYING) {
-    // The end of the file is reached, or we need to decode more data.
-    alSourcePlay(source);
-  }
-
-  alGetSourcei(source, AL_SOURCE_STATE, &status);
-  return status == AL_PLAYING;
+  free_buffers.clear();
 }
 
 /**
@@ -432,12 +696,25 @@ bool Music::update_playing() {
  */
 void Music::decode_spc(ALuint destination_buffer, ALsizei nb_samples) {
 
-  // decode the SPC data
+  const auto start_time = std::chrono::steady_clock::now();
   std::vector<ALushort> raw_data(nb_samples);
-  spc_decoder->decode((int16_t*) raw_data.data(), nb_samples);
+  ALsizei sample_rate = 32000;
+  if (spc_reader != nullptr) {
+    // read the prerendered music
+    spc_reader->read((int16_t*) raw_data.data(), nb_samples / 2);
+    sample_rate = SpcCache::get_output_frequency();
+  }
+  else {
+    // decode the SPC data
+    spc_decoder->decode((int16_t*) raw_data.data(), nb_samples);
+  }
+  OfflineAudio::add_decoding_time(
+      spc_reader != nullptr ? "spc (prerendered)" : "spc",
+      std::chrono::steady_clock::now() - start_time,
+      nb_samples / 2, sample_rate);
 
   // put this decoded data into the buffer
-  alBufferData(destination_buffer, AL_FORMAT_STEREO16, raw_data.data(), nb_samples * 2, 32000);
+  alBufferData(destination_buffer, AL_FORMAT_STEREO16, raw_data.data(), nb_samples * 2, sample_rate);
 
   int error = alGetError();
   if (error != AL_NO_ERROR) {
@@ -456,8 +733,12 @@ void Music::decode_spc(ALuint destination_buffer, ALsizei nb_samples) {
 void Music::decode_it(ALuint destination_buffer, ALsizei nb_samples) {
 
   // Decode the IT data.
+  const auto start_time = std::chrono::steady_clock::now();
   std::vector<ALushort> raw_data(nb_samples);
   int bytes_read = it_decoder->decode(raw_data.data(), nb_samples);
+  OfflineAudio::add_decoding_time("it",
+      std::chrono::steady_clock::now() - start_time,
+      nb_samples / 4, 44100);
 
   if (bytes_read > 0) {
     // Put this decoded data into the buffer.
@@ -493,6 +774,7 @@ void Music::decode_ogg(ALuint destination_buffer, ALsizei nb_samples) {
   }
 
   // decode the OGG data
+  const auto start_time = std::chrono::steady_clock::now();
   std::vector<ALshort> raw_data(nb_samples * info->channels);
   int bitstream;
   long bytes_read;
@@ -514,6 +796,9 @@ void Music::decode_ogg(ALuint destination_buffer, ALsizei nb_samples) {
     }
   }
   while (remaining_bytes > 0 && bytes_read > 0);
+  OfflineAudio::add_decoding_time("ogg",
+      std::chrono::steady_clock::now() - start_time,
+      int(total_bytes_read / (info->channels * sizeof(ALshort))), sample_rate);
 
   // Put this decoded data into the buffer.
   alBufferData(destination_buffer, al_format, raw_data.data(), ALsizei(total_bytes_read), sample_rate);
@@ -540,14 +825,36 @@ bool Music::start() {
     return false;
   }
 
+  std::string error;
+  if (!load(error)) {
+    Debug::error(error);
+    return false;
+  }
+  alSourcef(source, AL_GAIN, volume);
+
+  // The streaming thread will then take care of filling the buffers
+  // and playing them.
+  return true;
+}
+
+/**
+ * \brief Loads the file of this music and creates its buffers.
+ *
+ * This function can be called from the streaming thread:
+ * errors are returned rather than printed.
+ *
+ * \param[out] error Error message in case of failure.
+ * \return true if the music was loaded successfully
+ */
+bool Music::load(std::string& error) {
+
   // First time: find the file.
   if (file_name.empty()) {
     find_music_file(id, file_name, format);
 
     if (file_name.empty()) {
-      Debug::error(std::string("Cannot find music file 'musics/")
-          + id + "' (tried with extensions .ogg, .it and .spc)"
-      );
+      error = std::string("Cannot find music file 'musics/")
+          + id + "' (tried with extensions .ogg, .it and .spc)";
       return false;
     }
   }
@@ -555,56 +862,56 @@ bool Music::start() {
   bool success = true;
 
   // create the buffers and the source
-  alGenBuffers(nb_buffers, buffers);
+  buffers.resize(nb_buffers);
+  alGenBuffers(nb_buffers, buffers.data());
   alGenSources(1, &source);
-  alSourcef(source, AL_GAIN, volume);
 
-  // load the music into memory
-  std::string sound_buffer;
+  // load the music into memory, without copying it
+  DataFileViewPtr sound_buffer;
   switch (format) {
 
     case SPC:
 
-      sound_buffer = QuestFiles::data_file_read(file_name);
-
-      // load the SPC data into the SPC decoding library
-      spc_decoder->load((int16_t*) sound_buffer.data(), sound_buffer.size());
+    {
+      sound_buffer = QuestFiles::data_file_read_view(file_name);
 
-      for (int i = 0; i < nb_buffers; i++) {
-        decode_spc(buffers[i], 4096);
+      const std::shared_ptr<const SpcCache::Track>& track =
+          SpcCache::get_track(file_name, sound_buffer);
+      if (track != nullptr) {
+        // play the prerendered samples
+        spc_reader = std::unique_ptr<SpcCache::Reader>(new SpcCache::Reader(track));
+      }
+      else {
+        // load the SPC data into the SPC decoding library
+        spc_decoder = std::unique_ptr<SpcDecoder>(new SpcDecoder());
+        spc_decoder->load((int16_t*) sound_buffer->data(), sound_buffer->size());
       }
       break;
+    }
 
     case IT:
 
-      sound_buffer = QuestFiles::data_file_read(file_name);
+      sound_buffer = QuestFiles::data_file_read_view(file_name);
 
       // load the IT data into the IT decoding library
-      it_decoder->load(sound_buffer);
-
-      for (int i = 0; i < nb_buffers; i++) {
-        decode_it(buffers[i], 4096);
-      }
+      it_decoder = std::unique_ptr<ItDecoder>(new ItDecoder());
+      it_decoder->load(sound_buffer->data(), sound_buffer->size());
       break;
 
     case OGG:
     {
       ogg_mem.position = 0;
       ogg_mem.loop = this->loop;
-      ogg_mem.data = QuestFiles::data_file_read(file_name);
+      ogg_mem.data = QuestFiles::data_file_read_view(file_name);
       // now, ogg_mem contains the encoded data
 
-      int error = ov_open_callbacks(&ogg_mem, &ogg_file, nullptr, 0, Sound::ogg_callbacks);
-      if (error) {
+      int ogg_error = ov_open_callbacks(&ogg_mem, &ogg_file, nullptr, 0, Sound::ogg_callbacks);
+      if (ogg_error) {
         std::ostringstream oss;
         oss << "Cannot load music file '" << file_name
-            << "' from memory: error " << error;
-        Debug::error(oss.str());
-      }
-      else {
-        for (int i = 0; i < nb_buffers; i++) {
-          decode_ogg(buffers[i], 4096);
-        }
+            << "' from memory: error " << ogg_error;
+        error = oss.str();
+        success = false;
       }
       break;
     }
@@ -614,28 +921,30 @@ bool Music::start() {
       break;
   }
 
-  // start the streaming
-  alSourceQueueBuffers(source, nb_buffers, buffers);
-  int error = alGetError();
-  if (error != AL_NO_ERROR) {
+  int al_error = alGetError();
+  if (success && al_error != AL_NO_ERROR) {
     std::ostringstream oss;
     oss << "Cannot initialize buffers for music '"
-        << file_name << "': error " << error;
-    Debug::error(oss.str());
+        << file_name << "': error " << al_error;
+    error = oss.str();
     success = false;
   }
 
-  alSourcePlay(source);
+  if (!success) {
+    release();
+    return false;
+  }
 
-  // The update() function will then take care of filling the buffers
+  free_buffers = buffers;
 
-  return success;
+  return true;
 }
 
 /**
  * \brief Stops playing the music.
  *
  * The callback if any is not called.
+ * The decoders and the buffers are released when the music is destroyed.
  */
 void Music::stop() {
 
@@ -646,40 +955,45 @@ void Music::stop() {
   // Release the callback if any.
   callback_ref.clear();
 
-  // empty the source
+  stopped = true;
   alSourceStop(source);
+}
 
-  ALint nb_queued;
-  ALuint buffer;
-  alGetSourcei(source, AL_BUFFERS_QUEUED, &nb_queued);
-  for (int i = 0; i < nb_queued; i++) {
-    alSourceUnqueueBuffers(source, 1, &buffer);
-  }
-  alSourcei(source, AL_BUFFER, 0);
-
-  // delete the source
-  alDeleteSources(1, &source);
-
-  // delete the buffers
-  alDeleteBuffers(nb_buffers, buffers);
-
-  switch (format) {
+/**
+ * \brief Deletes the OpenAL source and buffers and the decoders of this music.
+ */
+void Music::release() {
 
-    case SPC:
-      break;
+  if (source != AL_NONE) {
+    // empty the source
+    alSourceStop(source);
 
-    case IT:
-      it_decoder->unload();
-      break;
+    ALint nb_queued;
+    ALuint buffer;
+    alGetSourcei(source, AL_BUFFERS_QUEUED, &nb_queued);
+    for (int i = 0; i < nb_queued; i++) {
+      alSourceUnqueueBuffers(source, 1, &buffer);
+    }
+    alSourcei(source, AL_BUFFER, 0);
 
-    case OGG:
-      ov_clear(&ogg_file);
-      ogg_mem.data.clear();
-      break;
+    // delete the source
+    alDeleteSources(1, &source);
+    source = AL_NONE;
+  }
 
-    case NO_FORMAT:
-      Debug::die("Invalid music format");
-      break;
+  // delete the buffers
+  if (!buffers.empty()) {
+    alDeleteBuffers(ALsizei(buffers.size()), buffers.data());
+  }
+  buffers.clear();
+  free_buffers.clear();
+
+  spc_reader = nullptr;
+  spc_decoder = nullptr;
+  it_decoder = nullptr;
+  if (ogg_mem.data != nullptr) {
+    ov_clear(&ogg_file);
+    ogg_mem.data = nullptr;
   }
 }
 
@@ -0,0 +1,296 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/OfflineAudio.h"
+#include <al.h>
+#include <iomanip>
+#include <iostream>
+
+// Declarations of the ALC_SOFT_loopback extension (from alext.h),
+// which is not available with all OpenAL headers.
+#ifndef ALC_SOFT_loopback
+#define ALC_SOFT_loopback 1
+#define ALC_FORMAT_CHANNELS_SOFT 0x1990
+#define ALC_FORMAT_TYPE_SOFT 0x1991
+#define ALC_SHORT_SOFT 0x1402
+#define ALC_STEREO_SOFT 0x1501
+typedef ALCdevice* (ALC_APIENTRY*LPALCLOOPBACKOPENDEVICESOFT)(const ALCchar*);
+typedef ALCboolean (ALC_APIENTRY*LPALCISRENDERFORMATSUPPORTEDSOFT)(ALCdevice*, ALCsizei, ALCenum, ALCenum);
+typedef void (ALC_APIENTRY*LPALCRENDERSAMPLESSOFT)(ALCdevice*, ALCvoid*, ALCsizei);
+#endif
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Sample rate of the offline device.
+ */
+constexpr int offline_frequency = 32000;
+
+/**
+ * \brief Value of -audio-output that renders without saving anything.
+ */
+const std::string null_output = "null";
+
+LPALCRENDERSAMPLESSOFT render_samples = nullptr;
+
+/**
+ * \brief Appends a little-endian integer to a WAV file.
+ * \param file The file.
+ * \param value The value to write.
+ * \param size Number of bytes to write.
+ */
+void write_le(std::ofstream& file, uint32_t value, int size) {
+
+  for (int i = 0; i < size; ++i) {
+    file.put(char((value >> (8 * i)) & 0xFF));
+  }
+}
+
+}
+
+bool OfflineAudio::enabled = false;
+ALCdevice* OfflineAudio::device = nullptr;
+int OfflineAudio::frequency = offline_frequency;
+uint64_t OfflineAudio::rendering_remainder = 0;
+std::vector<int16_t> OfflineAudio::samples;
+std::ofstream OfflineAudio::wav_file;
+uint64_t OfflineAudio::wav_data_size = 0;
+std::mutex OfflineAudio::stats_mutex;
+std::map<std::string, OfflineAudio::DecodingStats> OfflineAudio::decoding_stats;
+
+/**
+ * \brief Opens an OpenAL device that renders into memory.
+ * \param output "null" to discard the samples or the name of a WAV file
+ * to create.
+ * \param[in,out] context_attributes Attributes of the audio context to
+ * create. The format of the rendered samples is added.
+ * \return The device, or nullptr in case of failure.
+ */
+ALCdevice* OfflineAudio::open_device(
+    const std::string& output,
+    std::vector<ALCint>& context_attributes
+) {
+  if (!alcIsExtensionPresent(nullptr, "ALC_SOFT_loopback")) {
+    Debug::error("Offline audio requires the ALC_SOFT_loopback OpenAL extension");
+    return nullptr;
+  }
+
+  LPALCLOOPBACKOPENDEVICESOFT loopback_open_device =
+      (LPALCLOOPBACKOPENDEVICESOFT) alcGetProcAddress(nullptr, "alcLoopbackOpenDeviceSOFT");
+  LPALCISRENDERFORMATSUPPORTEDSOFT is_render_format_supported =
+      (LPALCISRENDERFORMATSUPPORTEDSOFT) alcGetProcAddress(nullptr, "alcIsRenderFormatSupportedSOFT");
+  render_samples =
+      (LPALCRENDERSAMPLESSOFT) alcGetProcAddress(nullptr, "alcRenderSamplesSOFT");
+  if (loopback_open_device == nullptr ||
+      is_render_format_supported == nullptr ||
+      render_samples == nullptr) {
+    Debug::error("Cannot find the ALC_SOFT_loopback OpenAL functions");
+    return nullptr;
+  }
+
+  device = loopback_open_device(nullptr);
+  if (device == nullptr) {
+    Debug::error("Cannot open offline audio device");
+    return nullptr;
+  }
+
+  frequency = offline_frequency;
+  if (!is_render_format_supported(device, frequency, ALC_STEREO_SOFT, ALC_SHORT_SOFT)) {
+    Debug::error("Unsupported offline audio format");
+    alcCloseDevice(device);
+    device = nullptr;
+    return nullptr;
+  }
+
+  // Replace the frequency if already set.
+  for (size_t i = 0; i + 1 < context_attributes.size(); i += 2) {
+    if (context_attributes[i] == ALC_FREQUENCY) {
+      context_attributes.erase(context_attributes.begin() + i, context_attributes.begin() + i + 2);
+      break;
+    }
+  }
+  context_attributes.insert(context_attributes.end(), {
+      ALC_FORMAT_CHANNELS_SOFT, ALC_STEREO_SOFT,
+      ALC_FORMAT_TYPE_SOFT, ALC_SHORT_SOFT,
+      ALC_FREQUENCY, frequency
+  });
+
+  if (output != null_output) {
+    wav_file.open(output.c_str(), std::ios::binary | std::ios::trunc);
+    if (!wav_file) {
+      Debug::error(std::string("Cannot create audio output file '") + output + "'");
+    }
+    else {
+      write_wav_header(0);  // Sizes are written when closing.
+    }
+  }
+
+  wav_data_size = 0;
+  rendering_remainder = 0;
+  enabled = true;
+  return device;
+}
+
+/**
+ * \brief Finishes the WAV file if any and prints decoding statistics.
+ *
+ * The device itself must be closed by the caller.
+ */
+void OfflineAudio::close() {
+
+  if (!enabled) {
+    return;
+  }
+
+  if (wav_file.is_open()) {
+    wav_file.seekp(0);
+    write_wav_header(uint32_t(wav_data_size));
+    wav_file.close();
+  }
+
+  print_decoding_stats();
+
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    decoding_stats.clear();
+  }
+  samples.clear();
+  device = nullptr;
+  render_samples = nullptr;
+  enabled = false;
+}
+
+/**
+ * \brief Returns whether the audio is rendered offline.
+ * \return \c true if the offline device is used.
+ */
+bool OfflineAudio::is_enabled() {
+  return enabled;
+}
+
+/**
+ * \brief Renders the audio corresponding to some simulated time.
+ * \param duration Simulated time elapsed in milliseconds.
+ */
+void OfflineAudio::render(uint32_t duration) {
+
+  if (!enabled) {
+    return;
+  }
+
+  // Keep the remainder to stay exact when the duration is not a multiple
+  // of a frame.
+  rendering_remainder += uint64_t(duration) * frequency;
+  const int nb_frames = int(rendering_remainder / 1000);
+  rendering_remainder %= 1000;
+  if (nb_frames == 0) {
+    return;
+  }
+
+  samples.resize(nb_frames * 2);
+  render_samples(device, samples.data(), nb_frames);
+
+  if (wav_file.is_open()) {
+    const size_t nb_bytes = samples.size() * sizeof(int16_t);
+    for (const int16_t sample: samples) {
+      write_le(wav_file, uint16_t(sample), 2);
+    }
+    wav_data_size += nb_bytes;
+  }
+}
+
+/**
+ * \brief Records the time spent decoding some audio.
+ *
+ * This function can be called from any thread.
+ * It does nothing if the audio is not rendered offline.
+ *
+ * \param format Name of the audio format.
+ * \param time Time spent decoding.
+ * \param nb_frames Number of frames decoded.
+ * \param sample_rate Sample rate of the frames decoded.
+ */
+void OfflineAudio::add_decoding_time(
+    const std::string& format,
+    std::chrono::steady_clock::duration time,
+    int nb_frames,
+    int sample_rate
+) {
+  if (!enabled || sample_rate <= 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  DecodingStats& stats = decoding_stats[format];
+  stats.time += time;
+  stats.audio_duration += double(nb_frames) / sample_rate;
+}
+
+/**
+ * \brief Writes the header of the WAV file.
+ * \param data_size Number of bytes of samples.
+ */
+void OfflineAudio::write_wav_header(uint32_t data_size) {
+
+  const int nb_channels = 2;
+  const int bytes_per_sample = 2;
+  wav_file.write("RIFF", 4);
+  write_le(wav_file, 36 + data_size, 4);
+  wav_file.write("WAVE", 4);
+  wav_file.write("fmt ", 4);
+  write_le(wav_file, 16, 4);  // Size of the format chunk.
+  write_le(wav_file, 1, 2);   // PCM.
+  write_le(wav_file, nb_channels, 2);
+  write_le(wav_file, frequency, 4);
+  write_le(wav_file, frequency * nb_channels * bytes_per_sample, 4);
+  write_le(wav_file, nb_channels * bytes_per_sample, 2);
+  write_le(wav_file, 8 * bytes_per_sample, 2);
+  wav_file.write("data", 4);
+  write_le(wav_file, data_size, 4);
+}
+
+/**
+ * \brief Prints the time spent decoding each audio format.
+ */
+void OfflineAudio::print_decoding_stats() {
+
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  if (decoding_stats.empty()) {
+    return;
+  }
+
+  std::cout << "Audio decoding time:" << std::endl;
+  for (const auto& kvp: decoding_stats) {
+    const DecodingStats& stats = kvp.second;
+    const double time = std::chrono::duration<double>(stats.time).count();
+    std::cout << "  " << kvp.first << ": "
+        << std::fixed << std::setprecision(1) << time * 1000.0 << " ms for "
+        << stats.audio_duration << " s of audio";
+    if (stats.audio_duration > 0.0) {
+      std::cout << " (" << std::setprecision(2)
+          << 100.0 * time / stats.audio_duration << "% of real time)";
+    }
+    std::cout << std::endl;
+  }
+  std::cout.unsetf(std::ios::fixed);
+  std::cout << std::setprecision(6);
+}
+
+}
+
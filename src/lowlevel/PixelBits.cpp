@@ -88,6 +88,16 @@ PixelBits::PixelBits(const Surface& surface, const Rectangle& image_position):
   }
 }
 
+/**
+ * \brief Returns the approximate memory used by this mask.
+ * \return The memory used in bytes.
+ */
+size_t PixelBits::get_memory_used() const {
+
+  return sizeof(PixelBits) +
+      bits.size() * (sizeof(std::vector<uint32_t>) + nb_integers_per_row * sizeof(uint32_t));
+}
+
 /**
  * \brief Detects whether the image represented by these pixel bits is
  * overlapping another image.
@@ -0,0 +1,475 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/QuestArchive.h"
+#include <algorithm>
+#include <zlib.h>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Maximum total size of entries inflated in advance and not read yet.
+ */
+constexpr size_t max_prefetched_size = 64 * 1024 * 1024;
+
+/**
+ * \brief Maximum number of threads that inflate entries in advance.
+ */
+constexpr unsigned max_workers = 4;
+
+/**
+ * \brief Signatures of the zip records used.
+ */
+constexpr uint32_t local_header_signature = 0x04034b50;
+constexpr uint32_t central_header_signature = 0x02014b50;
+constexpr uint32_t end_of_central_directory_signature = 0x06054b50;
+
+/**
+ * \brief Sizes of the fixed part of the zip records used.
+ */
+constexpr size_t local_header_size = 30;
+constexpr size_t central_header_size = 46;
+constexpr size_t end_of_central_directory_size = 22;
+
+/**
+ * \brief Reads a little-endian 16-bit value.
+ * \param data Where to read.
+ * \return The value.
+ */
+uint16_t read_uint16(const char* data) {
+
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  return uint16_t(bytes[0] | (bytes[1] << 8));
+}
+
+/**
+ * \brief Reads a little-endian 32-bit value.
+ * \param data Where to read.
+ * \return The value.
+ */
+uint32_t read_uint32(const char* data) {
+
+  const unsigned char* bytes = reinterpret_cast<const unsigned char*>(data);
+  return uint32_t(bytes[0]) |
+      (uint32_t(bytes[1]) << 8) |
+      (uint32_t(bytes[2]) << 16) |
+      (uint32_t(bytes[3]) << 24);
+}
+
+}
+
+/**
+ * \brief Opens a quest archive and builds the index of its entries.
+ * \param path Path of the archive on the filesystem.
+ * \return The archive, or nullptr if it cannot be mapped into memory or if
+ * its format is not supported.
+ */
+std::unique_ptr<QuestArchive> QuestArchive::open(const std::string& path) {
+
+  const DataFileViewPtr& mapping = DataFileView::create_from_file(path, 0);
+  if (mapping == nullptr) {
+    return nullptr;
+  }
+
+  std::unique_ptr<QuestArchive> archive(new QuestArchive(mapping));
+  if (!archive->read_index()) {
+    return nullptr;
+  }
+  return archive;
+}
+
+/**
+ * \brief Creates an archive from its content.
+ * \param mapping The whole archive.
+ */
+QuestArchive::QuestArchive(const DataFileViewPtr& mapping):
+  mapping(mapping),
+  entries(),
+  prefetch_mutex(),
+  prefetch_condition(),
+  files_to_prefetch(),
+  files_prefetching(),
+  prefetched(),
+  prefetch_requests(),
+  prefetch_generation(0),
+  prefetched_size(0),
+  stopping(false),
+  workers() {
+
+}
+
+/**
+ * \brief Destructor. Stops the workers.
+ */
+QuestArchive::~QuestArchive() {
+
+  {
+    std::lock_guard<std::mutex> lock(prefetch_mutex);
+    stopping = true;
+  }
+  prefetch_condition.notify_all();
+  for (std::thread& worker: workers) {
+    worker.join();
+  }
+}
+
+/**
+ * \brief Returns the number of files in the archive.
+ * \return The number of entries indexed.
+ */
+size_t QuestArchive::get_num_entries() const {
+  return entries.size();
+}
+
+/**
+ * \brief Returns whether a file exists in the archive.
+ * \param file_name Name of the file, relative to the archive root.
+ * \return \c true if the file exists.
+ */
+bool QuestArchive::has_entry(const std::string& file_name) const {
+  return entries.find(file_name) != entries.end();
+}
+
+/**
+ * \brief Returns the content of a file of the archive.
+ *
+ * If the file was prefetched, the buffer inflated in advance is returned.
+ * If it is being inflated by a worker, this function waits for it.
+ *
+ * This function can be called from any thread.
+ *
+ * \param file_name Name of the file, relative to the archive root.
+ * \return The content of the file, or nullptr if it does not exist or
+ * cannot be read.
+ */
+DataFileViewPtr QuestArchive::read(const std::string& file_name) {
+
+  const auto& it = entries.find(file_name);
+  if (it == entries.end()) {
+    return nullptr;
+  }
+  const Entry& entry = it->second;
+
+  if (entry.method != 0) {
+    std::unique_lock<std::mutex> lock(prefetch_mutex);
+    prefetch_condition.wait(lock, [&]() {
+      return files_prefetching.find(file_name) == files_prefetching.end();
+    });
+
+    const auto& prefetched_it = prefetched.find(file_name);
+    if (prefetched_it != prefetched.end()) {
+      DataFileViewPtr view = prefetched_it->second;
+      prefetched.erase(prefetched_it);
+      prefetch_requests.erase(file_name);
+      prefetched_size -= entry.uncompressed_size;
+      return view;
+    }
+
+    // Not started yet: no need to wait for a worker.
+    const auto& queued_it = std::find(
+        files_to_prefetch.begin(), files_to_prefetch.end(), file_name);
+    if (queued_it != files_to_prefetch.end()) {
+      files_to_prefetch.erase(queued_it);
+      prefetch_requests.erase(file_name);
+      prefetched_size -= entry.uncompressed_size;
+    }
+  }
+
+  return read_entry(entry);
+}
+
+/**
+ * \brief Starts inflating some files in the background.
+ *
+ * Call this function for files that will be needed soon.
+ * Their compressed content is inflated in parallel by worker threads and
+ * kept until read() is called.
+ * Files stored without compression or that do not exist are ignored since
+ * reading them is immediate.
+ * Files are also ignored when too much inflated content is already waiting
+ * to be read.
+ *
+ * Files prefetched by previous calls and not read yet are released,
+ * unless they are requested again.
+ *
+ * \param file_names The files to prepare.
+ */
+void QuestArchive::prefetch(const std::vector<std::string>& file_names) {
+
+  {
+    std::lock_guard<std::mutex> lock(prefetch_mutex);
+    ++prefetch_generation;
+
+    // Keep what is requested again, forget the rest.
+    for (const std::string& file_name: file_names) {
+      const auto& it = prefetch_requests.find(file_name);
+      if (it != prefetch_requests.end()) {
+        it->second = prefetch_generation;
+      }
+    }
+    release_stale_prefetches();
+
+    for (const std::string& file_name: file_names) {
+      const auto& it = entries.find(file_name);
+      if (it == entries.end() || it->second.method == 0) {
+        continue;
+      }
+      const Entry& entry = it->second;
+
+      if (prefetch_requests.find(file_name) != prefetch_requests.end()) {
+        // Already done or in progress.
+        continue;
+      }
+
+      if (prefetched_size + entry.uncompressed_size > max_prefetched_size) {
+        continue;
+      }
+
+      files_to_prefetch.push_back(file_name);
+      prefetch_requests[file_name] = prefetch_generation;
+      prefetched_size += entry.uncompressed_size;
+    }
+
+    if (files_to_prefetch.empty()) {
+      return;
+    }
+
+    if (workers.empty()) {
+      // Keep a core for the main thread.
+      const unsigned nb_cores = std::thread::hardware_concurrency();
+      const unsigned nb_workers = nb_cores > 1 ?
+          std::min(max_workers, nb_cores - 1) : 1;
+      for (unsigned i = 0; i < nb_workers; ++i) {
+        workers.emplace_back([this]() { run_worker(); });
+      }
+    }
+  }
+  prefetch_condition.notify_all();
+}
+
+/**
+ * \brief Reads the central directory of the archive.
+ * \return \c false if this is not a supported zip archive.
+ */
+bool QuestArchive::read_index() {
+
+  const char* data = mapping->data();
+  const size_t size = mapping->size();
+  if (size < end_of_central_directory_size) {
+    return false;
+  }
+
+  // Find the end of central directory record, which may be followed by
+  // a comment of up to 65535 bytes.
+  const size_t last_position = size - end_of_central_directory_size;
+  const size_t first_position = last_position > 0xFFFF ? last_position - 0xFFFF : 0;
+  const char* end_record = nullptr;
+  for (size_t position = last_position + 1; position > first_position; --position) {
+    if (read_uint32(data + position - 1) == end_of_central_directory_signature) {
+      end_record = data + position - 1;
+      break;
+    }
+  }
+  if (end_record == nullptr) {
+    return false;
+  }
+
+  const uint16_t nb_entries = read_uint16(end_record + 10);
+  const uint32_t directory_size = read_uint32(end_record + 12);
+  const uint32_t directory_offset = read_uint32(end_record + 16);
+  if (nb_entries == 0xFFFF || directory_offset == 0xFFFFFFFF) {
+    // Zip64.
+    return false;
+  }
+  if (size_t(directory_offset) + directory_size > size) {
+    return false;
+  }
+
+  entries.reserve(nb_entries);
+  const char* header = data + directory_offset;
+  const char* directory_end = header + directory_size;
+  for (int i = 0; i < nb_entries; ++i) {
+
+    if (header + central_header_size > directory_end ||
+        read_uint32(header) != central_header_signature) {
+      return false;
+    }
+
+    const uint16_t flags = read_uint16(header + 8);
+    Entry entry;
+    entry.method = read_uint16(header + 10);
+    entry.compressed_size = read_uint32(header + 20);
+    entry.uncompressed_size = read_uint32(header + 24);
+    const uint16_t name_length = read_uint16(header + 28);
+    const uint16_t extra_length = read_uint16(header + 30);
+    const uint16_t comment_length = read_uint16(header + 32);
+    entry.header_offset = read_uint32(header + 42);
+
+    const char* name = header + central_header_size;
+    header = name + name_length + extra_length + comment_length;
+    if (header > directory_end) {
+      return false;
+    }
+
+    const std::string file_name(name, name_length);
+    if (file_name.empty() || file_name.back() == '/') {
+      // Directory.
+      continue;
+    }
+    if ((flags & 1) != 0 ||
+        (entry.method != 0 && entry.method != 8) ||
+        (entry.method == 0 && entry.compressed_size != entry.uncompressed_size) ||
+        entry.compressed_size == 0xFFFFFFFF ||
+        entry.uncompressed_size == 0xFFFFFFFF) {
+      // Encrypted, unknown compression or zip64: let PhysFS handle it.
+      continue;
+    }
+
+    entries.emplace(file_name, entry);
+  }
+
+  return true;
+}
+
+/**
+ * \brief Extracts an entry.
+ *
+ * This function can be called from any thread.
+ *
+ * \param entry The entry to read.
+ * \return Its content, or nullptr in case of error.
+ */
+DataFileViewPtr QuestArchive::read_entry(const Entry& entry) const {
+
+  const char* data = mapping->data();
+  const size_t size = mapping->size();
+
+  const size_t header_offset = entry.header_offset;
+  if (header_offset + local_header_size > size ||
+      read_uint32(data + header_offset) != local_header_signature) {
+    return nullptr;
+  }
+  const size_t data_offset = header_offset + local_header_size +
+      read_uint16(data + header_offset + 26) +
+      read_uint16(data + header_offset + 28);
+  if (data_offset + entry.compressed_size > size) {
+    return nullptr;
+  }
+
+  if (entry.method == 0) {
+    // Stored: no copy.
+    return DataFileView::create_from_part(mapping, data_offset, entry.uncompressed_size);
+  }
+
+  if (entry.uncompressed_size == 0) {
+    return DataFileView::create_from_buffer(std::string());
+  }
+
+  // Deflated: inflate directly into the final buffer.
+  std::string buffer(entry.uncompressed_size, '\0');
+  z_stream stream;
+  stream.zalloc = Z_NULL;
+  stream.zfree = Z_NULL;
+  stream.opaque = Z_NULL;
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data + data_offset));
+  stream.avail_in = entry.compressed_size;
+  if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+    return nullptr;
+  }
+  stream.next_out = reinterpret_cast<Bytef*>(&buffer[0]);
+  stream.avail_out = entry.uncompressed_size;
+  const int result = inflate(&stream, Z_FINISH);
+  const uLong total_out = stream.total_out;
+  inflateEnd(&stream);
+
+  if (result != Z_STREAM_END || total_out != entry.uncompressed_size) {
+    return nullptr;
+  }
+  return DataFileView::create_from_buffer(std::move(buffer));
+}
+
+/**
+ * \brief Releases the entries requested by previous calls to prefetch()
+ * and not read.
+ *
+ * Entries being inflated are released by their worker when it is done.
+ * The prefetching mutex must be locked.
+ */
+void QuestArchive::release_stale_prefetches() {
+
+  for (auto it = prefetch_requests.begin(); it != prefetch_requests.end();) {
+    const std::string& file_name = it->first;
+    if (it->second == prefetch_generation ||
+        files_prefetching.find(file_name) != files_prefetching.end()) {
+      ++it;
+      continue;
+    }
+
+    const auto& queued_it = std::find(
+        files_to_prefetch.begin(), files_to_prefetch.end(), file_name);
+    if (queued_it != files_to_prefetch.end()) {
+      files_to_prefetch.erase(queued_it);
+    }
+    prefetched.erase(file_name);
+    prefetched_size -= entries.at(file_name).uncompressed_size;
+    it = prefetch_requests.erase(it);
+  }
+}
+
+/**
+ * \brief Function executed by worker threads.
+ *
+ * Inflates the files to prefetch until the archive is destroyed.
+ */
+void QuestArchive::run_worker() {
+
+  std::unique_lock<std::mutex> lock(prefetch_mutex);
+  while (true) {
+    prefetch_condition.wait(lock, [this]() {
+      return stopping || !files_to_prefetch.empty();
+    });
+    if (stopping) {
+      return;
+    }
+
+    const std::string file_name = files_to_prefetch.front();
+    files_to_prefetch.pop_front();
+    files_prefetching.insert(file_name);
+    const Entry& entry = entries.at(file_name);  // Entries never change.
+
+    lock.unlock();
+    const DataFileViewPtr& view = read_entry(entry);
+    lock.lock();
+
+    files_prefetching.erase(file_name);
+    if (view != nullptr &&
+        prefetch_requests[file_name] == prefetch_generation) {
+      prefetched[file_name] = view;
+    }
+    else {
+      // The error if any will be reported when the file is read normally.
+      // Otherwise, a more recent call to prefetch() did not request the file.
+      prefetch_requests.erase(file_name);
+      prefetched_size -= entry.uncompressed_size;
+    }
+    prefetch_condition.notify_all();
+  }
+}
+
+}
+
@@ -16,6 +16,7 @@
  */
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestArchive.h"
 #include "solarus/lua/LuaContext.h"
 #include "solarus/CurrentQuest.h"
 #include "solarus/Arguments.h"
@@ -38,6 +39,44 @@ std::string QuestFiles::quest_path;
 std::string QuestFiles::solarus_write_dir;
 std::string QuestFiles::quest_write_dir;
 std::vector<std::string> QuestFiles::temporary_files;
+std::map<std::string, std::weak_ptr<const DataFileView>> QuestFiles::views;
+std::mutex QuestFiles::views_mutex;
+std::unique_ptr<QuestArchive> QuestFiles::archive;
+
+namespace {
+
+/**
+ * \brief Files of the data directory smaller than this are read rather
+ * than mapped into memory.
+ */
+constexpr size_t min_mapped_size = 64 * 1024;
+
+/**
+ * \brief Number of views remembered above which expired ones are removed.
+ */
+constexpr size_t views_cleanup_threshold = 256;
+
+/**
+ * \brief Returns whether a file of the search path is in the quest write
+ * directory.
+ *
+ * Files there take precedence over the ones of the data directory or archive.
+ *
+ * \param full_file_name Name of the file, including the language directory
+ * if any.
+ * \return \c true if the file exists in the quest write directory.
+ */
+bool is_in_quest_write_dir(const std::string& full_file_name) {
+
+  if (QuestFiles::get_quest_write_dir().empty()) {
+    return false;
+  }
+
+  const char* path = PHYSFS_getRealDir(full_file_name.c_str());
+  return path != nullptr && std::string(path) == PHYSFS_getWriteDir();
+}
+
+}
 
 /**
  * \brief Initializes the file tools.
@@ -83,6 +122,15 @@ void QuestFiles::initialize(const Arguments& args) {
   PHYSFS_addToSearchPath((base_dir + "/" + archive_quest_path_1).c_str(), 1);
   PHYSFS_addToSearchPath((base_dir + "/" + archive_quest_path_2).c_str(), 1);
 
+  // If the quest is an archive, index it to access files without PhysFS.
+  char** search_path = PHYSFS_getSearchPath();
+  const std::string first_path = search_path[0] == nullptr ? "" : search_path[0];
+  PHYSFS_freeList(search_path);
+  if ((first_path.size() >= 12 && first_path.rfind("data.solarus") == first_path.size() - 12)
+      || (first_path.size() >= 16 && first_path.rfind("data.solarus.zip") == first_path.size() - 16)) {
+    archive = QuestArchive::open(first_path);
+  }
+
   // Check the existence of a quest at this location.
   if (!QuestFiles::data_file_exists("quest.dat")) {
     std::cout << "Fatal: No quest was found in the directory '" << quest_path
@@ -103,6 +151,12 @@ void QuestFiles::quit() {
 
   remove_temporary_files();
 
+  {
+    std::lock_guard<std::mutex> lock(views_mutex);
+    views.clear();
+  }
+  archive = nullptr;
+
   quest_path = "";
   solarus_write_dir = "";
   quest_write_dir = "";
@@ -132,6 +186,12 @@ const std::string& QuestFiles::get_quest_path() {
 QuestFiles::DataFileLocation QuestFiles::data_file_get_location(
     const std::string& file_name) {
 
+  if (archive != nullptr &&
+      archive->has_entry(file_name) &&
+      !is_in_quest_write_dir(file_name)) {
+    return LOCATION_DATA_ARCHIVE;
+  }
+
   const char* path_ptr = PHYSFS_getRealDir(file_name.c_str());
   std::string path = path_ptr == nullptr ? "" : path_ptr;
   if (path.empty()) {
@@ -179,6 +239,10 @@ bool QuestFiles::data_file_exists(const std::string& file_name,
   else {
     full_file_name = file_name;
   }
+
+  if (archive != nullptr && archive->has_entry(full_file_name)) {
+    return true;
+  }
   return PHYSFS_exists(full_file_name.c_str());
 }
 
@@ -192,17 +256,151 @@ std::string QuestFiles::data_file_read(
     const std::string& file_name,
     bool language_specific
 ) {
-  std::string full_file_name;
-  if (language_specific) {
-    Debug::check_assertion(!CurrentQuest::get_language().empty(),
-        std::string("Cannot open language-specific file '") + file_name
-        + "': no language was set"
-    );
-    full_file_name = std::string("languages/") +
-        CurrentQuest::get_language() + "/" + file_name;
+  return read_file(get_full_file_name(file_name, language_specific));
+}
+
+/**
+ * \brief Returns a read-only view of the content of a data file.
+ *
+ * Unlike data_file_read(), the content is not copied when possible.
+ * Large files of the data directory are mapped into memory.
+ * Files of the data archive are stored in the mapped archive or
+ * decompressed once, and their buffer is shared by all views of the same
+ * file that are still alive.
+ * Files of the quest write directory are always read since the engine
+ * can modify them.
+ *
+ * This function can be called from any thread.
+ *
+ * \param file_name Name of the file to open.
+ * \param language_specific \c true if the file is specific to the current language.
+ * \return The content of the file.
+ */
+DataFileViewPtr QuestFiles::data_file_read_view(
+    const std::string& file_name,
+    bool language_specific
+) {
+  const std::string& full_file_name = get_full_file_name(file_name, language_specific);
+  const DataFileLocation location = data_file_get_location(full_file_name);
+  Debug::check_assertion(location != LOCATION_NONE,
+      std::string("Data file '") + full_file_name + "' does not exist"
+  );
+
+  if (location == LOCATION_WRITE_DIRECTORY) {
+    return DataFileView::create_from_buffer(read_file(full_file_name));
   }
-  else {
-    full_file_name = file_name;
+
+  std::unique_lock<std::mutex> lock(views_mutex);
+  const auto& it = views.find(full_file_name);
+  if (it != views.end()) {
+    DataFileViewPtr view = it->second.lock();
+    if (view != nullptr) {
+      return view;
+    }
+  }
+
+  // Don't block other threads while reading the file.
+  lock.unlock();
+  DataFileViewPtr view;
+  if (location == LOCATION_DATA_DIRECTORY) {
+    const std::string& path =
+        std::string(PHYSFS_getRealDir(full_file_name.c_str())) + "/" + full_file_name;
+    view = DataFileView::create_from_file(path, min_mapped_size);
+  }
+  else if (archive != nullptr) {
+    view = archive->read(full_file_name);
+  }
+  if (view == nullptr) {
+    view = DataFileView::create_from_buffer(read_file(full_file_name));
+  }
+  lock.lock();
+
+  // Another thread may have read it meanwhile.
+  DataFileViewPtr existing_view = views[full_file_name].lock();
+  if (existing_view != nullptr) {
+    return existing_view;
+  }
+
+  if (views.size() >= views_cleanup_threshold) {
+    for (auto it = views.begin(); it != views.end();) {
+      if (it->second.expired()) {
+        it = views.erase(it);
+      }
+      else {
+        ++it;
+      }
+    }
+  }
+  views[full_file_name] = view;
+  return view;
+}
+
+/**
+ * \brief Starts preparing data files that will be read soon.
+ *
+ * When the quest is an archive, compressed files are inflated in parallel
+ * in the background.
+ * Otherwise, this function does nothing.
+ *
+ * \param file_names Names of data files. Files that do not exist are
+ * ignored.
+ */
+void QuestFiles::data_files_prefetch(const std::vector<std::string>& file_names) {
+
+  if (archive != nullptr) {
+    archive->prefetch(file_names);
+  }
+}
+
+/**
+ * \brief Returns the last modification date of a data file.
+ *
+ * This allows to know if a file has changed since the last time it was read.
+ *
+ * \param file_name Name of a data file.
+ * \return The date in seconds since the epoch, or -1 if it cannot be
+ * determined.
+ */
+int64_t QuestFiles::data_file_get_modification_date(const std::string& file_name) {
+
+  return PHYSFS_getLastModTime(file_name.c_str());
+}
+
+/**
+ * \brief Returns the name of a data file relative to the search path.
+ * \param file_name Name of a data file.
+ * \param language_specific \c true if the file is specific to the current language.
+ * \return The file name, prefixed by the language directory if necessary.
+ */
+std::string QuestFiles::get_full_file_name(
+    const std::string& file_name,
+    bool language_specific
+) {
+  if (!language_specific) {
+    return file_name;
+  }
+
+  Debug::check_assertion(!CurrentQuest::get_language().empty(),
+      std::string("Cannot open language-specific file '") + file_name
+      + "': no language was set"
+  );
+  return std::string("languages/") +
+      CurrentQuest::get_language() + "/" + file_name;
+}
+
+/**
+ * \brief Loads the content of a file of the search path into memory.
+ * \param full_file_name Name of the file, including the language directory
+ * if any.
+ * \return The content of the file.
+ */
+std::string QuestFiles::read_file(const std::string& full_file_name) {
+
+  if (archive != nullptr && !is_in_quest_write_dir(full_file_name)) {
+    const DataFileViewPtr& view = archive->read(full_file_name);
+    if (view != nullptr) {
+      return view->to_string();
+    }
   }
 
   // open the file
@@ -214,14 +412,16 @@ std::string QuestFiles::data_file_read(
       std::string("Cannot open data file '") + full_file_name + "'"
   );
 
-  // load it into memory
+  // load it into memory, directly in the string returned
   size_t size =  static_cast<size_t>(PHYSFS_fileLength(file));
-  std::vector<char> buffer(size);
+  std::string buffer(size, '\0');
 
-  PHYSFS_read(file, buffer.data(), 1, (PHYSFS_uint32) size);
+  if (size > 0) {
+    PHYSFS_read(file, &buffer[0], 1, (PHYSFS_uint32) size);
+  }
   PHYSFS_close(file);
 
-  return std::string(buffer.data(), size);
+  return buffer;
 }
 
 /**
@@ -15,24 +15,91 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include <algorithm>
+#include <chrono>
 #include <cstring>  // memcpy
 #include <sstream>
 #include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/FileWriter.h"
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lowlevel/Music.h"
+#include "solarus/lowlevel/OfflineAudio.h"
 #include "solarus/lowlevel/Sound.h"
+#include "solarus/lowlevel/System.h"
 #include "solarus/Arguments.h"
 #include "solarus/CurrentQuest.h"
 
 namespace Solarus {
 
+namespace {
+
+/**
+ * \brief Directory of the quest write directory where decoded sounds are saved.
+ */
+const std::string cache_directory = "sound_cache";
+
+/**
+ * \brief First line of decoded sound files.
+ */
+const std::string cache_file_magic = "SOLARUS_PCM";
+
+/**
+ * \brief Default number of OpenAL sources used to play sounds.
+ */
+const int default_nb_sources = 32;
+
+/**
+ * \brief Computes a 64-bit FNV-1a hash of an encoded sound file.
+ * \param file The file to hash.
+ * \return The hash.
+ */
+uint64_t compute_hash(const DataFileView& file) {
+
+  uint64_t hash = 14695981039346656037ULL;
+  const char* data = file.data();
+  for (size_t i = 0; i < file.size(); ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * \brief Duplicates mono samples into stereo samples.
+ *
+ * Each input sample is stored twice, with no branch in the loop,
+ * so that the compiler can use interleaving vector stores.
+ *
+ * \param mono The mono samples.
+ * \param nb_samples Number of mono samples.
+ * \param stereo Destination of 2 * nb_samples samples.
+ */
+void mono_to_stereo(const int16_t* mono, size_t nb_samples, int16_t* stereo) {
+
+  for (size_t i = 0; i < nb_samples; ++i) {
+    stereo[2 * i] = mono[i];
+    stereo[2 * i + 1] = mono[i];
+  }
+}
+
+}
+
 ALCdevice* Sound::device = nullptr;
 ALCcontext* Sound::context = nullptr;
 bool Sound::initialized = false;
 bool Sound::sounds_preloaded = false;
 float Sound::volume = 1.0;
-std::list<Sound*> Sound::current_sounds;
+bool Sound::cache_enabled = false;
 std::map<std::string, Sound> Sound::all_sounds;
+std::vector<ALuint> Sound::free_sources;
+std::vector<Sound::Voice> Sound::voices;
+uint32_t Sound::next_voice_serial = 0;
+Sound::VoiceStats Sound::voice_stats = { 0, 0, 0, 0, 0 };
+std::vector<std::thread> Sound::decoding_threads;
+std::vector<std::shared_ptr<Sound::DecodingJob>> Sound::decoding_queue;
+std::atomic<size_t> Sound::next_decoding_job(0);
+std::mutex Sound::decoding_mutex;
+std::condition_variable Sound::decoding_finished;
+std::list<Sound*> Sound::sounds_decoding;
 ov_callbacks Sound::ogg_callbacks = {
     cb_read,
     nullptr,
@@ -47,7 +114,10 @@ ov_callbacks Sound::ogg_callbacks = {
  */
 Sound::Sound(const std::string& sound_id):
   id(sound_id),
-  buffer(AL_NONE) {
+  buffer(AL_NONE),
+  nb_voices(0),
+  max_voices(0),
+  priority(0) {
 
 }
 
@@ -56,16 +126,17 @@ Sound::Sound(const std::string& sound_id):
  */
 Sound::~Sound() {
 
+  sounds_decoding.remove(this);
+
   if (is_initialized() && buffer != AL_NONE) {
 
     // stop the sources where this buffer is attached
-    for (ALuint source: sources) {
-      alSourceStop(source);
-      alSourcei(source, AL_BUFFER, 0);
-      alDeleteSources(1, &source);
+    for (size_t i = voices.size(); i > 0 && nb_voices > 0; --i) {
+      if (voices[i - 1].sound == this) {
+        release_voice(i - 1);
+      }
     }
     alDeleteBuffers(1, &buffer);
-    current_sounds.remove(this);
   }
 }
 
@@ -75,6 +146,8 @@ Sound::~Sound() {
  * This method should be called when the application starts.
  * If the argument -no-audio is provided, this function has no effect and
  * there will be no sound.
+ * With -audio-output=null or -audio-output=<file.wav>, the audio is
+ * rendered in software by OfflineAudio instead of using a sound card.
  *
  * \param args Command-line arguments.
  */
@@ -88,33 +161,79 @@ void Sound::initialize(const Arguments& args) {
 
   // Initialize OpenAL.
 
-  device = alcOpenDevice(nullptr);
-  if (!device) {
-    Debug::error("Cannot open audio device");
-    return;
+  std::vector<ALCint> attributes = { ALC_FREQUENCY, 32000 }; // 32 KHz is the SPC output sampling rate
+  const std::string& output = args.get_argument_value("-audio-output");
+  if (!output.empty()) {
+    device = OfflineAudio::open_device(output, attributes);
+    if (!device) {
+      return;
+    }
   }
+  else {
+    device = alcOpenDevice(nullptr);
+    if (!device) {
+      Debug::error("Cannot open audio device");
+      return;
+    }
+  }
+  attributes.push_back(0);
 
-  ALCint attr[] = { ALC_FREQUENCY, 32000, 0 }; // 32 KHz is the SPC output sampling rate
-  context = alcCreateContext(device, attr);
+  context = alcCreateContext(device, attributes.data());
   if (!context) {
     Debug::error("Cannot create audio context");
     alcCloseDevice(device);
+    OfflineAudio::close();
     return;
   }
   if (!alcMakeContextCurrent(context)) {
     Debug::error("Cannot activate audio context");
     alcDestroyContext(context);
     alcCloseDevice(device);
+    OfflineAudio::close();
     return;
   }
 
   alGenBuffers(0, nullptr);  // Necessary on some systems to avoid errors with the first sound loaded.
 
+  cache_enabled = args.get_argument_value("-sound-cache") == "yes";
+
+  // Create the pool of sources.
+  int nb_sources = default_nb_sources;
+  const std::string& nb_sources_value = args.get_argument_value("-sound-voices");
+  if (!nb_sources_value.empty()) {
+    std::istringstream iss(nb_sources_value);
+    if (!(iss >> nb_sources) || nb_sources < 0) {
+      Debug::error(std::string("Invalid number of sound voices: '") + nb_sources_value + "'");
+      nb_sources = default_nb_sources;
+    }
+  }
+  free_sources.reserve(nb_sources);
+  voices.reserve(nb_sources);
+  for (int i = 0; i < nb_sources; ++i) {
+    ALuint source;
+    alGenSources(1, &source);
+    if (alGetError() != AL_NO_ERROR) {
+      // The device has less sources: keep two for the music,
+      // one for the current music and one for the preloaded one.
+      for (int j = 0; j < 2 && !free_sources.empty(); ++j) {
+        alDeleteSources(1, &free_sources.back());
+        free_sources.pop_back();
+      }
+      std::ostringstream oss;
+      oss << "Only " << free_sources.size() << " audio sources available for sounds";
+      Debug::warning(oss.str());
+      break;
+    }
+    free_sources.push_back(source);
+  }
+  voice_stats = VoiceStats();
+  voice_stats.nb_sources = free_sources.size();
+
   initialized = true;
   set_volume(100);
 
   // initialize the music system
-  Music::initialize();
+  Music::initialize(args);
 }
 
 /**
@@ -130,6 +249,13 @@ void Sound::quit() {
     Music::quit();
 
     // clear the sounds
+    stop_decoding_threads();
+    sounds_decoding.clear();
+    stop_all_voices();
+    if (!free_sources.empty()) {
+      alDeleteSources(ALsizei(free_sources.size()), free_sources.data());
+    }
+    free_sources.clear();
     all_sounds.clear();
 
     // uninitialize OpenAL
@@ -139,6 +265,7 @@ void Sound::quit() {
     context = nullptr;
     alcCloseDevice(device);
     device = nullptr;
+    OfflineAudio::close();
 
     initialized = false;
   }
@@ -154,6 +281,10 @@ bool Sound::is_initialized() {
 
 /**
  * \brief Loads and decodes all sounds listed in the game database.
+ *
+ * Files are read immediately, but they are decoded in the background by
+ * several threads.
+ * Sounds become ready progressively during the next calls to update().
  */
 void Sound::load_all() {
 
@@ -164,8 +295,27 @@ void Sound::load_all() {
     for (const auto& kvp: sound_elements) {
       const std::string& sound_id = kvp.first;
 
-      all_sounds[sound_id] = Sound(sound_id);
-      all_sounds[sound_id].load();
+      Sound& sound = get_sound(sound_id);
+      if (sound.buffer != AL_NONE || sound.decoding_job != nullptr) {
+        // Already played before.
+        continue;
+      }
+      sound.decoding_job = sound.create_decoding_job();
+      sounds_decoding.push_back(&sound);
+      if (sound.decoding_job->state == DECODING_PENDING) {
+        decoding_queue.push_back(sound.decoding_job);
+      }
+    }
+
+    // Decode in parallel, keeping a core for the main loop.
+    const unsigned nb_cores = std::thread::hardware_concurrency();
+    const size_t nb_threads = std::min<size_t>(
+        decoding_queue.size(),
+        nb_cores > 1 ? nb_cores - 1 : 1
+    );
+    next_decoding_job = 0;
+    for (size_t i = 0; i < nb_threads; ++i) {
+      decoding_threads.emplace_back(run_decoding_thread);
     }
 
     sounds_preloaded = true;
@@ -190,11 +340,21 @@ bool Sound::exists(const std::string& sound_id) {
  */
 void Sound::play(const std::string& sound_id) {
 
-  if (all_sounds.find(sound_id) == all_sounds.end()) {
-    all_sounds[sound_id] = Sound(sound_id);
-  }
+  get_sound(sound_id).start();
+}
+
+/**
+ * \brief Returns the sound with the specified id, creating it if necessary.
+ * \param sound_id Id of a sound.
+ * \return The sound, not necessarily loaded yet.
+ */
+Sound& Sound::get_sound(const std::string& sound_id) {
 
-  all_sounds[sound_id].start();
+  auto it = all_sounds.find(sound_id);
+  if (it == all_sounds.end()) {
+    it = all_sounds.insert(std::make_pair(sound_id, Sound(sound_id))).first;
+  }
+  return it->second;
 }
 
 /**
@@ -216,6 +376,74 @@ void Sound::set_volume(int volume) {
   Sound::volume = volume / 100.0;
 }
 
+/**
+ * \brief Returns the priority of a sound.
+ * \param sound_id Id of a sound.
+ * \return The priority (0 by default).
+ */
+int Sound::get_priority(const std::string& sound_id) {
+
+  const auto& it = all_sounds.find(sound_id);
+  if (it == all_sounds.end()) {
+    return 0;
+  }
+  return it->second.priority;
+}
+
+/**
+ * \brief Sets the priority of a sound.
+ *
+ * When all sources are busy, the voices of lowest priority are interrupted
+ * first to play new sounds.
+ * A sound is never interrupted to play a sound of lower priority.
+ *
+ * \param sound_id Id of a sound.
+ * \param priority The priority.
+ */
+void Sound::set_priority(const std::string& sound_id, int priority) {
+
+  get_sound(sound_id).priority = priority;
+}
+
+/**
+ * \brief Returns how many instances of a sound can play at the same time.
+ * \param sound_id Id of a sound.
+ * \return The maximum number of voices, 0 means no limit.
+ */
+int Sound::get_max_voices(const std::string& sound_id) {
+
+  const auto& it = all_sounds.find(sound_id);
+  if (it == all_sounds.end()) {
+    return 0;
+  }
+  return it->second.max_voices;
+}
+
+/**
+ * \brief Sets how many instances of a sound can play at the same time.
+ *
+ * When the limit is reached, playing the sound again interrupts its oldest
+ * voice.
+ *
+ * \param sound_id Id of a sound.
+ * \param max_voices The maximum number of voices, 0 means no limit.
+ */
+void Sound::set_max_voices(const std::string& sound_id, int max_voices) {
+
+  get_sound(sound_id).max_voices = std::max(0, max_voices);
+}
+
+/**
+ * \brief Returns usage statistics of the sources playing sounds.
+ * \return The statistics since the audio system was initialized.
+ */
+Sound::VoiceStats Sound::get_voice_stats() {
+
+  VoiceStats stats = voice_stats;
+  stats.nb_active_voices = voices.size();
+  return stats;
+}
+
 /**
  * \brief Updates the audio (music and sound) system.
  *
@@ -223,64 +451,144 @@ void Sound::set_volume(int volume) {
  */
 void Sound::update() {
 
-  // update the playing sounds
-  std::list<Sound*> sounds_to_remove;
-  for (Sound* sound: current_sounds) {
-    if (!sound->update_playing()) {
-      sounds_to_remove.push_back(sound);
+  // Create the buffers of sounds decoded in the background.
+  if (!sounds_decoding.empty()) {
+    std::list<Sound*> sounds_ready;
+    for (Sound* sound: sounds_decoding) {
+      if (sound->decoding_job->state == DECODING_DONE) {
+        sounds_ready.push_back(sound);
+      }
+    }
+    for (Sound* sound: sounds_ready) {
+      sound->finish_loading();
+    }
+    if (sounds_decoding.empty()) {
+      stop_decoding_threads();
     }
   }
 
-  for (Sound* sound: sounds_to_remove) {
-    current_sounds.remove(sound);
+  // Give back the sources of finished sounds to the pool.
+  for (size_t i = voices.size(); i > 0; --i) {
+    ALint status;
+    alGetSourcei(voices[i - 1].source, AL_SOURCE_STATE, &status);
+    if (status != AL_PLAYING) {
+      release_voice(i - 1);
+    }
   }
 
   // also update the music
   Music::update();
+
+  // Without a sound card, mix what was played during this update.
+  OfflineAudio::render(System::timestep);
 }
 
 /**
- * \brief Updates this sound when it is playing.
- * \return true if the sound is still playing, false if it is finished.
+ * \brief Stops a voice and gives back its source to the pool.
+ *
+ * The last voice takes the place of the removed one.
+ *
+ * \param index Index of the voice to release.
  */
-bool Sound::update_playing() {
+void Sound::release_voice(size_t index) {
 
-  // See if this sound is still playing.
-  if (sources.empty()) {
-    return false;
-  }
+  const Voice voice = voices[index];
+  alSourceStop(voice.source);
+  alSourcei(voice.source, AL_BUFFER, 0);
+  free_sources.push_back(voice.source);
+  --voice.sound->nb_voices;
 
-  ALuint source = *sources.begin();
-  ALint status;
-  alGetSourcei(source, AL_SOURCE_STATE, &status);
+  voices[index] = voices.back();
+  voices.pop_back();
+}
 
-  if (status != AL_PLAYING) {
-    sources.pop_front();
-    alSourcei(source, AL_BUFFER, 0);
-    alDeleteSources(1, &source);
-  }
+/**
+ * \brief Stops all sounds currently playing.
+ */
+void Sound::stop_all_voices() {
 
-  return !sources.empty();
+  while (!voices.empty()) {
+    release_voice(voices.size() - 1);
+  }
 }
 
 /**
- * \brief Loads and decodes the sound into memory.
+ * \brief Returns the voice to interrupt when the pool has no free source.
+ *
+ * This is the oldest voice among the ones of lowest priority, provided
+ * that this priority is not higher than the one of this sound.
+ *
+ * \return Index of the voice to steal, or -1 if this sound cannot be played.
  */
-void Sound::load() {
+int Sound::find_voice_to_steal() const {
 
-  if (alGetError() != AL_NONE) {
-    Debug::error("Previous audio error not cleaned");
+  int best_index = -1;
+  for (size_t i = 0; i < voices.size(); ++i) {
+    const Voice& voice = voices[i];
+    if (voice.sound->priority > priority) {
+      continue;
+    }
+    if (best_index == -1) {
+      best_index = i;
+      continue;
+    }
+    const Voice& best = voices[best_index];
+    if (voice.sound->priority < best.sound->priority ||
+        (voice.sound->priority == best.sound->priority &&
+         int32_t(voice.serial - best.serial) < 0)) {
+      best_index = i;
+    }
   }
+  return best_index;
+}
 
-  std::string file_name = std::string("sounds/" + id);
-  if (id.find(".") == std::string::npos) {
-    file_name += ".ogg";
+/**
+ * \brief Takes a source from the pool to play this sound.
+ *
+ * Interrupts another voice if necessary.
+ *
+ * \return The source, or AL_NONE if the sound has to be dropped.
+ */
+ALuint Sound::acquire_source() {
+
+  if (max_voices > 0 && nb_voices >= max_voices) {
+    // Too many instances of this sound: restart the oldest one.
+    int oldest_index = -1;
+    for (size_t i = 0; i < voices.size(); ++i) {
+      if (voices[i].sound == this &&
+          (oldest_index == -1 ||
+           int32_t(voices[i].serial - voices[oldest_index].serial) < 0)) {
+        oldest_index = i;
+      }
+    }
+    if (oldest_index != -1) {
+      release_voice(oldest_index);
+      ++voice_stats.nb_stolen_voices;
+    }
   }
 
-  // Create an OpenAL buffer with the sound decoded by the library.
-  buffer = decode_file(file_name);
+  if (free_sources.empty()) {
+    const int index = find_voice_to_steal();
+    if (index == -1) {
+      ++voice_stats.nb_dropped_voices;
+      return AL_NONE;
+    }
+    release_voice(index);
+    ++voice_stats.nb_stolen_voices;
+  }
 
-  // buffer is now AL_NONE if there was an error.
+  const ALuint source = free_sources.back();
+  free_sources.pop_back();
+  return source;
+}
+
+/**
+ * \brief Loads and decodes the sound into memory.
+ */
+void Sound::load() {
+
+  decoding_job = create_decoding_job();
+  finish_loading();
 }
 
 /**
@@ -293,15 +601,24 @@ bool Sound::start() {
 
   if (is_initialized()) {
 
-    if (buffer == AL_NONE) { // first time: load and decode the file
-      load();
+    if (buffer == AL_NONE) {
+      if (decoding_job != nullptr) {
+        // Being preloaded: wait for this one.
+        finish_loading();
+      }
+      else {
+        // First time: load and decode the file.
+        load();
+      }
     }
 
     if (buffer != AL_NONE) {
 
-      // create a source
-      ALuint source;
-      alGenSources(1, &source);
+      // take a source from the pool
+      const ALuint source = acquire_source();
+      if (source == AL_NONE) {
+        return false;
+      }
       alSourcei(source, AL_BUFFER, buffer);
       alSourcef(source, AL_GAIN, volume);
 
@@ -312,12 +629,14 @@ bool Sound::start() {
         oss << "Cannot attach buffer " << buffer
             << " to the source to play sound '" << id << "': error " << error;
         Debug::error(oss.str());
-        alDeleteSources(1, &source);
+        alSourcei(source, AL_BUFFER, 0);
+        free_sources.push_back(source);
       }
       else {
-        sources.push_back(source);
-        current_sounds.remove(this); // to avoid duplicates
-        current_sounds.push_back(this);
+        voices.push_back({ source, this, next_voice_serial++ });
+        ++nb_voices;
+        voice_stats.max_active_voices = std::max(
+            voice_stats.max_active_voices, int(voices.size()));
         alSourcePlay(source);
         error = alGetError();
         if (error != AL_NO_ERROR) {
@@ -335,113 +654,309 @@ bool Sound::start() {
 }
 
 /**
- * \brief Loads the specified sound file and decodes its content into an OpenAL buffer.
- * \param file_name name of the file to open
- * \return the buffer created, or AL_NONE if the sound could not be loaded
+ * \brief Reads the sound file and prepares its decoding.
+ *
+ * The decoded samples are read from the disk cache if possible.
+ *
+ * \return The decoding job, in state DECODING_DONE if there is nothing
+ * to decode (samples found in the cache or error).
  */
-ALuint Sound::decode_file(const std::string& file_name) {
+std::shared_ptr<Sound::DecodingJob> Sound::create_decoding_job() const {
 
-  ALuint buffer = AL_NONE;
+  std::shared_ptr<DecodingJob> job = std::make_shared<DecodingJob>();
+  job->file_name = std::string("sounds/" + id);
+  if (id.find(".") == std::string::npos) {
+    job->file_name += ".ogg";
+  }
+  job->hash = 0;
+  job->sample_rate = 0;
+  job->from_cache = false;
+  job->state = DECODING_PENDING;
+
+  if (!QuestFiles::data_file_exists(job->file_name)) {
+    job->error = std::string("Cannot find sound file '") + job->file_name + "'";
+    job->state = DECODING_DONE;
+    return job;
+  }
+
+  job->encoded = QuestFiles::data_file_read_view(job->file_name);
 
-  if (!QuestFiles::data_file_exists(file_name)) {
-    Debug::error(std::string("Cannot find sound file '") + file_name + "'");
-    return AL_NONE;
+  if (cache_enabled) {
+    job->hash = compute_hash(*job->encoded);
+    if (load_from_cache(*job)) {
+      job->encoded = nullptr;
+      job->from_cache = true;
+      job->state = DECODING_DONE;
+    }
   }
 
-  // load the sound file
+  return job;
+}
+
+/**
+ * \brief Decodes a sound file into stereo samples.
+ *
+ * This function can be called from any thread: it does not use OpenAL
+ * and errors are stored in the job rather than printed.
+ *
+ * \param job The sound to decode.
+ */
+void Sound::decode(DecodingJob& job) {
+
+  const auto start_time = std::chrono::steady_clock::now();
+
   SoundFromMemory mem;
   mem.loop = false;
   mem.position = 0;
-  mem.data = QuestFiles::data_file_read(file_name);
+  mem.data = std::move(job.encoded);
 
   OggVorbis_File file;
   int error = ov_open_callbacks(&mem, &file, nullptr, 0, ogg_callbacks);
 
   if (error) {
     std::ostringstream oss;
-    oss << "Cannot load sound file '" << file_name
+    oss << "Cannot load sound file '" << job.file_name
         << "' from memory: error " << error;
-    Debug::error(oss.str());
+    job.error = oss.str();
+    return;
   }
-  else {
 
-    // read the encoded sound properties
-    vorbis_info* info = ov_info(&file, -1);
-    ALsizei sample_rate = ALsizei(info->rate);
+  // read the encoded sound properties
+  vorbis_info* info = ov_info(&file, -1);
+  const int nb_channels = info->channels;
+  job.sample_rate = ALsizei(info->rate);
+
+  if (nb_channels != 1 && nb_channels != 2) {
+    job.error = std::string("Invalid audio format for sound file '")
+        + job.file_name + "'";
+    ov_clear(&file);
+    return;
+  }
 
-    ALenum format = AL_NONE;
-    if (info->channels == 1) {
-      format = AL_FORMAT_MONO16;
+  // Decode directly at the end of the output, which is reserved
+  // assuming a usual compression ratio to avoid most reallocations.
+  std::vector<int16_t> decoded;
+  decoded.reserve(mem.data->size() * 6);
+  const int chunk_size = 4096;  // In bytes.
+  size_t total_bytes_read = 0;
+  int bitstream;
+  long bytes_read;
+  do {
+    decoded.resize((total_bytes_read + chunk_size) / sizeof(int16_t));
+    bytes_read = ov_read(&file,
+        reinterpret_cast<char*>(decoded.data()) + total_bytes_read,
+        chunk_size, 0, 2, 1, &bitstream);
+    if (bytes_read < 0) {
+      std::ostringstream oss;
+      oss << "Error while decoding ogg chunk in sound file '"
+          << job.file_name << "': " << bytes_read;
+      job.error = oss.str();
     }
-    else if (info->channels == 2) {
-      format = AL_FORMAT_STEREO16;
+    else {
+      total_bytes_read += bytes_read;
     }
+  }
+  while (bytes_read > 0);
+  decoded.resize(total_bytes_read / sizeof(int16_t));
+  ov_clear(&file);
+
+  if (nb_channels == 2) {
+    job.samples = std::move(decoded);
+  }
+  else {
+    // mono sound files make no sound on some machines
+    // workaround: convert them into stereo sounds
+    job.samples.resize(decoded.size() * 2);
+    mono_to_stereo(decoded.data(), decoded.size(), job.samples.data());
+  }
+
+  OfflineAudio::add_decoding_time("sound effects",
+      std::chrono::steady_clock::now() - start_time,
+      int(job.samples.size() / 2), job.sample_rate);
+}
+
+/**
+ * \brief Waits for the decoding of this sound and creates its OpenAL buffer.
+ *
+ * If no thread has started decoding the sound yet, it is decoded now.
+ */
+void Sound::finish_loading() {
+
+  std::shared_ptr<DecodingJob> job = decoding_job;
+  decoding_job = nullptr;
+  sounds_decoding.remove(this);
+
+  int expected_state = DECODING_PENDING;
+  if (job->state.compare_exchange_strong(expected_state, DECODING_RUNNING)) {
+    decode(*job);
+    job->state = DECODING_DONE;
+  }
+  else if (job->state != DECODING_DONE) {
+    std::unique_lock<std::mutex> lock(decoding_mutex);
+    decoding_finished.wait(lock, [&job] {
+      return job->state == DECODING_DONE;
+    });
+  }
+
+  if (!job->error.empty()) {
+    Debug::error(job->error);
+  }
+  if (job->samples.empty()) {
+    // buffer remains AL_NONE.
+    return;
+  }
+
+  if (alGetError() != AL_NONE) {
+    Debug::error("Previous audio error not cleaned");
+  }
+
+  // copy the samples into an OpenAL buffer
+  alGenBuffers(1, &buffer);
+  if (alGetError() != AL_NO_ERROR) {
+    Debug::error("Failed to generate audio buffer");
+  }
+  alBufferData(buffer,
+      AL_FORMAT_STEREO16,
+      job->samples.data(),
+      ALsizei(job->samples.size() * sizeof(int16_t)),
+      job->sample_rate);
+  ALenum error = alGetError();
+  if (error != AL_NO_ERROR) {
+    std::ostringstream oss;
+    oss << "Cannot copy the sound samples of '"
+        << job->file_name << "' into buffer " << buffer
+        << ": error " << error;
+    Debug::error(oss.str());
+    buffer = AL_NONE;
+    return;
+  }
 
-    if (format == AL_NONE) {
-      Debug::error(std::string("Invalid audio format for sound file '")
-          + file_name + "'");
+  if (cache_enabled && !job->from_cache) {
+    save_to_cache(job);
+  }
+}
+
+/**
+ * \brief Function executed by threads that decode preloaded sounds.
+ *
+ * Decodes sounds of the queue until there is no more.
+ */
+void Sound::run_decoding_thread() {
+
+  while (true) {
+    const size_t index = next_decoding_job++;
+    if (index >= decoding_queue.size()) {
+      return;
     }
-    else {
-      // decode the sound with vorbisfile
-      std::vector<char> samples;
-      int bitstream;
-      long bytes_read;
-      long total_bytes_read = 0;
-      const int buffer_size = 4096;
-      char samples_buffer[buffer_size];
-      do {
-        bytes_read = ov_read(&file, samples_buffer, buffer_size, 0, 2, 1, &bitstream);
-        if (bytes_read < 0) {
-          std::ostringstream oss;
-          oss << "Error while decoding ogg chunk in sound file '"
-              << file_name << "': " << bytes_read;
-          Debug::error(oss.str());
-        }
-        else {
-          total_bytes_read += bytes_read;
-          if (format == AL_FORMAT_STEREO16) {
-            samples.insert(samples.end(), samples_buffer, samples_buffer + bytes_read);
-          }
-          else {
-            // mono sound files make no sound on some machines
-            // workaround: convert them on-the-fly into stereo sounds
-            // TODO find a better solution
-            for (int i = 0; i < bytes_read; i += 2) {
-              samples.insert(samples.end(), samples_buffer + i, samples_buffer + i + 2);
-              samples.insert(samples.end(), samples_buffer + i, samples_buffer + i + 2);
-            }
-            total_bytes_read += bytes_read;
-          }
-        }
-      }
-      while (bytes_read > 0);
 
-      // copy the samples into an OpenAL buffer
-      alGenBuffers(1, &buffer);
-      if (alGetError() != AL_NO_ERROR) {
-          Debug::error("Failed to generate audio buffer");
-      }
-      alBufferData(buffer,
-          AL_FORMAT_STEREO16,
-          reinterpret_cast<ALshort*>(samples.data()),
-          ALsizei(total_bytes_read),
-          sample_rate);
-      ALenum error = alGetError();
-      if (error != AL_NO_ERROR) {
-        std::ostringstream oss;
-        oss << "Cannot copy the sound samples of '"
-            << file_name << "' into buffer " << buffer
-            << ": error " << error;
-        Debug::error(oss.str());
-        buffer = AL_NONE;
+    DecodingJob& job = *decoding_queue[index];
+    int expected_state = DECODING_PENDING;
+    if (job.state.compare_exchange_strong(expected_state, DECODING_RUNNING)) {
+      decode(job);
+      {
+        std::lock_guard<std::mutex> lock(decoding_mutex);
+        job.state = DECODING_DONE;
       }
+      decoding_finished.notify_all();
     }
-    ov_clear(&file);
   }
+}
 
-  mem.data.clear();
+/**
+ * \brief Waits for the threads that decode preloaded sounds.
+ *
+ * Sounds not decoded yet will be decoded when they are played.
+ */
+void Sound::stop_decoding_threads() {
+
+  next_decoding_job = decoding_queue.size();
+  for (std::thread& thread: decoding_threads) {
+    thread.join();
+  }
+  decoding_threads.clear();
+  decoding_queue.clear();
+}
+
+/**
+ * \brief Returns the file where the decoded samples of a sound are saved.
+ * \param file_name Name of the sound file.
+ * \return The corresponding file name, relative to the quest write directory.
+ */
+std::string Sound::get_cache_file_name(const std::string& file_name) {
+  return cache_directory + "/" + file_name + ".pcm";
+}
 
-  return buffer;
+/**
+ * \brief Reads the decoded samples of a sound from the quest write directory.
+ * \param job The sound to load. Its hash must be set.
+ * \return \c true if up-to-date samples were found.
+ */
+bool Sound::load_from_cache(DecodingJob& job) {
+
+  if (QuestFiles::get_quest_write_dir().empty()) {
+    return false;
+  }
+
+  const std::string& cache_file_name = get_cache_file_name(job.file_name);
+  if (!QuestFiles::data_file_exists(cache_file_name)) {
+    return false;
+  }
+
+  std::ostringstream oss;
+  oss << cache_file_magic << '\n' << std::hex << job.hash << '\n';
+  const std::string& header = oss.str();
+
+  const std::string& content = QuestFiles::data_file_read(cache_file_name);
+  if (content.compare(0, header.size(), header) != 0) {
+    // The sound has changed.
+    return false;
+  }
+
+  // The header is followed by the sample rate and the samples.
+  int32_t sample_rate = 0;
+  const size_t samples_position = header.size() + sizeof(sample_rate);
+  if (content.size() <= samples_position) {
+    return false;
+  }
+  std::memcpy(&sample_rate, content.data() + header.size(), sizeof(sample_rate));
+  job.sample_rate = sample_rate;
+  job.samples.resize((content.size() - samples_position) / sizeof(int16_t));
+  std::memcpy(job.samples.data(), content.data() + samples_position,
+      job.samples.size() * sizeof(int16_t));
+  return true;
+}
+
+/**
+ * \brief Saves the decoded samples of a sound into the quest write directory.
+ *
+ * The file is written later by the I/O thread of FileWriter, which keeps
+ * the job alive until then.
+ *
+ * \param job A decoded sound. Its samples must not change anymore.
+ */
+void Sound::save_to_cache(const std::shared_ptr<const DecodingJob>& job) {
+
+  if (QuestFiles::get_quest_write_dir().empty()) {
+    return;
+  }
+
+  const std::string& cache_file_name = get_cache_file_name(job->file_name);
+  FileWriter::write_async(
+      QuestFiles::get_full_quest_write_dir() + "/" + cache_file_name,
+      [job, cache_file_name]() {
+        // Failures are reported by FileWriter when opening the file.
+        const size_t last_slash = cache_file_name.rfind('/');
+        QuestFiles::data_file_mkdir(cache_file_name.substr(0, last_slash));
+
+        std::ostringstream oss;
+        oss << cache_file_magic << '\n' << std::hex << job->hash << '\n';
+        const int32_t sample_rate = job->sample_rate;
+        oss.write(reinterpret_cast<const char*>(&sample_rate), sizeof(sample_rate));
+        oss.write(reinterpret_cast<const char*>(job->samples.data()),
+            job->samples.size() * sizeof(int16_t));
+        return oss.str();
+      }
+  );
 }
 
 /**
@@ -459,7 +974,7 @@ size_t Sound::cb_read(void* ptr, size_t /* size */, size_t nb_bytes, void* datas
 
   SoundFromMemory* mem = static_cast<SoundFromMemory*>(datasource);
 
-  const size_t total_size = mem->data.size();
+  const size_t total_size = mem->data->size();
   if (mem->position >= total_size) {
     if (mem->loop) {
       mem->position = 0;
@@ -472,7 +987,7 @@ size_t Sound::cb_read(void* ptr, size_t /* size */, size_t nb_bytes, void* datas
     nb_bytes = total_size - mem->position;
   }
 
-  std::memcpy(ptr, mem->data.data() + mem->position, nb_bytes);
+  std::memcpy(ptr, mem->data->data() + mem->position, nb_bytes);
   mem->position += nb_bytes;
 
   return nb_bytes;
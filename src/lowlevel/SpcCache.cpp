@@ -0,0 +1,838 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/FileWriter.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/lowlevel/SpcCache.h"
+#include "solarus/third_party/snes_spc/spc.h"
+#include "solarus/Arguments.h"
+#include <al.h>
+#include <alc.h>
+#include <algorithm>
+#include <cstring>  // memcpy
+#include <sstream>
+#include <unordered_map>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Directory of the quest write directory where rendered musics are saved.
+ */
+const std::string cache_directory = "music_cache";
+
+/**
+ * \brief First line of rendered music files.
+ */
+const std::string cache_file_magic = "SOLARUS_SPC";
+
+/**
+ * \brief Sample rate of the SPC emulator.
+ */
+constexpr int spc_frequency = spc_sample_rate;
+
+/**
+ * \brief Number of stereo frames rendered by each call to the emulator.
+ */
+constexpr int chunk_size = 2048;
+
+/**
+ * \brief Number of stereo frames compressed together.
+ *
+ * Playback can only start at the beginning of a block,
+ * so blocks are kept small.
+ */
+constexpr int block_size = 4096;
+
+/**
+ * \brief Maximum duration rendered while searching the loop of a music.
+ */
+constexpr int max_rendered_frames = 300 * spc_frequency;
+
+/**
+ * \brief Number of frames hashed to find repeated parts of a music.
+ */
+constexpr int window_size = 1024;
+
+/**
+ * \brief Minimum duration of a loop.
+ */
+constexpr int min_loop_length = 2 * spc_frequency;
+
+/**
+ * \brief Maximum number of possible loops verified at the same time.
+ */
+constexpr size_t max_loop_candidates = 16;
+
+/**
+ * \brief Maximum number of positions remembered for a hash of a window.
+ */
+constexpr size_t max_positions_per_hash = 4;
+
+/**
+ * \brief Maximum number of rendered musics kept in memory.
+ */
+constexpr size_t max_tracks_in_memory = 4;
+
+/**
+ * \brief Base of the polynomial rolling hash of windows.
+ */
+constexpr uint64_t hash_base = 1099511628211ULL;
+
+/**
+ * \brief Computes a 64-bit FNV-1a hash of an SPC file.
+ * \param buffer The buffer to hash.
+ * \return The hash.
+ */
+uint64_t compute_hash(const DataFileView& buffer) {
+
+  uint64_t hash = 14695981039346656037ULL;
+  const char* data = buffer.data();
+  for (size_t i = 0; i < buffer.size(); ++i) {
+    hash ^= static_cast<unsigned char>(data[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * \brief Returns whether the position of a window should be remembered.
+ *
+ * Only about one window out of 64 is remembered to save memory.
+ * Since the choice only depends on the content, a repeated window is
+ * remembered both times.
+ *
+ * \param window_hash Rolling hash of the window.
+ * \return \c true if the window is remembered.
+ */
+bool is_window_sampled(uint64_t window_hash) {
+  return ((window_hash * 0x9E3779B97F4A7C15ULL) >> 58) == 0;
+}
+
+/**
+ * \brief Appends an unsigned integer to a buffer as a variable-length integer.
+ * \param value The value to write.
+ * \param data The buffer.
+ */
+void write_varint(uint32_t value, std::vector<uint8_t>& data) {
+
+  while (value >= 0x80) {
+    data.push_back(uint8_t(value | 0x80));
+    value >>= 7;
+  }
+  data.push_back(uint8_t(value));
+}
+
+/**
+ * \brief Reads a variable-length integer.
+ * \param[in,out] data Current position in the buffer.
+ * \param end End of the buffer.
+ * \return The value read, 0 if the buffer is too short.
+ */
+uint32_t read_varint(const uint8_t*& data, const uint8_t* end) {
+
+  uint32_t value = 0;
+  int shift = 0;
+  while (data < end && shift < 32) {
+    const uint8_t byte = *data++;
+    value |= uint32_t(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+    shift += 7;
+  }
+  return 0;
+}
+
+/**
+ * \brief Appends a 32-bit integer to a stream.
+ * \param oss The stream.
+ * \param value The value to write.
+ */
+void write_int32(std::ostringstream& oss, uint32_t value) {
+  oss.write(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+/**
+ * \brief Reads a 32-bit integer from a buffer.
+ * \param content The buffer.
+ * \param[in,out] position Where to read in the buffer.
+ * \param[out] value The value read.
+ * \return \c false if the buffer is too short.
+ */
+bool read_int32(const std::string& content, size_t& position, uint32_t& value) {
+
+  if (position + sizeof(value) > content.size()) {
+    return false;
+  }
+  std::memcpy(&value, content.data() + position, sizeof(value));
+  position += sizeof(value);
+  return true;
+}
+
+}
+
+bool SpcCache::enabled = false;
+int SpcCache::output_frequency = spc_frequency;
+std::map<std::string, SpcCache::Entry> SpcCache::entries;
+std::list<std::string> SpcCache::entries_order;
+std::list<std::string> SpcCache::files_rendering;
+std::thread SpcCache::rendering_thread;
+std::atomic<bool> SpcCache::rendering_stopped(false);
+std::mutex SpcCache::rendering_mutex;
+std::condition_variable SpcCache::rendering_condition;
+std::list<std::shared_ptr<SpcCache::RenderingJob>> SpcCache::jobs_to_render;
+std::list<std::shared_ptr<SpcCache::RenderingJob>> SpcCache::jobs_rendered;
+
+/**
+ * \brief Initializes the SPC cache.
+ *
+ * The audio context must be created.
+ * The option -spc-prerender=yes enables the cache (default no).
+ *
+ * \param args Command-line arguments.
+ */
+void SpcCache::initialize(const Arguments& args) {
+
+  enabled = args.get_argument_value("-spc-prerender") == "yes";
+
+  // The device may not have accepted the frequency we asked.
+  output_frequency = spc_frequency;
+  ALCcontext* context = alcGetCurrentContext();
+  if (context != nullptr) {
+    ALCint frequency = 0;
+    alcGetIntegerv(alcGetContextsDevice(context), ALC_FREQUENCY, 1, &frequency);
+    if (frequency > 0) {
+      output_frequency = frequency;
+    }
+  }
+
+  rendering_stopped = false;
+}
+
+/**
+ * \brief Stops rendering and frees the rendered musics.
+ */
+void SpcCache::quit() {
+
+  if (rendering_thread.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(rendering_mutex);
+      rendering_stopped = true;
+    }
+    rendering_condition.notify_all();
+    rendering_thread.join();
+  }
+
+  jobs_to_render.clear();
+  jobs_rendered.clear();
+  files_rendering.clear();
+  entries.clear();
+  entries_order.clear();
+  enabled = false;
+}
+
+/**
+ * \brief Returns whether SPC musics are prerendered.
+ * \return \c true if the cache is enabled.
+ */
+bool SpcCache::is_enabled() {
+  return enabled;
+}
+
+/**
+ * \brief Returns the sample rate rendered musics are resampled to.
+ * \return The frequency of the audio device in Hz.
+ */
+int SpcCache::get_output_frequency() {
+  return output_frequency;
+}
+
+/**
+ * \brief Collects the musics rendered by the background thread.
+ *
+ * This function is called repeatedly by the main thread.
+ * Rendered musics are saved in the quest write directory by the I/O thread
+ * of FileWriter.
+ */
+void SpcCache::update() {
+
+  if (!enabled) {
+    return;
+  }
+
+  std::list<std::shared_ptr<RenderingJob>> jobs;
+  std::vector<std::pair<std::string, Entry>> entries_to_save;
+  {
+    std::lock_guard<std::mutex> lock(rendering_mutex);
+    jobs.swap(jobs_rendered);
+    for (const std::shared_ptr<RenderingJob>& job: jobs) {
+      // In case of error, don't try again: this music will be emulated.
+      files_rendering.remove(job->file_name);
+      Entry entry;
+      entry.hash = job->hash;
+      entry.track = std::move(job->track);
+      add_entry(job->file_name, entry);
+      if (job->error.empty()) {
+        entries_to_save.emplace_back(job->file_name, std::move(entry));
+      }
+    }
+  }
+
+  for (const std::shared_ptr<RenderingJob>& job: jobs) {
+    if (!job->error.empty()) {
+      Debug::error(job->error);
+    }
+  }
+
+  for (const std::pair<std::string, Entry>& entry: entries_to_save) {
+    save_to_disk(entry.first, entry.second);
+  }
+}
+
+/**
+ * \brief Returns the rendered version of an SPC music.
+ *
+ * If the music was never rendered, it starts being rendered in the
+ * background and will be available the next time.
+ * This function can be called from the music streaming thread.
+ *
+ * \param file_name Name of the SPC file.
+ * \param spc_data Content of the SPC file.
+ * \return The rendered music, or nullptr if it has to be emulated.
+ */
+std::shared_ptr<const SpcCache::Track> SpcCache::get_track(
+    const std::string& file_name,
+    const DataFileViewPtr& spc_data
+) {
+  if (!enabled) {
+    return nullptr;
+  }
+
+  const uint64_t hash = compute_hash(*spc_data);
+
+  std::unique_lock<std::mutex> lock(rendering_mutex);
+
+  // Try the memory.
+  const auto& it = entries.find(file_name);
+  if (it != entries.end() && it->second.hash == hash) {
+    entries_order.remove(file_name);
+    entries_order.push_front(file_name);
+    return it->second.track;
+  }
+
+  // Try the disk.
+  Entry entry;
+  if (load_from_disk(file_name, hash, entry)) {
+    add_entry(file_name, entry);
+    return entry.track;
+  }
+
+  if (std::find(files_rendering.begin(), files_rendering.end(), file_name) !=
+      files_rendering.end()) {
+    // Already being rendered.
+    return nullptr;
+  }
+
+  // Render it in the background.
+  std::shared_ptr<RenderingJob> job = std::make_shared<RenderingJob>();
+  job->file_name = file_name;
+  job->spc_data = spc_data;
+  job->hash = hash;
+  files_rendering.push_back(file_name);
+  jobs_to_render.push_back(job);
+  if (!rendering_thread.joinable()) {
+    rendering_thread = std::thread(run_rendering_thread);
+  }
+  lock.unlock();
+  rendering_condition.notify_one();
+
+  return nullptr;
+}
+
+/**
+ * \brief Stores a track in memory, forgetting the least recently used ones.
+ * \param file_name Name of the SPC file.
+ * \param entry The track.
+ */
+void SpcCache::add_entry(const std::string& file_name, const Entry& entry) {
+
+  entries[file_name] = entry;
+  entries_order.remove(file_name);
+  entries_order.push_front(file_name);
+
+  while (entries_order.size() > max_tracks_in_memory) {
+    // Musics playing keep their track alive.
+    entries.erase(entries_order.back());
+    entries_order.pop_back();
+  }
+}
+
+/**
+ * \brief Function executed by the thread that renders SPC musics.
+ *
+ * Renders the musics queued until quit() is called.
+ */
+void SpcCache::run_rendering_thread() {
+
+  while (true) {
+    std::shared_ptr<RenderingJob> job;
+    {
+      std::unique_lock<std::mutex> lock(rendering_mutex);
+      rendering_condition.wait(lock, [] {
+        return rendering_stopped || !jobs_to_render.empty();
+      });
+      if (rendering_stopped) {
+        return;
+      }
+      job = jobs_to_render.front();
+      jobs_to_render.pop_front();
+    }
+
+    if (render(*job) || !job->error.empty()) {
+      std::lock_guard<std::mutex> lock(rendering_mutex);
+      jobs_rendered.push_back(job);
+    }
+  }
+}
+
+/**
+ * \brief Emulates an SPC music until its loop is found.
+ *
+ * A loop is detected when a part of the music is exactly repeated during
+ * at least the length of the loop.
+ * Candidate loop lengths are found by remembering the hash of some
+ * windows of frames and looking for windows seen before.
+ *
+ * This function is called from the rendering thread: it does not use
+ * OpenAL and errors are stored in the job rather than printed.
+ *
+ * \param job The music to render. Its track is left to nullptr if no
+ * loop is found.
+ * \return \c false if the rendering was interrupted or failed.
+ */
+bool SpcCache::render(RenderingJob& job) {
+
+  std::unique_ptr<SNES_SPC, void(*)(SNES_SPC*)> spc(spc_new(), spc_delete);
+  std::unique_ptr<SPC_Filter, void(*)(SPC_Filter*)> filter(
+      spc_filter_new(), spc_filter_delete);
+  if (spc == nullptr || filter == nullptr) {
+    job.error = "Cannot create SPC emulator to render '" + job.file_name + "'";
+    return false;
+  }
+
+  const char* error = spc_load_spc(spc.get(), job.spc_data->data(), long(job.spc_data->size()));
+  job.spc_data = nullptr;
+  if (error != nullptr) {
+    job.error = "Cannot load SPC music '" + job.file_name + "': " + error;
+    return false;
+  }
+  spc_clear_echo(spc.get());
+  spc_filter_clear(filter.get());
+
+  /**
+   * A loop length being verified.
+   */
+  struct Candidate {
+    int length;           /**< Number of frames of the loop. */
+    int verify_start;     /**< First frame known to be equal to the one a loop before. */
+  };
+
+  uint64_t hash_base_power = 1;  // hash_base ^ window_size.
+  for (int i = 0; i < window_size; ++i) {
+    hash_base_power *= hash_base;
+  }
+
+  std::vector<uint32_t> frames;  // Left and right samples of each frame.
+  std::vector<int16_t> chunk(chunk_size * 2);
+  std::unordered_map<uint64_t, std::vector<int>> window_positions;
+  std::vector<Candidate> candidates;
+  uint64_t window_hash = 0;
+  int loop_start = 0;
+  int loop_length = 0;
+
+  while (loop_length == 0 && frames.size() < size_t(max_rendered_frames)) {
+
+    if (rendering_stopped) {
+      return false;
+    }
+
+    error = spc_play(spc.get(), int(chunk.size()), chunk.data());
+    if (error != nullptr) {
+      job.error = "Failed to render SPC music '" + job.file_name + "': " + error;
+      return false;
+    }
+    spc_filter_run(filter.get(), chunk.data(), int(chunk.size()));
+
+    for (int i = 0; i < chunk_size && loop_length == 0; ++i) {
+
+      const int x = int(frames.size());
+      const uint32_t frame = uint32_t(uint16_t(chunk[2 * i])) |
+          (uint32_t(uint16_t(chunk[2 * i + 1])) << 16);
+      frames.push_back(frame);
+
+      window_hash = window_hash * hash_base + frame;
+      if (x >= window_size) {
+        window_hash -= frames[x - window_size] * hash_base_power;
+      }
+
+      // Continue verifying the possible loops.
+      for (auto it = candidates.begin(); it != candidates.end();) {
+        if (frames[x - it->length] != frame) {
+          it = candidates.erase(it);
+        }
+        else if (x - it->verify_start + 1 >= it->length) {
+          // A whole loop was repeated.
+          loop_length = it->length;
+          loop_start = it->verify_start - it->length;
+          break;
+        }
+        else {
+          ++it;
+        }
+      }
+
+      if (loop_length != 0 ||
+          x + 1 < window_size ||
+          !is_window_sampled(window_hash)) {
+        continue;
+      }
+
+      // See if this window was already seen.
+      std::vector<int>& positions = window_positions[window_hash];
+      for (const int position: positions) {
+        const int length = x - position;
+        if (length < min_loop_length ||
+            candidates.size() >= max_loop_candidates ||
+            std::any_of(candidates.begin(), candidates.end(), [length](const Candidate& candidate) {
+              return candidate.length == length;
+            })) {
+          continue;
+        }
+        const auto& window_start = frames.begin() + (x - window_size + 1);
+        if (std::equal(window_start, frames.end(), window_start - length)) {
+          candidates.push_back({ length, x - window_size + 1 });
+        }
+      }
+      positions.push_back(x);
+      if (positions.size() > max_positions_per_hash) {
+        positions.erase(positions.begin());
+      }
+    }
+  }
+
+  if (loop_length == 0) {
+    // No loop found: the music will be emulated.
+    return true;
+  }
+
+  // Start the loop as early as possible.
+  while (loop_start > 0 &&
+      frames[loop_start - 1] == frames[loop_start - 1 + loop_length]) {
+    --loop_start;
+  }
+  frames.resize(loop_start + loop_length);
+
+  std::shared_ptr<Track> track = std::make_shared<Track>();
+  compress(frames, *track);
+  track->loop_start = loop_start;
+  job.track = track;
+  return true;
+}
+
+/**
+ * \brief Compresses rendered frames into a track.
+ *
+ * Each sample is predicted from the two previous samples of its channel,
+ * and the difference is stored as a variable-length integer.
+ * This is lossless and typically halves the size of the samples,
+ * while decoding costs only a few operations per sample.
+ *
+ * \param frames The frames to compress.
+ * \param track The track to fill.
+ */
+void SpcCache::compress(const std::vector<uint32_t>& frames, Track& track) {
+
+  track.nb_frames = int(frames.size());
+  track.data.clear();
+  track.block_offsets.clear();
+
+  for (size_t block_start = 0; block_start < frames.size(); block_start += block_size) {
+
+    track.block_offsets.push_back(uint32_t(track.data.size()));
+    const size_t block_end = std::min(block_start + block_size, frames.size());
+    int32_t previous[2] = { 0, 0 };
+    int32_t previous_2[2] = { 0, 0 };
+    for (size_t i = block_start; i < block_end; ++i) {
+      for (int channel = 0; channel < 2; ++channel) {
+        const int32_t sample = int16_t(uint16_t(frames[i] >> (16 * channel)));
+        const int32_t residual = sample - (2 * previous[channel] - previous_2[channel]);
+        write_varint((uint32_t(residual) << 1) ^ uint32_t(residual >> 31), track.data);
+        previous_2[channel] = previous[channel];
+        previous[channel] = sample;
+      }
+    }
+  }
+}
+
+/**
+ * \brief Returns the file where a rendered music is saved.
+ * \param file_name Name of the SPC file.
+ * \return The corresponding file name, relative to the quest write directory.
+ */
+std::string SpcCache::get_cache_file_name(const std::string& file_name) {
+  return cache_directory + "/" + file_name + ".pcm";
+}
+
+/**
+ * \brief Reads a rendered music from the quest write directory.
+ * \param[in] file_name Name of the SPC file.
+ * \param[in] hash Hash of the current content of the SPC file.
+ * \param[out] entry The rendered music.
+ * \return \c true if an up-to-date rendering was found.
+ */
+bool SpcCache::load_from_disk(
+    const std::string& file_name,
+    uint64_t hash,
+    Entry& entry
+) {
+  if (QuestFiles::get_quest_write_dir().empty()) {
+    return false;
+  }
+
+  const std::string& cache_file_name = get_cache_file_name(file_name);
+  if (!QuestFiles::data_file_exists(cache_file_name)) {
+    return false;
+  }
+
+  std::ostringstream oss;
+  oss << cache_file_magic << '\n' << std::hex << hash << '\n';
+  const std::string& header = oss.str();
+
+  const std::string& content = QuestFiles::data_file_read(cache_file_name);
+  if (content.compare(0, header.size(), header) != 0) {
+    // The music has changed.
+    return false;
+  }
+
+  // The header is followed by the number of frames, the loop start,
+  // the offset of each block and the compressed data.
+  size_t position = header.size();
+  uint32_t nb_frames = 0;
+  uint32_t loop_start = 0;
+  if (!read_int32(content, position, nb_frames) ||
+      !read_int32(content, position, loop_start)) {
+    return false;
+  }
+
+  entry.hash = hash;
+  entry.track = nullptr;
+  if (nb_frames == 0) {
+    // Known to have no loop.
+    return true;
+  }
+
+  if (loop_start >= nb_frames || nb_frames > uint32_t(max_rendered_frames)) {
+    return false;
+  }
+
+  std::shared_ptr<Track> track = std::make_shared<Track>();
+  track->nb_frames = int(nb_frames);
+  track->loop_start = int(loop_start);
+  const size_t nb_blocks = (nb_frames + block_size - 1) / block_size;
+  track->block_offsets.resize(nb_blocks);
+  for (uint32_t& offset: track->block_offsets) {
+    if (!read_int32(content, position, offset)) {
+      return false;
+    }
+  }
+  track->data.assign(content.begin() + position, content.end());
+  for (size_t i = 0; i < nb_blocks; ++i) {
+    if (track->block_offsets[i] > track->data.size() ||
+        (i > 0 && track->block_offsets[i] < track->block_offsets[i - 1])) {
+      return false;
+    }
+  }
+
+  entry.track = track;
+  return true;
+}
+
+/**
+ * \brief Saves a rendered music into the quest write directory.
+ *
+ * The file is built and written later by the I/O thread of FileWriter.
+ * Tracks are never modified once rendered, so the entry can be shared.
+ *
+ * \param file_name Name of the SPC file.
+ * \param entry The rendered music.
+ */
+void SpcCache::save_to_disk(const std::string& file_name, const Entry& entry) {
+
+  if (QuestFiles::get_quest_write_dir().empty()) {
+    return;
+  }
+
+  const std::string& cache_file_name = get_cache_file_name(file_name);
+  FileWriter::write_async(
+      QuestFiles::get_full_quest_write_dir() + "/" + cache_file_name,
+      [entry, cache_file_name]() {
+        // Failures are reported by FileWriter when opening the file.
+        const size_t last_slash = cache_file_name.rfind('/');
+        QuestFiles::data_file_mkdir(cache_file_name.substr(0, last_slash));
+
+        std::ostringstream oss;
+        oss << cache_file_magic << '\n' << std::hex << entry.hash << '\n';
+        if (entry.track == nullptr) {
+          write_int32(oss, 0);
+          write_int32(oss, 0);
+        }
+        else {
+          const Track& track = *entry.track;
+          write_int32(oss, track.nb_frames);
+          write_int32(oss, track.loop_start);
+          for (const uint32_t offset: track.block_offsets) {
+            write_int32(oss, offset);
+          }
+          oss.write(reinterpret_cast<const char*>(track.data.data()), track.data.size());
+        }
+        return oss.str();
+      }
+  );
+}
+
+/**
+ * \brief Creates a reader of a rendered music, starting at the beginning.
+ * \param track The rendered music.
+ */
+SpcCache::Reader::Reader(const std::shared_ptr<const Track>& track):
+  track(track),
+  position(0),
+  decoded_block_index(-1),
+  nb_input_frames(0),
+  phase(0) {
+
+  Debug::check_assertion(track != nullptr && track->nb_frames > 0,
+      "Missing rendered SPC track");
+}
+
+/**
+ * \brief Reads the next frames of the music at the output frequency.
+ *
+ * Frames are linearly interpolated between the 32 KHz samples.
+ *
+ * \param output Where to write the stereo samples.
+ * \param nb_frames Number of stereo frames to write.
+ */
+void SpcCache::Reader::read(int16_t* output, int nb_frames) {
+
+  if (output_frequency == spc_frequency) {
+    read_frames(output, nb_frames);
+    return;
+  }
+
+  const uint64_t step = (uint64_t(spc_frequency) << 16) / output_frequency;
+  const uint64_t end_phase = phase + step * nb_frames;
+  const int nb_frames_needed = int(end_phase >> 16) + 2;
+  if (nb_frames_needed > nb_input_frames) {
+    input.resize(nb_frames_needed * 2);
+    read_frames(&input[nb_input_frames * 2], nb_frames_needed - nb_input_frames);
+    nb_input_frames = nb_frames_needed;
+  }
+
+  // Weights have 15 bits so that products fit in 32 bits.
+  const int16_t* in = input.data();
+  uint64_t current_phase = phase;
+  for (int i = 0; i < nb_frames; ++i) {
+    const size_t index = size_t(current_phase >> 16) * 2;
+    const int32_t weight = int32_t(current_phase & 0xFFFF) >> 1;
+    output[2 * i] = int16_t(in[index] + (((in[index + 2] - in[index]) * weight) >> 15));
+    output[2 * i + 1] = int16_t(in[index + 1] + (((in[index + 3] - in[index + 1]) * weight) >> 15));
+    current_phase += step;
+  }
+
+  // Keep the frames still needed by the next call.
+  const int nb_frames_consumed = int(current_phase >> 16);
+  std::copy(input.begin() + nb_frames_consumed * 2,
+      input.begin() + nb_input_frames * 2,
+      input.begin());
+  nb_input_frames -= nb_frames_consumed;
+  phase = uint32_t(current_phase & 0xFFFF);
+}
+
+/**
+ * \brief Reads the next frames of the music at 32 KHz.
+ *
+ * Goes back to the start of the loop when the end is reached.
+ *
+ * \param output Where to write the stereo samples.
+ * \param nb_frames Number of stereo frames to write.
+ */
+void SpcCache::Reader::read_frames(int16_t* output, int nb_frames) {
+
+  while (nb_frames > 0) {
+    if (position >= track->nb_frames) {
+      position = track->loop_start;
+    }
+
+    const int block_index = position / block_size;
+    if (block_index != decoded_block_index) {
+      decode_block(block_index);
+    }
+
+    const int offset = position - block_index * block_size;
+    const int nb_block_frames = int(decoded_block.size() / 2);
+    const int count = std::min(nb_frames, nb_block_frames - offset);
+    std::memcpy(output, &decoded_block[offset * 2], count * 2 * sizeof(int16_t));
+    output += count * 2;
+    nb_frames -= count;
+    position += count;
+  }
+}
+
+/**
+ * \brief Decompresses a block of the track.
+ * \param block_index Index of the block to decode.
+ */
+void SpcCache::Reader::decode_block(int block_index) {
+
+  const int block_start = block_index * block_size;
+  const int nb_block_frames = std::min(block_size, track->nb_frames - block_start);
+  decoded_block.resize(nb_block_frames * 2);
+
+  const uint8_t* data = track->data.data() + track->block_offsets[block_index];
+  const uint8_t* end = track->data.data() + (
+      size_t(block_index + 1) < track->block_offsets.size() ?
+          track->block_offsets[block_index + 1] : track->data.size());
+  int32_t previous[2] = { 0, 0 };
+  int32_t previous_2[2] = { 0, 0 };
+  for (int i = 0; i < nb_block_frames; ++i) {
+    for (int channel = 0; channel < 2; ++channel) {
+      const uint32_t value = read_varint(data, end);
+      const int32_t residual = int32_t(value >> 1) ^ -int32_t(value & 1);
+      const int32_t sample = 2 * previous[channel] - previous_2[channel] + residual;
+      decoded_block[2 * i + channel] = int16_t(sample);
+      previous_2[channel] = previous[channel];
+      previous[channel] = sample;
+    }
+  }
+  decoded_block_index = block_index;
+}
+
+}
+
@@ -214,8 +214,8 @@ SDL_Surface* Surface::get_surface_from_file(
     return nullptr;
   }
 
-  const std::string& buffer = QuestFiles::data_file_read(prefixed_file_name, language_specific);
-  SDL_RWops* rw = SDL_RWFromMem(const_cast<char*>(buffer.data()), (int) buffer.size());
+  const DataFileViewPtr& buffer = QuestFiles::data_file_read_view(prefixed_file_name, language_specific);
+  SDL_RWops* rw = SDL_RWFromConstMem(buffer->data(), (int) buffer->size());
 
   SDL_Surface* software_surface = IMG_Load_RW(rw, 0);
 
@@ -15,6 +15,7 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "solarus/lowlevel/Color.h"
+#include "solarus/lowlevel/FileWriter.h"
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lowlevel/FontResource.h"
 #include "solarus/lowlevel/InputEvent.h"
@@ -22,8 +23,10 @@
 #include "solarus/lowlevel/Sound.h"
 #include "solarus/lowlevel/System.h"
 #include "solarus/lowlevel/Video.h"
+#include "solarus/lua/LuaBytecodeCache.h"
 #include "solarus/Sprite.h"
 #include <SDL.h>
+#include <SDL_image.h>
 #ifdef SOLARUS_USE_APPLE_POOL
 #  include "lowlevel/apple/AppleInterface.h"
 #endif
@@ -45,11 +48,15 @@ void System::initialize(const Arguments& args) {
 
   // initialize SDL
   SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK);
+  // Load the image decoders now so that images can be decoded by any thread.
+  IMG_Init(IMG_INIT_PNG);
   initial_time = get_real_time();
   ticks = 0;
 
   // files
   QuestFiles::initialize(args);
+  LuaBytecodeCache::initialize(args);
+  FileWriter::initialize();
 
   // audio
   Sound::initialize(args);
@@ -63,7 +70,7 @@ void System::initialize(const Arguments& args) {
   // video
   Video::initialize(args);
   FontResource::initialize();
-  Sprite::initialize();
+  Sprite::initialize(args);
 }
 
 /**
@@ -79,8 +86,11 @@ void System::quit() {
   Sprite::quit();
   FontResource::quit();
   Video::quit();
+  LuaBytecodeCache::quit();
+  FileWriter::quit();
   QuestFiles::quit();
 
+  IMG_Quit();
   SDL_Quit();
 }
 
@@ -94,6 +104,7 @@ void System::update() {
   // Use a constant timestep here to have deterministic updates.
   ticks += timestep;
   Sound::update();
+  FileWriter::update();
 }
 
 /**
@@ -23,6 +23,25 @@
 
 namespace Solarus {
 
+namespace {
+
+/**
+ * \brief Checks that the argument at some index is the id of a sound.
+ * \param l A Lua context.
+ * \param index An index in the stack.
+ * \return The sound id.
+ */
+std::string check_sound_id(lua_State* l, int index) {
+
+  const std::string& sound_id = LuaTools::check_string(l, index);
+  if (!Sound::exists(sound_id)) {
+    LuaTools::arg_error(l, index, std::string("No such sound: '") + sound_id + "'");
+  }
+  return sound_id;
+}
+
+}
+
 /**
  * Name of the Lua table representing the audio module.
  */
@@ -38,10 +57,16 @@ void LuaContext::register_audio_module() {
       { "set_sound_volume", audio_api_set_sound_volume },
       { "play_sound", audio_api_play_sound },
       { "preload_sounds", audio_api_preload_sounds },
+      { "get_sound_priority", audio_api_get_sound_priority },
+      { "set_sound_priority", audio_api_set_sound_priority },
+      { "get_sound_max_voices", audio_api_get_sound_max_voices },
+      { "set_sound_max_voices", audio_api_set_sound_max_voices },
+      { "get_sound_stats", audio_api_get_sound_stats },
       { "get_music_volume", audio_api_get_music_volume },
       { "set_music_volume", audio_api_set_music_volume },
       { "play_music", audio_api_play_music },
       { "stop_music", audio_api_stop_music },
+      { "preload_music", audio_api_preload_music },
       { "get_music", audio_api_get_music },
       { "get_music_format", audio_api_get_music_format },
       { "get_music_num_channels", audio_api_get_music_num_channels },
@@ -114,6 +139,107 @@ int LuaContext::audio_api_preload_sounds(lua_State* l) {
   });
 }
 
+/**
+ * \brief Implementation of sol.audio.get_sound_priority().
+ * \param l the Lua context that is calling this function
+ * \return number of values to return to Lua
+ */
+int LuaContext::audio_api_get_sound_priority(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    const std::string& sound_id = check_sound_id(l, 1);
+
+    lua_pushinteger(l, Sound::get_priority(sound_id));
+    return 1;
+  });
+}
+
+/**
+ * \brief Implementation of sol.audio.set_sound_priority().
+ * \param l the Lua context that is calling this function
+ * \return number of values to return to Lua
+ */
+int LuaContext::audio_api_set_sound_priority(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    const std::string& sound_id = check_sound_id(l, 1);
+    int priority = LuaTools::check_int(l, 2);
+
+    Sound::set_priority(sound_id, priority);
+
+    return 0;
+  });
+}
+
+/**
+ * \brief Implementation of sol.audio.get_sound_max_voices().
+ * \param l the Lua context that is calling this function
+ * \return number of values to return to Lua
+ */
+int LuaContext::audio_api_get_sound_max_voices(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    const std::string& sound_id = check_sound_id(l, 1);
+
+    const int max_voices = Sound::get_max_voices(sound_id);
+    if (max_voices == 0) {
+      lua_pushnil(l);
+    }
+    else {
+      lua_pushinteger(l, max_voices);
+    }
+    return 1;
+  });
+}
+
+/**
+ * \brief Implementation of sol.audio.set_sound_max_voices().
+ * \param l the Lua context that is calling this function
+ * \return number of values to return to Lua
+ */
+int LuaContext::audio_api_set_sound_max_voices(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    const std::string& sound_id = check_sound_id(l, 1);
+    int max_voices = 0;
+    if (!lua_isnil(l, 2)) {
+      max_voices = LuaTools::check_int(l, 2);
+      if (max_voices <= 0) {
+        LuaTools::arg_error(l, 2, "The maximum number of voices must be positive");
+      }
+    }
+
+    Sound::set_max_voices(sound_id, max_voices);
+
+    return 0;
+  });
+}
+
+/**
+ * \brief Implementation of sol.audio.get_sound_stats().
+ * \param l the Lua context that is calling this function
+ * \return number of values to return to Lua
+ */
+int LuaContext::audio_api_get_sound_stats(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    const Sound::VoiceStats& stats = Sound::get_voice_stats();
+
+    lua_newtable(l);
+    lua_pushinteger(l, stats.nb_sources);
+    lua_setfield(l, -2, "sources");
+    lua_pushinteger(l, stats.nb_active_voices);
+    lua_setfield(l, -2, "active_voices");
+    lua_pushinteger(l, stats.max_active_voices);
+    lua_setfield(l, -2, "max_active_voices");
+    lua_pushinteger(l, stats.nb_stolen_voices);
+    lua_setfield(l, -2, "stolen_voices");
+    lua_pushinteger(l, stats.nb_dropped_voices);
+    lua_setfield(l, -2, "dropped_voices");
+    return 1;
+  });
+}
+
 /**
  * \brief Implementation of sol.audio.get_music_volume().
  * \param l the Lua context that is calling this function
@@ -197,6 +323,31 @@ int LuaContext::audio_api_stop_music(lua_State* l) {
   });
 }
 
+/**
+ * \brief Implementation of sol.audio.preload_music().
+ * \param l the Lua context that is calling this function
+ * \return number of values to return to Lua
+ */
+int LuaContext::audio_api_preload_music(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    const std::string& music_id = LuaTools::opt_string(l, 1, "");
+    bool loop = LuaTools::opt_boolean(l, 2, true);
+
+    if (music_id.empty()) {
+      Music::preload(Music::none, loop);
+    }
+    else {
+      if (!Music::exists(music_id)) {
+        LuaTools::error(l, std::string("No such music: '") + music_id + "'");
+      }
+      Music::preload(music_id, loop);
+    }
+
+    return 0;
+  });
+}
+
 /**
  * \brief Implementation of sol.audio.get_music().
  * \param l The Lua context that is calling this function.
@@ -22,6 +22,7 @@
 #include "solarus/Drawable.h"
 #include "solarus/TransitionFade.h"
 #include <lua.hpp>
+#include <algorithm>
 
 /* This file contains common code for all drawable types known by Lua,
  * i.e. surfaces, text surfaces and sprites.
@@ -69,7 +70,7 @@ std::shared_ptr<Drawable> LuaContext::check_drawable(lua_State* l, int index) {
  */
 bool LuaContext::has_drawable(const std::shared_ptr<Drawable>& drawable) {
 
-  return drawables.find(drawable) != drawables.end();
+  return drawables_index.find(drawable.get()) != drawables_index.end();
 }
 
 /**
@@ -81,11 +82,18 @@ void LuaContext::add_drawable(const std::shared_ptr<Drawable>& drawable) {
   Debug::check_assertion(!has_drawable(drawable),
       "This drawable object is already registered");
 
-  drawables.insert(drawable);
+  if (drawables_to_remove.erase(drawable.get()) == 0) {
+    drawables.push_back(drawable);
+  }
+  drawables_index.insert(drawable.get());
 }
 
 /**
  * \brief Unregisters a drawable object created by this script.
+ *
+ * The drawable is removed from the list at the next cycle, because this
+ * can happen while the list is being traversed.
+ *
  * \param drawable a drawable object
  */
 void LuaContext::remove_drawable(const std::shared_ptr<Drawable>& drawable) {
@@ -93,7 +101,8 @@ void LuaContext::remove_drawable(const std::shared_ptr<Drawable>& drawable) {
   Debug::check_assertion(has_drawable(drawable),
       "This drawable object was not created by Lua");
 
-  drawables_to_remove.insert(drawable);
+  drawables_index.erase(drawable.get());
+  drawables_to_remove.insert(drawable.get());
 }
 
 /**
@@ -103,6 +112,7 @@ void LuaContext::remove_drawable(const std::shared_ptr<Drawable>& drawable) {
 void LuaContext::destroy_drawables() {
 
   drawables.clear();
+  drawables_index.clear();
   drawables_to_remove.clear();
 }
 
@@ -112,14 +122,25 @@ void LuaContext::destroy_drawables() {
 void LuaContext::update_drawables() {
 
   // Update all drawables.
-  for (const std::shared_ptr<Drawable>& drawable: drawables) {
-    if (has_drawable(drawable)) {
+  // Drawables created during the loop are appended and will be updated
+  // from the next cycle.
+  const size_t num_drawables = drawables.size();
+  for (size_t i = 0; i < num_drawables; ++i) {
+    Drawable* drawable = drawables[i].get();
+    if (drawables_to_remove.empty() ||
+        drawables_to_remove.find(drawable) == drawables_to_remove.end()) {
       drawable->update();
     }
   }
 
   // Remove the ones that should be removed.
-  drawables_to_remove.clear();
+  if (!drawables_to_remove.empty()) {
+    drawables.erase(std::remove_if(drawables.begin(), drawables.end(),
+        [&](const std::shared_ptr<Drawable>& drawable) {
+          return drawables_to_remove.find(drawable.get()) != drawables_to_remove.end();
+        }), drawables.end());
+    drawables_to_remove.clear();
+  }
 }
 
 /**
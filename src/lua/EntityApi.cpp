@@ -486,6 +486,11 @@ void LuaContext::register_entity_module() {
   register_type(get_entity_internal_type_name(EntityType::ARROW), nullptr, entity_common_methods, metamethods);
   register_type(get_entity_internal_type_name(EntityType::HOOKSHOT), nullptr, entity_common_methods, metamethods);
   register_type(get_entity_internal_type_name(EntityType::BOOMERANG), nullptr, entity_common_methods, metamethods);
+
+#ifdef LUAJIT_VERSION
+  // Faster versions of some methods.
+  register_entity_ffi_api();
+#endif
 }
 
 /**
@@ -0,0 +1,344 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/EntityTypeInfo.h"
+#include "solarus/entities/MapEntity.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/Geometry.h"
+#include "solarus/lowlevel/Rectangle.h"
+#include "solarus/lua/EntityFfiApi.h"
+#include "solarus/lua/ExportableToLuaPtr.h"
+#include "solarus/lua/LuaContext.h"
+#include "solarus/lua/LuaTools.h"
+#include <lua.hpp>
+#include <cstring>
+#include <string>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Lua code that replaces entity methods by FFI wrappers.
+ *
+ * Arguments of the chunk: a table whose keys are the metatables of all entity
+ * types, followed by the addresses of the C functions in the order of
+ * ffi_functions.
+ * Returns whether the wrappers were installed.
+ *
+ * Each wrapper first checks the metatable of its arguments, which the JIT
+ * compiler turns into a cheap guard.
+ * Anything unusual (wrong types, numbers given as strings, non-integer
+ * coordinates...) is forwarded to the original method so that error
+ * messages and conversions stay the same.
+ */
+const char* ffi_wrappers_source = R"lua(
+local entity_metatables,
+    get_position_address,
+    get_distance_address,
+    get_distance_to_entity_address,
+    get_direction4_to_address,
+    get_direction4_to_entity_address,
+    get_direction8_to_address,
+    get_direction8_to_entity_address,
+    overlaps_address,
+    overlaps_entity_address = ...
+
+local ffi_available, ffi = pcall(require, "ffi")
+if not ffi_available then
+  return false
+end
+
+local get_position_c = ffi.cast("void (*)(const void*, int*)", get_position_address)
+local get_distance_c = ffi.cast("int (*)(const void*, int, int)", get_distance_address)
+local get_distance_to_entity_c = ffi.cast("int (*)(const void*, const void*)", get_distance_to_entity_address)
+local get_direction4_to_c = ffi.cast("int (*)(const void*, int, int)", get_direction4_to_address)
+local get_direction4_to_entity_c = ffi.cast("int (*)(const void*, const void*)", get_direction4_to_entity_address)
+local get_direction8_to_c = ffi.cast("int (*)(const void*, int, int)", get_direction8_to_address)
+local get_direction8_to_entity_c = ffi.cast("int (*)(const void*, const void*)", get_direction8_to_entity_address)
+local overlaps_c = ffi.cast("int (*)(const void*, int, int, int, int)", overlaps_address)
+local overlaps_entity_c = ffi.cast("int (*)(const void*, const void*)", overlaps_entity_address)
+
+local xyz = ffi.new("int[3]")
+local getmetatable, type = getmetatable, type
+
+local function is_entity(value)
+  return type(value) == "userdata" and entity_metatables[getmetatable(value)] ~= nil
+end
+
+local function is_int(value)
+  return type(value) == "number" and value % 1 == 0
+end
+
+-- Wraps a method that takes either another entity or x, y.
+local function make_entity_or_xy_wrapper(classic, xy_c, entity_c)
+  return function(entity, x, y)
+    if is_entity(entity) then
+      if y == nil then
+        if is_entity(x) then
+          return entity_c(entity, x)
+        end
+      elseif type(x) == "number" and type(y) == "number" then
+        return xy_c(entity, x, y)
+      end
+    end
+    if y == nil then
+      return classic(entity, x)
+    end
+    return classic(entity, x, y)
+  end
+end
+
+for meta in pairs(entity_metatables) do
+
+  local classic_get_position = meta.get_position
+  meta.get_position = function(entity)
+    if is_entity(entity) then
+      get_position_c(entity, xyz)
+      return xyz[0], xyz[1], xyz[2]
+    end
+    return classic_get_position(entity)
+  end
+
+  meta.get_distance = make_entity_or_xy_wrapper(
+      meta.get_distance, get_distance_c, get_distance_to_entity_c)
+  meta.get_direction4_to = make_entity_or_xy_wrapper(
+      meta.get_direction4_to, get_direction4_to_c, get_direction4_to_entity_c)
+  meta.get_direction8_to = make_entity_or_xy_wrapper(
+      meta.get_direction8_to, get_direction8_to_c, get_direction8_to_entity_c)
+
+  local classic_overlaps = meta.overlaps
+  meta.overlaps = function(entity, x, y, width, height)
+    if is_entity(entity) then
+      if y == nil then
+        if is_entity(x) then
+          return overlaps_entity_c(entity, x) ~= 0
+        end
+      elseif is_int(x) and is_int(y) then
+        width = width or 1
+        height = height or 1
+        if is_int(width) and is_int(height) then
+          return overlaps_c(entity, x, y, width, height) ~= 0
+        end
+      end
+    end
+    return classic_overlaps(entity, x, y, width, height)
+  end
+end
+
+return true
+)lua";
+
+/**
+ * \brief Returns the entity corresponding to a handle given by the FFI.
+ * \param handle Address of the userdata of an entity.
+ * \return The entity.
+ */
+const Entity& get_entity(const void* handle) {
+
+  const ExportableToLuaPtr& userdata = *static_cast<const ExportableToLuaPtr*>(handle);
+  return static_cast<const Entity&>(*userdata);
+}
+
+/**
+ * \brief Converts an angle to a 4-direction like entity:get_direction4_to().
+ * \param angle An angle in radians.
+ * \return The direction between 0 and 3.
+ */
+int get_direction4(double angle) {
+
+  const int direction4 = (angle + Geometry::PI_OVER_4) / Geometry::PI_OVER_2;
+  return (direction4 + 4) % 4;
+}
+
+/**
+ * \brief Converts an angle to an 8-direction like entity:get_direction8_to().
+ * \param angle An angle in radians.
+ * \return The direction between 0 and 7.
+ */
+int get_direction8(double angle) {
+
+  const int direction8 = (angle + Geometry::PI_OVER_4 / 2) / Geometry::PI_OVER_4;
+  return (direction8 + 8) % 8;
+}
+
+}
+
+/**
+ * \brief Replaces some methods of entities by faster FFI wrappers.
+ *
+ * Does nothing if the LuaJIT FFI is not available.
+ * The original methods remain used for unusual arguments.
+ */
+void LuaContext::register_entity_ffi_api() {
+
+  using FfiFunction = void (*)();
+  static const FfiFunction ffi_functions[] = {
+      reinterpret_cast<FfiFunction>(&solarus_entity_get_position),
+      reinterpret_cast<FfiFunction>(&solarus_entity_get_distance),
+      reinterpret_cast<FfiFunction>(&solarus_entity_get_distance_to_entity),
+      reinterpret_cast<FfiFunction>(&solarus_entity_get_direction4_to),
+      reinterpret_cast<FfiFunction>(&solarus_entity_get_direction4_to_entity),
+      reinterpret_cast<FfiFunction>(&solarus_entity_get_direction8_to),
+      reinterpret_cast<FfiFunction>(&solarus_entity_get_direction8_to_entity),
+      reinterpret_cast<FfiFunction>(&solarus_entity_overlaps),
+      reinterpret_cast<FfiFunction>(&solarus_entity_overlaps_entity),
+  };
+
+                                  // --
+  if (luaL_loadbuffer(l, ffi_wrappers_source, std::strlen(ffi_wrappers_source),
+      "entity FFI wrappers") != 0) {
+    Debug::error(std::string("Failed to load entity FFI wrappers: ") + lua_tostring(l, -1));
+    lua_pop(l, 1);
+                                  // --
+    return;
+  }
+                                  // chunk
+  lua_newtable(l);
+                                  // chunk metatables
+  for (const auto& kvp: EntityTypeInfo::get_entity_type_names()) {
+    luaL_getmetatable(l, get_entity_internal_type_name(kvp.first).c_str());
+                                  // chunk metatables meta
+    lua_pushboolean(l, true);
+                                  // chunk metatables meta true
+    lua_rawset(l, -3);
+                                  // chunk metatables
+  }
+  for (const FfiFunction function: ffi_functions) {
+    lua_pushlightuserdata(l, reinterpret_cast<void*>(function));
+  }
+                                  // chunk metatables functions...
+  if (!LuaTools::call_function(l, 1 + sizeof(ffi_functions) / sizeof(FfiFunction), 1,
+      "entity FFI wrappers")) {
+                                  // --
+    return;
+  }
+                                  // installed
+  lua_pop(l, 1);
+                                  // --
+}
+
+}
+
+using namespace Solarus;
+
+/**
+ * \brief Gets the position and the layer of an entity.
+ * \param entity An entity handle.
+ * \param xyz Array of 3 integers where to write x, y and the layer.
+ */
+void solarus_entity_get_position(const void* entity, int* xyz) {
+
+  const Entity& e = get_entity(entity);
+  xyz[0] = e.get_x();
+  xyz[1] = e.get_y();
+  xyz[2] = e.get_layer();
+}
+
+/**
+ * \brief Returns the distance between the origin of an entity and a point.
+ * \param entity An entity handle.
+ * \param x X coordinate of the point.
+ * \param y Y coordinate of the point.
+ * \return The distance in pixels.
+ */
+int solarus_entity_get_distance(const void* entity, int x, int y) {
+
+  return get_entity(entity).get_distance(x, y);
+}
+
+/**
+ * \brief Returns the distance between the origins of two entities.
+ * \param entity An entity handle.
+ * \param other Another entity handle.
+ * \return The distance in pixels.
+ */
+int solarus_entity_get_distance_to_entity(const void* entity, const void* other) {
+
+  return get_entity(entity).get_distance(get_entity(other));
+}
+
+/**
+ * \brief Returns the 4-direction from an entity to a point.
+ * \param entity An entity handle.
+ * \param x X coordinate of the point.
+ * \param y Y coordinate of the point.
+ * \return The direction between 0 and 3.
+ */
+int solarus_entity_get_direction4_to(const void* entity, int x, int y) {
+
+  return get_direction4(get_entity(entity).get_angle(x, y));
+}
+
+/**
+ * \brief Returns the 4-direction from an entity to another one.
+ * \param entity An entity handle.
+ * \param other Another entity handle.
+ * \return The direction between 0 and 3.
+ */
+int solarus_entity_get_direction4_to_entity(const void* entity, const void* other) {
+
+  return get_direction4(get_entity(entity).get_angle(get_entity(other)));
+}
+
+/**
+ * \brief Returns the 8-direction from an entity to a point.
+ * \param entity An entity handle.
+ * \param x X coordinate of the point.
+ * \param y Y coordinate of the point.
+ * \return The direction between 0 and 7.
+ */
+int solarus_entity_get_direction8_to(const void* entity, int x, int y) {
+
+  return get_direction8(get_entity(entity).get_angle(x, y));
+}
+
+/**
+ * \brief Returns the 8-direction from an entity to another one.
+ * \param entity An entity handle.
+ * \param other Another entity handle.
+ * \return The direction between 0 and 7.
+ */
+int solarus_entity_get_direction8_to_entity(const void* entity, const void* other) {
+
+  return get_direction8(get_entity(entity).get_angle(get_entity(other)));
+}
+
+/**
+ * \brief Returns whether the bounding box of an entity overlaps a rectangle.
+ * \param entity An entity handle.
+ * \param x X coordinate of the rectangle.
+ * \param y Y coordinate of the rectangle.
+ * \param width Width of the rectangle.
+ * \param height Height of the rectangle.
+ * \return 1 if they overlap, 0 otherwise.
+ */
+int solarus_entity_overlaps(const void* entity, int x, int y, int width, int height) {
+
+  return get_entity(entity).overlaps(Rectangle(x, y, width, height)) ? 1 : 0;
+}
+
+/**
+ * \brief Returns whether the bounding boxes of two entities overlap.
+ * \param entity An entity handle.
+ * \param other Another entity handle.
+ * \return 1 if they overlap, 0 otherwise.
+ */
+int solarus_entity_overlaps_entity(const void* entity, const void* other) {
+
+  return get_entity(entity).overlaps(get_entity(other)) ? 1 : 0;
+}
+
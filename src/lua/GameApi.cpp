@@ -15,6 +15,7 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/FileWriter.h"
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lua/LuaContext.h"
 #include "solarus/lua/LuaTools.h"
@@ -34,6 +35,57 @@ namespace Solarus {
  */
 const std::string LuaContext::game_module_name = "sol.game";
 
+namespace {
+
+/**
+ * \brief Checks that a value is a valid savegame variable name and returns
+ * its key.
+ *
+ * Keys are cached in a registry table indexed by the Lua string, so a name
+ * already seen is neither validated nor hashed again:
+ * Lua strings are interned and their hash is already known.
+ *
+ * \param l A Lua context.
+ * \param index An index in the stack.
+ * \return The savegame key of this name.
+ */
+Savegame::Key check_savegame_key(lua_State* l, int index) {
+
+  index = LuaTools::get_positive_index(l, index);
+  lua_getfield(l, LUA_REGISTRYINDEX, "sol.savegame_keys");
+                                  // ... keys
+  lua_pushvalue(l, index);
+                                  // ... keys name
+  lua_rawget(l, -2);
+                                  // ... keys key_index/nil
+  if (lua_isnumber(l, -1)) {
+    const int key_index = static_cast<int>(lua_tointeger(l, -1));
+    lua_pop(l, 2);
+    return Savegame::Key::from_index(key_index);
+  }
+  lua_pop(l, 1);
+                                  // ... keys
+
+  const std::string& name = LuaTools::check_string(l, index);
+  if (!LuaTools::is_valid_lua_identifier(name)) {
+    LuaTools::arg_error(l, index,
+        std::string("Invalid savegame variable '") + name
+        + "': the name should only contain alphanumeric characters or '_'"
+        + " and cannot start with a digit");
+  }
+
+  const Savegame::Key key(name);
+  lua_pushvalue(l, index);
+  lua_pushinteger(l, key.get_index());
+                                  // ... keys name key_index
+  lua_rawset(l, -3);
+                                  // ... keys
+  lua_pop(l, 1);
+  return key;
+}
+
+}
+
 /**
  * \brief Initializes the game features provided to Lua.
  */
@@ -116,6 +168,10 @@ void LuaContext::register_game_module() {
   };
 
   register_type(game_module_name, functions, methods, metamethods);
+
+  // Cache of savegame keys used from Lua.
+  lua_newtable(l);
+  lua_setfield(l, LUA_REGISTRYINDEX, "sol.savegame_keys");
 }
 
 /**
@@ -164,6 +220,7 @@ int LuaContext::game_api_exists(lua_State* l) {
       LuaTools::error(l, "Cannot check savegame: no write directory was specified in quest.dat");
     }
 
+    FileWriter::flush();
     bool exists = QuestFiles::data_file_exists(file_name);
 
     lua_pushboolean(l, exists);
@@ -185,6 +242,7 @@ int LuaContext::game_api_delete(lua_State* l) {
       LuaTools::error(l, "Cannot delete savegame: no write directory was specified in quest.dat");
     }
 
+    FileWriter::flush();
     QuestFiles::data_file_delete(file_name);
 
     return 0;
@@ -229,7 +287,20 @@ int LuaContext::game_api_save(lua_State* l) {
       LuaTools::error(l, "Cannot save game: no write directory was specified in quest.dat");
     }
 
-    savegame.save();
+    const ScopedLuaRef& callback_ref = LuaTools::opt_function(l, 2);
+
+    if (callback_ref.is_empty()) {
+      savegame.save();
+    }
+    else {
+      // Called from the main thread once the file is written.
+      savegame.save([callback_ref](bool success) {
+        lua_State* l = callback_ref.get_lua_state();
+        callback_ref.push();
+        lua_pushboolean(l, success);
+        LuaTools::call_function(l, 1, 0, "game save callback");
+      });
+    }
 
     return 0;
   });
@@ -593,14 +664,7 @@ int LuaContext::game_api_get_value(lua_State* l) {
 
   return LuaTools::exception_boundary_handle(l, [&] {
     Savegame& savegame = *check_game(l, 1);
-    const std::string& key = LuaTools::check_string(l, 2);
-
-    if (!LuaTools::is_valid_lua_identifier(key)) {
-      LuaTools::arg_error(l, 3,
-          std::string("Invalid savegame variable '") + key
-          + "': the name should only contain alphanumeric characters or '_'"
-          + " and cannot start with a digit");
-    }
+    const Savegame::Key& key = check_savegame_key(l, 2);
 
     if (savegame.is_boolean(key)) {
       lua_pushboolean(l, savegame.get_boolean(key));
@@ -628,21 +692,14 @@ int LuaContext::game_api_set_value(lua_State* l) {
 
   return LuaTools::exception_boundary_handle(l, [&] {
     Savegame& savegame = *check_game(l, 1);
-    const std::string& key = LuaTools::check_string(l, 2);
+    const Savegame::Key& key = check_savegame_key(l, 2);
 
-    if (key[0] == '_') {
+    if (key.get_name()[0] == '_') {
       LuaTools::arg_error(l, 3,
-          std::string("Invalid savegame variable '") + key
+          std::string("Invalid savegame variable '") + key.get_name()
           + "': names prefixed by '_' are reserved for built-in variables");
     }
 
-    if (!LuaTools::is_valid_lua_identifier(key)) {
-      LuaTools::arg_error(l, 3,
-          std::string("Invalid savegame variable '") + key
-          + "': the name should only contain alphanumeric characters or '_'"
-          + " and cannot start with a digit");
-    }
-
     switch (lua_type(l, 3)) {
 
     case LUA_TBOOLEAN:
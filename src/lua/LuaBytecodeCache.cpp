@@ -0,0 +1,410 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/lua/LuaBytecodeCache.h"
+#include "solarus/Arguments.h"
+#include <lua.hpp>
+#include <cstring>
+#include <sstream>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Directory of the quest write directory where bytecode is saved.
+ */
+const std::string cache_directory = "lua_cache";
+
+/**
+ * \brief First line of bytecode files saved on disk.
+ */
+const std::string cache_file_magic = "SOLARUS_LUAC";
+
+/**
+ * \brief Identifies the virtual machine that produced some bytecode.
+ *
+ * Bytecode is not portable between Lua implementations, so files
+ * saved by another one are ignored.
+ */
+#ifdef LUAJIT_VERSION
+const std::string vm_name = LUAJIT_VERSION;
+#else
+const std::string vm_name = LUA_RELEASE;
+#endif
+
+/**
+ * \brief lua_Writer that appends a dumped chunk to an std::string.
+ * \param l The Lua state.
+ * \param data The bytes to write.
+ * \param size Number of bytes to write.
+ * \param userdata The std::string to write to.
+ * \return 0 (success).
+ */
+int write_chunk(lua_State* /* l */, const void* data, size_t size, void* userdata) {
+
+  std::string* bytecode = static_cast<std::string*>(userdata);
+  bytecode->append(static_cast<const char*>(data), size);
+  return 0;
+}
+
+}
+
+LuaBytecodeCache::Mode LuaBytecodeCache::mode = LuaBytecodeCache::Mode::MEMORY;
+std::map<std::string, LuaBytecodeCache::Entry> LuaBytecodeCache::entries;
+std::atomic<int> LuaBytecodeCache::num_hits(0);
+std::atomic<int> LuaBytecodeCache::num_misses(0);
+std::mutex LuaBytecodeCache::mutex;
+
+/**
+ * \brief Initializes the bytecode cache.
+ *
+ * The option -lua-bytecode-cache=no|memory|disk sets the mode
+ * (default memory).
+ *
+ * \param args Command-line arguments.
+ */
+void LuaBytecodeCache::initialize(const Arguments& args) {
+
+  const std::string& mode_name = args.get_argument_value("-lua-bytecode-cache");
+  if (mode_name == "no") {
+    mode = Mode::DISABLED;
+  }
+  else if (mode_name == "disk") {
+    mode = Mode::DISK;
+  }
+  else {
+    mode = Mode::MEMORY;
+  }
+}
+
+/**
+ * \brief Frees all compiled chunks.
+ */
+void LuaBytecodeCache::quit() {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  entries.clear();
+  num_hits = 0;
+  num_misses = 0;
+}
+
+/**
+ * \brief Returns the current caching policy.
+ * \return The mode.
+ */
+LuaBytecodeCache::Mode LuaBytecodeCache::get_mode() {
+  return mode;
+}
+
+/**
+ * \brief Sets the caching policy.
+ *
+ * Chunks already cached in memory are forgotten if the cache is disabled.
+ *
+ * \param mode The new mode.
+ */
+void LuaBytecodeCache::set_mode(Mode mode) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  LuaBytecodeCache::mode = mode;
+  if (mode == Mode::DISABLED) {
+    entries.clear();
+  }
+}
+
+/**
+ * \brief Returns whether a buffer contains a precompiled Lua chunk.
+ * \param buffer The content of a file.
+ * \return \c true if this is bytecode rather than Lua source.
+ */
+bool LuaBytecodeCache::is_bytecode(const std::string& buffer) {
+  return is_bytecode(buffer.data(), buffer.size());
+}
+
+/**
+ * \brief Returns whether a memory area contains a precompiled Lua chunk.
+ * \param buffer The content of a file.
+ * \param size Size of the buffer in bytes.
+ * \return \c true if this is bytecode rather than Lua source.
+ */
+bool LuaBytecodeCache::is_bytecode(const char* buffer, size_t size) {
+
+  // Both Lua and LuaJIT binary chunks start with the escape character.
+  return size > 0 && buffer[0] == '\033';
+}
+
+/**
+ * \brief Loads a Lua chunk, using compiled bytecode when possible.
+ *
+ * This is equivalent to luaL_loadbuffer(): in case of success, the compiled
+ * chunk is left on top of the stack as a function,
+ * otherwise the error message is left on top of the stack.
+ *
+ * \param l The Lua state where to load the chunk.
+ * \param buffer Lua source or bytecode to load.
+ * \param chunk_name Name of the file the chunk comes from, relative to the
+ * quest data directory. It identifies the chunk in the cache and is used in
+ * error messages.
+ * \return 0 in case of success, or a Lua error code.
+ */
+int LuaBytecodeCache::load_buffer(
+    lua_State* l,
+    const std::string& buffer,
+    const std::string& chunk_name
+) {
+  return load_buffer(l, buffer.data(), buffer.size(), chunk_name);
+}
+
+/**
+ * \brief Loads a Lua chunk from a memory area, using compiled bytecode when
+ * possible.
+ *
+ * Same as the other version, without requiring the source to be copied
+ * into a string.
+ *
+ * \param l The Lua state where to load the chunk.
+ * \param buffer Lua source or bytecode to load.
+ * \param size Size of the buffer in bytes.
+ * \param chunk_name Name of the file the chunk comes from.
+ * \return 0 in case of success, or a Lua error code.
+ */
+int LuaBytecodeCache::load_buffer(
+    lua_State* l,
+    const char* buffer,
+    size_t size,
+    const std::string& chunk_name
+) {
+  Mode current_mode = Mode::DISABLED;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    current_mode = mode;
+  }
+  if (current_mode == Mode::DISABLED || is_bytecode(buffer, size)) {
+    return luaL_loadbuffer(l, buffer, size, chunk_name.c_str());
+  }
+
+  const uint64_t source_hash = compute_hash(buffer, size);
+
+  // Try the memory cache.
+  std::shared_ptr<const std::string> cached_bytecode;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto& it = entries.find(chunk_name);
+    if (it != entries.end() && it->second.source_hash == source_hash) {
+      cached_bytecode = it->second.bytecode;
+    }
+  }
+
+  if (cached_bytecode != nullptr) {
+    const std::string& bytecode = *cached_bytecode;
+    if (luaL_loadbuffer(l, bytecode.data(), bytecode.size(), chunk_name.c_str()) == 0) {
+      ++num_hits;
+      return 0;
+    }
+    // Should not happen, but compiling the source again is always possible.
+    lua_pop(l, 1);
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto& it = entries.find(chunk_name);
+    if (it != entries.end() && it->second.bytecode == cached_bytecode) {
+      entries.erase(it);
+    }
+  }
+  else if (current_mode == Mode::DISK) {
+    // Try the bytecode saved by a previous execution.
+    std::string bytecode;
+    if (load_from_disk(chunk_name, source_hash, bytecode)) {
+      if (luaL_loadbuffer(l, bytecode.data(), bytecode.size(), chunk_name.c_str()) == 0) {
+        Entry entry;
+        entry.source_hash = source_hash;
+        entry.bytecode = std::make_shared<const std::string>(std::move(bytecode));
+        insert_entry(chunk_name, entry);
+        ++num_hits;
+        return 0;
+      }
+      // Bytecode from an incompatible build: it will be overwritten.
+      lua_pop(l, 1);
+    }
+  }
+
+  // Compile the source.
+  ++num_misses;
+  const int result = luaL_loadbuffer(l, buffer, size, chunk_name.c_str());
+  if (result != 0) {
+    return result;
+  }
+
+  std::string bytecode;
+  if (lua_dump(l, write_chunk, &bytecode) != 0 ||
+      bytecode.empty()) {
+    // Not fatal: the chunk just won't be cached.
+    return 0;
+  }
+
+  Entry entry;
+  entry.source_hash = source_hash;
+  entry.bytecode = std::make_shared<const std::string>(std::move(bytecode));
+  if (insert_entry(chunk_name, entry) && current_mode == Mode::DISK) {
+    save_to_disk(chunk_name, entry);
+  }
+  return 0;
+}
+
+/**
+ * \brief Adds a compiled chunk to the memory cache.
+ *
+ * If another thread has already cached the same source meanwhile,
+ * its entry is kept and nothing is done.
+ *
+ * \param chunk_name Name of the chunk.
+ * \param entry The compiled chunk.
+ * \return \c true if the entry was inserted.
+ */
+bool LuaBytecodeCache::insert_entry(
+    const std::string& chunk_name,
+    const Entry& entry
+) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (mode == Mode::DISABLED) {
+    // The cache was disabled meanwhile.
+    return false;
+  }
+
+  const auto& result = entries.insert(std::make_pair(chunk_name, entry));
+  if (result.second) {
+    return true;
+  }
+
+  Entry& existing_entry = result.first->second;
+  if (existing_entry.source_hash == entry.source_hash) {
+    // Same source compiled by another thread: keep the first one.
+    return false;
+  }
+
+  // The source has changed since the existing entry was compiled.
+  existing_entry = entry;
+  return true;
+}
+
+/**
+ * \brief Returns the number of chunks that were loaded from bytecode.
+ * \return The number of cache hits since the initialization.
+ */
+int LuaBytecodeCache::get_num_hits() {
+  return num_hits;
+}
+
+/**
+ * \brief Returns the number of chunks that had to be compiled.
+ * \return The number of cache misses since the initialization.
+ */
+int LuaBytecodeCache::get_num_misses() {
+  return num_misses;
+}
+
+/**
+ * \brief Computes a 64-bit FNV-1a hash of a source buffer.
+ * \param buffer The buffer to hash.
+ * \param size Size of the buffer in bytes.
+ * \return The hash.
+ */
+uint64_t LuaBytecodeCache::compute_hash(const char* buffer, size_t size) {
+
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < size; ++i) {
+    hash ^= static_cast<unsigned char>(buffer[i]);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+/**
+ * \brief Returns the file where the bytecode of a chunk is saved.
+ * \param chunk_name Name of the chunk.
+ * \return The corresponding file name, relative to the quest write directory.
+ */
+std::string LuaBytecodeCache::get_disk_file_name(const std::string& chunk_name) {
+  return cache_directory + "/" + chunk_name + ".luac";
+}
+
+/**
+ * \brief Reads the bytecode of a chunk from the quest write directory.
+ * \param[in] chunk_name Name of the chunk.
+ * \param[in] source_hash Hash of the current source of the chunk.
+ * \param[out] bytecode The bytecode read.
+ * \return \c true if up-to-date bytecode was found.
+ */
+bool LuaBytecodeCache::load_from_disk(
+    const std::string& chunk_name,
+    uint64_t source_hash,
+    std::string& bytecode
+) {
+  if (QuestFiles::get_quest_write_dir().empty()) {
+    return false;
+  }
+
+  const std::string& file_name = get_disk_file_name(chunk_name);
+  if (!QuestFiles::data_file_exists(file_name)) {
+    return false;
+  }
+
+  std::ostringstream oss;
+  oss << cache_file_magic << '\n' << vm_name << '\n'
+      << std::hex << source_hash << '\n';
+  const std::string& header = oss.str();
+
+  std::string content = QuestFiles::data_file_read(file_name);
+  if (content.compare(0, header.size(), header) != 0) {
+    // Older source or other virtual machine.
+    return false;
+  }
+
+  bytecode = content.substr(header.size());
+  return !bytecode.empty();
+}
+
+/**
+ * \brief Saves the bytecode of a chunk into the quest write directory.
+ * \param chunk_name Name of the chunk.
+ * \param entry The compiled chunk to save.
+ */
+void LuaBytecodeCache::save_to_disk(
+    const std::string& chunk_name,
+    const Entry& entry
+) {
+  if (QuestFiles::get_quest_write_dir().empty()) {
+    return;
+  }
+
+  const std::string& file_name = get_disk_file_name(chunk_name);
+  const size_t last_slash = file_name.rfind('/');
+  if (!QuestFiles::data_file_mkdir(file_name.substr(0, last_slash))) {
+    Debug::warning(std::string("Cannot create the Lua bytecode cache directory for '")
+        + chunk_name + "'");
+    return;
+  }
+
+  std::ostringstream oss;
+  oss << cache_file_magic << '\n' << vm_name << '\n'
+      << std::hex << entry.source_hash << '\n';
+  oss.write(entry.bytecode->data(), entry.bytecode->size());
+  QuestFiles::data_file_save(file_name, oss.str());
+}
+
+}
+
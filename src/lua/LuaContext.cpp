@@ -28,9 +28,12 @@
 #include "solarus/entities/Switch.h"
 #include "solarus/entities/Tileset.h"
 #include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/FileWriter.h"
 #include "solarus/lowlevel/QuestFiles.h"
 #include "solarus/lua/ExportableToLuaPtr.h"
+#include "solarus/lua/LuaBytecodeCache.h"
 #include "solarus/lua/LuaContext.h"
+#include "solarus/lua/LuaProfiler.h"
 #include "solarus/lua/LuaTools.h"
 #include "solarus/AbilityInfo.h"
 #include "solarus/Equipment.h"
@@ -171,10 +174,16 @@ void LuaContext::exit() {
     // Call sol.main.on_finished() if it exists.
     main_on_finished();
 
+    // Finish writing files while their callbacks can still use Lua.
+    FileWriter::finish();
+
     // Destroy unfinished objects.
     destroy_menus();
     destroy_timers();
     destroy_drawables();
+    destroy_movements();
+    destroy_threads();
+    profiler = nullptr;
 
     // Finalize Lua.
     lua_close(l);
@@ -200,6 +209,7 @@ void LuaContext::update() {
   update_movements();
   update_menus();
   update_timers();
+  update_threads();
 
   // Call sol.main.on_update().
   main_on_update();
@@ -677,8 +687,8 @@ bool LuaContext::load_file_if_exists(lua_State* l, const std::string& script_nam
 
   if (QuestFiles::data_file_exists(file_name)) {
     // Load the file.
-    const std::string& buffer = QuestFiles::data_file_read(file_name);
-    int result = luaL_loadbuffer(l, buffer.data(), buffer.size(), file_name.c_str());
+    const DataFileViewPtr& buffer = QuestFiles::data_file_read_view(file_name);
+    int result = LuaBytecodeCache::load_buffer(l, buffer->data(), buffer->size(), file_name);
 
     if (result != 0) {
       Debug::error(std::string("Failed to load script '")
@@ -828,6 +838,37 @@ void LuaContext::register_functions(
   // create a table and fill it with the functions
   luaL_register(l, module_name.c_str(), functions);
   lua_pop(l, 1);
+
+  register_api_function_names(module_name, functions, ".");
+}
+
+/**
+ * \brief Remembers the names of C++ functions exported to Lua.
+ *
+ * This is only used to make profiling reports readable.
+ * A function shared by several types keeps the name it was first
+ * registered with.
+ *
+ * \param module_name Name of the module or type (e.g. "sol.main").
+ * \param functions List of functions or nullptr.
+ * Must end with {nullptr, nullptr}.
+ * \param separator Separator between the module name and the function name.
+ */
+void LuaContext::register_api_function_names(
+    const std::string& module_name,
+    const luaL_Reg* functions,
+    const std::string& separator
+) {
+  if (functions == nullptr) {
+    return;
+  }
+
+  for (const luaL_Reg* function = functions; function->name != nullptr; ++function) {
+    api_function_names.insert(std::make_pair(
+        function->func,
+        module_name + separator + function->name
+    ));
+  }
 }
 
 /**
@@ -893,6 +934,10 @@ void LuaContext::register_type(
                                   // meta
   }
 
+  register_api_function_names(module_name, functions, ".");
+  register_api_function_names(module_name, methods, ":");
+  register_api_function_names(module_name, metamethods, ":");
+
   // make metatable.__index = metatable,
   // unless if __index is already defined
   lua_getfield(l, -1, "__index");
@@ -922,6 +967,7 @@ void LuaContext::register_modules() {
   register_entity_module();
   register_audio_module();
   register_timer_module();
+  register_thread_module();
   register_surface_module();
   register_text_surface_module();
   register_sprite_module();
@@ -15,11 +15,12 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/FileWriter.h"
 #include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/lua/LuaBytecodeCache.h"
 #include "solarus/lua/LuaData.h"
+#include "solarus/CurrentQuest.h"
 #include <lua.hpp>
-#include <cstdio>
-#include <fstream>
 #include <ostream>
 #include <sstream>
 
@@ -28,16 +29,41 @@ namespace Solarus {
 /**
  * \brief Imports a Lua data file from memory to this object.
  * \param[in] buffer A memory area with the content of a data file
- * encoded in UTF-8.
+ * encoded in UTF-8, or its precompiled bytecode.
+ * \param[in] file_name Name of the quest file the buffer comes from,
+ * relative to the quest data directory, or an empty string.
+ * When set, the compiled chunk is kept in the Lua bytecode cache.
  * \return \c true in case of success, \c false if the file could not be loaded.
  */
-bool LuaData::import_from_buffer(const std::string& buffer) {
+bool LuaData::import_from_buffer(
+    const std::string& buffer,
+    const std::string& file_name
+) {
+  return import_from_memory(buffer.data(), buffer.size(), file_name);
+}
 
+/**
+ * \brief Imports a Lua data file from a memory area to this object.
+ * \param[in] buffer A memory area with the content of a data file
+ * encoded in UTF-8, or its precompiled bytecode.
+ * \param[in] size Size of the memory area in bytes.
+ * \param[in] file_name Name of the quest file the buffer comes from,
+ * or an empty string.
+ * \return \c true in case of success, \c false if the file could not be loaded.
+ */
+bool LuaData::import_from_memory(
+    const char* buffer,
+    size_t size,
+    const std::string& file_name
+) {
   // Read the file.
   lua_State* l = luaL_newstate();
-  if (luaL_loadbuffer(l, buffer.data(), buffer.size(), "data file") != 0) {
+  const int load_result = file_name.empty() ?
+      luaL_loadbuffer(l, buffer, size, "data file") :
+      LuaBytecodeCache::load_buffer(l, buffer, size, file_name);
+  if (load_result != 0) {
     Debug::error(std::string("Failed to load data file: ") + lua_tostring(l, -1));
-    lua_pop(l, 1);
+    lua_close(l);
     return false;
   }
 
@@ -89,15 +115,60 @@ bool LuaData::import_from_quest_file(
     const std::string& quest_file_name,
     bool language_specific
 ) {
+  if (!language_specific && import_from_compiled_quest_file(quest_file_name)) {
+    return true;
+  }
+
   if (!QuestFiles::data_file_exists(quest_file_name, language_specific)) {
     Debug::error(std::string("Cannot find quest file '") + quest_file_name + "'");
     return false;
   }
 
-  const std::string& buffer = QuestFiles::data_file_read(
+  const DataFileViewPtr& buffer = QuestFiles::data_file_read_view(
       quest_file_name, language_specific
   );
-  return import_from_buffer(buffer);
+  const std::string& file_name = language_specific ?
+      "languages/" + CurrentQuest::get_language() + "/" + quest_file_name :
+      quest_file_name;
+  return import_from_memory(buffer->data(), buffer->size(), file_name);
+}
+
+/**
+ * \brief Imports the compiled version of a quest file if it is up-to-date.
+ * \param quest_file_name Path of the text file, relative to the quest
+ * data path.
+ * \return \c true in case of success, \c false if there is no compiled
+ * file, if it is older than the text file or if it is invalid.
+ */
+bool LuaData::import_from_compiled_quest_file(const std::string& quest_file_name) {
+
+  const std::string& compiled_file_name = get_compiled_file_name(quest_file_name);
+  if (!QuestFiles::data_file_exists(compiled_file_name)) {
+    return false;
+  }
+
+  // The text file is the reference: ignore the compiled one if it is older.
+  if (QuestFiles::data_file_exists(quest_file_name) &&
+      QuestFiles::data_file_get_modification_date(compiled_file_name) <
+      QuestFiles::data_file_get_modification_date(quest_file_name)) {
+    return false;
+  }
+
+  const DataFileViewPtr& buffer = QuestFiles::data_file_read_view(compiled_file_name);
+  if (!import_from_binary(buffer->data(), buffer->size())) {
+    Debug::warning("Ignoring invalid compiled data file '" + compiled_file_name + "'");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * \brief Returns the name of the compiled version of a data file.
+ * \param quest_file_name A text data file, relative to the quest data path.
+ * \return The corresponding binary file name.
+ */
+std::string LuaData::get_compiled_file_name(const std::string& quest_file_name) {
+  return quest_file_name + ".bin";
 }
 
 /**
@@ -127,34 +198,29 @@ bool LuaData::export_to_buffer(std::string& buffer) const {
  */
 bool LuaData::export_to_file(const std::string& file_name) const {
 
-  // Work on a temporary file to keep the initial one intact in case of failure.
-  std::string tmp_file_name = file_name + ".solarus_tmp";
-  std::ofstream tmp_out(tmp_file_name);
-  if (!tmp_out) {
+  std::ostringstream oss;
+  if (!export_to_lua(oss)) {
     return false;
   }
 
-  if (!export_to_lua(tmp_out)) {
-    std::remove(tmp_file_name.c_str());
-    return false;
-  }
-  tmp_out.flush();
-  tmp_out.close();
+  // The writer keeps the initial file intact in case of failure.
+  return FileWriter::write(file_name, oss.str());
+}
 
-  std::ifstream in(tmp_file_name);
-  if (!in) {
-    return false;
-  }
-  std::ofstream out(file_name);
-  if (!out) {
+/**
+ * \brief Saves the data into a binary file.
+ * \param[in] file_name Path of the file to save.
+ * \return \c true in case of success, \c false if the data
+ * could not be exported.
+ */
+bool LuaData::export_to_binary_file(const std::string& file_name) const {
+
+  std::string buffer;
+  if (!export_to_binary(buffer)) {
     return false;
   }
-  out << in.rdbuf();
 
-  in.close();
-  std::remove(tmp_file_name.c_str());
-  out.flush();
-  return true;
+  return FileWriter::write(file_name, buffer);
 }
 
 /**
@@ -177,4 +243,32 @@ bool LuaData::export_to_lua(std::ostream& /* out */) const {
   return false;
 }
 
+/**
+ * \brief Loads data from a binary data file.
+ *
+ * The object is left unchanged in case of failure.
+ *
+ * \param buffer Content of the binary file.
+ * \param size Size of the buffer in bytes.
+ * \return \c true in case of success, \c false if the buffer is not a valid
+ * binary file for this kind of data.
+ */
+bool LuaData::import_from_binary(const char* /* buffer */, size_t /* size */) {
+
+  // Binary files are optional. Not supported by default.
+  return false;
+}
+
+/**
+ * \brief Saves this data into a binary data file.
+ * \param[out] buffer The binary file content.
+ * \return \c true in case of success, \c false if the data
+ * could not be exported.
+ */
+bool LuaData::export_to_binary(std::string& /* buffer */) const {
+
+  // Binary files are optional. Not supported by default.
+  return false;
+}
+
 }
@@ -0,0 +1,545 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lua/LuaProfiler.h"
+#include <lua.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+namespace Solarus {
+
+LuaProfiler* LuaProfiler::running_profiler = nullptr;
+
+namespace {
+
+/**
+ * \brief Returns a readable name of a function being executed.
+ * \param ar Debug information with at least the "S" and "n" fields.
+ * \return The function name.
+ */
+std::string get_function_name(const lua_Debug& ar) {
+
+  if (ar.name != nullptr) {
+    return ar.name;
+  }
+
+  if (std::string(ar.what) == "main") {
+    return "main chunk";
+  }
+
+  if (std::string(ar.what) == "C") {
+    return "?";
+  }
+
+  std::ostringstream oss;
+  oss << "function <" << ar.short_src << ":" << ar.linedefined << ">";
+  return oss.str();
+}
+
+/**
+ * \brief Escapes a string to be written in a JSON document.
+ * \param text The string to escape.
+ * \return The escaped string, with surrounding quotes.
+ */
+std::string json_string(const std::string& text) {
+
+  std::ostringstream oss;
+  oss << '"';
+  for (const char c: text) {
+    switch (c) {
+
+    case '"':
+      oss << "\\\"";
+      break;
+
+    case '\\':
+      oss << "\\\\";
+      break;
+
+    case '\n':
+      oss << "\\n";
+      break;
+
+    case '\t':
+      oss << "\\t";
+      break;
+
+    default:
+      if (static_cast<unsigned char>(c) < 0x20) {
+        oss << "\\u" << std::hex << std::setw(4) << std::setfill('0')
+            << static_cast<int>(c) << std::dec;
+      }
+      else {
+        oss << c;
+      }
+      break;
+    }
+  }
+  oss << '"';
+  return oss.str();
+}
+
+/**
+ * \brief Returns the elements of a map sorted by decreasing value.
+ * \param elements The map to sort.
+ * \param get_value Returns the value to compare of an element.
+ * \return The elements in decreasing order.
+ */
+template<typename Map, typename GetValue>
+std::vector<typename Map::const_iterator> sort_by_decreasing(
+    const Map& elements,
+    GetValue get_value
+) {
+  std::vector<typename Map::const_iterator> sorted;
+  sorted.reserve(elements.size());
+  for (auto it = elements.begin(); it != elements.end(); ++it) {
+    sorted.push_back(it);
+  }
+  std::stable_sort(sorted.begin(), sorted.end(),
+      [&](const typename Map::const_iterator& lhs, const typename Map::const_iterator& rhs) {
+    return get_value(*lhs) > get_value(*rhs);
+  });
+  return sorted;
+}
+
+}
+
+/**
+ * \brief Creates a profiler for a Lua state.
+ *
+ * The profiler is initially stopped.
+ *
+ * \param l The Lua state to profile.
+ * \param api_function_names Name of each C++ function exported to Lua.
+ * The map must live as long as the profiler.
+ */
+LuaProfiler::LuaProfiler(
+    lua_State* l,
+    const std::map<lua_CFunction, std::string>& api_function_names
+):
+  l(l),
+  api_function_names(api_function_names),
+  running(false),
+  callgraph_depth(0),
+  lua_nesting(0),
+  last_event_date(),
+  current_location(),
+  current_function(),
+  current_stack(),
+  total_time(0) {
+
+}
+
+/**
+ * \brief Destroys the profiler, removing its hooks if they are installed.
+ */
+LuaProfiler::~LuaProfiler() {
+
+  if (running) {
+    stop();
+  }
+}
+
+/**
+ * \brief Clears previous results and starts profiling.
+ *
+ * This function is supposed to be called from Lua code
+ * (sol.main.start_profiler()).
+ *
+ * \param sample_interval Number of Lua instructions between two samples of
+ * the current line, or 0 to only track function calls.
+ * \param callgraph_depth Maximum number of stack levels to record for the
+ * callgraph, or 0 to disable the callgraph.
+ */
+void LuaProfiler::start(int sample_interval, int callgraph_depth) {
+
+  if (running_profiler != nullptr) {
+    running_profiler->stop();
+  }
+
+  this->callgraph_depth = callgraph_depth;
+  total_time = 0;
+  locations.clear();
+  stacks.clear();
+  api_calls.clear();
+  current_location.clear();
+  current_function.clear();
+  current_stack.clear();
+
+  // We are called from Lua: the calling function is at level 1.
+  lua_nesting = 1;
+  lua_Debug ar;
+  if (lua_getstack(l, 1, &ar) && lua_getinfo(l, "Snl", &ar)) {
+    set_current_location(l, ar, true);
+  }
+
+  int mask = LUA_MASKCALL | LUA_MASKRET;
+  if (sample_interval > 0) {
+    mask |= LUA_MASKCOUNT;
+  }
+  lua_sethook(l, hook, mask, sample_interval);
+
+  running = true;
+  running_profiler = this;
+  last_event_date = Clock::now();
+}
+
+/**
+ * \brief Stops profiling.
+ *
+ * Results are kept until the next call to start().
+ */
+void LuaProfiler::stop() {
+
+  if (!running) {
+    return;
+  }
+
+  add_elapsed_time();
+  lua_sethook(l, nullptr, 0, 0);
+  current_location.clear();
+  running = false;
+  if (running_profiler == this) {
+    running_profiler = nullptr;
+  }
+}
+
+/**
+ * \brief Returns whether the profiler is currently measuring.
+ * \return \c true if hooks are installed.
+ */
+bool LuaProfiler::is_running() const {
+  return running;
+}
+
+/**
+ * \brief Notifies the profiler that the engine is calling Lua.
+ *
+ * Time elapsed outside Lua is not measured.
+ */
+void LuaProfiler::notify_lua_entered() {
+
+  LuaProfiler* profiler = running_profiler;
+  if (profiler == nullptr) {
+    return;
+  }
+
+  if (profiler->lua_nesting++ == 0) {
+    profiler->last_event_date = Clock::now();
+  }
+}
+
+/**
+ * \brief Notifies the profiler that a call from the engine to Lua has
+ * just returned.
+ */
+void LuaProfiler::notify_lua_left() {
+
+  LuaProfiler* profiler = running_profiler;
+  if (profiler == nullptr || profiler->lua_nesting <= 0) {
+    return;
+  }
+
+  if (--profiler->lua_nesting == 0) {
+    profiler->add_elapsed_time();
+    profiler->current_location.clear();
+  }
+}
+
+/**
+ * \brief Lua hook installed while a profiler is running.
+ * \param l The Lua state (possibly a coroutine).
+ * \param ar Information about the event.
+ */
+void LuaProfiler::hook(lua_State* l, lua_Debug* ar) {
+
+  if (running_profiler != nullptr) {
+    running_profiler->on_hook_event(l, ar);
+  }
+}
+
+/**
+ * \brief Handles a hook event.
+ * \param l The Lua state (possibly a coroutine).
+ * \param ar Information about the event.
+ */
+void LuaProfiler::on_hook_event(lua_State* l, lua_Debug* ar) {
+
+  // The time since the previous event belongs to the previous location.
+  add_elapsed_time();
+
+  switch (ar->event) {
+
+  case LUA_HOOKCALL:
+  {
+    lua_getinfo(l, "Snf", ar);
+    if (lua_iscfunction(l, -1)) {
+      // Count calls to the Solarus API.
+      // Their time is attributed to the calling line.
+      const lua_CFunction function = lua_tocfunction(l, -1);
+      if (api_function_names.find(function) != api_function_names.end()) {
+        ++api_calls[function];
+      }
+    }
+    else {
+      set_current_location(l, *ar, false);
+    }
+    lua_pop(l, 1);
+    break;
+  }
+
+  case LUA_HOOKRET:
+  case LUA_HOOKTAILRET:
+  {
+    // Back to the caller.
+    lua_Debug caller;
+    if (lua_getstack(l, 1, &caller) &&
+        lua_getinfo(l, "Snl", &caller) &&
+        caller.currentline > 0) {
+      set_current_location(l, caller, true);
+    }
+    break;
+  }
+
+  default:
+    // Count hook: sample the current line.
+    lua_getinfo(l, "Snl", ar);
+    set_current_location(l, *ar, true);
+    break;
+  }
+}
+
+/**
+ * \brief Attributes the time elapsed since the last event to the current
+ * location.
+ */
+void LuaProfiler::add_elapsed_time() {
+
+  const Clock::time_point now = Clock::now();
+  const uint64_t elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      now - last_event_date
+  ).count();
+  last_event_date = now;
+
+  if (current_location.empty()) {
+    return;
+  }
+
+  total_time += elapsed;
+  LocationStats& stats = locations[current_location];
+  if (stats.function_name.empty()) {
+    stats.function_name = current_function;
+  }
+  stats.time += elapsed;
+  ++stats.num_samples;
+
+  if (callgraph_depth > 0 && !current_stack.empty()) {
+    stacks[current_stack] += elapsed;
+  }
+}
+
+/**
+ * \brief Changes the location that the next elapsed time is attributed to.
+ * \param l The Lua state (possibly a coroutine).
+ * \param ar Debug information with at least the "S", "n" and "l" fields.
+ * \param use_current_line \c true to use the line being executed,
+ * \c false to use the line where the function is defined.
+ */
+void LuaProfiler::set_current_location(
+    lua_State* l,
+    lua_Debug& ar,
+    bool use_current_line
+) {
+  std::ostringstream oss;
+  oss << ar.short_src << ":"
+      << (use_current_line ? ar.currentline : ar.linedefined);
+  current_location = oss.str();
+  current_function = get_function_name(ar);
+
+  if (callgraph_depth > 0) {
+    current_stack = get_stack(l);
+  }
+}
+
+/**
+ * \brief Returns the current call stack in collapsed form.
+ * \param l The Lua state (possibly a coroutine).
+ * \return The functions of the stack separated by semicolons,
+ * starting from the outermost one.
+ */
+std::string LuaProfiler::get_stack(lua_State* l) const {
+
+  std::vector<std::string> frames;
+  lua_Debug ar;
+  for (int level = 0;
+      level < callgraph_depth && lua_getstack(l, level, &ar);
+      ++level) {
+    lua_getinfo(l, "Sn", &ar);
+    std::ostringstream oss;
+    oss << get_function_name(ar);
+    if (std::string(ar.what) != "C") {
+      oss << " (" << ar.short_src << ":" << ar.linedefined << ")";
+    }
+    frames.push_back(oss.str());
+  }
+
+  std::string stack;
+  for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+    if (!stack.empty()) {
+      stack += ';';
+    }
+    stack += *it;
+  }
+  return stack;
+}
+
+/**
+ * \brief Returns the results of the last profiling session.
+ * \param format The format of the report.
+ * \return The report.
+ */
+std::string LuaProfiler::get_report(ReportFormat format) const {
+
+  switch (format) {
+
+  case ReportFormat::FLAT:
+    return get_flat_report();
+
+  case ReportFormat::CALLGRAPH:
+    return get_callgraph_report();
+
+  case ReportFormat::JSON:
+    return get_json_report();
+  }
+
+  return "";
+}
+
+/**
+ * \brief Returns a text report of the self time of each line
+ * and of the API call counts.
+ * \return The flat report.
+ */
+std::string LuaProfiler::get_flat_report() const {
+
+  std::ostringstream oss;
+  oss << std::fixed << std::setprecision(2);
+  oss << "Lua profile: " << (total_time / 1000.0) << " ms measured in "
+      << locations.size() << " lines\n\n";
+
+  oss << std::setw(10) << "self ms" << std::setw(8) << "%"
+      << std::setw(10) << "samples" << "  location (function)\n";
+  const auto& sorted_locations = sort_by_decreasing(locations,
+      [](const std::pair<const std::string, LocationStats>& element) {
+    return element.second.time;
+  });
+  for (const auto& it: sorted_locations) {
+    const LocationStats& stats = it->second;
+    const double percent = total_time == 0 ? 0.0 : (100.0 * stats.time / total_time);
+    oss << std::setw(10) << (stats.time / 1000.0)
+        << std::setw(8) << percent
+        << std::setw(10) << stats.num_samples
+        << "  " << it->first << " (" << stats.function_name << ")\n";
+  }
+
+  oss << "\n" << std::setw(10) << "calls" << "  Solarus API function\n";
+  const auto& sorted_api_calls = sort_by_decreasing(api_calls,
+      [](const std::pair<const lua_CFunction, int>& element) {
+    return element.second;
+  });
+  for (const auto& it: sorted_api_calls) {
+    oss << std::setw(10) << it->second
+        << "  " << api_function_names.at(it->first) << "\n";
+  }
+
+  return oss.str();
+}
+
+/**
+ * \brief Returns a text report with the time of each call stack.
+ *
+ * Each line is a call stack, outermost function first, separated by
+ * semicolons, followed by its time in microseconds.
+ * This is the input format of usual flame graph tools.
+ *
+ * \return The callgraph report.
+ */
+std::string LuaProfiler::get_callgraph_report() const {
+
+  std::ostringstream oss;
+  for (const auto& kvp: stacks) {
+    oss << kvp.first << " " << kvp.second << "\n";
+  }
+  return oss.str();
+}
+
+/**
+ * \brief Returns all results as a JSON object.
+ * \return The JSON report.
+ */
+std::string LuaProfiler::get_json_report() const {
+
+  std::ostringstream oss;
+  oss << "{\n  \"total_time_us\": " << total_time << ",\n";
+
+  oss << "  \"lines\": [";
+  const auto& sorted_locations = sort_by_decreasing(locations,
+      [](const std::pair<const std::string, LocationStats>& element) {
+    return element.second.time;
+  });
+  bool first = true;
+  for (const auto& it: sorted_locations) {
+    const LocationStats& stats = it->second;
+    oss << (first ? "\n" : ",\n")
+        << "    { \"location\": " << json_string(it->first)
+        << ", \"function\": " << json_string(stats.function_name)
+        << ", \"time_us\": " << stats.time
+        << ", \"samples\": " << stats.num_samples << " }";
+    first = false;
+  }
+  oss << "\n  ],\n";
+
+  oss << "  \"api_calls\": [";
+  const auto& sorted_api_calls = sort_by_decreasing(api_calls,
+      [](const std::pair<const lua_CFunction, int>& element) {
+    return element.second;
+  });
+  first = true;
+  for (const auto& it: sorted_api_calls) {
+    oss << (first ? "\n" : ",\n")
+        << "    { \"function\": " << json_string(api_function_names.at(it->first))
+        << ", \"calls\": " << it->second << " }";
+    first = false;
+  }
+  oss << "\n  ],\n";
+
+  oss << "  \"callgraph\": [";
+  first = true;
+  for (const auto& kvp: stacks) {
+    oss << (first ? "\n" : ",\n")
+        << "    { \"stack\": " << json_string(kvp.first)
+        << ", \"time_us\": " << kvp.second << " }";
+    first = false;
+  }
+  oss << "\n  ]\n}\n";
+
+  return oss.str();
+}
+
+}
+
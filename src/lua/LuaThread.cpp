@@ -0,0 +1,512 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lua/LuaContext.h"
+#include "solarus/lua/LuaThread.h"
+#include <lua.hpp>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Number of Lua instructions between two checks of a stop request.
+ */
+constexpr int stop_check_interval = 10000;
+
+/**
+ * \brief Maximum number of nested tables in a message.
+ *
+ * This also detects tables that contain themselves.
+ */
+constexpr int max_message_depth = 32;
+
+/**
+ * \brief Appends the binary representation of a value to a message.
+ * \param message The message to append to.
+ * \param value The value to write.
+ */
+template<typename T>
+void write_raw(std::string& message, const T& value) {
+  message.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+/**
+ * \brief Reads a value written by write_raw().
+ * \param message The message to read.
+ * \param position Current position in the message, updated.
+ * \return The value read.
+ */
+template<typename T>
+T read_raw(const std::string& message, size_t& position) {
+  T value;
+  std::memcpy(&value, message.data() + position, sizeof(T));
+  position += sizeof(T);
+  return value;
+}
+
+/**
+ * \brief Appends a Lua value to a message.
+ * \param[in] l A Lua state.
+ * \param[in] index Absolute index of the value in the stack.
+ * \param[in] depth Number of tables the value is nested in.
+ * \param[out] message The message to append to.
+ * \param[out] error_message Why the value cannot be sent in case of failure.
+ * \return \c true in case of success.
+ */
+bool serialize_value(
+    lua_State* l,
+    int index,
+    int depth,
+    std::string& message,
+    std::string& error_message
+) {
+  switch (lua_type(l, index)) {
+
+  case LUA_TNONE:
+  case LUA_TNIL:
+    message.push_back('n');
+    return true;
+
+  case LUA_TBOOLEAN:
+    message.push_back('b');
+    message.push_back(lua_toboolean(l, index) ? 1 : 0);
+    return true;
+
+  case LUA_TNUMBER:
+    message.push_back('d');
+    write_raw(message, lua_tonumber(l, index));
+    return true;
+
+  case LUA_TSTRING:
+  {
+    size_t size = 0;
+    const char* text = lua_tolstring(l, index, &size);
+    message.push_back('s');
+    write_raw(message, static_cast<uint32_t>(size));
+    message.append(text, size);
+    return true;
+  }
+
+  case LUA_TTABLE:
+    if (depth >= max_message_depth || !lua_checkstack(l, 2)) {
+      error_message = "tables are nested too deeply";
+      return false;
+    }
+    message.push_back('t');
+                                  // ...
+    lua_pushnil(l);
+                                  // ... nil
+    while (lua_next(l, index)) {
+                                  // ... key value
+      const int value_index = lua_gettop(l);
+      if (!serialize_value(l, value_index - 1, depth + 1, message, error_message) ||
+          !serialize_value(l, value_index, depth + 1, message, error_message)) {
+        lua_pop(l, 2);
+                                  // ...
+        return false;
+      }
+      lua_pop(l, 1);
+                                  // ... key
+    }
+                                  // ...
+    message.push_back('e');
+    return true;
+
+  default:
+    error_message = std::string("cannot send a value of type ")
+        + luaL_typename(l, index);
+    return false;
+  }
+}
+
+/**
+ * \brief Pushes onto the stack a value read from a message.
+ * \param l A Lua state.
+ * \param message A message made by serialize_value().
+ * \param position Position of the value in the message, updated.
+ */
+void deserialize_value(lua_State* l, const std::string& message, size_t& position) {
+
+  lua_checkstack(l, 3);
+  const char type = message[position++];
+  switch (type) {
+
+  case 'b':
+    lua_pushboolean(l, message[position++] != 0);
+    break;
+
+  case 'd':
+    lua_pushnumber(l, read_raw<lua_Number>(message, position));
+    break;
+
+  case 's':
+  {
+    const uint32_t size = read_raw<uint32_t>(message, position);
+    lua_pushlstring(l, message.data() + position, size);
+    position += size;
+    break;
+  }
+
+  case 't':
+                                  // ...
+    lua_newtable(l);
+                                  // ... table
+    while (message[position] != 'e') {
+      deserialize_value(l, message, position);
+                                  // ... table key
+      deserialize_value(l, message, position);
+                                  // ... table key value
+      lua_rawset(l, -3);
+                                  // ... table
+    }
+    ++position;
+    break;
+
+  default:
+    lua_pushnil(l);
+    break;
+  }
+}
+
+}
+
+/**
+ * \brief Creates a thread for a worker script.
+ *
+ * The worker does not run until start() is called.
+ *
+ * \param script_name Name of the script, used in error messages.
+ * \param source Lua code of the script (source or bytecode).
+ */
+LuaThread::LuaThread(const std::string& script_name, const std::string& source):
+  ExportableToLua(),
+  script_name(script_name),
+  source(source),
+  thread(),
+  stop_requested(false),
+  finished(false) {
+
+}
+
+/**
+ * \brief Destructor.
+ *
+ * Asks the worker to stop and waits for it.
+ */
+LuaThread::~LuaThread() {
+
+  stop();
+  if (thread.joinable()) {
+    thread.join();
+  }
+}
+
+/**
+ * \brief Returns the name of the worker script.
+ * \return The script name.
+ */
+const std::string& LuaThread::get_script_name() const {
+  return script_name;
+}
+
+/**
+ * \brief Starts running the worker script.
+ */
+void LuaThread::start() {
+
+  thread = std::thread(&LuaThread::run, this);
+}
+
+/**
+ * \brief Asks the worker to stop.
+ *
+ * The worker script is interrupted the next time it calls
+ * sol.thread.receive() or after a few Lua instructions.
+ * Note that with LuaJIT, JIT-compiled loops cannot be interrupted.
+ */
+void LuaThread::stop() {
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stop_requested = true;
+  }
+  messages_to_worker_changed.notify_all();
+}
+
+/**
+ * \brief Returns whether the worker script has returned.
+ *
+ * Messages posted by the worker may still be waiting to be received.
+ *
+ * \return \c true if the worker is finished.
+ */
+bool LuaThread::is_finished() const {
+  return finished;
+}
+
+/**
+ * \brief Returns the error that stopped the worker script if any.
+ * \return The error message, or an empty string.
+ */
+std::string LuaThread::get_error() const {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  return error;
+}
+
+/**
+ * \brief Sends a message to the worker.
+ * \param message A message made by serialize().
+ */
+void LuaThread::post_to_worker(std::string&& message) {
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    messages_to_worker.push_back(std::move(message));
+  }
+  messages_to_worker_changed.notify_one();
+}
+
+/**
+ * \brief Gets the oldest message sent by the worker, if any.
+ * \param[out] message The message received.
+ * \return \c false if there was no message.
+ */
+bool LuaThread::receive_from_worker(std::string& message) {
+
+  std::lock_guard<std::mutex> lock(mutex);
+  if (messages_from_worker.empty()) {
+    return false;
+  }
+  message = std::move(messages_from_worker.front());
+  messages_from_worker.pop_front();
+  return true;
+}
+
+/**
+ * \brief Converts a Lua value to a message that can be sent to another state.
+ *
+ * Does not raise Lua errors.
+ *
+ * \param[in] l A Lua state.
+ * \param[in] index Index of the value to send.
+ * \param[out] message The message.
+ * \param[out] error_message Why the value cannot be sent in case of failure.
+ * \return \c true in case of success.
+ */
+bool LuaThread::serialize(
+    lua_State* l,
+    int index,
+    std::string& message,
+    std::string& error_message
+) {
+  if (index < 0 && index > LUA_REGISTRYINDEX) {
+    index = lua_gettop(l) + index + 1;
+  }
+  message.clear();
+  return serialize_value(l, index, 0, message, error_message);
+}
+
+/**
+ * \brief Pushes onto the stack the value of a message.
+ * \param l A Lua state.
+ * \param message A message made by serialize().
+ */
+void LuaThread::deserialize(lua_State* l, const std::string& message) {
+
+  if (message.empty()) {
+    lua_pushnil(l);
+    return;
+  }
+  size_t position = 0;
+  deserialize_value(l, message, position);
+}
+
+/**
+ * \brief Returns the name identifying this type in Lua.
+ * \return The name identifying this type in Lua.
+ */
+const std::string& LuaThread::get_lua_type_name() const {
+  return LuaContext::thread_module_name;
+}
+
+/**
+ * \brief Function executed by the worker thread.
+ */
+void LuaThread::run() {
+
+  lua_State* l = luaL_newstate();
+  if (l == nullptr) {
+    std::lock_guard<std::mutex> lock(mutex);
+    error = "Cannot create a Lua state";
+    finished = true;
+    return;
+  }
+  luaL_openlibs(l);
+
+  lua_pushlightuserdata(l, this);
+  lua_setfield(l, LUA_REGISTRYINDEX, "sol.thread");
+
+  // The only API of the worker: sol.thread.post() and sol.thread.receive().
+                                  // --
+  lua_newtable(l);
+                                  // sol
+  lua_newtable(l);
+                                  // sol thread
+  lua_pushcfunction(l, l_post);
+                                  // sol thread post
+  lua_setfield(l, -2, "post");
+                                  // sol thread
+  lua_pushcfunction(l, l_receive);
+                                  // sol thread receive
+  lua_setfield(l, -2, "receive");
+                                  // sol thread
+  lua_setfield(l, -2, "thread");
+                                  // sol
+  lua_setglobal(l, "sol");
+                                  // --
+
+  lua_sethook(l, l_hook, LUA_MASKCOUNT, stop_check_interval);
+
+  int result = luaL_loadbuffer(l, source.data(), source.size(), script_name.c_str());
+  if (result == 0) {
+    result = lua_pcall(l, 0, 0, 0);
+  }
+  if (result != 0 && !stop_requested) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const char* message = lua_tostring(l, -1);
+    error = (message != nullptr) ? message : "Unknown error";
+  }
+
+  lua_close(l);
+  finished = true;
+}
+
+/**
+ * \brief Returns the thread object of a worker Lua state.
+ * \param l The Lua state of a worker.
+ * \return The corresponding thread.
+ */
+LuaThread& LuaThread::get_thread(lua_State* l) {
+
+  lua_getfield(l, LUA_REGISTRYINDEX, "sol.thread");
+  LuaThread* thread = static_cast<LuaThread*>(lua_touserdata(l, -1));
+  lua_pop(l, 1);
+  return *thread;
+}
+
+/**
+ * \brief Implementation of sol.thread.post() in a worker.
+ *
+ * Sends a message to the main Lua state.
+ * This function does not throw C++ exceptions and does not keep C++ objects
+ * alive when raising a Lua error, since workers have no exception boundary.
+ *
+ * \param l The Lua state of a worker.
+ * \return Number of values to return to Lua.
+ */
+int LuaThread::l_post(lua_State* l) {
+
+  bool success = false;
+  {
+    LuaThread& thread = get_thread(l);
+    std::string message;
+    std::string error_message;
+    success = serialize(l, 1, message, error_message);
+    if (success) {
+      std::lock_guard<std::mutex> lock(thread.mutex);
+      thread.messages_from_worker.push_back(std::move(message));
+    }
+    else {
+      lua_pushstring(l, (std::string("bad argument #1 to 'post' (")
+          + error_message + ")").c_str());
+    }
+  }
+
+  if (!success) {
+    return lua_error(l);
+  }
+  return 0;
+}
+
+/**
+ * \brief Implementation of sol.thread.receive() in a worker.
+ *
+ * Returns the oldest message sent by the main Lua state.
+ * If there is none, waits for one, unless the first parameter is false,
+ * in which case nil is returned.
+ * Raises an error if the thread is being stopped.
+ *
+ * \param l The Lua state of a worker.
+ * \return Number of values to return to Lua.
+ */
+int LuaThread::l_receive(lua_State* l) {
+
+  const bool wait = lua_isnoneornil(l, 1) || lua_toboolean(l, 1);
+  bool stopped = false;
+  {
+    LuaThread& thread = get_thread(l);
+    std::string message;
+    bool received = false;
+    {
+      std::unique_lock<std::mutex> lock(thread.mutex);
+      if (wait) {
+        thread.messages_to_worker_changed.wait(lock, [&thread] {
+          return thread.stop_requested || !thread.messages_to_worker.empty();
+        });
+      }
+      if (thread.stop_requested) {
+        stopped = true;
+      }
+      else if (!thread.messages_to_worker.empty()) {
+        message = std::move(thread.messages_to_worker.front());
+        thread.messages_to_worker.pop_front();
+        received = true;
+      }
+    }
+
+    if (received) {
+      deserialize(l, message);
+    }
+    else {
+      lua_pushnil(l);
+    }
+  }
+
+  if (stopped) {
+    return luaL_error(l, "Thread stopped");
+  }
+  return 1;
+}
+
+/**
+ * \brief Lua hook that interrupts the worker script when it has to stop.
+ * \param l The Lua state of a worker.
+ * \param ar Information about the current event.
+ */
+void LuaThread::l_hook(lua_State* l, lua_Debug* /* ar */) {
+
+  if (get_thread(l).stop_requested) {
+    luaL_error(l, "Thread stopped");
+  }
+}
+
+}
+
@@ -17,6 +17,7 @@
 #include "solarus/lua/LuaTools.h"
 #include "solarus/lowlevel/Color.h"
 #include "solarus/lua/LuaException.h"
+#include "solarus/lua/LuaProfiler.h"
 #include "solarus/lua/ScopedLuaRef.h"
 #include <cctype>
 #include <sstream>
@@ -113,13 +114,16 @@ bool call_function(
     int nb_results,
     const char* function_name
 ) {
+  LuaProfiler::notify_lua_entered();
   if (lua_pcall(l, nb_arguments, nb_results, 0) != 0) {
+    LuaProfiler::notify_lua_left();
     Debug::error(std::string("In ") + function_name + ": "
         + lua_tostring(l, -1)
     );
     lua_pop(l, 1);
     return false;
   }
+  LuaProfiler::notify_lua_left();
 
   return true;
 }
@@ -15,6 +15,7 @@
  * with this program. If not, see <http://www.gnu.org/licenses/>.
  */
 #include "solarus/lua/LuaContext.h"
+#include "solarus/lua/LuaProfiler.h"
 #include "solarus/lua/LuaTools.h"
 #include "solarus/lowlevel/Geometry.h"
 #include "solarus/lowlevel/QuestFiles.h"
@@ -49,6 +50,8 @@ void LuaContext::register_main_module() {
       { "get_angle", main_api_get_angle },
       { "get_metatable", main_api_get_metatable },
       { "get_os", main_api_get_os },
+      { "start_profiler", main_api_start_profiler },
+      { "stop_profiler", main_api_stop_profiler },
       { nullptr, nullptr }
   };
 
@@ -305,6 +308,75 @@ int LuaContext::main_api_get_os(lua_State* l) {
   return 1;
 }
 
+/**
+ * \brief Implementation of sol.main.start_profiler().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::main_api_start_profiler(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    int sample_interval = 1000;
+    int callgraph_depth = 0;
+    if (lua_gettop(l) >= 1) {
+      LuaTools::check_type(l, 1, LUA_TTABLE);
+      sample_interval = LuaTools::opt_int_field(l, 1, "sample_interval", sample_interval);
+      callgraph_depth = LuaTools::opt_int_field(l, 1, "callgraph_depth", callgraph_depth);
+    }
+
+    if (sample_interval < 0) {
+      LuaTools::arg_error(l, 1, "sample_interval should be positive or zero");
+    }
+    if (callgraph_depth < 0) {
+      LuaTools::arg_error(l, 1, "callgraph_depth should be positive or zero");
+    }
+
+    LuaContext& lua_context = get_lua_context(l);
+    if (lua_context.profiler == nullptr) {
+      lua_context.profiler = std::unique_ptr<LuaProfiler>(
+          new LuaProfiler(lua_context.l, lua_context.api_function_names)
+      );
+    }
+    else if (lua_context.profiler->is_running()) {
+      LuaTools::error(l, "The profiler is already running");
+    }
+
+    lua_context.profiler->start(sample_interval, callgraph_depth);
+
+    return 0;
+  });
+}
+
+/**
+ * \brief Implementation of sol.main.stop_profiler().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::main_api_stop_profiler(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    static const std::map<LuaProfiler::ReportFormat, std::string> format_names = {
+        { LuaProfiler::ReportFormat::FLAT, "flat" },
+        { LuaProfiler::ReportFormat::CALLGRAPH, "callgraph" },
+        { LuaProfiler::ReportFormat::JSON, "json" }
+    };
+    LuaProfiler::ReportFormat format = LuaTools::opt_enum<LuaProfiler::ReportFormat>(
+        l, 1, format_names, LuaProfiler::ReportFormat::FLAT
+    );
+
+    LuaContext& lua_context = get_lua_context(l);
+    if (lua_context.profiler == nullptr ||
+        !lua_context.profiler->is_running()) {
+      LuaTools::error(l, "The profiler is not running");
+    }
+
+    lua_context.profiler->stop();
+
+    push_string(l, lua_context.profiler->get_report(format));
+    return 1;
+  });
+}
+
 /**
  * \brief Calls sol.main.on_started() if it exists.
  *
@@ -313,25 +313,13 @@ int LuaContext::l_create_tile(lua_State* l) {
   return LuaTools::exception_boundary_handle(l, [&] {
     Map& map = *check_map(l, 1);
     EntityData& data = *(static_cast<EntityData*>(lua_touserdata(l, 2)));
-    const int x = data.get_xy().x;
-    const int y = data.get_xy().y;
     const Size size =  entity_creation_check_size(l, 1, data);
-    const std::string& tile_pattern_id = data.get_string("pattern");
-
-    const TilePattern& pattern = map.get_tileset().get_tile_pattern(tile_pattern_id);
-
-    for (int current_y = y; current_y < y + size.height; current_y += pattern.get_height()) {
-      for (int current_x = x; current_x < x + size.width; current_x += pattern.get_width()) {
-        EntityPtr entity = std::make_shared<Tile>(
-            data.get_layer(),
-            Point(current_x, current_y),
-            pattern.get_size(),
-            map.get_tileset(),
-            tile_pattern_id
-        );
-        map.get_entities().add_entity(entity);
-      }
-    }
+
+    map.get_entities().add_tiles(
+        data.get_layer(),
+        Rectangle(data.get_xy(), size),
+        data.get_string("pattern")
+    );
 
     return 0;
   });
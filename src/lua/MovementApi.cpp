@@ -33,6 +33,7 @@
 #include "solarus/Game.h"
 #include "solarus/Map.h"
 #include "solarus/Drawable.h"
+#include <algorithm>
 
 namespace Solarus {
 
@@ -313,6 +314,85 @@ void LuaContext::register_movement_module() {
                                   // ... movements
   lua_setfield(l, LUA_REGISTRYINDEX, "sol.movements_on_points");
                                   // ...
+
+  // Create the metatable of the object that detects garbage collections.
+  lua_newtable(l);
+                                  // ... meta
+  lua_pushcfunction(l, l_movements_on_points_gc);
+                                  // ... meta gc
+  lua_setfield(l, -2, "__gc");
+                                  // ... meta
+  lua_setfield(l, LUA_REGISTRYINDEX, "sol.movements_on_points_sentinel");
+                                  // ...
+  push_movements_on_points_sentinel();
+  lua_pop(l, 1);
+}
+
+/**
+ * \brief Creates an unreferenced object whose finalizer looks for the x,y
+ * tables that were just collected.
+ *
+ * It is collected by the next garbage collection cycle,
+ * and its finalizer creates a new one.
+ * The object is left on the stack.
+ */
+void LuaContext::push_movements_on_points_sentinel() {
+
+                                  // ...
+  lua_newuserdata(l, 1);
+                                  // ... sentinel
+  lua_getfield(l, LUA_REGISTRYINDEX, "sol.movements_on_points_sentinel");
+                                  // ... sentinel meta
+  lua_setmetatable(l, -2);
+                                  // ... sentinel
+}
+
+/**
+ * \brief Marks for removal the movements whose x,y table was collected.
+ *
+ * Called by the garbage collector, after weak values are cleared,
+ * so that update_movements() does not have to look into Lua.
+ */
+void LuaContext::find_movements_on_collected_points() {
+
+  if (movements_on_points.empty()) {
+    return;
+  }
+
+                                  // ...
+  lua_getfield(l, LUA_REGISTRYINDEX, "sol.movements_on_points");
+                                  // ... movements
+  for (const std::shared_ptr<Movement>& movement: movements_on_points) {
+    push_movement(l, *movement);
+                                  // ... movements movement
+    lua_gettable(l, -2);
+                                  // ... movements xy/nil
+    if (lua_isnil(l, -1)) {
+      movements_on_points_to_remove.insert(movement.get());
+    }
+    lua_pop(l, 1);
+                                  // ... movements
+  }
+  lua_pop(l, 1);
+                                  // ...
+}
+
+/**
+ * \brief Finalizer of the object that detects garbage collections.
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::l_movements_on_points_gc(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    LuaContext& lua_context = get_lua_context(l);
+    lua_context.find_movements_on_collected_points();
+
+    // Detect the next cycle too.
+    lua_context.push_movements_on_points_sentinel();
+    lua_pop(l, 1);
+    return 0;
+  });
 }
 
 /**
@@ -427,6 +507,12 @@ void LuaContext::start_movement_on_point(
   lua_pop(l, 1);
                                   // ...
   movement->set_xy(x, y);
+
+  if (movements_on_points_to_remove.erase(movement.get()) == 0 &&
+      std::find(movements_on_points.begin(), movements_on_points.end(), movement) ==
+      movements_on_points.end()) {
+    movements_on_points.push_back(movement);
+  }
 }
 
 /**
@@ -446,6 +532,12 @@ void LuaContext::stop_movement_on_point(const std::shared_ptr<Movement>& movemen
                                   // ... movements
   lua_pop(l, 1);
                                   // ...
+
+  // Removed at the next cycle because this can happen during the update loop.
+  if (std::find(movements_on_points.begin(), movements_on_points.end(), movement) !=
+      movements_on_points.end()) {
+    movements_on_points_to_remove.insert(movement.get());
+  }
 }
 
 /**
@@ -457,14 +549,51 @@ void LuaContext::stop_movement_on_point(const std::shared_ptr<Movement>& movemen
  */
 void LuaContext::update_movements() {
 
-  lua_getfield(l, LUA_REGISTRYINDEX, "sol.movements_on_points");
-  lua_pushnil(l);  // First key.
-  while (lua_next(l, -2)) {
-    Movement& movement = *check_movement(l, -2);
-    movement.update();
-    lua_pop(l, 1);  // Pop the value, keep the key for next iteration.
+  // Movements whose x,y table was collected are marked for removal by the
+  // garbage collector itself: see find_movements_on_collected_points().
+
+  // Movements started during the loop are updated from the next cycle.
+  const size_t num_movements = movements_on_points.size();
+  for (size_t i = 0; i < num_movements; ++i) {
+    Movement* movement = movements_on_points[i].get();
+    if (!movements_on_points_to_remove.empty() &&
+        movements_on_points_to_remove.find(movement) != movements_on_points_to_remove.end()) {
+      continue;
+    }
+    movement->update();
+  }
+
+  // Remove the ones that should be removed.
+  if (!movements_on_points_to_remove.empty()) {
+    movements_on_points.erase(std::remove_if(
+        movements_on_points.begin(), movements_on_points.end(),
+        [&](const std::shared_ptr<Movement>& movement) {
+          return movements_on_points_to_remove.find(movement.get()) !=
+              movements_on_points_to_remove.end();
+        }), movements_on_points.end());
+    movements_on_points_to_remove.clear();
   }
-  lua_pop(l, 1);  // Pop the movements table.
+}
+
+/**
+ * \brief Forgets all movements applied to x,y points.
+ */
+void LuaContext::destroy_movements() {
+
+  movements_on_points.clear();
+  movements_on_points_to_remove.clear();
+
+  // Stop detecting garbage collections: the sentinel would otherwise keep
+  // creating new ones while Lua finalizes everything.
+                                  // ...
+  lua_getfield(l, LUA_REGISTRYINDEX, "sol.movements_on_points_sentinel");
+                                  // ... meta
+  lua_pushnil(l);
+                                  // ... meta nil
+  lua_setfield(l, -2, "__gc");
+                                  // ... meta
+  lua_pop(l, 1);
+                                  // ...
 }
 
 /**
@@ -0,0 +1,269 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/lua/LuaContext.h"
+#include "solarus/lua/LuaThread.h"
+#include "solarus/lua/LuaTools.h"
+#include <lua.hpp>
+#include <algorithm>
+
+namespace Solarus {
+
+/**
+ * Name of the Lua table representing the thread module.
+ */
+const std::string LuaContext::thread_module_name = "sol.thread";
+
+/**
+ * \brief Initializes the thread features provided to Lua.
+ */
+void LuaContext::register_thread_module() {
+
+  // Functions of sol.thread.
+  static const luaL_Reg functions[] = {
+      { "start", thread_api_start },
+      { nullptr, nullptr }
+  };
+
+  // Methods of the thread type.
+  static const luaL_Reg methods[] = {
+      { "post", thread_api_post },
+      { "stop", thread_api_stop },
+      { "is_running", thread_api_is_running },
+      { nullptr, nullptr }
+  };
+
+  static const luaL_Reg metamethods[] = {
+      { "__gc", userdata_meta_gc },
+      { "__newindex", userdata_meta_newindex_as_table },
+      { "__index", userdata_meta_index_as_table },
+      { nullptr, nullptr }
+  };
+
+  register_type(thread_module_name, functions, methods, metamethods);
+}
+
+/**
+ * \brief Returns whether a value is a userdata of type thread.
+ * \param l A Lua context.
+ * \param index An index in the stack.
+ * \return true if the value at this index is a thread.
+ */
+bool LuaContext::is_thread(lua_State* l, int index) {
+  return is_userdata(l, index, thread_module_name);
+}
+
+/**
+ * \brief Checks that the userdata at the specified index of the stack is a
+ * thread and returns it.
+ * \param l A Lua context.
+ * \param index An index in the stack.
+ * \return The thread.
+ */
+std::shared_ptr<LuaThread> LuaContext::check_thread(lua_State* l, int index) {
+  return std::static_pointer_cast<LuaThread>(
+      check_userdata(l, index, thread_module_name)
+  );
+}
+
+/**
+ * \brief Pushes a thread userdata onto the stack.
+ * \param l A Lua context.
+ * \param thread A thread.
+ */
+void LuaContext::push_thread(lua_State* l, LuaThread& thread) {
+  push_userdata(l, thread);
+}
+
+/**
+ * \brief Stops all worker threads started by this script.
+ */
+void LuaContext::destroy_threads() {
+
+  for (const std::shared_ptr<LuaThread>& thread: threads) {
+    thread->stop();
+  }
+  threads.clear();
+}
+
+/**
+ * \brief Delivers the messages sent by worker threads and forgets the
+ * threads that are finished.
+ */
+void LuaContext::update_threads() {
+
+  // Threads started from callbacks are appended and updated from the
+  // next cycle.
+  std::vector<const LuaThread*> finished_threads;
+  const size_t num_threads = threads.size();
+  for (size_t i = 0; i < num_threads; ++i) {
+    const std::shared_ptr<LuaThread> thread = threads[i];
+
+    // Check this first so that no message posted before the end is lost.
+    const bool finished = thread->is_finished();
+
+    std::string message;
+    while (thread->receive_from_worker(message)) {
+      thread_on_message(*thread, message);
+    }
+
+    if (finished) {
+      const std::string& error = thread->get_error();
+      if (!error.empty()) {
+        Debug::error(std::string("Error in thread '")
+            + thread->get_script_name() + "': " + error);
+      }
+      thread_on_finished(*thread);
+      finished_threads.push_back(thread.get());
+    }
+  }
+
+  if (!finished_threads.empty()) {
+    threads.erase(std::remove_if(threads.begin(), threads.end(),
+        [&](const std::shared_ptr<LuaThread>& thread) {
+          return std::find(finished_threads.begin(), finished_threads.end(),
+              thread.get()) != finished_threads.end();
+        }), threads.end());
+  }
+}
+
+/**
+ * \brief Implementation of sol.thread.start().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::thread_api_start(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    LuaContext& lua_context = get_lua_context(l);
+    const std::string& script_name = LuaTools::check_string(l, 1);
+
+    std::string file_name = script_name;
+    if (!QuestFiles::data_file_exists(file_name)) {
+      file_name += ".lua";
+    }
+    if (!QuestFiles::data_file_exists(file_name)) {
+      LuaTools::arg_error(l, 1,
+          std::string("Cannot find thread script '") + script_name + "'");
+    }
+
+    const std::shared_ptr<LuaThread> thread = std::make_shared<LuaThread>(
+        file_name, QuestFiles::data_file_read(file_name)
+    );
+    thread->start();
+    lua_context.threads.push_back(thread);
+
+    push_thread(l, *thread);
+    return 1;
+  });
+}
+
+/**
+ * \brief Implementation of thread:post().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::thread_api_post(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    const std::shared_ptr<LuaThread>& thread = check_thread(l, 1);
+
+    std::string message;
+    std::string error_message;
+    if (!LuaThread::serialize(l, 2, message, error_message)) {
+      LuaTools::arg_error(l, 2, error_message);
+    }
+    thread->post_to_worker(std::move(message));
+
+    return 0;
+  });
+}
+
+/**
+ * \brief Implementation of thread:stop().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::thread_api_stop(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    const std::shared_ptr<LuaThread>& thread = check_thread(l, 1);
+
+    thread->stop();
+
+    return 0;
+  });
+}
+
+/**
+ * \brief Implementation of thread:is_running().
+ * \param l The Lua context that is calling this function.
+ * \return Number of values to return to Lua.
+ */
+int LuaContext::thread_api_is_running(lua_State* l) {
+
+  return LuaTools::exception_boundary_handle(l, [&] {
+    const std::shared_ptr<LuaThread>& thread = check_thread(l, 1);
+
+    lua_pushboolean(l, !thread->is_finished());
+    return 1;
+  });
+}
+
+/**
+ * \brief Calls the on_message() method of a Lua thread.
+ *
+ * Does nothing if the method is not defined.
+ *
+ * \param thread A thread.
+ * \param message The message posted by the worker.
+ */
+void LuaContext::thread_on_message(LuaThread& thread, const std::string& message) {
+
+  if (!userdata_has_field(thread, "on_message")) {
+    return;
+  }
+
+  push_thread(l, thread);
+  if (find_method("on_message")) {
+    LuaThread::deserialize(l, message);
+    call_function(2, 0, "on_message");
+  }
+  lua_pop(l, 1);
+}
+
+/**
+ * \brief Calls the on_finished() method of a Lua thread.
+ *
+ * Does nothing if the method is not defined.
+ *
+ * \param thread A thread.
+ */
+void LuaContext::thread_on_finished(LuaThread& thread) {
+
+  if (!userdata_has_field(thread, "on_finished")) {
+    return;
+  }
+
+  push_thread(l, thread);
+  on_finished();
+  lua_pop(l, 1);
+}
+
+}
+
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/TilesetData.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/Arguments.h"
+#include "solarus/BakedMapData.h"
+#include "solarus/MapData.h"
+#include "solarus/QuestResources.h"
+#include "solarus/SpriteData.h"
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace {
+
+using namespace Solarus;
+
+/**
+ * \brief Compiles a data file of the quest into its binary version.
+ *
+ * The binary file is written next to the text file, in the quest data
+ * directory. It is then read again and compared to the text file.
+ *
+ * \param file_name A text data file, relative to the quest data directory.
+ * \return \c true in case of success.
+ */
+template<typename Data>
+bool compile_file(const std::string& file_name) {
+
+  if (!QuestFiles::data_file_exists(file_name)) {
+    std::cerr << "Missing file: " << file_name << std::endl;
+    return false;
+  }
+
+  // Always read the text version, even if a compiled one exists.
+  Data data;
+  if (!data.import_from_buffer(QuestFiles::data_file_read(file_name), file_name)) {
+    std::cerr << "Failed to read file: " << file_name << std::endl;
+    return false;
+  }
+
+  std::string binary_buffer;
+  Data compiled_data;
+  std::string text_buffer;
+  std::string compiled_text_buffer;
+  if (!data.export_to_binary(binary_buffer) ||
+      !compiled_data.import_from_binary(binary_buffer.data(), binary_buffer.size()) ||
+      !data.export_to_buffer(text_buffer) ||
+      !compiled_data.export_to_buffer(compiled_text_buffer) ||
+      text_buffer != compiled_text_buffer) {
+    std::cerr << "Failed to compile file: " << file_name << std::endl;
+    return false;
+  }
+
+  const std::string& compiled_file_name =
+      QuestFiles::get_quest_path() + "/data/" + LuaData::get_compiled_file_name(file_name);
+  if (!data.export_to_binary_file(compiled_file_name)) {
+    std::cerr << "Failed to write file: " << compiled_file_name << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * \brief Computes in advance the ground and the tile regions of a map.
+ *
+ * The result is written to maps/<map_id>.baked in the quest data directory.
+ *
+ * \param map_id Id of the map to bake.
+ * \return \c true in case of success.
+ */
+bool bake_map(const std::string& map_id) {
+
+  const std::string& map_file_name = "maps/" + map_id + ".dat";
+  MapData map_data;
+  if (!map_data.import_from_buffer(QuestFiles::data_file_read(map_file_name), map_file_name)) {
+    std::cerr << "Failed to read file: " << map_file_name << std::endl;
+    return false;
+  }
+
+  const std::string& tileset_file_name = "tilesets/" + map_data.get_tileset_id() + ".dat";
+  TilesetData tileset_data;
+  if (!QuestFiles::data_file_exists(tileset_file_name) ||
+      !tileset_data.import_from_buffer(QuestFiles::data_file_read(tileset_file_name), tileset_file_name)) {
+    std::cerr << "Failed to read file: " << tileset_file_name << std::endl;
+    return false;
+  }
+
+  BakedMapData baked_data;
+  std::string buffer;
+  BakedMapData imported_baked_data;
+  if (!baked_data.build(map_data, tileset_data) ||
+      !baked_data.export_to_binary(buffer) ||
+      !imported_baked_data.import_from_binary(buffer.data(), buffer.size())) {
+    std::cerr << "Failed to bake map: " << map_id << std::endl;
+    return false;
+  }
+
+  const std::string& baked_file_name =
+      QuestFiles::get_quest_path() + "/data/" + BakedMapData::get_file_name(map_id);
+  std::ofstream out(baked_file_name, std::ios::out | std::ios::binary);
+  out.write(buffer.data(), buffer.size());
+  if (!out) {
+    std::cerr << "Failed to write file: " << baked_file_name << std::endl;
+    return false;
+  }
+  return true;
+}
+
+/**
+ * \brief Compiles all data files of a type of resource.
+ * \param resources The resource list of the quest.
+ * \param resource_type Type of resources to compile.
+ * \param prefix Directory of the data files.
+ * \param[in,out] num_compiled Incremented for each file compiled.
+ * \param[in,out] num_errors Incremented for each failure.
+ */
+template<typename Data>
+void compile_resources(
+    const QuestResources& resources,
+    ResourceType resource_type,
+    const std::string& prefix,
+    int& num_compiled,
+    int& num_errors
+) {
+  for (const auto& kvp : resources.get_elements(resource_type)) {
+    if (compile_file<Data>(prefix + kvp.first + ".dat")) {
+      ++num_compiled;
+    }
+    else {
+      ++num_errors;
+    }
+  }
+}
+
+}
+
+/**
+ * \brief Entry point of the quest data compiler.
+ *
+ * Usage: solarus_compile [quest_path]
+ *
+ * Converts the map, tileset and sprite data files of a quest into binary
+ * files (.dat.bin) that the engine loads much faster than Lua.
+ * Also computes the ground and the tile regions of each map (.baked) so
+ * that the engine does not have to do it when loading the map.
+ * The quest must be a data directory, not an archive.
+ * The text files are not modified: they remain the files to edit.
+ * The engine ignores compiled files older than their text file,
+ * but run this tool again after editing a quest to benefit from them.
+ *
+ * \param argc Number of command-line arguments.
+ * \param argv Command-line arguments.
+ * \return 0 in case of success, 1 if some files could not be compiled.
+ */
+int main(int argc, char** argv) {
+
+  using namespace Solarus;
+
+  const Arguments args(argc, argv);
+  QuestFiles::initialize(args);
+
+  if (QuestFiles::data_file_get_location("quest.dat") != QuestFiles::LOCATION_DATA_DIRECTORY) {
+    std::cerr << "The quest must be a data directory to be compiled" << std::endl;
+    QuestFiles::quit();
+    return 1;
+  }
+
+  QuestResources resources;
+  if (!resources.import_from_quest_file("project_db.dat")) {
+    std::cerr << "Failed to read the resource list" << std::endl;
+    QuestFiles::quit();
+    return 1;
+  }
+
+  int num_compiled = 0;
+  int num_errors = 0;
+  compile_resources<MapData>(resources, ResourceType::MAP, "maps/", num_compiled, num_errors);
+  compile_resources<TilesetData>(resources, ResourceType::TILESET, "tilesets/", num_compiled, num_errors);
+  compile_resources<SpriteData>(resources, ResourceType::SPRITE, "sprites/", num_compiled, num_errors);
+
+  for (const auto& kvp : resources.get_elements(ResourceType::MAP)) {
+    if (bake_map(kvp.first)) {
+      ++num_compiled;
+    }
+    else {
+      ++num_errors;
+    }
+  }
+
+  std::cout << num_compiled << " file(s) compiled, " << num_errors << " error(s)." << std::endl;
+
+  QuestFiles::quit();
+  return num_errors == 0 ? 0 : 1;
+}
+
@@ -20,9 +20,12 @@
 #include "solarus/lowlevel/Output.h"
 #include "solarus/Arguments.h"
 #include "solarus/MainLoop.h"
+#ifdef __linux__
+#  include "solarus/server/Client.h"
+#  include "solarus/server/Types.h"
+#endif
 #include <iostream>
 #include <string>
-#include "solarus/server/Client.h"
 
 namespace {
 
@@ -61,6 +64,24 @@ void print_help(const Solarus::Arguments& args) {
     << "  -quest-size=<width>x<height>  sets the size of the drawing area (if compatible with the quest)"
     << std::endl
     << "  -win-console=yes|no           allows to see output in a console, only needed on Windows (default no)"
+    << std::endl
+    << "  -lua-bytecode-cache=no|memory|disk  keeps compiled Lua scripts and data files, possibly in the quest write directory (default memory)"
+    << std::endl
+    << "  -map-cache-size=<megabytes>   keeps recently visited maps and tilesets in memory (default 32, 0 to disable)"
+    << std::endl
+    << "  -music-buffer-count=<number>  sets the number of buffers used to stream musics (default 8)"
+    << std::endl
+    << "  -music-buffer-size=<samples>  sets the size of each music streaming buffer (default 4096)"
+    << std::endl
+    << "  -sound-cache=yes|no           saves decoded sounds in the quest write directory (default no)"
+    << std::endl
+    << "  -sound-voices=<number>        sets the number of sounds that can play at the same time (default 32)"
+    << std::endl
+    << "  -spc-prerender=yes|no         plays SPC musics from samples rendered once instead of emulating them (default no)"
+    << std::endl
+    << "  -sprite-cache-size=<megabytes>  keeps sprites no longer used in memory (default 16, 0 to free them immediately)"
+    << std::endl
+    << "  -audio-output=null|<file.wav> renders the audio without a sound card, optionally into a WAV file"
     << std::endl;
 }
 
@@ -88,6 +109,25 @@ void print_help(const Solarus::Arguments& args) {
  *   -quest-size=<width>x<height>      Sets the size of the drawing area (if compatible with the quest).
  *   -win-console=yes|no               Opens a console to see debug output (default: no).
  *                                     Windows only (other systems use their existing console if any).
+ *   -lua-bytecode-cache=no|memory|disk Keeps compiled Lua scripts and data files to avoid parsing them
+ *                                     again, possibly in the quest write directory (default: memory).
+ *   -map-cache-size=<megabytes>       Keeps the data and images of recently visited maps and
+ *                                     tilesets in memory (default: 32, 0 to disable).
+ *   -music-buffer-count=<number>      Sets the number of buffers used to stream musics (default: 8).
+ *   -music-buffer-size=<samples>      Sets the size of each music streaming buffer (default: 4096).
+ *                                     More or bigger buffers increase the latency but avoid gaps.
+ *   -sound-cache=yes|no               Saves decoded sounds in the quest write directory
+ *                                     to load them faster next time (default: no).
+ *   -sound-voices=<number>            Sets the number of sounds that can play at the
+ *                                     same time (default: 32).
+ *   -spc-prerender=yes|no             Plays SPC musics from samples rendered once in the
+ *                                     background instead of emulating them (default: no).
+ *   -sprite-cache-size=<megabytes>    Keeps sprite animation sets no longer used by any sprite
+ *                                     in memory, least recently used ones being freed first
+ *                                     (default: 16, 0 to free them immediately).
+ *   -audio-output=null|<file.wav>     Renders the audio in software at the speed of the
+ *                                     main loop instead of using a sound card, and optionally
+ *                                     saves it into a WAV file. Prints decoding times at exit.
  *
  * \param argc Number of command-line arguments.
  * \param argv Command-line arguments.
@@ -107,16 +147,15 @@ int main(int argc, char** argv) {
     print_help(args);
   }
   else {
-    // Run the main loop.
-    int pid = getpid();
-    
-    Client* cli;
-    cli = new Client();
-    cli->Connect((char*)"127.0.0.1",SERVER_PORT);
+#ifdef __linux__
+    // Connect to the local game server if one is running.
+    // The server only exists on Linux.
+    Client client;
+    client.connect("127.0.0.1", default_server_port);
+#endif
 
-    if (getpid() == pid) {
-      MainLoop(args).run();
-    }
+    // Run the main loop.
+    MainLoop(args).run();
   }
 
   return 0;
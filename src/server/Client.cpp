@@ -1,30 +1,155 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
 #include "solarus/server/Client.h"
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace Solarus {
+
+/**
+ * \brief Creates a client not connected yet.
+ */
+Client::Client():
+  socket(-1) {
 
-Client::Client(){
 }
 
-Client::~Client(){
+/**
+ * \brief Destructor. Closes the connection if any.
+ */
+Client::~Client() {
+  disconnect();
 }
 
-bool Client::Connect(char* srv_addr, unsigned short int port){
-	if((this->sock = socket(AF_INET, SOCK_STREAM, 0)) < 0){
-		cout << "Client socket not created" << endl;
-		return false;
-	} 
+/**
+ * \brief Connects to a server.
+ * \param host IPv4 address of the server.
+ * \param port Port of the server.
+ * \return \c true in case of success.
+ */
+bool Client::connect(const std::string& host, uint16_t port) {
+
+  disconnect();
+
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_port = htons(port);
+  if (inet_pton(AF_INET, host.c_str(), &address.sin_addr) <= 0) {
+    std::cout << "Invalid server address: '" << host << "'" << std::endl;
+    return false;
+  }
+
+  socket = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (socket < 0) {
+    std::cout << "Client socket not created: " << std::strerror(errno) << std::endl;
+    return false;
+  }
 
-	memset(&this->srv_addr, '0', sizeof(this->srv_addr)); 
-	this->srv_addr.sin_family = AF_INET;
-	this->srv_addr.sin_port = htons(port); 
+  if (::connect(socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+    std::cout << "Cannot connect to server " << host << ":" << port << ": "
+        << std::strerror(errno) << std::endl;
+    disconnect();
+    return false;
+  }
 
-	if(inet_pton(AF_INET, srv_addr, &this->srv_addr.sin_addr)<=0){
-		cout << "inet_pton failed" << endl;
-		return false;
-	} 
+  // Game commands are small and must be sent immediately.
+  const int enable = 1;
+  setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+  return true;
+}
+
+/**
+ * \brief Closes the connection.
+ */
+void Client::disconnect() {
 
-	if( connect(this->sock, (struct sockaddr *)&this->srv_addr, sizeof(this->srv_addr)) < 0){
-		cout << "Client connection failed" << endl;
-		return false;
-	}
+  if (socket >= 0) {
+    close(socket);
+    socket = -1;
+  }
+}
+
+/**
+ * \brief Returns whether the client is connected.
+ * \return \c true if the connection is open.
+ */
+bool Client::is_connected() const {
+  return socket >= 0;
+}
 
-	return true; 
+/**
+ * \brief Returns the socket of the connection.
+ * \return The socket, or -1 if the client is not connected.
+ */
+int Client::get_socket() const {
+  return socket;
 }
+
+/**
+ * \brief Sends bytes to the server.
+ * \param bytes The bytes to send.
+ * \param size Number of bytes to send.
+ * \return \c true if all bytes were sent.
+ */
+bool Client::send(const char* bytes, size_t size) {
+
+  while (size > 0) {
+    const ssize_t result = ::send(socket, bytes, size, MSG_NOSIGNAL);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    bytes += result;
+    size -= result;
+  }
+  return true;
+}
+
+/**
+ * \brief Waits for bytes from the server.
+ * \param bytes Where to store the bytes received.
+ * \param size Number of bytes to receive.
+ * \return \c true if all bytes were received, \c false if the connection
+ * was closed before.
+ */
+bool Client::receive(char* bytes, size_t size) {
+
+  while (size > 0) {
+    const ssize_t result = recv(socket, bytes, size, 0);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    }
+    if (result <= 0) {
+      return false;
+    }
+    bytes += result;
+    size -= result;
+  }
+  return true;
+}
+
+}
+
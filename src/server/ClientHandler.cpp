@@ -1,28 +1,259 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
 #include "solarus/server/ClientHandler.h"
-#define BUFFSIZE 256
+#include "solarus/server/GameSession.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <unistd.h>
 
-ClientHandler::ClientHandler(client_data* c){
-	this->cl_d.client_addr = c->client_addr;
-	this->cl_d.socket = c->socket;
+namespace Solarus {
 
-	this->Handle();
+/**
+ * \brief Creates a handler for a connection just accepted.
+ * \param socket The connected socket. It must be non-blocking.
+ * \param address Address of the client.
+ * \param buffer_size Size of the input and output buffers in bytes.
+ * The input buffer can always hold at least one packet of the maximum size,
+ * and the output buffer a snapshot of the maximum size if there is a game.
+ * \param session The game hosted by the server, or nullptr.
+ */
+ClientHandler::ClientHandler(
+    int socket,
+    const sockaddr_in& address,
+    size_t buffer_size,
+    GameSession* session
+):
+  socket(socket),
+  address(address),
+  input(std::max(buffer_size, Protocol::max_packet_size)),
+  output(session != nullptr ?
+      std::max(buffer_size, Protocol::max_snapshot_packet_size) : buffer_size),
+  reader(input),
+  session(session),
+  has_sequence(false),
+  last_sequence(0),
+  num_commands(0) {
+
+}
+
+/**
+ * \brief Destructor. Closes the connection.
+ */
+ClientHandler::~ClientHandler() {
+
+  if (socket >= 0) {
+    close(socket);
+  }
+}
+
+/**
+ * \brief Returns the socket of this connection.
+ * \return The socket.
+ */
+int ClientHandler::get_socket() const {
+  return socket;
+}
+
+/**
+ * \brief Returns the address of the client as a string.
+ * \return The IP address and port of the client.
+ */
+std::string ClientHandler::get_address() const {
+
+  char ip[INET_ADDRSTRLEN] = "";
+  inet_ntop(AF_INET, &address.sin_addr, ip, sizeof(ip));
+  return std::string(ip) + ":" + std::to_string(ntohs(address.sin_port));
+}
+
+/**
+ * \brief Returns whether the handler can accept more incoming bytes.
+ *
+ * When the buffers are full because the client does not read its replies,
+ * the server stops reading from this client until it can send again.
+ *
+ * \return \c true if the socket should be watched for reading.
+ */
+bool ClientHandler::wants_input() const {
+  return !input.is_full();
+}
+
+/**
+ * \brief Returns whether some bytes are waiting to be sent.
+ * \return \c true if the socket should be watched for writing.
+ */
+bool ClientHandler::has_output() const {
+  return !output.is_empty();
+}
+
+/**
+ * \brief Reads what is available on the socket and processes it.
+ * \return \c false if the connection is closed or broken.
+ */
+bool ClientHandler::on_readable() {
+
+  while (!input.is_full()) {
+    const ssize_t result = input.read_from(socket);
+    if (result == 0) {
+      // Closed by the client.
+      return false;
+    }
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return false;
+    }
+    if (!process_input()) {
+      return false;
+    }
+  }
+
+  // Try to reply immediately rather than waiting for the next event.
+  return on_writable();
 }
 
-void ClientHandler::Handle(){
-	cout << "Client " << inet_ntoa(this->cl_d.client_addr.sin_addr) << " connected" << endl;
+/**
+ * \brief Sends as many pending bytes as the socket accepts.
+ * \return \c false if the connection is broken.
+ */
+bool ClientHandler::on_writable() {
+
+  while (!output.is_empty()) {
+    const ssize_t result = output.write_to(socket);
+    if (result < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        break;
+      }
+      return false;
+    }
+  }
+
+  // Room was made in the output buffer: process what was waiting.
+  if (!input.is_empty()) {
+    return process_input();
+  }
+  return true;
+}
+
+/**
+ * \brief Queues a packet to be sent.
+ *
+ * The packet is sent when the socket is writable.
+ *
+ * \param packet The packet.
+ * \return \c false if the output buffer has no room for it: nothing
+ * is queued in this case.
+ */
+bool ClientHandler::send(const std::string& packet) {
+
+  if (output.get_free_space() < packet.size()) {
+    return false;
+  }
+  output.push(packet.data(), packet.size());
+  return true;
+}
+
+/**
+ * \brief Returns the number of game command events received.
+ * \return The number of events, not counting duplicates.
+ */
+uint64_t ClientHandler::get_num_commands() const {
+  return num_commands;
+}
+
+/**
+ * \brief Returns the sequence number of the last game command event received.
+ * \param[out] sequence The sequence number.
+ * \return \c false if no event was received yet.
+ */
+bool ClientHandler::get_last_sequence(uint32_t& sequence) const {
+
+  sequence = last_sequence;
+  return has_sequence;
+}
+
+/**
+ * \brief Decodes and handles the packets received.
+ *
+ * Packets are processed as long as the output buffer has room for the
+ * acknowledgement.
+ *
+ * \return \c false if the client sent invalid data.
+ */
+bool ClientHandler::process_input() {
+
+  bool acknowledge = false;
+  Protocol::Packet packet;
+  while (output.get_free_space() >= Protocol::ack_packet_size) {
+
+    const PacketReader::Result result = reader.next(packet);
+    if (result == PacketReader::Result::INCOMPLETE) {
+      break;
+    }
+    if (result == PacketReader::Result::INVALID) {
+      return false;
+    }
+
+    if (packet.type == Protocol::MessageType::SNAPSHOT_ACK && session != nullptr) {
+      uint32_t tick = 0;
+      if (!Protocol::decode_snapshot_ack(packet, tick)) {
+        return false;
+      }
+      session->on_snapshot_ack(*this, tick);
+      continue;
+    }
+
+    const Protocol::CommandBatch batch(packet);
+    if (!batch.is_valid()) {
+      // Clients only send commands and snapshot acknowledgements.
+      return false;
+    }
+
+    const size_t num_events = batch.get_num_events();
+    for (size_t i = 0; i < num_events; ++i) {
+      const Protocol::GameCommandEvent& event = batch.get_event(i);
+      if (has_sequence && !Protocol::is_sequence_newer(event.sequence, last_sequence)) {
+        // Already received.
+        continue;
+      }
+      has_sequence = true;
+      last_sequence = event.sequence;
+      ++num_commands;
+      if (session != nullptr) {
+        session->on_command(*this, event);
+      }
+    }
+    acknowledge = has_sequence;
+  }
+  reader.release();
 
-	string cmd;
-	char buffer[BUFFSIZE];
-	int n;
-	while((n = read(this->cl_d.socket, buffer, BUFFSIZE)) > 0) {
-		cmd = string (buffer);
-		cout << cmd;
-		bzero(buffer,BUFFSIZE);
-	}
+  if (acknowledge) {
+    char ack[Protocol::ack_packet_size];
+    Protocol::encode_ack(last_sequence, ack);
+    output.push(ack, sizeof(ack));
+  }
+  return true;
 }
 
-ClientHandler::~ClientHandler(){
-	if (this->cl_d.socket > 0) {
-		close(this->cl_d.socket);
-	}
 }
@@ -0,0 +1,434 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/Hero.h"
+#include "solarus/entities/MapEntities.h"
+#include "solarus/server/ClientHandler.h"
+#include "solarus/server/GameSession.h"
+#include "solarus/Game.h"
+#include "solarus/MainLoop.h"
+#include "solarus/Map.h"
+#include "solarus/Savegame.h"
+#include "solarus/Sprite.h"
+#include <algorithm>
+#include <chrono>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Maximum number of snapshots kept for each client.
+ *
+ * If a client does not acknowledge any of them, it receives a full
+ * snapshot again.
+ */
+const size_t max_snapshot_history = 64;
+
+/**
+ * \brief Number of built-in game commands.
+ */
+const int num_game_commands = static_cast<int>(GameCommand::DOWN) + 1;
+
+}
+
+/**
+ * \brief Creates a session for a main loop.
+ *
+ * The main loop should be created with the options -no-video and -no-audio.
+ *
+ * \param main_loop The main loop to simulate.
+ */
+GameSession::GameSession(MainLoop& main_loop):
+  main_loop(main_loop),
+  game(nullptr),
+  current_tick(0),
+  clients(),
+  pending_commands(),
+  snapshot(),
+  entity_ids(),
+  previous_entity_ids(),
+  next_entity_id(0),
+  strings(),
+  string_indexes(),
+  packet(),
+  total_tick_time(0),
+  num_bytes_sent(0),
+  num_snapshots_sent(0) {
+
+  std::fill(num_holders, num_holders + num_game_commands, 0);
+
+  // Index 0 is used by entities without sprite.
+  get_string_index("");
+}
+
+/**
+ * \brief Starts a new game in the main loop.
+ *
+ * The game actually starts at the next tick.
+ *
+ * \param savegame_file Name of the savegame file to load if it exists.
+ * \param map_id Id of the map to start, or an empty string to use the
+ * starting map of the savegame.
+ */
+void GameSession::start_game(const std::string& savegame_file, const std::string& map_id) {
+
+  std::shared_ptr<Savegame> savegame = std::make_shared<Savegame>(main_loop, savegame_file);
+  savegame->initialize();
+  if (!map_id.empty()) {
+    savegame->set_string(Savegame::KEY_STARTING_MAP, map_id);
+  }
+  main_loop.set_game(new Game(main_loop, savegame));
+}
+
+/**
+ * \brief Registers a new client.
+ *
+ * It will receive a full snapshot after the next tick.
+ *
+ * \param client The client.
+ */
+void GameSession::add_client(ClientHandler& client) {
+  clients[&client] = ClientState();
+}
+
+/**
+ * \brief Forgets a client that is disconnected.
+ *
+ * The commands it was holding are released.
+ *
+ * \param client The client.
+ */
+void GameSession::remove_client(ClientHandler& client) {
+
+  const auto& it = clients.find(&client);
+  if (it == clients.end()) {
+    return;
+  }
+
+  ClientState& state = it->second;
+  for (int i = 0; i < num_game_commands; ++i) {
+    set_command_pressed(state, static_cast<GameCommand>(i), false);
+  }
+  clients.erase(it);
+
+  pending_commands.erase(std::remove_if(pending_commands.begin(), pending_commands.end(),
+      [&client](const std::pair<ClientHandler*, Protocol::GameCommandEvent>& command) {
+    return command.first == &client;
+  }), pending_commands.end());
+}
+
+/**
+ * \brief Receives a game command event from a client.
+ *
+ * It will be applied at the beginning of the next tick.
+ *
+ * \param client The client.
+ * \param event The event.
+ */
+void GameSession::on_command(ClientHandler& client, const Protocol::GameCommandEvent& event) {
+  pending_commands.emplace_back(&client, event);
+}
+
+/**
+ * \brief Receives the acknowledgement of a snapshot from a client.
+ *
+ * Next snapshots sent to this client will be encoded against it.
+ *
+ * \param client The client.
+ * \param tick Tick of the snapshot received.
+ */
+void GameSession::on_snapshot_ack(ClientHandler& client, uint32_t tick) {
+
+  const auto& it = clients.find(&client);
+  if (it == clients.end()) {
+    return;
+  }
+
+  ClientState& state = it->second;
+  if (state.has_ack && !Protocol::is_sequence_newer(tick, state.acked_tick)) {
+    return;
+  }
+  state.has_ack = true;
+  state.acked_tick = tick;
+
+  // Older snapshots will never be used as a baseline.
+  while (!state.sent.empty() && Protocol::is_sequence_newer(tick, state.sent.front().tick)) {
+    state.sent.pop_front();
+  }
+}
+
+/**
+ * \brief Simulates one step of the game and sends snapshots to clients.
+ */
+void GameSession::tick() {
+
+  const std::chrono::steady_clock::time_point start_date = std::chrono::steady_clock::now();
+
+  ++current_tick;
+  apply_commands();
+  main_loop.step();
+  check_game_changed();
+  capture_snapshot();
+  for (auto& kvp: clients) {
+    send_snapshot(*kvp.first, kvp.second);
+  }
+
+  total_tick_time += std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start_date).count();
+}
+
+/**
+ * \brief Returns the number of ticks simulated.
+ * \return The current tick.
+ */
+uint32_t GameSession::get_tick() const {
+  return current_tick;
+}
+
+/**
+ * \brief Returns the number of clients connected.
+ * \return The number of clients.
+ */
+int GameSession::get_num_clients() const {
+  return static_cast<int>(clients.size());
+}
+
+/**
+ * \brief Returns the time spent in ticks, including encoding snapshots.
+ * \return The total time in microseconds.
+ */
+uint64_t GameSession::get_total_tick_time() const {
+  return total_tick_time;
+}
+
+/**
+ * \brief Returns the size of all snapshots sent.
+ * \return The number of bytes sent.
+ */
+uint64_t GameSession::get_num_bytes_sent() const {
+  return num_bytes_sent;
+}
+
+/**
+ * \brief Returns the number of snapshots sent to all clients.
+ * \return The number of snapshots.
+ */
+uint64_t GameSession::get_num_snapshots_sent() const {
+  return num_snapshots_sent;
+}
+
+/**
+ * \brief Applies the game command events received since the last tick.
+ */
+void GameSession::apply_commands() {
+
+  check_game_changed();
+  for (const std::pair<ClientHandler*, Protocol::GameCommandEvent>& command: pending_commands) {
+    const auto& it = clients.find(command.first);
+    if (it != clients.end()) {
+      set_command_pressed(it->second, command.second.command, command.second.pressed);
+    }
+  }
+  pending_commands.clear();
+}
+
+/**
+ * \brief Presses or releases a game command on behalf of a client.
+ *
+ * The game is only notified when the first client presses the command
+ * and when the last one releases it.
+ *
+ * \param state The client.
+ * \param command The command.
+ * \param pressed \c true to press it, \c false to release it.
+ */
+void GameSession::set_command_pressed(ClientState& state, GameCommand command, bool pressed) {
+
+  const int index = static_cast<int>(command);
+  const uint16_t bit = static_cast<uint16_t>(1 << index);
+  if (((state.commands_pressed & bit) != 0) == pressed) {
+    return;
+  }
+
+  if (pressed) {
+    state.commands_pressed |= bit;
+    if (num_holders[index]++ == 0 && game != nullptr) {
+      game->hold_command(command);
+    }
+  }
+  else {
+    state.commands_pressed &= ~bit;
+    if (--num_holders[index] == 0 && game != nullptr) {
+      game->release_held_command(command);
+    }
+  }
+}
+
+/**
+ * \brief Presses the commands held by clients again if the game has changed.
+ *
+ * A new game does not know the commands pressed before it started.
+ * Commands are only sent once the game has a map.
+ */
+void GameSession::check_game_changed() {
+
+  Game* current_game = main_loop.get_game();
+  if (current_game != nullptr && !current_game->has_current_map()) {
+    current_game = nullptr;
+  }
+
+  if (current_game == game) {
+    return;
+  }
+
+  game = current_game;
+  if (game == nullptr) {
+    return;
+  }
+
+  for (int i = 0; i < num_game_commands; ++i) {
+    if (num_holders[i] > 0) {
+      game->hold_command(static_cast<GameCommand>(i));
+    }
+  }
+}
+
+/**
+ * \brief Records the state of the entities of the current map.
+ */
+void GameSession::capture_snapshot() {
+
+  snapshot.tick = current_tick;
+  snapshot.entities.clear();
+  previous_entity_ids.swap(entity_ids);
+  entity_ids.clear();
+
+  if (game != nullptr) {
+    add_entity(game->get_hero());
+    for (const EntityPtr& entity: game->get_current_map().get_entities().get_entities()) {
+      add_entity(entity);
+    }
+  }
+
+  std::sort(snapshot.entities.begin(), snapshot.entities.end(),
+      [](const EntityState& entity_1, const EntityState& entity_2) {
+    return entity_1.id < entity_2.id;
+  });
+  snapshot.num_strings = strings.size();
+}
+
+/**
+ * \brief Adds an entity to the current snapshot.
+ *
+ * Entities keep the same id as long as they exist.
+ *
+ * \param entity The entity.
+ */
+void GameSession::add_entity(const std::shared_ptr<Entity>& entity) {
+
+  const auto& it = previous_entity_ids.find(entity.get());
+  uint32_t id = 0;
+  if (it != previous_entity_ids.end() && !it->second.entity.expired()) {
+    id = it->second.id;
+  }
+  else {
+    // New entity, or the previous one with this address was destroyed.
+    id = next_entity_id++;
+  }
+  EntityId& entity_id = entity_ids[entity.get()];
+  entity_id.entity = entity;
+  entity_id.id = id;
+
+  EntityState state;
+  const Point& xy = entity->get_xy();
+  state.id = id;
+  state.x = xy.x;
+  state.y = xy.y;
+  state.layer = static_cast<uint8_t>(entity->get_layer());
+  state.sprite = 0;
+  state.animation = 0;
+  state.direction = 0;
+  state.frame = 0;
+  if (entity->has_sprite()) {
+    const Sprite& sprite = entity->get_sprite();
+    state.sprite = get_string_index(sprite.get_animation_set_id());
+    state.animation = get_string_index(sprite.get_current_animation());
+    state.direction = static_cast<uint8_t>(sprite.get_current_direction());
+    state.frame = static_cast<uint16_t>(sprite.get_current_frame());
+  }
+  snapshot.entities.push_back(state);
+}
+
+/**
+ * \brief Returns the index of a string in the string table, adding it
+ * if necessary.
+ * \param string A sprite or animation name.
+ * \return Its index, or 0 (the empty string) if it cannot be sent.
+ */
+uint16_t GameSession::get_string_index(const std::string& string) {
+
+  const auto& it = string_indexes.find(string);
+  if (it != string_indexes.end()) {
+    return it->second;
+  }
+
+  if (strings.size() >= 0xFFFF) {
+    // The table is full.
+    return 0;
+  }
+  if (string.size() > SnapshotCodec::max_string_length) {
+    // Snapshots cannot hold it.
+    return 0;
+  }
+  const uint16_t index = static_cast<uint16_t>(strings.size());
+  strings.push_back(string);
+  string_indexes[string] = index;
+  return index;
+}
+
+/**
+ * \brief Sends the current snapshot to a client.
+ *
+ * If the output buffer of the client is full, nothing is sent this time.
+ *
+ * \param client The client.
+ * \param state What the session knows about this client.
+ */
+void GameSession::send_snapshot(ClientHandler& client, ClientState& state) {
+
+  const Snapshot* baseline = nullptr;
+  if (state.has_ack && !state.sent.empty() && state.sent.front().tick == state.acked_tick) {
+    baseline = &state.sent.front();
+  }
+
+  Snapshot sent;
+  packet.clear();
+  SnapshotCodec::encode(baseline, snapshot, strings, packet, sent);
+  if (!client.send(packet)) {
+    return;
+  }
+
+  state.sent.push_back(std::move(sent));
+  if (state.sent.size() > max_snapshot_history) {
+    state.sent.pop_front();
+  }
+  num_bytes_sent += packet.size();
+  ++num_snapshots_sent;
+}
+
+}
+
@@ -0,0 +1,474 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/server/Protocol.h"
+#include "solarus/server/Types.h"
+#include "solarus/Arguments.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sstream>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace Solarus;
+
+/*
+ * Load generator for the game server.
+ *
+ * It measures two things against a running server:
+ * - the connection rate: connections are opened, send one packet of game
+ *   commands, wait for its acknowledgement and are closed, as fast as
+ *   possible;
+ * - the latency of requests on persistent connections: each connection
+ *   sends a packet of game commands and waits for its acknowledgement
+ *   before sending the next one.
+ */
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+/**
+ * \brief Settings of a benchmark.
+ */
+struct Settings {
+  sockaddr_in address;           /**< Address of the server. */
+  int num_connections;           /**< Concurrent connections per thread. */
+  int num_threads;               /**< Number of threads generating load. */
+  double duration;               /**< Duration of each test in seconds. */
+  size_t num_commands;           /**< Game command events per packet. */
+};
+
+/**
+ * \brief Results of a test in a thread.
+ */
+struct Results {
+  uint64_t num_done = 0;                 /**< Connections or requests completed. */
+  uint64_t num_errors = 0;               /**< Failed connections. */
+  std::vector<uint32_t> latencies;       /**< Latency of each one in microseconds. */
+};
+
+/**
+ * \brief State of a connection of the load generator.
+ */
+struct Connection {
+  int socket = -1;               /**< The socket, or -1. */
+  bool connected = false;        /**< Whether the connection is established. */
+  uint32_t next_sequence = 0;    /**< Sequence number of the next event. */
+  size_t num_received = 0;       /**< Bytes of the acknowledgement received so far. */
+  char ack[Protocol::ack_packet_size];  /**< The acknowledgement received. */
+  Clock::time_point start_date;  /**< When the current exchange started. */
+};
+
+/**
+ * \brief Returns the microseconds elapsed since a date.
+ * \param date A date in the past.
+ * \return The time elapsed.
+ */
+uint32_t get_elapsed_us(const Clock::time_point& date) {
+  return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+      Clock::now() - date).count());
+}
+
+/**
+ * \brief Closes a connection immediately.
+ *
+ * The connection is reset instead of going through TIME_WAIT,
+ * otherwise local ports run out after a few seconds of connection test.
+ *
+ * \param connection The connection to close.
+ */
+void close_connection(Connection& connection) {
+
+  if (connection.socket >= 0) {
+    linger option;
+    option.l_onoff = 1;
+    option.l_linger = 0;
+    setsockopt(connection.socket, SOL_SOCKET, SO_LINGER, &option, sizeof(option));
+    close(connection.socket);
+  }
+  connection.socket = -1;
+  connection.connected = false;
+  connection.num_received = 0;
+}
+
+/**
+ * \brief Starts a non-blocking connection to the server.
+ * \param settings Settings of the benchmark.
+ * \param epoll_fd The epoll instance to register the socket to.
+ * \param index Index of the connection, stored in epoll events.
+ * \param connection The connection to open.
+ * \return \c true if the connection is started.
+ */
+bool open_connection(
+    const Settings& settings,
+    int epoll_fd,
+    int index,
+    Connection& connection
+) {
+  connection.socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (connection.socket < 0) {
+    return false;
+  }
+  const int enable = 1;
+  setsockopt(connection.socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+  connection.start_date = Clock::now();
+  connection.connected = false;
+  connection.num_received = 0;
+  if (connect(connection.socket, reinterpret_cast<const sockaddr*>(&settings.address),
+      sizeof(settings.address)) < 0 && errno != EINPROGRESS) {
+    close_connection(connection);
+    return false;
+  }
+
+  epoll_event event;
+  std::memset(&event, 0, sizeof(event));
+  event.events = EPOLLOUT;
+  event.data.u32 = static_cast<uint32_t>(index);
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection.socket, &event) < 0) {
+    close_connection(connection);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * \brief Sends a packet of game commands and waits for its acknowledgement.
+ * \param settings Settings of the benchmark.
+ * \param epoll_fd The epoll instance of the connection.
+ * \param index Index of the connection, stored in epoll events.
+ * \param connection The connection.
+ * \param[in,out] commands Buffer reused to build the events.
+ * \param[in,out] packet Buffer reused to encode the packet.
+ * \return \c true in case of success.
+ */
+bool send_commands(
+    const Settings& settings,
+    int epoll_fd,
+    int index,
+    Connection& connection,
+    std::vector<Protocol::GameCommandEvent>& commands,
+    std::string& packet
+) {
+  const uint32_t timestamp = static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+      Clock::now().time_since_epoch()).count());
+  commands.resize(settings.num_commands);
+  for (size_t i = 0; i < commands.size(); ++i) {
+    Protocol::GameCommandEvent& command = commands[i];
+    command.sequence = connection.next_sequence++;
+    command.timestamp = timestamp;
+    command.command = (i / 2) % 2 == 0 ? GameCommand::RIGHT : GameCommand::UP;
+    command.pressed = i % 2 == 0;
+  }
+  packet.clear();
+  Protocol::encode_commands(commands.data(), commands.size(), packet);
+
+  // Packets are small: the socket buffer always accepts them entirely.
+  if (send(connection.socket, packet.data(), packet.size(), MSG_NOSIGNAL) !=
+      static_cast<ssize_t>(packet.size())) {
+    return false;
+  }
+  connection.num_received = 0;
+
+  epoll_event event;
+  std::memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u32 = static_cast<uint32_t>(index);
+  return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection.socket, &event) == 0;
+}
+
+/**
+ * \brief Checks the acknowledgement received on a connection.
+ * \param connection The connection.
+ * \return \c true if the server acknowledged the last event sent.
+ */
+bool check_ack(const Connection& connection) {
+
+  Protocol::Packet packet;
+  size_t payload_size = 0;
+  uint32_t sequence = 0;
+  if (!Protocol::read_header(connection.ack, packet.type, payload_size)) {
+    return false;
+  }
+  packet.payload = connection.ack + Protocol::header_size;
+  packet.size = payload_size;
+  return Protocol::decode_ack(packet, sequence) &&
+      sequence == connection.next_sequence - 1;
+}
+
+/**
+ * \brief Runs a test in the current thread.
+ * \param settings Settings of the benchmark.
+ * \param reconnect \c true to open a new connection for each packet
+ * (connection test), \c false to keep connections open (latency test).
+ * \param results Where to store the results.
+ */
+void run_test(const Settings& settings, bool reconnect, Results& results) {
+
+  const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  std::vector<Protocol::GameCommandEvent> commands;
+  std::string packet;
+  std::vector<Connection> connections(settings.num_connections);
+  const Clock::time_point end_date = Clock::now() +
+      std::chrono::microseconds(static_cast<int64_t>(settings.duration * 1000000));
+
+  for (int i = 0; i < settings.num_connections; ++i) {
+    if (!open_connection(settings, epoll_fd, i, connections[i])) {
+      ++results.num_errors;
+    }
+  }
+
+  std::vector<epoll_event> events(settings.num_connections);
+  while (Clock::now() < end_date) {
+    const int num_events = epoll_wait(epoll_fd, events.data(), settings.num_connections, 100);
+    for (int j = 0; j < num_events; ++j) {
+      const int index = static_cast<int>(events[j].data.u32);
+      Connection& connection = connections[index];
+      bool ok = (events[j].events & (EPOLLERR | EPOLLHUP)) == 0;
+
+      if (ok && !connection.connected) {
+        // Connection established.
+        connection.connected = true;
+        if (!reconnect) {
+          connection.start_date = Clock::now();
+        }
+        ok = send_commands(settings, epoll_fd, index, connection, commands, packet);
+      }
+      else if (ok) {
+        // Part of the acknowledgement received.
+        const ssize_t result = recv(connection.socket,
+            connection.ack + connection.num_received,
+            Protocol::ack_packet_size - connection.num_received, 0);
+        if (result < 0 && (errno == EAGAIN || errno == EINTR)) {
+          continue;
+        }
+        ok = result > 0;
+        if (ok) {
+          connection.num_received += result;
+        }
+        if (ok && connection.num_received == Protocol::ack_packet_size) {
+          ok = check_ack(connection);
+          if (ok) {
+            ++results.num_done;
+            results.latencies.push_back(get_elapsed_us(connection.start_date));
+            if (reconnect) {
+              close_connection(connection);
+              if (!open_connection(settings, epoll_fd, index, connection)) {
+                ++results.num_errors;
+              }
+              continue;
+            }
+            connection.start_date = Clock::now();
+            ok = send_commands(settings, epoll_fd, index, connection, commands, packet);
+          }
+        }
+      }
+
+      if (!ok) {
+        ++results.num_errors;
+        close_connection(connection);
+        if (!open_connection(settings, epoll_fd, index, connection)) {
+          ++results.num_errors;
+        }
+      }
+    }
+  }
+
+  for (Connection& connection: connections) {
+    close_connection(connection);
+  }
+  close(epoll_fd);
+}
+
+/**
+ * \brief Returns a percentile of sorted latencies.
+ * \param latencies Sorted latencies.
+ * \param percentile The percentile to get, between 0 and 100.
+ * \return The corresponding latency.
+ */
+uint32_t get_percentile(const std::vector<uint32_t>& latencies, double percentile) {
+
+  if (latencies.empty()) {
+    return 0;
+  }
+  const size_t index = static_cast<size_t>(percentile / 100.0 * (latencies.size() - 1) + 0.5);
+  return latencies[std::min(index, latencies.size() - 1)];
+}
+
+/**
+ * \brief Runs a test in all threads and prints its results.
+ * \param settings Settings of the benchmark.
+ * \param reconnect \c true for the connection test,
+ * \c false for the latency test.
+ */
+void run_and_print_test(const Settings& settings, bool reconnect) {
+
+  std::vector<Results> results(settings.num_threads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < settings.num_threads; ++i) {
+    threads.emplace_back(run_test, std::cref(settings), reconnect, std::ref(results[i]));
+  }
+  for (std::thread& thread: threads) {
+    thread.join();
+  }
+
+  Results total;
+  for (const Results& thread_results: results) {
+    total.num_done += thread_results.num_done;
+    total.num_errors += thread_results.num_errors;
+    total.latencies.insert(total.latencies.end(),
+        thread_results.latencies.begin(), thread_results.latencies.end());
+  }
+  std::sort(total.latencies.begin(), total.latencies.end());
+
+  std::cout << (reconnect ? "Connections" : "Requests") << ": "
+      << total.num_done << " in " << settings.duration << " s ("
+      << std::fixed << std::setprecision(0) << (total.num_done / settings.duration)
+      << (reconnect ? " connections/s" : " requests/s") << "), "
+      << total.num_errors << " error(s)" << std::endl
+      << "  latency (us): p50 " << get_percentile(total.latencies, 50)
+      << ", p90 " << get_percentile(total.latencies, 90)
+      << ", p99 " << get_percentile(total.latencies, 99)
+      << ", p99.9 " << get_percentile(total.latencies, 99.9)
+      << ", max " << (total.latencies.empty() ? 0 : total.latencies.back())
+      << std::endl;
+}
+
+/**
+ * \brief Returns the value of an option.
+ * \param args Command-line arguments.
+ * \param key Name of the option, with its leading dash.
+ * \param default_value Value to return if the option is missing or invalid.
+ * \return The value of the option.
+ */
+template<typename T>
+T get_argument(const Arguments& args, const std::string& key, T default_value) {
+
+  const std::string& value_string = args.get_argument_value(key);
+  if (value_string.empty()) {
+    return default_value;
+  }
+
+  std::istringstream iss(value_string);
+  T value = T();
+  if (!(iss >> value) || value <= 0) {
+    std::cerr << "Invalid value for " << key << ": '" << value_string << "'" << std::endl;
+    return default_value;
+  }
+  return value;
+}
+
+/**
+ * \brief Prints the usage of the load generator.
+ * \param args Command-line arguments.
+ */
+void print_help(const Arguments& args) {
+
+  std::string binary_name = args.get_program_name();
+  if (binary_name.empty()) {
+    binary_name = "solarus_server_load";
+  }
+  std::cout << "Usage: " << binary_name << " [options]"
+    << std::endl << std::endl
+    << "Measures the connection rate and the request latency of a game server."
+    << std::endl << std::endl
+    << "Options:"
+    << std::endl
+    << "  -help                         shows this help message and exits"
+    << std::endl
+    << "  -host=<address>               sets the IPv4 address of the server (default 127.0.0.1)"
+    << std::endl
+    << "  -port=<port>                  sets the port of the server (default "
+    << default_server_port << ")"
+    << std::endl
+    << "  -test=connect|latency|all     chooses the tests to run (default all)"
+    << std::endl
+    << "  -connections=<number>         sets the number of concurrent connections per thread (default 32)"
+    << std::endl
+    << "  -threads=<number>             sets the number of threads generating load (default 1)"
+    << std::endl
+    << "  -duration=<seconds>           sets the duration of each test (default 5)"
+    << std::endl
+    << "  -commands=<number>            sets the number of game command events per packet (default 4)"
+    << std::endl;
+}
+
+}
+
+/**
+ * \brief Entry point of the load generator.
+ * \param argc Number of command-line arguments.
+ * \param argv Command-line arguments.
+ * \return 0 in case of success.
+ */
+int main(int argc, char** argv) {
+
+  const Arguments args(argc, argv);
+  if (args.has_argument("-help")) {
+    print_help(args);
+    return 0;
+  }
+
+  Settings settings;
+  std::memset(&settings.address, 0, sizeof(settings.address));
+  settings.address.sin_family = AF_INET;
+  settings.address.sin_port = htons(get_argument<uint16_t>(args, "-port", default_server_port));
+  std::string host = args.get_argument_value("-host");
+  if (host.empty()) {
+    host = "127.0.0.1";
+  }
+  if (inet_pton(AF_INET, host.c_str(), &settings.address.sin_addr) <= 0) {
+    std::cerr << "Invalid server address: '" << host << "'" << std::endl;
+    return 1;
+  }
+  settings.num_connections = get_argument<int>(args, "-connections", 32);
+  settings.num_threads = get_argument<int>(args, "-threads", 1);
+  settings.duration = get_argument<double>(args, "-duration", 5.0);
+  settings.num_commands = std::min(get_argument<size_t>(args, "-commands", 4),
+      Protocol::max_commands_per_packet);
+
+  std::string test = args.get_argument_value("-test");
+  if (test.empty()) {
+    test = "all";
+  }
+
+  std::cout << "Server " << host << ":" << ntohs(settings.address.sin_port) << ", "
+      << settings.num_threads << " thread(s) x " << settings.num_connections
+      << " connection(s), " << settings.num_commands << " command(s) per packet" << std::endl;
+
+  if (test == "connect" || test == "all") {
+    run_and_print_test(settings, true);
+  }
+  if (test == "latency" || test == "all") {
+    run_and_print_test(settings, false);
+  }
+  return 0;
+}
+
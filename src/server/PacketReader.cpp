@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/server/PacketReader.h"
+#include "solarus/server/RingBuffer.h"
+
+namespace Solarus {
+
+/**
+ * \brief Creates a reader of packets.
+ * \param input The buffer where bytes received are accumulated.
+ * Its capacity must be at least Protocol::max_packet_size.
+ * Bigger packets are only accepted if they fit in it.
+ */
+PacketReader::PacketReader(RingBuffer& input):
+  input(input),
+  scratch(input.get_capacity()),
+  packet_size(0) {
+
+}
+
+/**
+ * \brief Reads the next complete packet.
+ *
+ * The packet returned previously is released first.
+ *
+ * \param[out] packet The packet read, if any. Its payload remains valid
+ * until the next call to next() or release().
+ * \return Whether a packet was read.
+ */
+PacketReader::Result PacketReader::next(Protocol::Packet& packet) {
+
+  release();
+
+  char header[Protocol::header_size];
+  if (input.peek(header, Protocol::header_size) < Protocol::header_size) {
+    return Result::INCOMPLETE;
+  }
+
+  size_t payload_size = 0;
+  if (!Protocol::read_header(header, packet.type, payload_size)) {
+    return Result::INVALID;
+  }
+
+  const size_t size = Protocol::header_size + payload_size;
+  if (size > input.get_capacity()) {
+    // This packet can never be received completely.
+    return Result::INVALID;
+  }
+  if (input.get_size() < size) {
+    return Result::INCOMPLETE;
+  }
+
+  size_t contiguous_size = 0;
+  const char* data = input.get_contiguous_data(contiguous_size);
+  if (contiguous_size >= size) {
+    // Usual case: parse directly from the ring buffer.
+    packet.payload = data + Protocol::header_size;
+  }
+  else {
+    input.peek(scratch.data(), Protocol::header_size, payload_size);
+    packet.payload = scratch.data();
+  }
+  packet.size = payload_size;
+  packet_size = size;
+  return Result::PACKET;
+}
+
+/**
+ * \brief Removes the packet returned last from the input buffer.
+ *
+ * Call this when the packet is no longer used. Bytes can be appended to
+ * the input buffer before, but it must not be consumed or cleared by
+ * anything else.
+ */
+void PacketReader::release() {
+
+  input.consume(packet_size);
+  packet_size = 0;
+}
+
+}
+
@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/server/Protocol.h"
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Highest bit of the command byte of an event: set if pressed.
+ */
+const uint8_t pressed_flag = 0x80;
+
+/**
+ * \brief Number of built-in game commands.
+ */
+const int num_game_commands = static_cast<int>(GameCommand::DOWN) + 1;
+
+}
+
+const size_t Protocol::header_size;
+const size_t Protocol::max_packet_size;
+const size_t Protocol::commands_header_size;
+const size_t Protocol::command_event_size;
+const size_t Protocol::max_commands_per_packet;
+const size_t Protocol::ack_packet_size;
+const size_t Protocol::max_snapshot_packet_size;
+
+/**
+ * \brief Decodes the header of a packet.
+ * \param[in] header The first header_size bytes of the packet.
+ * \param[out] type Type of message.
+ * \param[out] payload_size Size of the payload that follows the header.
+ * \return \c false if the header is invalid: unknown type or packet too big.
+ * Only snapshots can exceed max_packet_size.
+ */
+bool Protocol::read_header(const char* header, MessageType& type, size_t& payload_size) {
+
+  payload_size = read_uint16(header);
+  type = static_cast<MessageType>(header[2]);
+  switch (type) {
+
+    case MessageType::SNAPSHOT:
+      return true;
+
+    case MessageType::COMMANDS:
+    case MessageType::ACK:
+    case MessageType::SNAPSHOT_ACK:
+      return payload_size <= max_packet_size - header_size;
+  }
+  return false;
+}
+
+/**
+ * \brief Appends game command events to a buffer as COMMANDS packets.
+ *
+ * Consecutive events are batched into the same packet as long as their
+ * sequence numbers follow each other, their timestamps are close enough
+ * and the packet does not exceed the maximum size.
+ *
+ * \param events The events to encode.
+ * \param num_events Number of events.
+ * \param buffer The buffer to append packets to.
+ * It is not cleared, so that the same allocation can be reused.
+ * \return Number of packets appended.
+ */
+size_t Protocol::encode_commands(
+    const GameCommandEvent* events,
+    size_t num_events,
+    std::string& buffer
+) {
+  size_t num_packets = 0;
+  size_t first = 0;
+  while (first < num_events) {
+
+    // Find how many events fit in this packet.
+    const GameCommandEvent& first_event = events[first];
+    size_t end = first + 1;
+    while (end < num_events &&
+        end - first < max_commands_per_packet &&
+        events[end].sequence == first_event.sequence + (end - first) &&
+        events[end].timestamp - first_event.timestamp <= 0xFFFF) {
+      ++end;
+    }
+
+    const size_t payload_size = commands_header_size + (end - first) * command_event_size;
+    const size_t offset = buffer.size();
+    buffer.resize(offset + header_size + payload_size);
+    char* bytes = &buffer[offset];
+    write_header(bytes, MessageType::COMMANDS, payload_size);
+    bytes += header_size;
+    write_uint32(bytes, first_event.sequence);
+    write_uint32(bytes + 4, first_event.timestamp);
+    bytes += commands_header_size;
+
+    for (size_t i = first; i < end; ++i) {
+      const GameCommandEvent& event = events[i];
+      uint8_t code = static_cast<uint8_t>(event.command);
+      if (event.pressed) {
+        code |= pressed_flag;
+      }
+      bytes[0] = static_cast<char>(code);
+      write_uint16(bytes + 1, static_cast<uint16_t>(event.timestamp - first_event.timestamp));
+      bytes += command_event_size;
+    }
+
+    ++num_packets;
+    first = end;
+  }
+  return num_packets;
+}
+
+/**
+ * \brief Appends an ACK packet to a buffer.
+ * \param sequence Sequence number of the last event processed.
+ * \param buffer The buffer to append the packet to.
+ */
+void Protocol::encode_ack(uint32_t sequence, std::string& buffer) {
+
+  const size_t offset = buffer.size();
+  buffer.resize(offset + ack_packet_size);
+  encode_ack(sequence, &buffer[offset]);
+}
+
+/**
+ * \brief Writes an ACK packet to memory.
+ * \param sequence Sequence number of the last event processed.
+ * \param packet Where to write the ack_packet_size bytes of the packet.
+ */
+void Protocol::encode_ack(uint32_t sequence, char* packet) {
+
+  write_header(packet, MessageType::ACK, ack_packet_size - header_size);
+  write_uint32(packet + header_size, sequence);
+}
+
+/**
+ * \brief Decodes an ACK packet.
+ * \param[in] packet The packet.
+ * \param[out] sequence Sequence number of the last event processed.
+ * \return \c false if this is not a valid ACK packet.
+ */
+bool Protocol::decode_ack(const Packet& packet, uint32_t& sequence) {
+
+  if (packet.type != MessageType::ACK ||
+      packet.size != ack_packet_size - header_size) {
+    return false;
+  }
+  sequence = read_uint32(packet.payload);
+  return true;
+}
+
+/**
+ * \brief Appends a SNAPSHOT_ACK packet to a buffer.
+ * \param tick Tick of the last snapshot received.
+ * \param buffer The buffer to append the packet to.
+ */
+void Protocol::encode_snapshot_ack(uint32_t tick, std::string& buffer) {
+
+  const size_t offset = buffer.size();
+  buffer.resize(offset + header_size + 4);
+  write_header(&buffer[offset], MessageType::SNAPSHOT_ACK, 4);
+  write_uint32(&buffer[offset + header_size], tick);
+}
+
+/**
+ * \brief Decodes a SNAPSHOT_ACK packet.
+ * \param[in] packet The packet.
+ * \param[out] tick Tick of the last snapshot received.
+ * \return \c false if this is not a valid SNAPSHOT_ACK packet.
+ */
+bool Protocol::decode_snapshot_ack(const Packet& packet, uint32_t& tick) {
+
+  if (packet.type != MessageType::SNAPSHOT_ACK || packet.size != 4) {
+    return false;
+  }
+  tick = read_uint32(packet.payload);
+  return true;
+}
+
+/**
+ * \brief Compares two sequence numbers, taking wrapping into account.
+ * \param sequence A sequence number.
+ * \param reference Another sequence number.
+ * \return \c true if \c sequence comes after \c reference.
+ */
+bool Protocol::is_sequence_newer(uint32_t sequence, uint32_t reference) {
+  return static_cast<int32_t>(sequence - reference) > 0;
+}
+
+/**
+ * \brief Creates a view of the events of a packet.
+ *
+ * The packet must remain valid as long as the view is used.
+ *
+ * \param packet A packet received.
+ */
+Protocol::CommandBatch::CommandBatch(const Packet& packet):
+  payload(packet.payload),
+  num_events(0),
+  valid(false) {
+
+  if (packet.type != MessageType::COMMANDS ||
+      packet.size < commands_header_size + command_event_size ||
+      (packet.size - commands_header_size) % command_event_size != 0) {
+    return;
+  }
+
+  num_events = (packet.size - commands_header_size) / command_event_size;
+  const char* bytes = payload + commands_header_size;
+  for (size_t i = 0; i < num_events; ++i) {
+    if ((static_cast<uint8_t>(bytes[0]) & ~pressed_flag) >= num_game_commands) {
+      num_events = 0;
+      return;
+    }
+    bytes += command_event_size;
+  }
+  valid = true;
+}
+
+/**
+ * \brief Returns whether the packet contains well-formed events.
+ *
+ * Invalid packets have no events.
+ *
+ * \return \c true if the batch is valid.
+ */
+bool Protocol::CommandBatch::is_valid() const {
+  return valid;
+}
+
+/**
+ * \brief Returns the number of events in the batch.
+ * \return The number of events.
+ */
+size_t Protocol::CommandBatch::get_num_events() const {
+  return num_events;
+}
+
+/**
+ * \brief Decodes an event of the batch.
+ * \param index Index of the event, lower than get_num_events().
+ * \return The event.
+ */
+Protocol::GameCommandEvent Protocol::CommandBatch::get_event(size_t index) const {
+
+  const char* bytes = payload + commands_header_size + index * command_event_size;
+  const uint8_t code = static_cast<uint8_t>(bytes[0]);
+
+  GameCommandEvent event;
+  event.sequence = read_uint32(payload) + static_cast<uint32_t>(index);
+  event.timestamp = read_uint32(payload + 4) + read_uint16(bytes + 1);
+  event.command = static_cast<GameCommand>(code & ~pressed_flag);
+  event.pressed = (code & pressed_flag) != 0;
+  return event;
+}
+
+/**
+ * \brief Reads a little-endian 16-bit integer.
+ * \param bytes The bytes to read.
+ * \return The integer.
+ */
+uint16_t Protocol::read_uint16(const char* bytes) {
+
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(bytes);
+  return static_cast<uint16_t>(data[0] | (data[1] << 8));
+}
+
+/**
+ * \brief Reads a little-endian 32-bit integer.
+ * \param bytes The bytes to read.
+ * \return The integer.
+ */
+uint32_t Protocol::read_uint32(const char* bytes) {
+
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(bytes);
+  return static_cast<uint32_t>(data[0]) |
+      (static_cast<uint32_t>(data[1]) << 8) |
+      (static_cast<uint32_t>(data[2]) << 16) |
+      (static_cast<uint32_t>(data[3]) << 24);
+}
+
+/**
+ * \brief Writes a little-endian 16-bit integer.
+ * \param bytes Where to write.
+ * \param value The integer.
+ */
+void Protocol::write_uint16(char* bytes, uint16_t value) {
+
+  bytes[0] = static_cast<char>(value & 0xFF);
+  bytes[1] = static_cast<char>(value >> 8);
+}
+
+/**
+ * \brief Writes a little-endian 32-bit integer.
+ * \param bytes Where to write.
+ * \param value The integer.
+ */
+void Protocol::write_uint32(char* bytes, uint32_t value) {
+
+  bytes[0] = static_cast<char>(value & 0xFF);
+  bytes[1] = static_cast<char>((value >> 8) & 0xFF);
+  bytes[2] = static_cast<char>((value >> 16) & 0xFF);
+  bytes[3] = static_cast<char>(value >> 24);
+}
+
+/**
+ * \brief Writes the header of a packet.
+ * \param bytes Where to write.
+ * \param type Type of message.
+ * \param payload_size Size of the payload.
+ */
+void Protocol::write_header(char* bytes, MessageType type, size_t payload_size) {
+
+  write_uint16(bytes, static_cast<uint16_t>(payload_size));
+  bytes[2] = static_cast<char>(type);
+}
+
+}
+
@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/server/RingBuffer.h"
+#include <algorithm>
+#include <cstring>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace Solarus {
+
+/**
+ * \brief Creates an empty buffer.
+ * \param capacity Minimum number of bytes the buffer can hold.
+ * It is rounded up to a power of two.
+ */
+RingBuffer::RingBuffer(size_t capacity):
+  bytes(),
+  mask(0),
+  read_position(0),
+  write_position(0) {
+
+  size_t real_capacity = 1;
+  while (real_capacity < capacity) {
+    real_capacity *= 2;
+  }
+  bytes.resize(real_capacity);
+  mask = real_capacity - 1;
+}
+
+/**
+ * \brief Returns the number of bytes the buffer can hold.
+ * \return The capacity.
+ */
+size_t RingBuffer::get_capacity() const {
+  return bytes.size();
+}
+
+/**
+ * \brief Returns the number of bytes currently stored.
+ * \return The size.
+ */
+size_t RingBuffer::get_size() const {
+  return static_cast<size_t>(write_position - read_position);
+}
+
+/**
+ * \brief Returns the number of bytes that can still be pushed.
+ * \return The free space.
+ */
+size_t RingBuffer::get_free_space() const {
+  return get_capacity() - get_size();
+}
+
+/**
+ * \brief Returns whether no bytes are stored.
+ * \return \c true if the buffer is empty.
+ */
+bool RingBuffer::is_empty() const {
+  return write_position == read_position;
+}
+
+/**
+ * \brief Returns whether no more bytes can be pushed.
+ * \return \c true if the buffer is full.
+ */
+bool RingBuffer::is_full() const {
+  return get_size() == get_capacity();
+}
+
+/**
+ * \brief Removes all bytes.
+ */
+void RingBuffer::clear() {
+  read_position = 0;
+  write_position = 0;
+}
+
+/**
+ * \brief Appends bytes at the end of the buffer.
+ * \param bytes The bytes to append.
+ * \param size Number of bytes to append.
+ * \return Number of bytes actually appended, less than \c size if the
+ * buffer becomes full.
+ */
+size_t RingBuffer::push(const char* bytes, size_t size) {
+
+  size = std::min(size, get_free_space());
+  const size_t start = static_cast<size_t>(write_position) & mask;
+  const size_t first_part = std::min(size, get_capacity() - start);
+  std::memcpy(&this->bytes[start], bytes, first_part);
+  std::memcpy(&this->bytes[0], bytes + first_part, size - first_part);
+  write_position += size;
+  return size;
+}
+
+/**
+ * \brief Copies bytes from the beginning of the buffer without consuming them.
+ * \param bytes Where to copy the bytes.
+ * \param size Number of bytes to copy.
+ * \return Number of bytes actually copied.
+ */
+size_t RingBuffer::peek(char* bytes, size_t size) const {
+  return peek(bytes, 0, size);
+}
+
+/**
+ * \brief Copies bytes from the buffer without consuming them.
+ * \param bytes Where to copy the bytes.
+ * \param offset Number of bytes to skip from the beginning of the buffer.
+ * \param size Number of bytes to copy.
+ * \return Number of bytes actually copied.
+ */
+size_t RingBuffer::peek(char* bytes, size_t offset, size_t size) const {
+
+  if (offset >= get_size()) {
+    return 0;
+  }
+  size = std::min(size, get_size() - offset);
+  const size_t start = static_cast<size_t>(read_position + offset) & mask;
+  const size_t first_part = std::min(size, get_capacity() - start);
+  std::memcpy(bytes, &this->bytes[start], first_part);
+  std::memcpy(bytes + first_part, &this->bytes[0], size - first_part);
+  return size;
+}
+
+/**
+ * \brief Returns the bytes that can be read in place from the beginning
+ * of the buffer.
+ *
+ * If the stored bytes wrap around the end of the storage, only the first
+ * part is returned.
+ *
+ * \param[out] size Number of contiguous bytes available.
+ * \return The first byte stored.
+ */
+const char* RingBuffer::get_contiguous_data(size_t& size) const {
+
+  const size_t start = static_cast<size_t>(read_position) & mask;
+  size = std::min(get_size(), get_capacity() - start);
+  return &bytes[start];
+}
+
+/**
+ * \brief Removes bytes from the beginning of the buffer.
+ * \param size Number of bytes to remove. It must not exceed the size.
+ */
+void RingBuffer::consume(size_t size) {
+
+  read_position += std::min(size, get_size());
+  if (read_position == write_position) {
+    // Start again at the beginning to keep data contiguous.
+    clear();
+  }
+}
+
+/**
+ * \brief Moves as many bytes as possible from this buffer to the end of
+ * another one.
+ * \param other The destination buffer.
+ * \return Number of bytes moved.
+ */
+size_t RingBuffer::move_to(RingBuffer& other) {
+
+  size_t moved = 0;
+  while (!is_empty() && !other.is_full()) {
+    size_t size = 0;
+    const char* data = get_contiguous_data(size);
+    const size_t pushed = other.push(data, size);
+    consume(pushed);
+    moved += pushed;
+  }
+  return moved;
+}
+
+/**
+ * \brief Reads bytes from a file descriptor into the free space of the buffer.
+ *
+ * A single readv() call fills both free parts of the ring.
+ * The buffer must not be full, otherwise nothing can be read and 0 is
+ * returned as if the stream was finished.
+ *
+ * \param fd A file descriptor, usually a non-blocking socket.
+ * \return The result of readv(): the number of bytes read, 0 at the end
+ * of the stream, or -1 in case of error (see errno).
+ */
+ssize_t RingBuffer::read_from(int fd) {
+
+  const size_t free_space = get_free_space();
+  const size_t start = static_cast<size_t>(write_position) & mask;
+  const size_t first_part = std::min(free_space, get_capacity() - start);
+
+  iovec parts[2];
+  parts[0].iov_base = &bytes[start];
+  parts[0].iov_len = first_part;
+  parts[1].iov_base = &bytes[0];
+  parts[1].iov_len = free_space - first_part;
+
+  const ssize_t result = readv(fd, parts, parts[1].iov_len > 0 ? 2 : 1);
+  if (result > 0) {
+    write_position += result;
+  }
+  return result;
+}
+
+/**
+ * \brief Writes bytes of the buffer to a file descriptor and consumes them.
+ *
+ * A single writev() call sends both used parts of the ring.
+ *
+ * \param fd A file descriptor, usually a non-blocking socket.
+ * \return The result of writev(): the number of bytes written, or -1 in
+ * case of error (see errno).
+ */
+ssize_t RingBuffer::write_to(int fd) {
+
+  const size_t size = get_size();
+  const size_t start = static_cast<size_t>(read_position) & mask;
+  const size_t first_part = std::min(size, get_capacity() - start);
+
+  iovec parts[2];
+  parts[0].iov_base = &bytes[start];
+  parts[0].iov_len = first_part;
+  parts[1].iov_base = &bytes[0];
+  parts[1].iov_len = size - first_part;
+
+  const ssize_t result = writev(fd, parts, parts[1].iov_len > 0 ? 2 : 1);
+  if (result > 0) {
+    consume(result);
+  }
+  return result;
+}
+
+}
+
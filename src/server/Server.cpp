@@ -1,61 +1,529 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/System.h"
+#include "solarus/server/GameSession.h"
 #include "solarus/server/Server.h"
-#include "ClientHandler.cpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
 
-Server::Server(unsigned short int port,unsigned short int maxpending) {
-	this->srv_d->port = port;
-	this->srv_d->maxpending = maxpending;
-	this->srv_d->ready = this->Connect();
-	this->Run();
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Maximum number of events handled per call to epoll_wait().
+ */
+const int max_events = 256;
+
+/**
+ * \brief Maximum number of ticks simulated at once to catch up with
+ * the real time.
+ */
+const uint64_t max_ticks_per_event = 10;
+
+/**
+ * \brief Returns the epoll data of a file descriptor.
+ *
+ * A socket number can be reused by a new connection while events of the
+ * old one are still being handled in the same batch. The generation of the
+ * connection is stored with the socket to detect these stale events.
+ *
+ * \param fd The file descriptor.
+ * \param generation Generation of the connection, or 0 for the
+ * descriptors of the worker itself.
+ * \return The value to store in epoll_event::data::u64.
+ */
+uint64_t make_event_data(int fd, uint32_t generation) {
+  return (static_cast<uint64_t>(generation) << 32) | static_cast<uint32_t>(fd);
 }
 
-bool Server::Connect() {
-    if ((this->srv_d->port > 0) && (this->srv_d->maxpending > 0)) {
-        if ((this->srv_d->socket = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP)) < 0) {
-            return false;
-        }
+}
 
-        memset(&this->srv_d->server_addr, 0, sizeof(this->srv_d->server_addr));
-        this->srv_d->server_addr.sin_family = AF_INET;
-        this->srv_d->server_addr.sin_addr.s_addr = htonl(INADDR_ANY);
-        this->srv_d->server_addr.sin_port = htons(this->srv_d->port);
+/**
+ * \brief Creates a server. Call start() to accept connections.
+ * \param port Port to listen to, or 0 to use any free port.
+ * \param num_workers Number of worker threads (at least 1).
+ * \param max_pending Maximum length of the queue of pending connections.
+ * \param buffer_size Size in bytes of each buffer of a connection.
+ */
+Server::Server(
+    uint16_t port,
+    int num_workers,
+    int max_pending,
+    size_t buffer_size
+):
+  port(port),
+  num_workers(num_workers < 1 ? 1 : num_workers),
+  max_pending(max_pending),
+  buffer_size(buffer_size),
+  running(false),
+  session(nullptr),
+  workers(),
+  num_clients(0),
+  num_accepted(0) {
 
-        if (bind(this->srv_d->socket, (const sockaddr *) &this->srv_d->server_addr, sizeof(this->srv_d->server_addr)) < 0) {
-            	cout << "Port not free" << endl;
-		return false;
-        }
+}
 
-        if (listen(this->srv_d->socket, this->srv_d->maxpending) < 0) {
-            return false;
-        }
-    } else {
-        return false;
-    }
+/**
+ * \brief Destructor. Stops the server and closes all connections.
+ */
+Server::~Server() {
+  stop();
+}
+
+/**
+ * \brief Makes the server host a game.
+ *
+ * This must be called before start().
+ * The server then uses a single worker thread, which ticks the session.
+ *
+ * \param session The game session, or nullptr to host no game.
+ * It must live as long as the server is running.
+ */
+void Server::set_session(GameSession* session) {
+
+  this->session = session;
+  if (session != nullptr) {
+    num_workers = 1;
+  }
+}
 
+/**
+ * \brief Opens the listening sockets and starts the worker threads.
+ * \return \c true in case of success.
+ */
+bool Server::start() {
+
+  if (running) {
     return true;
+  }
+
+  for (int i = 0; i < num_workers; ++i) {
+    std::unique_ptr<Worker> worker(new Worker());
+    if (!open_worker(*worker)) {
+      close_worker(*worker);
+      for (const std::unique_ptr<Worker>& other_worker: workers) {
+        close_worker(*other_worker);
+      }
+      workers.clear();
+      return false;
+    }
+    workers.emplace_back(std::move(worker));
+  }
+
+  running = true;
+  for (const std::unique_ptr<Worker>& worker: workers) {
+    Worker* worker_ptr = worker.get();
+    worker->thread = std::thread([this, worker_ptr]() {
+      run_worker(*worker_ptr);
+    });
+  }
+  return true;
+}
+
+/**
+ * \brief Stops the worker threads and closes all connections.
+ */
+void Server::stop() {
+
+  if (!running) {
+    return;
+  }
+
+  for (const std::unique_ptr<Worker>& worker: workers) {
+    const uint64_t value = 1;
+    if (write(worker->stop_fd, &value, sizeof(value)) != sizeof(value)) {
+      std::cerr << "Error: Failed to stop a server worker: "
+          << std::strerror(errno) << std::endl;
+    }
+  }
+  for (const std::unique_ptr<Worker>& worker: workers) {
+    worker->thread.join();
+    close_worker(*worker);
+  }
+  workers.clear();
+  running = false;
+}
+
+/**
+ * \brief Returns whether the server is accepting connections.
+ * \return \c true if the server is started.
+ */
+bool Server::is_running() const {
+  return running;
+}
+
+/**
+ * \brief Returns the port the server listens to.
+ * \return The port. If 0 was requested, this is the port chosen by the
+ * system once the server is started.
+ */
+uint16_t Server::get_port() const {
+  return port;
+}
+
+/**
+ * \brief Returns the number of worker threads.
+ * \return The number of workers.
+ */
+int Server::get_num_workers() const {
+  return num_workers;
+}
+
+/**
+ * \brief Returns the number of connections currently open.
+ * \return The number of clients.
+ */
+int Server::get_num_clients() const {
+  return num_clients;
+}
+
+/**
+ * \brief Returns the number of connections accepted since the start.
+ * \return The number of connections accepted.
+ */
+uint64_t Server::get_num_accepted() const {
+  return num_accepted;
+}
+
+/**
+ * \brief Creates the listening socket and the epoll instance of a worker.
+ * \param worker The worker to initialize.
+ * \return \c true in case of success.
+ */
+bool Server::open_worker(Worker& worker) {
+
+  worker.listen_socket = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+  if (worker.listen_socket < 0) {
+    std::cerr << "Error: Cannot create server socket: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  // Let each worker bind its own socket to the same port.
+  const int enable = 1;
+  setsockopt(worker.listen_socket, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+  if (setsockopt(worker.listen_socket, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable)) < 0) {
+    std::cerr << "Error: SO_REUSEPORT is not supported: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  sockaddr_in address;
+  std::memset(&address, 0, sizeof(address));
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(port);
+  if (bind(worker.listen_socket, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) < 0) {
+    std::cerr << "Error: Cannot bind server socket to port " << port << ": "
+        << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  if (port == 0) {
+    // The system chose a port: the other workers will use the same one.
+    socklen_t address_size = sizeof(address);
+    getsockname(worker.listen_socket, reinterpret_cast<sockaddr*>(&address), &address_size);
+    port = ntohs(address.sin_port);
+  }
+
+  if (listen(worker.listen_socket, max_pending) < 0) {
+    std::cerr << "Error: Cannot listen to port " << port << ": "
+        << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  worker.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  worker.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (worker.epoll_fd < 0 || worker.stop_fd < 0) {
+    std::cerr << "Error: Cannot create server event loop: " << std::strerror(errno) << std::endl;
+    return false;
+  }
+
+  epoll_event event;
+  std::memset(&event, 0, sizeof(event));
+  event.events = EPOLLIN;
+  event.data.u64 = make_event_data(worker.listen_socket, 0);
+  epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, worker.listen_socket, &event);
+  event.data.u64 = make_event_data(worker.stop_fd, 0);
+  epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, worker.stop_fd, &event);
+
+  if (session != nullptr) {
+    // Tick the game at the same rate as the main loop.
+    worker.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (worker.timer_fd < 0) {
+      std::cerr << "Error: Cannot create game timer: " << std::strerror(errno) << std::endl;
+      return false;
+    }
+    itimerspec period;
+    std::memset(&period, 0, sizeof(period));
+    period.it_interval.tv_nsec = System::timestep * 1000000L;
+    period.it_value = period.it_interval;
+    timerfd_settime(worker.timer_fd, 0, &period, nullptr);
+    event.data.u64 = make_event_data(worker.timer_fd, 0);
+    epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, worker.timer_fd, &event);
+  }
+  return true;
+}
+
+/**
+ * \brief Closes all sockets of a worker whose thread is not running.
+ * \param worker The worker to close.
+ */
+void Server::close_worker(Worker& worker) {
+
+  num_clients -= static_cast<int>(worker.clients.size());
+  if (session != nullptr) {
+    for (const auto& kvp: worker.clients) {
+      session->remove_client(*kvp.second.handler);
+    }
+  }
+  worker.clients.clear();
+
+  if (worker.listen_socket >= 0) {
+    close(worker.listen_socket);
+    worker.listen_socket = -1;
+  }
+  if (worker.epoll_fd >= 0) {
+    close(worker.epoll_fd);
+    worker.epoll_fd = -1;
+  }
+  if (worker.stop_fd >= 0) {
+    close(worker.stop_fd);
+    worker.stop_fd = -1;
+  }
+  if (worker.timer_fd >= 0) {
+    close(worker.timer_fd);
+    worker.timer_fd = -1;
+  }
 }
 
-void Server::Run() {
-	if (this->srv_d->ready){
-		client_data cl_d;
-		cout << "Server running in process " << getpid() << endl;
-		while (this->srv_d->ready) {
-			unsigned int clientlen = sizeof(cl_d.client_addr);
-			// Wait for client connection
-			if ((cl_d.socket = accept(this->srv_d->socket, (struct sockaddr *) &cl_d.client_addr, &clientlen)) < 0) {
-				break;		
-			}else{
-				int pid_c;
-				if ((pid_c=fork())==0) {
-					ClientHandler ch = ClientHandler(&cl_d);
-				}
-			}
-		}
-	}else{
-		cout << "Server not connected" << endl;
-	}
-}
-
-// TODO
-Server::~Server(){
-	close(this->srv_d->socket);
+/**
+ * \brief Event loop of a worker thread.
+ * \param worker The worker.
+ */
+void Server::run_worker(Worker& worker) {
+
+  epoll_event events[max_events];
+  while (true) {
+    const int num_events = epoll_wait(worker.epoll_fd, events, max_events, -1);
+    if (num_events < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "Error: Server event loop failed: " << std::strerror(errno) << std::endl;
+      return;
+    }
+
+    for (int i = 0; i < num_events; ++i) {
+      const int fd = static_cast<int>(events[i].data.u64 & 0xFFFFFFFF);
+      const uint32_t generation = static_cast<uint32_t>(events[i].data.u64 >> 32);
+      const uint32_t flags = events[i].events;
+
+      if (fd == worker.stop_fd) {
+        return;
+      }
+
+      if (fd == worker.listen_socket) {
+        accept_clients(worker);
+        continue;
+      }
+
+      if (fd == worker.timer_fd) {
+        tick_session(worker);
+        continue;
+      }
+
+      const auto& it = worker.clients.find(fd);
+      if (it == worker.clients.end() || it->second.generation != generation) {
+        // Already removed by a previous event of this batch,
+        // and maybe replaced by a new connection with the same socket.
+        continue;
+      }
+      Connection& connection = it->second;
+      ClientHandler& client = *connection.handler;
+
+      bool ok = (flags & (EPOLLERR | EPOLLHUP)) == 0 || (flags & EPOLLIN) != 0;
+      if (ok && (flags & EPOLLIN) != 0) {
+        ok = client.on_readable();
+      }
+      if (ok && (flags & EPOLLOUT) != 0) {
+        ok = client.on_writable();
+      }
+
+      if (!ok) {
+        remove_client(worker, fd);
+      }
+      else {
+        update_events(worker, connection);
+      }
+    }
+  }
 }
+
+/**
+ * \brief Accepts all pending connections of the listening socket of a worker.
+ * \param worker The worker.
+ */
+void Server::accept_clients(Worker& worker) {
+
+  while (true) {
+    sockaddr_in address;
+    socklen_t address_size = sizeof(address);
+    const int client_socket = accept4(
+        worker.listen_socket,
+        reinterpret_cast<sockaddr*>(&address),
+        &address_size,
+        SOCK_NONBLOCK | SOCK_CLOEXEC
+    );
+    if (client_socket < 0) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        std::cerr << "Error: Failed to accept a connection: " << std::strerror(errno) << std::endl;
+      }
+      return;
+    }
+
+    // Small messages must not wait for more data to be sent.
+    const int enable = 1;
+    setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+
+    // Generation 0 is for the descriptors of the worker.
+    ++worker.last_generation;
+    if (worker.last_generation == 0) {
+      worker.last_generation = 1;
+    }
+
+    epoll_event event;
+    std::memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.u64 = make_event_data(client_socket, worker.last_generation);
+    if (epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, client_socket, &event) < 0) {
+      close(client_socket);
+      continue;
+    }
+
+    Connection& connection = worker.clients[client_socket];
+    connection.generation = worker.last_generation;
+    connection.handler = std::unique_ptr<ClientHandler>(
+        new ClientHandler(client_socket, address, buffer_size, session)
+    );
+    connection.events = EPOLLIN;
+    if (session != nullptr) {
+      session->add_client(*connection.handler);
+    }
+    ++num_clients;
+    ++num_accepted;
+  }
+}
+
+/**
+ * \brief Updates the events watched for a connection depending on the
+ * state of its buffers.
+ * \param worker The worker of the connection.
+ * \param connection The connection.
+ */
+void Server::update_events(Worker& worker, Connection& connection) {
+
+  const ClientHandler& client = *connection.handler;
+  uint32_t events = 0;
+  if (client.wants_input()) {
+    events |= EPOLLIN;
+  }
+  if (client.has_output()) {
+    events |= EPOLLOUT;
+  }
+
+  if (events == connection.events) {
+    // Avoid a system call in the usual case.
+    return;
+  }
+
+  epoll_event event;
+  std::memset(&event, 0, sizeof(event));
+  event.events = events;
+  event.data.u64 = make_event_data(client.get_socket(), connection.generation);
+  epoll_ctl(worker.epoll_fd, EPOLL_CTL_MOD, client.get_socket(), &event);
+  connection.events = events;
+}
+
+/**
+ * \brief Closes a connection.
+ * \param worker The worker of the connection.
+ * \param socket Socket of the connection.
+ */
+void Server::remove_client(Worker& worker, int socket) {
+
+  epoll_ctl(worker.epoll_fd, EPOLL_CTL_DEL, socket, nullptr);
+  if (session != nullptr) {
+    const auto& it = worker.clients.find(socket);
+    if (it != worker.clients.end()) {
+      session->remove_client(*it->second.handler);
+    }
+  }
+  worker.clients.erase(socket);
+  --num_clients;
+}
+
+/**
+ * \brief Simulates the ticks of the game session that are due and sends
+ * the resulting snapshots.
+ * \param worker The worker that hosts the session.
+ */
+void Server::tick_session(Worker& worker) {
+
+  uint64_t num_expirations = 0;
+  if (read(worker.timer_fd, &num_expirations, sizeof(num_expirations)) !=
+      sizeof(num_expirations)) {
+    return;
+  }
+
+  // Catch up if the system was slow, like the main loop does.
+  num_expirations = std::min(num_expirations, max_ticks_per_event);
+  for (uint64_t i = 0; i < num_expirations; ++i) {
+    session->tick();
+  }
+
+  // Send the snapshots immediately.
+  std::vector<int> broken_sockets;
+  for (auto& kvp: worker.clients) {
+    Connection& connection = kvp.second;
+    if (connection.handler->on_writable()) {
+      update_events(worker, connection);
+    }
+    else {
+      broken_sockets.push_back(kvp.first);
+    }
+  }
+  for (int socket: broken_sockets) {
+    remove_client(worker, socket);
+  }
+}
+
+}
+
@@ -0,0 +1,566 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/server/SnapshotCodec.h"
+#include <algorithm>
+
+namespace Solarus {
+
+namespace {
+
+/**
+ * \brief Bits of the mask of fields of an entity.
+ */
+enum Field : uint8_t {
+  FIELD_POSITION = 0x01,
+  FIELD_LAYER = 0x02,
+  FIELD_SPRITE = 0x04,
+  FIELD_ANIMATION = 0x08,
+  FIELD_DIRECTION = 0x10,
+  FIELD_FRAME = 0x20,
+  FIELD_ALL = 0x3F
+};
+
+/**
+ * \brief Size of the header of a snapshot payload: ticks and counts.
+ */
+const size_t snapshot_header_size = 4 + 4 + 2 + 2 + 2 + 2;
+
+/**
+ * \brief Appends an 8-bit integer to a buffer.
+ */
+void append_uint8(std::string& buffer, uint8_t value) {
+  buffer.push_back(static_cast<char>(value));
+}
+
+/**
+ * \brief Appends a little-endian 16-bit integer to a buffer.
+ */
+void append_uint16(std::string& buffer, uint16_t value) {
+
+  char bytes[2];
+  Protocol::write_uint16(bytes, value);
+  buffer.append(bytes, sizeof(bytes));
+}
+
+/**
+ * \brief Appends a little-endian 32-bit integer to a buffer.
+ */
+void append_uint32(std::string& buffer, uint32_t value) {
+
+  char bytes[4];
+  Protocol::write_uint32(bytes, value);
+  buffer.append(bytes, sizeof(bytes));
+}
+
+/**
+ * \brief Returns the fields that differ between two states of an entity.
+ * \param before Previous state.
+ * \param after New state.
+ * \return Bit mask of the fields that changed.
+ */
+uint8_t get_changed_fields(const EntityState& before, const EntityState& after) {
+
+  uint8_t mask = 0;
+  if (after.x != before.x || after.y != before.y) {
+    mask |= FIELD_POSITION;
+  }
+  if (after.layer != before.layer) {
+    mask |= FIELD_LAYER;
+  }
+  if (after.sprite != before.sprite) {
+    mask |= FIELD_SPRITE;
+  }
+  if (after.animation != before.animation) {
+    mask |= FIELD_ANIMATION;
+  }
+  if (after.direction != before.direction) {
+    mask |= FIELD_DIRECTION;
+  }
+  if (after.frame != before.frame) {
+    mask |= FIELD_FRAME;
+  }
+  return mask;
+}
+
+/**
+ * \brief Returns the encoded size of the fields of an entity.
+ * \param mask Bit mask of the fields present.
+ * \return The size in bytes, including the id and the mask.
+ */
+size_t get_encoded_size(uint8_t mask) {
+
+  size_t size = 4 + 1;
+  if (mask & FIELD_POSITION) {
+    size += 8;
+  }
+  if (mask & FIELD_LAYER) {
+    size += 1;
+  }
+  if (mask & FIELD_SPRITE) {
+    size += 2;
+  }
+  if (mask & FIELD_ANIMATION) {
+    size += 2;
+  }
+  if (mask & FIELD_DIRECTION) {
+    size += 1;
+  }
+  if (mask & FIELD_FRAME) {
+    size += 2;
+  }
+  return size;
+}
+
+/**
+ * \brief Returns whether the strings used by some fields of an entity
+ * are known by the client.
+ * \param entity State of the entity.
+ * \param mask Fields that will be sent.
+ * \param num_strings Number of strings known by the client.
+ */
+bool are_strings_known(const EntityState& entity, uint8_t mask, size_t num_strings) {
+
+  return ((mask & FIELD_SPRITE) == 0 || entity.sprite < num_strings) &&
+      ((mask & FIELD_ANIMATION) == 0 || entity.animation < num_strings);
+}
+
+/**
+ * \brief Appends the fields of an entity to a buffer.
+ * \param buffer The buffer.
+ * \param entity State of the entity.
+ * \param mask Fields to write.
+ */
+void append_entity(std::string& buffer, const EntityState& entity, uint8_t mask) {
+
+  append_uint32(buffer, entity.id);
+  append_uint8(buffer, mask);
+  if (mask & FIELD_POSITION) {
+    append_uint32(buffer, static_cast<uint32_t>(entity.x));
+    append_uint32(buffer, static_cast<uint32_t>(entity.y));
+  }
+  if (mask & FIELD_LAYER) {
+    append_uint8(buffer, entity.layer);
+  }
+  if (mask & FIELD_SPRITE) {
+    append_uint16(buffer, entity.sprite);
+  }
+  if (mask & FIELD_ANIMATION) {
+    append_uint16(buffer, entity.animation);
+  }
+  if (mask & FIELD_DIRECTION) {
+    append_uint8(buffer, entity.direction);
+  }
+  if (mask & FIELD_FRAME) {
+    append_uint16(buffer, entity.frame);
+  }
+}
+
+/**
+ * \brief Reads the payload of a packet with bounds checking.
+ */
+class PayloadReader {
+
+  public:
+
+    /**
+     * \brief Creates a reader at the beginning of a packet.
+     * \param packet The packet to read.
+     */
+    explicit PayloadReader(const Protocol::Packet& packet):
+      data(packet.payload),
+      size(packet.size),
+      position(0),
+      valid(true) {
+    }
+
+    /**
+     * \brief Returns whether no read went past the end of the payload.
+     * \return \c true if all reads were valid.
+     */
+    bool is_valid() const {
+      return valid;
+    }
+
+    /**
+     * \brief Returns whether the whole payload was read.
+     * \return \c true if the reader is at the end.
+     */
+    bool is_finished() const {
+      return position == size;
+    }
+
+    /**
+     * \brief Skips some bytes and returns them.
+     * \param length Number of bytes to read.
+     * \return The bytes, or nullptr if the payload is too short.
+     */
+    const char* read_bytes(size_t length) {
+
+      if (!valid || size - position < length) {
+        valid = false;
+        return nullptr;
+      }
+      const char* bytes = data + position;
+      position += length;
+      return bytes;
+    }
+
+    /**
+     * \brief Reads an 8-bit integer.
+     * \return The integer, or 0 if the payload is too short.
+     */
+    uint8_t read_uint8() {
+      const char* bytes = read_bytes(1);
+      return bytes != nullptr ? static_cast<uint8_t>(bytes[0]) : 0;
+    }
+
+    /**
+     * \brief Reads a 16-bit integer.
+     * \return The integer, or 0 if the payload is too short.
+     */
+    uint16_t read_uint16() {
+      const char* bytes = read_bytes(2);
+      return bytes != nullptr ? Protocol::read_uint16(bytes) : 0;
+    }
+
+    /**
+     * \brief Reads a 32-bit integer.
+     * \return The integer, or 0 if the payload is too short.
+     */
+    uint32_t read_uint32() {
+      const char* bytes = read_bytes(4);
+      return bytes != nullptr ? Protocol::read_uint32(bytes) : 0;
+    }
+
+  private:
+
+    const char* data;      /**< The payload. */
+    size_t size;           /**< Size of the payload. */
+    size_t position;       /**< Current position in the payload. */
+    bool valid;            /**< Whether all reads succeeded. */
+
+};
+
+/**
+ * \brief Reads the fields of an entity.
+ * \param reader The reader, placed after the id and the mask.
+ * \param mask Fields present.
+ * \param entity The entity to modify.
+ */
+void read_entity(PayloadReader& reader, uint8_t mask, EntityState& entity) {
+
+  if (mask & FIELD_POSITION) {
+    entity.x = static_cast<int32_t>(reader.read_uint32());
+    entity.y = static_cast<int32_t>(reader.read_uint32());
+  }
+  if (mask & FIELD_LAYER) {
+    entity.layer = reader.read_uint8();
+  }
+  if (mask & FIELD_SPRITE) {
+    entity.sprite = reader.read_uint16();
+  }
+  if (mask & FIELD_ANIMATION) {
+    entity.animation = reader.read_uint16();
+  }
+  if (mask & FIELD_DIRECTION) {
+    entity.direction = reader.read_uint8();
+  }
+  if (mask & FIELD_FRAME) {
+    entity.frame = reader.read_uint16();
+  }
+}
+
+}
+
+const uint32_t SnapshotCodec::no_baseline;
+const size_t SnapshotCodec::max_string_length;
+
+/**
+ * \brief Appends a SNAPSHOT packet to a buffer.
+ * \param[in] baseline The last snapshot acknowledged by the client,
+ * or nullptr to send a full snapshot.
+ * \param[in] current The snapshot to send.
+ * \param[in] strings The string table. It must contain at least
+ * current.num_strings elements, none of them longer than
+ * max_string_length.
+ * \param[in,out] buffer The buffer to append the packet to.
+ * \param[out] sent The snapshot the client will have after decoding the
+ * packet. It differs from \c current if some changes did not fit.
+ */
+void SnapshotCodec::encode(
+    const Snapshot* baseline,
+    const Snapshot& current,
+    const std::vector<std::string>& strings,
+    std::string& buffer,
+    Snapshot& sent
+) {
+  static const std::vector<EntityState> no_entities;
+  const std::vector<EntityState>& old_entities =
+      baseline != nullptr ? baseline->entities : no_entities;
+  const std::vector<EntityState>& new_entities = current.entities;
+
+  const size_t offset = buffer.size();
+  const size_t max_end = offset + Protocol::max_snapshot_packet_size;
+  buffer.resize(offset + Protocol::header_size);
+  append_uint32(buffer, current.tick);
+  append_uint32(buffer, baseline != nullptr ? baseline->tick : no_baseline);
+
+  // Strings created since the baseline.
+  const size_t first_string = baseline != nullptr ? baseline->num_strings : 0;
+  size_t num_strings = first_string;
+  append_uint16(buffer, static_cast<uint16_t>(first_string));
+  const size_t num_strings_position = buffer.size();
+  append_uint16(buffer, 0);
+  while (num_strings < current.num_strings) {
+    const std::string& string = strings[num_strings];
+    const size_t length = string.size();
+    Debug::check_assertion(length <= max_string_length,
+        "String too long for a snapshot: '" + string + "'");
+    if (buffer.size() + 1 + length + 4 > max_end) {
+      break;
+    }
+    append_uint8(buffer, static_cast<uint8_t>(length));
+    buffer.append(string.data(), length);
+    ++num_strings;
+  }
+  Protocol::write_uint16(&buffer[num_strings_position],
+      static_cast<uint16_t>(num_strings - first_string));
+
+  sent.tick = current.tick;
+  sent.num_strings = num_strings;
+  sent.entities.clear();
+
+  // Removed entities.
+  // Only a prefix of them is sent if the packet is full.
+  const size_t num_removed_position = buffer.size();
+  append_uint16(buffer, 0);
+  size_t num_removed = 0;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < old_entities.size()) {
+    if (j < new_entities.size() && new_entities[j].id <= old_entities[i].id) {
+      if (new_entities[j].id == old_entities[i].id) {
+        ++i;
+      }
+      ++j;
+      continue;
+    }
+    if (buffer.size() + 4 + 2 > max_end || num_removed == 0xFFFF) {
+      break;
+    }
+    append_uint32(buffer, old_entities[i].id);
+    ++num_removed;
+    ++i;
+  }
+  Protocol::write_uint16(&buffer[num_removed_position], static_cast<uint16_t>(num_removed));
+
+  // New and changed entities.
+  const size_t num_changed_position = buffer.size();
+  append_uint16(buffer, 0);
+  size_t num_changed = 0;
+  size_t num_removed_seen = 0;
+  i = 0;
+  j = 0;
+  while (i < old_entities.size() || j < new_entities.size()) {
+
+    if (j == new_entities.size() ||
+        (i < old_entities.size() && old_entities[i].id < new_entities[j].id)) {
+      // Removed entity: the client still has it if its removal did not fit.
+      if (num_removed_seen >= num_removed) {
+        sent.entities.push_back(old_entities[i]);
+      }
+      ++num_removed_seen;
+      ++i;
+      continue;
+    }
+
+    const EntityState& entity = new_entities[j];
+    const bool is_new = i == old_entities.size() || old_entities[i].id != entity.id;
+    const uint8_t mask = is_new ? static_cast<uint8_t>(FIELD_ALL) :
+        get_changed_fields(old_entities[i], entity);
+
+    if (mask == 0) {
+      sent.entities.push_back(entity);
+    }
+    else if (buffer.size() + get_encoded_size(mask) <= max_end &&
+        num_changed < 0xFFFF &&
+        are_strings_known(entity, mask, num_strings)) {
+      append_entity(buffer, entity, mask);
+      ++num_changed;
+      sent.entities.push_back(entity);
+    }
+    else if (!is_new) {
+      // Does not fit: the client keeps the old state.
+      sent.entities.push_back(old_entities[i]);
+    }
+
+    if (!is_new) {
+      ++i;
+    }
+    ++j;
+  }
+  Protocol::write_uint16(&buffer[num_changed_position], static_cast<uint16_t>(num_changed));
+
+  Protocol::write_header(&buffer[offset], Protocol::MessageType::SNAPSHOT,
+      buffer.size() - offset - Protocol::header_size);
+}
+
+/**
+ * \brief Reads the ticks of a SNAPSHOT packet.
+ *
+ * This allows to find the baseline needed to decode it.
+ *
+ * \param[in] packet The packet.
+ * \param[out] tick Tick of the snapshot.
+ * \param[out] baseline_tick Tick of its baseline, or no_baseline.
+ * \return \c false if this is not a SNAPSHOT packet.
+ */
+bool SnapshotCodec::read_ticks(
+    const Protocol::Packet& packet,
+    uint32_t& tick,
+    uint32_t& baseline_tick
+) {
+  if (packet.type != Protocol::MessageType::SNAPSHOT ||
+      packet.size < snapshot_header_size) {
+    return false;
+  }
+  tick = Protocol::read_uint32(packet.payload);
+  baseline_tick = Protocol::read_uint32(packet.payload + 4);
+  return true;
+}
+
+/**
+ * \brief Decodes a SNAPSHOT packet.
+ * \param[in] packet The packet.
+ * \param[in] baseline The snapshot whose tick is the baseline tick of the
+ * packet (see read_ticks()), or nullptr if the packet has no baseline.
+ * \param[in,out] strings The string table, where new strings are added.
+ * \param[out] snapshot The snapshot decoded.
+ * \return \c false if the packet is invalid or if the baseline is wrong.
+ */
+bool SnapshotCodec::decode(
+    const Protocol::Packet& packet,
+    const Snapshot* baseline,
+    std::vector<std::string>& strings,
+    Snapshot& snapshot
+) {
+  uint32_t tick = 0;
+  uint32_t baseline_tick = 0;
+  if (!read_ticks(packet, tick, baseline_tick)) {
+    return false;
+  }
+  if (baseline_tick == no_baseline) {
+    baseline = nullptr;
+  }
+  else if (baseline == nullptr || baseline->tick != baseline_tick) {
+    return false;
+  }
+
+  PayloadReader reader(packet);
+  reader.read_bytes(8);
+
+  // Strings.
+  const size_t first_string = reader.read_uint16();
+  const size_t num_new_strings = reader.read_uint16();
+  if (first_string > strings.size()) {
+    return false;
+  }
+  strings.resize(std::max(strings.size(), first_string + num_new_strings));
+  for (size_t k = 0; k < num_new_strings; ++k) {
+    const size_t length = reader.read_uint8();
+    const char* bytes = reader.read_bytes(length);
+    if (bytes == nullptr) {
+      return false;
+    }
+    strings[first_string + k].assign(bytes, length);
+  }
+
+  // Removed entities.
+  static const std::vector<EntityState> no_entities;
+  const std::vector<EntityState>& old_entities =
+      baseline != nullptr ? baseline->entities : no_entities;
+  std::vector<EntityState> kept_entities;
+  kept_entities.reserve(old_entities.size());
+  size_t i = 0;
+  const size_t num_removed = reader.read_uint16();
+  for (size_t k = 0; k < num_removed; ++k) {
+    const uint32_t id = reader.read_uint32();
+    while (i < old_entities.size() && old_entities[i].id < id) {
+      kept_entities.push_back(old_entities[i]);
+      ++i;
+    }
+    if (i == old_entities.size() || old_entities[i].id != id) {
+      // Unknown or unsorted id.
+      return false;
+    }
+    ++i;
+  }
+  kept_entities.insert(kept_entities.end(), old_entities.begin() + i, old_entities.end());
+
+  // New and changed entities.
+  std::vector<EntityState> entities;
+  entities.reserve(kept_entities.size());
+  i = 0;
+  const size_t num_changed = reader.read_uint16();
+  bool has_previous_id = false;
+  uint32_t previous_id = 0;
+  for (size_t k = 0; k < num_changed; ++k) {
+    const uint32_t id = reader.read_uint32();
+    const uint8_t mask = reader.read_uint8();
+    if (!reader.is_valid() ||
+        (has_previous_id && id <= previous_id) ||
+        (mask & ~FIELD_ALL) != 0) {
+      return false;
+    }
+    has_previous_id = true;
+    previous_id = id;
+
+    while (i < kept_entities.size() && kept_entities[i].id < id) {
+      entities.push_back(kept_entities[i]);
+      ++i;
+    }
+    EntityState entity;
+    if (i < kept_entities.size() && kept_entities[i].id == id) {
+      entity = kept_entities[i];
+      ++i;
+    }
+    else if (mask != FIELD_ALL) {
+      // New entities must have all fields.
+      return false;
+    }
+    entity.id = id;
+    read_entity(reader, mask, entity);
+    if (entity.sprite >= strings.size() || entity.animation >= strings.size()) {
+      return false;
+    }
+    entities.push_back(entity);
+  }
+  entities.insert(entities.end(), kept_entities.begin() + i, kept_entities.end());
+
+  if (!reader.is_valid() || !reader.is_finished()) {
+    return false;
+  }
+
+  snapshot.tick = tick;
+  snapshot.num_strings = strings.size();
+  snapshot.entities = std::move(entities);
+  return true;
+}
+
+}
+
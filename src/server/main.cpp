@@ -1,5 +1,183 @@
-#include "Server.cpp"
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/server/GameSession.h"
+#include "solarus/server/Server.h"
+#include "solarus/server/Types.h"
+#include "solarus/Arguments.h"
+#include "solarus/MainLoop.h"
+#include <csignal>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
 
-int main(){
-	Server srv = Server(SERVER_PORT, MAXPENDING);
+namespace {
+
+/**
+ * \brief Prints the usage of the server.
+ * \param args Command-line arguments.
+ */
+void print_help(const Solarus::Arguments& args) {
+
+  std::string binary_name = args.get_program_name();
+  if (binary_name.empty()) {
+    binary_name = "solarus_server";
+  }
+  std::cout << "Usage: " << binary_name << " [options] [quest_path]"
+    << std::endl << std::endl
+    << "With -game, the quest path can be a directory or an archive as for solarus_run."
+    << std::endl << std::endl
+    << "Options:"
+    << std::endl
+    << "  -help                         shows this help message and exits"
+    << std::endl
+    << "  -port=<port>                  sets the port to listen to (default "
+    << Solarus::default_server_port << ")"
+    << std::endl
+    << "  -workers=<number>             sets the number of event loop threads (default: number of CPUs)"
+    << std::endl
+    << "  -max-pending=<number>         sets the maximum number of connections waiting to be accepted (default "
+    << Solarus::default_max_pending << ")"
+    << std::endl
+    << "  -buffer-size=<bytes>          sets the size of the input and output buffers of each connection (default "
+    << Solarus::default_buffer_size << ")"
+    << std::endl
+    << "  -game                         hosts a game of the quest, simulated without window or audio"
+    << std::endl
+    << "  -map=<id>                     sets the map where the hosted game starts (default: from the savegame)"
+    << std::endl
+    << "  -savegame=<file>              sets the savegame file of the hosted game (default server.dat)"
+    << std::endl;
+}
+
+/**
+ * \brief Returns the integer value of an option.
+ * \param args Command-line arguments.
+ * \param key Name of the option, with its leading dash.
+ * \param default_value Value to return if the option is missing or invalid.
+ * \return The value of the option.
+ */
+int get_int_argument(const Solarus::Arguments& args, const std::string& key, int default_value) {
+
+  const std::string& value_string = args.get_argument_value(key);
+  if (value_string.empty()) {
+    return default_value;
+  }
+
+  std::istringstream iss(value_string);
+  int value = 0;
+  if (!(iss >> value) || value < 0) {
+    std::cerr << "Invalid value for " << key << ": '" << value_string << "'" << std::endl;
+    return default_value;
+  }
+  return value;
 }
+
+}
+
+/**
+ * \brief Entry point of the game server.
+ *
+ * Usage: solarus_server [options] [quest_path]
+ *
+ * The following options are supported:
+ *   -help                             Shows a help message.
+ *   -port=<port>                      Port to listen to (default: 14000).
+ *   -workers=<number>                 Number of event loop threads, each with its
+ *                                     own listening socket (default: number of CPUs).
+ *   -max-pending=<number>             Maximum number of connections waiting to be accepted
+ *                                     by each worker (default: 1024).
+ *   -buffer-size=<bytes>              Size of the input and output buffers of each
+ *                                     connection (default: 16384).
+ *   -game                             Hosts a game of the quest, simulated without window
+ *                                     or audio. The server then uses a single worker.
+ *   -map=<id>                         Map where the hosted game starts
+ *                                     (default: starting map of the savegame).
+ *   -savegame=<file>                  Savegame file of the hosted game (default: server.dat).
+ *
+ * The server runs until it receives SIGINT or SIGTERM.
+ *
+ * \param argc Number of command-line arguments.
+ * \param argv Command-line arguments.
+ * \return 0 in case of success.
+ */
+int main(int argc, char** argv) {
+
+  using namespace Solarus;
+
+  const Arguments args(argc, argv);
+  if (args.has_argument("-help")) {
+    print_help(args);
+    return 0;
+  }
+
+  const int num_cpus = static_cast<int>(std::thread::hardware_concurrency());
+  const int port = get_int_argument(args, "-port", default_server_port);
+  const int num_workers = get_int_argument(args, "-workers", num_cpus > 0 ? num_cpus : 1);
+  const int max_pending = get_int_argument(args, "-max-pending", default_max_pending);
+  const int buffer_size = get_int_argument(args, "-buffer-size", static_cast<int>(default_buffer_size));
+
+  // Block termination signals in all threads: the main thread waits for them.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  // Create the game before the server thread, with no window and no audio.
+  std::unique_ptr<MainLoop> main_loop;
+  std::unique_ptr<GameSession> session;
+  if (args.has_argument("-game")) {
+    Arguments game_args = args;
+    game_args.add_argument("-no-video");
+    game_args.add_argument("-no-audio");
+    main_loop = std::unique_ptr<MainLoop>(new MainLoop(game_args));
+    session = std::unique_ptr<GameSession>(new GameSession(*main_loop));
+
+    std::string savegame_file = args.get_argument_value("-savegame");
+    if (savegame_file.empty()) {
+      savegame_file = "server.dat";
+    }
+    session->start_game(savegame_file, args.get_argument_value("-map"));
+  }
+
+  Server server(static_cast<uint16_t>(port), num_workers, max_pending, buffer_size);
+  server.set_session(session.get());
+  if (!server.start()) {
+    std::cerr << "Server not started" << std::endl;
+    return 1;
+  }
+  std::cout << "Server listening on port " << server.get_port()
+      << " with " << server.get_num_workers() << " worker(s)" << std::endl;
+
+  int signal_number = 0;
+  sigwait(&signals, &signal_number);
+
+  std::cout << "Stopping server after " << server.get_num_accepted()
+      << " connection(s)" << std::endl;
+  server.stop();
+
+  if (session != nullptr && session->get_tick() > 0) {
+    std::cout << "Game simulated for " << session->get_tick() << " tick(s): "
+        << session->get_total_tick_time() / session->get_tick() << " us per tick, "
+        << session->get_num_bytes_sent() / session->get_tick() << " bytes sent per tick"
+        << std::endl;
+  }
+  return 0;
+}
+
@@ -0,0 +1,165 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/MapEntities.h"
+#include "solarus/entities/NonAnimatedRegions.h"
+#include "solarus/entities/TilePattern.h"
+#include "solarus/entities/Tileset.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/lua/LuaContext.h"
+#include "solarus/Map.h"
+#include "solarus/MapCache.h"
+#include "solarus/MapData.h"
+#include "test_tools/TestEnvironment.h"
+#include <lua.hpp>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+
+using namespace Solarus;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const std::string map_id = "map_load_benchmark";              /**< Map with many tiles. */
+const std::string empty_map_id = "map_load_benchmark_empty";  /**< Same map without tiles. */
+const int map_width = 3200;           /**< Width of the maps in pixels. */
+const int map_height = 1600;          /**< Height of the maps in pixels. */
+const int tile_size = 16;             /**< Size of tile pattern "3" of tileset "castle". */
+const int num_runs = 5;               /**< Loads measured for each path. */
+
+/**
+ * \brief Returns the milliseconds elapsed since a date.
+ */
+double get_elapsed_ms(const Clock::time_point& date) {
+  return std::chrono::duration<double, std::milli>(Clock::now() - date).count();
+}
+
+/**
+ * \brief Writes a map data file with the given tiles in the write directory.
+ * \param id Id of the map to create.
+ * \param num_tiles Number of 16x16 tiles, one map data entity each,
+ * filling the map row by row.
+ */
+void save_map(const std::string& id, int num_tiles) {
+
+  std::ostringstream oss;
+  oss << "properties{\n  x = 0,\n  y = 0,\n  width = " << map_width
+      << ",\n  height = " << map_height << ",\n  tileset = \"castle\",\n}\n\n";
+
+  const int num_columns = map_width / tile_size;
+  for (int i = 0; i < num_tiles; ++i) {
+    oss << "tile{\n  layer = 0,\n  x = " << (i % num_columns) * tile_size
+        << ",\n  y = " << (i / num_columns) * tile_size
+        << ",\n  width = " << tile_size << ",\n  height = " << tile_size
+        << ",\n  pattern = \"3\",\n}\n\n";
+  }
+
+  QuestFiles::data_file_save("maps/" + id + ".dat", oss.str());
+}
+
+/**
+ * \brief Loads a map outside of the game flow and returns it.
+ * \param game The game.
+ * \param id Id of the map to load.
+ */
+std::shared_ptr<Map> load_map(Game& game, const std::string& id) {
+
+  std::shared_ptr<Map> map = std::make_shared<Map>(id);
+  map->load(game);
+  return map;
+}
+
+/**
+ * \brief Measures loading a map where each tile is a separate map data entity.
+ *
+ * The native path is a normal load: MapLoader creates the tiles directly.
+ * The Lua path loads the same map without tiles and then creates each tile
+ * with LuaContext::create_map_entity_from_data(), which is what MapLoader
+ * did for every entity before tiles bypassed Lua.
+ */
+void run_benchmark(TestEnvironment& env) {
+
+  const int num_tiles = (map_width / tile_size) * (map_height / tile_size);
+  Debug::check_assertion(QuestFiles::data_file_mkdir("maps"),
+      "Failed to create the maps directory in the write directory");
+  save_map(map_id, num_tiles);
+  save_map(empty_map_id, 0);
+
+  Game& game = env.get_game();
+  LuaContext& lua_context = env.get_main_loop().get_lua_context();
+  lua_State* l = lua_context.get_internal_state();
+
+  // Parse the files and decode the tileset once, outside of the measures.
+  const std::shared_ptr<const MapData>& data = MapCache::get_map_data(map_id);
+  Debug::check_assertion(data != nullptr, "Failed to parse the benchmark map");
+  Debug::check_assertion(data->get_num_entities(LAYER_LOW) == num_tiles,
+      "Wrong number of tiles in the benchmark map");
+  load_map(game, map_id);
+  load_map(game, empty_map_id);
+
+  double native_ms = 0.0;
+  double lua_ms = 0.0;
+  for (int run = 0; run < num_runs; ++run) {
+
+    Clock::time_point start_date = Clock::now();
+    std::shared_ptr<Map> map = load_map(game, map_id);
+    native_ms += get_elapsed_ms(start_date);
+
+    start_date = Clock::now();
+    std::shared_ptr<Map> lua_map = load_map(game, empty_map_id);
+    for (int i = 0; i < num_tiles; ++i) {
+      if (lua_context.create_map_entity_from_data(*lua_map, data->get_entity({ LAYER_LOW, i }))) {
+        lua_pop(l, 1);
+      }
+    }
+    lua_ms += get_elapsed_ms(start_date);
+
+    map = nullptr;
+    lua_map = nullptr;
+    lua_gc(l, LUA_GCCOLLECT, 0);
+  }
+  native_ms /= num_runs;
+  lua_ms /= num_runs;
+
+  std::cout << num_tiles << " tiles, average of " << num_runs << " loads" << std::endl
+      << "Tiles created through Lua: " << lua_ms << " ms" << std::endl
+      << "Tiles created natively: " << native_ms << " ms" << std::endl
+      << "Saved: " << (lua_ms - native_ms) << " ms ("
+      << (100.0 * (lua_ms - native_ms) / lua_ms) << "%)" << std::endl;
+
+  QuestFiles::data_file_delete("maps/" + map_id + ".dat");
+  QuestFiles::data_file_delete("maps/" + empty_map_id + ".dat");
+}
+
+}
+
+/**
+ * \brief Measures the load time of a map with many tiles, with tiles created
+ * natively and through Lua.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  run_benchmark(env);
+
+  return 0;
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/server/PacketReader.h"
+#include "solarus/server/Protocol.h"
+#include "solarus/server/RingBuffer.h"
+#include "test_tools/TestEnvironment.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace Solarus;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+const size_t num_events = 2000000;        /**< Events encoded and decoded. */
+const size_t events_per_packet = 16;      /**< Size of each batch. */
+const size_t chunk_size = 1500;           /**< Bytes received per socket read. */
+
+/**
+ * \brief Returns the seconds elapsed since a date.
+ */
+double get_elapsed_seconds(const Clock::time_point& date) {
+  return std::chrono::duration<double>(Clock::now() - date).count();
+}
+
+/**
+ * \brief Prints the throughput of a step of the benchmark.
+ */
+void print_throughput(const std::string& step, size_t num_bytes, double seconds) {
+
+  std::cout << step << ": " << static_cast<uint64_t>(num_events / seconds)
+      << " events/s, " << static_cast<uint64_t>(num_bytes / seconds / 1000000)
+      << " MB/s" << std::endl;
+}
+
+/**
+ * \brief Measures the speed of encoding and decoding game command events.
+ */
+void run_benchmark(TestEnvironment& /* env */) {
+
+  std::vector<Protocol::GameCommandEvent> events(events_per_packet);
+  std::string stream;
+  stream.reserve(num_events / events_per_packet * (Protocol::header_size +
+      Protocol::commands_header_size + events_per_packet * Protocol::command_event_size));
+
+  // Encode batches into the stream, as a client would do every frame.
+  Clock::time_point start_date = Clock::now();
+  uint32_t sequence = 0;
+  for (size_t i = 0; i < num_events; i += events_per_packet) {
+    for (size_t j = 0; j < events_per_packet; ++j) {
+      Protocol::GameCommandEvent& event = events[j];
+      event.sequence = sequence++;
+      event.timestamp = static_cast<uint32_t>(i);
+      event.command = static_cast<GameCommand>(j % 9);
+      event.pressed = j % 2 == 0;
+    }
+    Protocol::encode_commands(events.data(), events.size(), stream);
+  }
+  print_throughput("Encoding", stream.size(), get_elapsed_seconds(start_date));
+
+  // Decode the stream received in chunks, as the server does.
+  RingBuffer input(Protocol::max_packet_size * 4);
+  PacketReader reader(input);
+  Protocol::Packet packet;
+  size_t num_decoded = 0;
+  uint32_t last_sequence = 0;
+  size_t position = 0;
+  start_date = Clock::now();
+  while (position < stream.size()) {
+    const size_t size = std::min(chunk_size, stream.size() - position);
+    position += input.push(&stream[position], size);
+    while (reader.next(packet) == PacketReader::Result::PACKET) {
+      const Protocol::CommandBatch batch(packet);
+      const size_t batch_size = batch.get_num_events();
+      for (size_t i = 0; i < batch_size; ++i) {
+        last_sequence = batch.get_event(i).sequence;
+      }
+      num_decoded += batch_size;
+    }
+  }
+  reader.release();
+  print_throughput("Decoding", stream.size(), get_elapsed_seconds(start_date));
+
+  Debug::check_assertion(num_decoded == num_events,
+      "Decoded " + std::to_string(num_decoded) + " events instead of " +
+      std::to_string(num_events));
+  Debug::check_assertion(last_sequence == num_events - 1, "Wrong last sequence number");
+  Debug::check_assertion(input.is_empty(), "Bytes left in the input buffer");
+}
+
+}
+
+/**
+ * \brief Measures the throughput of the binary protocol of the game server.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  run_benchmark(env);
+
+  return 0;
+}
+
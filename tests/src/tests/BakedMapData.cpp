@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/MapEntities.h"
+#include "solarus/entities/TilesetData.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/BakedMapData.h"
+#include "solarus/CurrentQuest.h"
+#include "solarus/Map.h"
+#include "solarus/MapData.h"
+#include "test_tools/TestEnvironment.h"
+
+using namespace Solarus;
+
+namespace {
+
+/**
+ * \brief Reads a map and its tileset from their text files.
+ */
+void read_map(const std::string& map_id, MapData& map_data, TilesetData& tileset_data) {
+
+  const std::string& map_file_name = "maps/" + map_id + ".dat";
+  bool success = map_data.import_from_buffer(QuestFiles::data_file_read(map_file_name), map_file_name);
+  Debug::check_assertion(success, "Map import failed: " + map_id);
+
+  const std::string& tileset_file_name = "tilesets/" + map_data.get_tileset_id() + ".dat";
+  success = tileset_data.import_from_buffer(QuestFiles::data_file_read(tileset_file_name), tileset_file_name);
+  Debug::check_assertion(success, "Tileset import failed: " + map_data.get_tileset_id());
+}
+
+/**
+ * \brief Checks baking a map and reading the baked file again.
+ */
+void check_map(const std::string& map_id) {
+
+  MapData map_data;
+  TilesetData tileset_data;
+  read_map(map_id, map_data, tileset_data);
+
+  BakedMapData baked_data;
+  bool success = baked_data.build(map_data, tileset_data);
+  Debug::check_assertion(success, "Baking failed: " + map_id);
+
+  std::string buffer;
+  success = baked_data.export_to_binary(buffer);
+  Debug::check_assertion(success, "Baked export failed: " + map_id);
+
+  BakedMapData imported_data;
+  success = imported_data.import_from_binary(buffer.data(), buffer.size());
+  Debug::check_assertion(success, "Baked import failed: " + map_id);
+
+  Debug::check_assertion(imported_data.get_hash() == baked_data.get_hash(), "Hash differs");
+  Debug::check_assertion(imported_data.get_hash() == BakedMapData::compute_hash(map_data, tileset_data),
+      "Wrong hash");
+  for (int i = LAYER_LOW; i < LAYER_NB; ++i) {
+    const Layer layer = static_cast<Layer>(i);
+    Debug::check_assertion(imported_data.get_tiles_ground(layer) == baked_data.get_tiles_ground(layer),
+        "Ground differs");
+    Debug::check_assertion(imported_data.get_animated_squares(layer) == baked_data.get_animated_squares(layer),
+        "Animated squares differ");
+    Debug::check_assertion(imported_data.get_rejected_tiles(layer) == baked_data.get_rejected_tiles(layer),
+        "Rejected tiles differ");
+    Debug::check_assertion(imported_data.get_num_tiles(layer) == baked_data.get_num_tiles(layer),
+        "Number of tiles differs");
+  }
+
+  success = imported_data.import_from_binary(buffer.data(), buffer.size() - 1);
+  Debug::check_assertion(!success, "Truncated baked file accepted: " + map_id);
+}
+
+/**
+ * \brief Checks that the baked ground is the same as the one computed
+ * when loading the map.
+ */
+void check_ground(TestEnvironment& env) {
+
+  Map& map = env.get_map();
+  MapData map_data;
+  TilesetData tileset_data;
+  read_map(map.get_id(), map_data, tileset_data);
+
+  BakedMapData baked_data;
+  bool success = baked_data.build(map_data, tileset_data);
+  Debug::check_assertion(success, "Baking failed");
+
+  const MapEntities& entities = env.get_entities();
+  for (int i = LAYER_LOW; i < LAYER_NB; ++i) {
+    const Layer layer = static_cast<Layer>(i);
+    const std::vector<Ground>& baked_ground = baked_data.get_tiles_ground(layer);
+    for (int y8 = 0; y8 < map.get_height8(); ++y8) {
+      for (int x8 = 0; x8 < map.get_width8(); ++x8) {
+        Debug::check_assertion(
+            baked_ground[y8 * map.get_width8() + x8] == entities.get_tile_ground(layer, x8 * 8, y8 * 8),
+            "Baked ground differs from the ground of the map");
+      }
+    }
+  }
+
+  // Moving a tile must invalidate the baked data.
+  for (int i = LAYER_LOW; i < LAYER_NB; ++i) {
+    const Layer layer = static_cast<Layer>(i);
+    for (int j = 0; j < map_data.get_num_entities(layer); ++j) {
+      EntityData& entity_data = map_data.get_entity({ layer, j });
+      if (entity_data.get_type() == EntityType::TILE) {
+        entity_data.set_xy(entity_data.get_xy() + Point(8, 0));
+        Debug::check_assertion(
+            BakedMapData::compute_hash(map_data, tileset_data) != baked_data.get_hash(),
+            "Hash unchanged after moving a tile");
+        return;
+      }
+    }
+  }
+}
+
+}
+
+/**
+ * \brief Tests the ground and tile regions computed in advance.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  for (const auto& kvp : CurrentQuest::get_resources().get_elements(ResourceType::MAP)) {
+    check_map(kvp.first);
+  }
+  check_ground(env);
+
+  return 0;
+}
+
@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/TilesetData.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/CurrentQuest.h"
+#include "solarus/MapData.h"
+#include "solarus/SpriteData.h"
+#include "test_tools/TestEnvironment.h"
+#include <iostream>
+
+using namespace Solarus;
+
+namespace {
+
+/**
+ * \brief Checks compiling a data file and reading the binary version again.
+ */
+template<typename Data>
+void check_data_file(const std::string& file_name) {
+
+  Data data;
+  bool success = data.import_from_buffer(QuestFiles::data_file_read(file_name), file_name);
+  Debug::check_assertion(success, "Import failed: " + file_name);
+
+  // Compile it.
+  std::string binary_buffer;
+  success = data.export_to_binary(binary_buffer);
+  Debug::check_assertion(success, "Binary export failed: " + file_name);
+
+  // Read the binary version.
+  Data compiled_data;
+  success = compiled_data.import_from_binary(binary_buffer.data(), binary_buffer.size());
+  Debug::check_assertion(success, "Binary import failed: " + file_name);
+
+  // Both versions must give the same text file.
+  std::string text_buffer;
+  std::string compiled_text_buffer;
+  data.export_to_buffer(text_buffer);
+  compiled_data.export_to_buffer(compiled_text_buffer);
+  if (compiled_text_buffer != text_buffer) {
+    std::cerr << "*** Original file:" << std::endl << text_buffer << std::endl
+        << "*** Compiled file:" << std::endl << compiled_text_buffer << std::endl;
+    Debug::die("'" + file_name + "': compiled file differs from the original one");
+  }
+
+  // Truncated or altered files must be rejected.
+  Data truncated_data;
+  success = truncated_data.import_from_binary(binary_buffer.data(), binary_buffer.size() - 1);
+  Debug::check_assertion(!success, "Truncated binary file accepted: " + file_name);
+
+  std::string other_version = binary_buffer;
+  ++other_version[8];  // Version number.
+  success = truncated_data.import_from_binary(other_version.data(), other_version.size());
+  Debug::check_assertion(!success, "Binary file with wrong version accepted: " + file_name);
+}
+
+/**
+ * \brief Checks all data files of a type of resource.
+ */
+template<typename Data>
+void check_resources(ResourceType resource_type, const std::string& prefix) {
+
+  const std::map<std::string, std::string>& elements =
+      CurrentQuest::get_resources().get_elements(resource_type);
+  Debug::check_assertion(!elements.empty(), "No " + prefix + " elements");
+  for (const auto& kvp : elements) {
+    check_data_file<Data>(prefix + kvp.first + ".dat");
+  }
+}
+
+}
+
+/**
+ * \brief Tests the binary format of maps, tilesets and sprites.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  check_resources<MapData>(ResourceType::MAP, "maps/");
+  check_resources<TilesetData>(ResourceType::TILESET, "tilesets/");
+  check_resources<SpriteData>(ResourceType::SPRITE, "sprites/");
+
+  return 0;
+}
+
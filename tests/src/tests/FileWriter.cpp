@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/FileWriter.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "test_tools/TestEnvironment.h"
+#include <string>
+#include <vector>
+
+using namespace Solarus;
+
+namespace {
+
+const std::string file_name = "file_writer_test.dat";
+
+/**
+ * \brief Returns the full path of the test file.
+ */
+std::string get_path() {
+  return QuestFiles::get_full_quest_write_dir() + "/" + file_name;
+}
+
+/**
+ * \brief Checks writing a file and waiting for the result.
+ */
+void check_write(TestEnvironment& /* env */) {
+
+  Debug::check_assertion(FileWriter::is_running(), "I/O thread not started");
+
+  Debug::check_assertion(FileWriter::write(get_path(), "first"),
+      "Failed to write '" + file_name + "'");
+  Debug::check_assertion(QuestFiles::data_file_read(file_name) == "first",
+      "Wrong content in '" + file_name + "'");
+  Debug::check_assertion(!QuestFiles::data_file_exists(file_name + ".solarus_tmp"),
+      "Temporary file left after writing '" + file_name + "'");
+}
+
+/**
+ * \brief Checks that saving a file several times in a row only keeps
+ * the last content and calls every callback.
+ */
+void check_coalesced_writes(TestEnvironment& /* env */) {
+
+  std::vector<bool> results;
+  for (int i = 0; i < 10; ++i) {
+    const std::string content = "content " + std::to_string(i);
+    FileWriter::write_async(
+        get_path(),
+        [content]() { return content; },
+        [&results](bool success) { results.push_back(success); }
+    );
+  }
+  FileWriter::flush();
+
+  Debug::check_assertion(results.empty(),
+      "Callbacks called from the I/O thread");
+  FileWriter::update();
+  Debug::check_assertion(results.size() == 10, "Missing callbacks");
+  for (bool success: results) {
+    Debug::check_assertion(success, "Failed to write '" + file_name + "'");
+  }
+  Debug::check_assertion(QuestFiles::data_file_read(file_name) == "content 9",
+      "Wrong content in '" + file_name + "'");
+
+  QuestFiles::data_file_delete(file_name);
+}
+
+/**
+ * \brief Checks that finish() also waits for files requested by callbacks.
+ */
+void check_finish(TestEnvironment& /* env */) {
+
+  bool first_done = false;
+  bool second_done = false;
+  FileWriter::write_async(
+      get_path(),
+      []() { return std::string("first"); },
+      [&](bool) {
+        first_done = true;
+        FileWriter::write_async(
+            get_path(),
+            []() { return std::string("second"); },
+            [&second_done](bool) { second_done = true; }
+        );
+      }
+  );
+  FileWriter::finish();
+
+  Debug::check_assertion(first_done, "First callback not called");
+  Debug::check_assertion(second_done, "Callback of a file requested by a callback not called");
+  Debug::check_assertion(QuestFiles::data_file_read(file_name) == "second",
+      "Wrong content in '" + file_name + "'");
+
+  QuestFiles::data_file_delete(file_name);
+}
+
+}
+
+/**
+ * \brief Tests writing files in the background.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  check_write(env);
+  check_coalesced_writes(env);
+  check_finish(env);
+
+  return 0;
+}
+
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/Hero.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/server/Client.h"
+#include "solarus/server/GameSession.h"
+#include "solarus/server/PacketReader.h"
+#include "solarus/server/Protocol.h"
+#include "solarus/server/RingBuffer.h"
+#include "solarus/server/Server.h"
+#include "solarus/server/SnapshotCodec.h"
+#include "solarus/Sprite.h"
+#include "test_tools/TestEnvironment.h"
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <poll.h>
+#include <string>
+#include <vector>
+
+using namespace Solarus;
+
+namespace {
+
+const int num_clients = 4;             /**< Clients connected to the server. */
+const size_t num_snapshots = 100;      /**< Snapshots each client waits for. */
+
+/**
+ * \brief A client that receives snapshots and acknowledges them.
+ */
+struct TestClient {
+
+  TestClient():
+    input(Protocol::max_snapshot_packet_size * 2),
+    reader(input) {
+  }
+
+  Client client;                          /**< The connection. */
+  RingBuffer input;                       /**< Bytes received. */
+  PacketReader reader;                    /**< Splits the input into packets. */
+  std::vector<std::string> strings;       /**< String table. */
+  std::deque<Snapshot> snapshots;         /**< Snapshots received recently. */
+  size_t num_snapshots_received = 0;      /**< Number of snapshots decoded. */
+  size_t num_bytes_received = 0;          /**< Size of all snapshot packets. */
+  size_t first_snapshot_size = 0;         /**< Size of the first (full) snapshot. */
+};
+
+/**
+ * \brief Sends game command events to the server.
+ * \param client The client.
+ * \param sequence Sequence number of the event.
+ * \param command The command.
+ * \param pressed \c true to press it.
+ */
+void send_command(TestClient& client, uint32_t sequence, GameCommand command, bool pressed) {
+
+  Protocol::GameCommandEvent event;
+  event.sequence = sequence;
+  event.timestamp = 0;
+  event.command = command;
+  event.pressed = pressed;
+  std::string packet;
+  Protocol::encode_commands(&event, 1, packet);
+  Debug::check_assertion(client.client.send(packet.data(), packet.size()),
+      "Failed to send commands");
+}
+
+/**
+ * \brief Decodes the packets received by a client.
+ * \param client The client.
+ */
+void process_packets(TestClient& client) {
+
+  Protocol::Packet packet;
+  PacketReader::Result result;
+  std::string ack;
+  while ((result = client.reader.next(packet)) == PacketReader::Result::PACKET) {
+    if (packet.type == Protocol::MessageType::ACK) {
+      continue;
+    }
+
+    uint32_t tick = 0;
+    uint32_t baseline_tick = 0;
+    Debug::check_assertion(SnapshotCodec::read_ticks(packet, tick, baseline_tick),
+        "Unexpected packet");
+
+    const Snapshot* baseline = nullptr;
+    for (const Snapshot& snapshot: client.snapshots) {
+      if (snapshot.tick == baseline_tick) {
+        baseline = &snapshot;
+      }
+    }
+    Snapshot snapshot;
+    Debug::check_assertion(SnapshotCodec::decode(packet, baseline, client.strings, snapshot),
+        "Failed to decode snapshot " + std::to_string(tick));
+
+    if (client.num_snapshots_received == 0) {
+      Debug::check_assertion(baseline_tick == SnapshotCodec::no_baseline,
+          "The first snapshot should be complete");
+      client.first_snapshot_size = Protocol::header_size + packet.size;
+    }
+    ++client.num_snapshots_received;
+    client.num_bytes_received += Protocol::header_size + packet.size;
+
+    client.snapshots.push_back(std::move(snapshot));
+    if (client.snapshots.size() > 64) {
+      client.snapshots.pop_front();
+    }
+    Protocol::encode_snapshot_ack(tick, ack);
+  }
+  client.reader.release();
+  Debug::check_assertion(result == PacketReader::Result::INCOMPLETE, "Invalid stream");
+
+  if (!ack.empty()) {
+    Debug::check_assertion(client.client.send(ack.data(), ack.size()),
+        "Failed to acknowledge snapshots");
+  }
+}
+
+/**
+ * \brief Connects several clients to a server hosting the game and checks
+ * that they follow the simulation.
+ */
+void check_game_session(TestEnvironment& env) {
+
+  Hero& hero = env.get_hero();
+  env.get_map();
+  const int initial_x = hero.get_x();
+
+  GameSession session(env.get_main_loop());
+  Server server(0);
+  server.set_session(&session);
+  Debug::check_assertion(server.start(), "Failed to start the server");
+
+  std::vector<std::unique_ptr<TestClient>> clients;
+  for (int i = 0; i < num_clients; ++i) {
+    clients.emplace_back(new TestClient());
+    Debug::check_assertion(clients.back()->client.connect("127.0.0.1", server.get_port()),
+        "Failed to connect to the server");
+  }
+
+  // Two clients press right: the hero walks until both release it.
+  send_command(*clients[0], 0, GameCommand::RIGHT, true);
+  send_command(*clients[1], 0, GameCommand::RIGHT, true);
+
+  std::vector<pollfd> sockets(num_clients);
+  for (int i = 0; i < num_clients; ++i) {
+    sockets[i].fd = clients[i]->client.get_socket();
+    sockets[i].events = POLLIN;
+  }
+
+  bool finished = false;
+  bool released = false;
+  while (!finished) {
+    Debug::check_assertion(poll(sockets.data(), sockets.size(), 5000) > 0,
+        "No snapshot received");
+
+    finished = true;
+    for (int i = 0; i < num_clients; ++i) {
+      TestClient& client = *clients[i];
+      if ((sockets[i].revents & POLLIN) != 0) {
+        Debug::check_assertion(client.input.read_from(sockets[i].fd) > 0,
+            "Connection closed by the server");
+        process_packets(client);
+      }
+      finished = finished && client.num_snapshots_received >= num_snapshots;
+    }
+
+    if (!released && clients[0]->num_snapshots_received >= num_snapshots / 2) {
+      send_command(*clients[0], 1, GameCommand::RIGHT, false);
+      send_command(*clients[1], 1, GameCommand::RIGHT, false);
+      released = true;
+    }
+  }
+
+  // Every client sees the same entities as the server.
+  server.stop();
+  const Snapshot& last_snapshot = clients[0]->snapshots.back();
+  Debug::check_assertion(!last_snapshot.entities.empty(), "No entities in snapshots");
+  Debug::check_assertion(hero.get_x() > initial_x, "The hero did not move");
+  const int final_x = hero.get_x();
+  for (int i = 0; i < 10; ++i) {
+    env.step();
+  }
+  Debug::check_assertion(hero.get_x() == final_x, "The hero still walks after the release");
+  bool hero_found = false;
+  for (const EntityState& entity: last_snapshot.entities) {
+    if (entity.x == hero.get_x() && entity.y == hero.get_y() &&
+        clients[0]->strings[entity.sprite] == hero.get_sprite().get_animation_set_id()) {
+      hero_found = true;
+    }
+  }
+  Debug::check_assertion(hero_found, "The hero is not in the last snapshot");
+
+  // Deltas are much smaller than full snapshots.
+  for (const std::unique_ptr<TestClient>& client: clients) {
+    const size_t average_delta_size = (client->num_bytes_received - client->first_snapshot_size) /
+        (client->num_snapshots_received - 1);
+    Debug::check_assertion(average_delta_size < client->first_snapshot_size,
+        "Delta snapshots are not smaller than full ones");
+  }
+
+  std::cout << num_clients << " clients, " << last_snapshot.entities.size() << " entities: "
+      << session.get_total_tick_time() / session.get_tick() << " us per tick, "
+      << session.get_num_bytes_sent() / session.get_tick() << " bytes sent per tick, "
+      << "full snapshot " << clients[0]->first_snapshot_size << " bytes" << std::endl;
+}
+
+}
+
+/**
+ * \brief Tests a game hosted by the server with clients in the same process.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  check_game_session(env);
+
+  return 0;
+}
+
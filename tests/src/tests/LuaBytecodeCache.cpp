@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/lua/LuaBytecodeCache.h"
+#include "test_tools/TestEnvironment.h"
+#include <lua.hpp>
+#include <string>
+
+using namespace Solarus;
+
+namespace {
+
+/**
+ * \brief Loads a chunk through the cache and runs it.
+ * \param l A Lua state.
+ * \param source Lua code of the chunk, that must return a number.
+ * \param chunk_name Name of the chunk.
+ * \return The number returned by the chunk.
+ */
+int load_and_run(lua_State* l, const std::string& source, const std::string& chunk_name) {
+
+  Debug::check_assertion(LuaBytecodeCache::load_buffer(l, source, chunk_name) == 0,
+      "Failed to load chunk '" + chunk_name + "'");
+  Debug::check_assertion(lua_pcall(l, 0, 1, 0) == 0,
+      "Failed to run chunk '" + chunk_name + "'");
+  const int result = (int) lua_tointeger(l, -1);
+  lua_pop(l, 1);
+  return result;
+}
+
+/**
+ * \brief Checks that loading the same source again hits the memory cache.
+ */
+void check_memory_hit(lua_State* l) {
+
+  LuaBytecodeCache::quit();
+  LuaBytecodeCache::set_mode(LuaBytecodeCache::Mode::MEMORY);
+
+  Debug::check_assertion(load_and_run(l, "return 1", "test/hit.lua") == 1,
+      "Wrong result");
+  Debug::check_assertion(LuaBytecodeCache::get_num_misses() == 1,
+      "Expected one cache miss");
+  Debug::check_assertion(LuaBytecodeCache::get_num_hits() == 0,
+      "Unexpected cache hit");
+
+  Debug::check_assertion(load_and_run(l, "return 1", "test/hit.lua") == 1,
+      "Wrong result from the cache");
+  Debug::check_assertion(LuaBytecodeCache::get_num_misses() == 1,
+      "Source compiled twice");
+  Debug::check_assertion(LuaBytecodeCache::get_num_hits() == 1,
+      "Expected one cache hit");
+
+  // Another chunk with the same source is cached separately.
+  Debug::check_assertion(load_and_run(l, "return 1", "test/other.lua") == 1,
+      "Wrong result");
+  Debug::check_assertion(LuaBytecodeCache::get_num_misses() == 2,
+      "Chunks with different names mixed up");
+}
+
+/**
+ * \brief Checks that the bytecode of an older source is never used.
+ */
+void check_invalidation(lua_State* l) {
+
+  LuaBytecodeCache::quit();
+  LuaBytecodeCache::set_mode(LuaBytecodeCache::Mode::MEMORY);
+
+  Debug::check_assertion(load_and_run(l, "return 1", "test/changed.lua") == 1,
+      "Wrong result");
+  Debug::check_assertion(load_and_run(l, "return 1", "test/changed.lua") == 1,
+      "Wrong result from the cache");
+
+  // The source changes.
+  Debug::check_assertion(load_and_run(l, "return 2", "test/changed.lua") == 2,
+      "Old bytecode used for a changed source");
+  Debug::check_assertion(LuaBytecodeCache::get_num_misses() == 2,
+      "Changed source not compiled");
+  Debug::check_assertion(load_and_run(l, "return 2", "test/changed.lua") == 2,
+      "Wrong result from the cache");
+  Debug::check_assertion(LuaBytecodeCache::get_num_hits() == 2,
+      "New source not cached");
+
+  // And changes back.
+  Debug::check_assertion(load_and_run(l, "return 1", "test/changed.lua") == 1,
+      "Old bytecode used for a changed source");
+  Debug::check_assertion(LuaBytecodeCache::get_num_misses() == 3,
+      "Changed source not compiled");
+}
+
+/**
+ * \brief Checks chunks that are not cached: errors, bytecode and the
+ * disabled mode.
+ */
+void check_not_cached(lua_State* l) {
+
+  LuaBytecodeCache::quit();
+  LuaBytecodeCache::set_mode(LuaBytecodeCache::Mode::MEMORY);
+
+  // Syntax errors are reported like luaL_loadbuffer() does.
+  Debug::check_assertion(
+      LuaBytecodeCache::load_buffer(l, "return +", "test/error.lua") != 0,
+      "Syntax error not detected");
+  Debug::check_assertion(lua_isstring(l, -1), "Missing error message");
+  lua_pop(l, 1);
+  Debug::check_assertion(
+      LuaBytecodeCache::load_buffer(l, "return +", "test/error.lua") != 0,
+      "Syntax error not detected twice");
+  lua_pop(l, 1);
+  Debug::check_assertion(LuaBytecodeCache::get_num_hits() == 0,
+      "Invalid chunk cached");
+
+  // Precompiled chunks are loaded directly.
+  Debug::check_assertion(luaL_loadstring(l, "return 3") == 0,
+      "Failed to compile chunk");
+  std::string bytecode;
+  lua_dump(l, [](lua_State* /* l */, const void* data, size_t size, void* userdata) {
+    static_cast<std::string*>(userdata)->append(static_cast<const char*>(data), size);
+    return 0;
+  }, &bytecode);
+  lua_pop(l, 1);
+  Debug::check_assertion(LuaBytecodeCache::is_bytecode(bytecode),
+      "Bytecode not detected");
+  const int num_misses = LuaBytecodeCache::get_num_misses();
+  Debug::check_assertion(load_and_run(l, bytecode, "test/bytecode.lua") == 3,
+      "Wrong result from bytecode");
+  Debug::check_assertion(LuaBytecodeCache::get_num_misses() == num_misses &&
+      LuaBytecodeCache::get_num_hits() == 0,
+      "Bytecode went through the cache");
+
+  // The disabled cache always compiles.
+  LuaBytecodeCache::set_mode(LuaBytecodeCache::Mode::DISABLED);
+  Debug::check_assertion(load_and_run(l, "return 4", "test/disabled.lua") == 4,
+      "Wrong result");
+  Debug::check_assertion(load_and_run(l, "return 4", "test/disabled.lua") == 4,
+      "Wrong result");
+  Debug::check_assertion(LuaBytecodeCache::get_num_misses() == num_misses &&
+      LuaBytecodeCache::get_num_hits() == 0,
+      "Disabled cache was used");
+}
+
+/**
+ * \brief Checks that bytecode is persisted in the write directory
+ * and reused after the memory cache is cleared.
+ */
+void check_disk(lua_State* l) {
+
+  const std::string chunk_name = "test/disk.lua";
+  const std::string file_name = "lua_cache/test/disk.lua.luac";
+  QuestFiles::data_file_delete(file_name);
+
+  LuaBytecodeCache::quit();
+  LuaBytecodeCache::set_mode(LuaBytecodeCache::Mode::DISK);
+
+  Debug::check_assertion(load_and_run(l, "return 5", chunk_name) == 5,
+      "Wrong result");
+  Debug::check_assertion(LuaBytecodeCache::get_num_misses() == 1,
+      "Expected one cache miss");
+  Debug::check_assertion(QuestFiles::data_file_exists(file_name),
+      "Bytecode not saved in the write directory");
+
+  // As if the quest was started again.
+  LuaBytecodeCache::quit();
+  Debug::check_assertion(load_and_run(l, "return 5", chunk_name) == 5,
+      "Wrong result from the disk cache");
+  Debug::check_assertion(LuaBytecodeCache::get_num_hits() == 1 &&
+      LuaBytecodeCache::get_num_misses() == 0,
+      "Bytecode not loaded from the disk");
+
+  // The source changes: the file is not used and is replaced.
+  LuaBytecodeCache::quit();
+  Debug::check_assertion(load_and_run(l, "return 6", chunk_name) == 6,
+      "Old bytecode from the disk used for a changed source");
+  Debug::check_assertion(LuaBytecodeCache::get_num_misses() == 1,
+      "Changed source not compiled");
+
+  LuaBytecodeCache::quit();
+  Debug::check_assertion(load_and_run(l, "return 6", chunk_name) == 6,
+      "Wrong result from the disk cache");
+  Debug::check_assertion(LuaBytecodeCache::get_num_hits() == 1,
+      "Updated bytecode not saved");
+
+  // A corrupt file is ignored.
+  QuestFiles::data_file_save(file_name, "garbage");
+  LuaBytecodeCache::quit();
+  Debug::check_assertion(load_and_run(l, "return 6", chunk_name) == 6,
+      "Wrong result with a corrupt cache file");
+  Debug::check_assertion(LuaBytecodeCache::get_num_misses() == 1,
+      "Corrupt cache file used");
+
+  QuestFiles::data_file_delete(file_name);
+  LuaBytecodeCache::set_mode(LuaBytecodeCache::Mode::MEMORY);
+}
+
+}
+
+/**
+ * \brief Tests the cache of compiled Lua chunks.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  lua_State* l = luaL_newstate();
+  luaL_openlibs(l);
+
+  check_memory_hit(l);
+  check_invalidation(l);
+  check_not_cached(l);
+  check_disk(l);
+
+  lua_close(l);
+
+  return 0;
+}
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/TilesetData.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/lowlevel/Surface.h"
+#include "solarus/Arguments.h"
+#include "solarus/MapCache.h"
+#include "solarus/MapData.h"
+#include "test_tools/TestEnvironment.h"
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Solarus;
+
+namespace {
+
+/**
+ * \brief Checks that parsing a map data file again hits the cache.
+ */
+void check_map_data(TestEnvironment& /* env */) {
+
+  const int num_hits = MapCache::get_num_hits();
+  const std::shared_ptr<const MapData>& data_1 = MapCache::get_map_data("traversable");
+  const std::shared_ptr<const MapData>& data_2 = MapCache::get_map_data("traversable");
+  Debug::check_assertion(data_1 != nullptr, "Failed to load map 'traversable'");
+  Debug::check_assertion(data_1 == data_2, "Map data was parsed twice");
+  Debug::check_assertion(MapCache::get_num_hits() == num_hits + 1,
+      "Expected one cache hit");
+  Debug::check_assertion(MapCache::get_memory_used() > 0,
+      "The cache should not be empty");
+}
+
+/**
+ * \brief Checks that tilesets are shared.
+ */
+void check_tileset(TestEnvironment& /* env */) {
+
+  const std::shared_ptr<const TilesetData>& data_1 = MapCache::get_tileset_data("castle");
+  const std::shared_ptr<const TilesetData>& data_2 = MapCache::get_tileset_data("castle");
+  Debug::check_assertion(data_1 == data_2, "Tileset data was parsed twice");
+  Debug::check_assertion(!data_1->get_patterns().empty(), "Tileset 'castle' is empty");
+
+  const SurfacePtr& image_1 = MapCache::get_tileset_image("tilesets/castle.tiles.png");
+  const SurfacePtr& image_2 = MapCache::get_tileset_image("tilesets/castle.tiles.png");
+  Debug::check_assertion(image_1 != nullptr, "Failed to load tiles image");
+  Debug::check_assertion(image_1 == image_2, "Tiles image was decoded twice");
+}
+
+/**
+ * \brief Checks that missing files are not cached.
+ */
+void check_missing_file(TestEnvironment& /* env */) {
+
+  const int num_misses = MapCache::get_num_misses();
+  Debug::check_assertion(MapCache::get_tileset_image("tilesets/no_such_image.png") == nullptr,
+      "Unexpected image");
+  Debug::check_assertion(MapCache::get_tileset_image("tilesets/no_such_image.png") == nullptr,
+      "Unexpected image");
+  Debug::check_assertion(MapCache::get_num_misses() == num_misses + 2,
+      "Expected two cache misses");
+}
+
+/**
+ * \brief Checks that an element whose file has changed is loaded again.
+ */
+void check_stale_entry(TestEnvironment& /* env */) {
+
+  const std::string map_id = "map_cache_test";
+  const std::string file_name = "maps/" + map_id + ".dat";
+  Debug::check_assertion(QuestFiles::data_file_mkdir("maps"),
+      "Failed to create the maps directory in the write directory");
+  QuestFiles::data_file_save(file_name, QuestFiles::data_file_read("maps/traversable.dat"));
+
+  std::weak_ptr<const MapData> data = MapCache::get_map_data(map_id);
+  Debug::check_assertion(!data.expired(), "Map data was not cached");
+  const size_t memory_used = MapCache::get_memory_used();
+
+  // The file disappears: the element is not valid anymore.
+  QuestFiles::data_file_delete(file_name);
+  Debug::set_die_on_error(false);
+  Debug::check_assertion(MapCache::get_map_data(map_id) == nullptr,
+      "Map data of a deleted file was returned");
+  Debug::set_die_on_error(true);
+  Debug::check_assertion(MapCache::get_memory_used() < memory_used,
+      "Stale element still counted");
+
+  // It is only destroyed by the main loop.
+  Debug::check_assertion(!data.expired(), "Stale element destroyed too early");
+  MapCache::update();
+  Debug::check_assertion(data.expired(), "Stale element not released");
+}
+
+/**
+ * \brief Checks that least recently used images are evicted, and released
+ * by the main thread even if they are evicted by another thread.
+ */
+void check_eviction(TestEnvironment& /* env */) {
+
+  // A budget of 2 MiB holds one of these 1 MiB images at most.
+  std::string option = "-map-cache-size=2";
+  char program_name[] = "";
+  char* argv[] = { program_name, &option[0] };
+  MapCache::quit();
+  MapCache::initialize(Arguments(2, argv));
+
+  std::weak_ptr<Surface> first_image = MapCache::get_tileset_image("sprites/hero/jumping.png");
+  Debug::check_assertion(!first_image.expired(), "Image was not cached");
+
+  std::thread loader([]() {
+    MapCache::get_tileset_image("sprites/hero/falling.png");
+    MapCache::get_tileset_image("sprites/hero/dying.png");
+  });
+  loader.join();
+
+  Debug::check_assertion(MapCache::get_memory_used() <= 2 * 1024 * 1024,
+      "Memory budget exceeded");
+  int num_misses = MapCache::get_num_misses();
+  MapCache::get_tileset_image("sprites/hero/dying.png");
+  Debug::check_assertion(MapCache::get_num_misses() == num_misses,
+      "Most recent image was evicted");
+
+  Debug::check_assertion(!first_image.expired(),
+      "Evicted image destroyed by another thread");
+  MapCache::update();
+  Debug::check_assertion(first_image.expired(), "Evicted image not released");
+
+  num_misses = MapCache::get_num_misses();
+  MapCache::get_tileset_image("sprites/hero/jumping.png");
+  Debug::check_assertion(MapCache::get_num_misses() == num_misses + 1,
+      "Least recently used image was not evicted");
+}
+
+}
+
+/**
+ * \brief Tests the cache of map data, tileset data and tileset images.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  check_map_data(env);
+  check_tileset(env);
+  check_missing_file(env);
+  check_stale_entry(env);
+  check_eviction(env);
+
+  return 0;
+}
+
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/Ground.h"
+#include "solarus/entities/MapEntities.h"
+#include "solarus/entities/NonAnimatedRegions.h"
+#include "solarus/entities/TilePattern.h"
+#include "solarus/entities/Tileset.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/Map.h"
+#include "test_tools/TestEnvironment.h"
+#include <memory>
+
+using namespace Solarus;
+
+namespace {
+
+/**
+ * \brief Checks that a tile whose pattern does not exist is skipped
+ * with an error instead of stopping the loading of the map.
+ */
+void check_missing_tile_pattern(TestEnvironment& env) {
+
+  Debug::set_die_on_error(false);
+  Debug::set_abort_on_die(false);
+
+  const std::shared_ptr<Map> map = std::make_shared<Map>("bugs/missing_tile_pattern");
+  map->load(env.get_game());
+
+  Debug::set_abort_on_die(true);
+  Debug::set_die_on_error(true);
+
+  Debug::check_assertion(map->is_loaded(), "Map with a missing tile pattern not loaded");
+  Debug::check_assertion(
+      map->get_entities().get_tile_ground(LAYER_LOW, 168, 128) == Ground::TRAVERSABLE,
+      "Wrong ground under the missing tile pattern"
+  );
+  map->unload();
+}
+
+}
+
+/**
+ * \brief Tests creating the static tiles of a map.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  check_missing_tile_pattern(env);
+
+  return 0;
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/entities/MapEntities.h"
+#include "solarus/entities/NonAnimatedRegions.h"
+#include "solarus/entities/TilePattern.h"
+#include "solarus/entities/Tileset.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/Map.h"
+#include "solarus/SolarusFatal.h"
+#include "test_tools/TestEnvironment.h"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace Solarus;
+
+namespace {
+
+/**
+ * \brief Checks loading a map whose files were read by a worker thread.
+ */
+void check_prepared_map(TestEnvironment& env) {
+
+  const std::shared_ptr<Map> map = std::make_shared<Map>("traversable");
+  Debug::check_assertion(!map->is_prepared(), "Map prepared too early");
+  map->start_preparing();
+
+  // 10 seconds at most.
+  for (int i = 0; i < 10000 && !map->is_prepared(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  Debug::check_assertion(map->is_prepared(), "Map preparation not finished");
+
+  map->load(env.get_game());
+  Debug::check_assertion(map->is_loaded(), "Prepared map not loaded");
+  Debug::check_assertion(map->get_width() == 320 && map->get_height() == 240,
+      "Wrong size of prepared map");
+  map->unload();
+}
+
+/**
+ * \brief Checks that maps can be destroyed while their preparation is
+ * still running, like when the hero teleports again during a transition.
+ */
+void check_abandoned_preparation(TestEnvironment& /* env */) {
+
+  for (int i = 0; i < 10; ++i) {
+    std::shared_ptr<Map> map = std::make_shared<Map>("traversable");
+    map->start_preparing();
+  }
+}
+
+/**
+ * \brief Checks that an error in the worker thread is thrown again
+ * when the map is loaded by the main thread.
+ */
+void check_error_rethrown(TestEnvironment& env) {
+
+  Debug::set_die_on_error(false);
+  Debug::set_abort_on_die(false);
+
+  const std::shared_ptr<Map> map = std::make_shared<Map>("no_such_map");
+  map->start_preparing();
+
+  std::string error_message;
+  try {
+    map->load(env.get_game());
+  }
+  catch (const SolarusFatal& ex) {
+    error_message = ex.what();
+  }
+
+  Debug::set_abort_on_die(true);
+  Debug::set_die_on_error(true);
+
+  Debug::check_assertion(!error_message.empty(),
+      "Error of the preparation not thrown again");
+  Debug::check_assertion(error_message.find("no_such_map") != std::string::npos,
+      "Unexpected error: " + error_message);
+  Debug::check_assertion(!map->is_loaded(), "Map with errors marked as loaded");
+}
+
+}
+
+/**
+ * \brief Tests reading map files in a worker thread before loading them.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  check_prepared_map(env);
+  check_abandoned_preparation(env);
+  check_error_rethrown(env);
+
+  return 0;
+}
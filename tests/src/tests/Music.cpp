@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/Music.h"
+#include "test_tools/TestEnvironment.h"
+#include <alc.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace Solarus;
+
+namespace {
+
+const std::string music_id = "short";
+
+/**
+ * \brief Number of cycles after which a music that does not loop
+ * should be finished (it lasts less than one second).
+ */
+constexpr int max_steps = 500;
+
+/**
+ * \brief Runs the main loop until the current music stops.
+ * \param env The test environment.
+ * \return The number of cycles simulated, at most max_steps.
+ */
+int run_until_music_stops(TestEnvironment& env) {
+
+  int num_steps = 0;
+  while (Music::get_current_music_id() != Music::none && num_steps < max_steps) {
+    env.step();
+    ++num_steps;
+  }
+  return num_steps;
+}
+
+/**
+ * \brief Checks that a music played with or without a loop
+ * ends as expected.
+ */
+void check_play(TestEnvironment& env) {
+
+  Music::play(music_id, false);
+  Debug::check_assertion(Music::get_current_music_id() == music_id,
+      "Music not played");
+  Debug::check_assertion(run_until_music_stops(env) < max_steps,
+      "Music without loop not finished");
+
+  Music::play(music_id, true);
+  Debug::check_assertion(run_until_music_stops(env) == max_steps,
+      "Music with a loop finished");
+  Music::stop_playing();
+}
+
+/**
+ * \brief Checks playing preloaded musics without a loop.
+ */
+void check_preload(TestEnvironment& env) {
+
+  // Preloaded with a loop, then played without a loop.
+  Music::preload(music_id, true);
+  env.step();
+  Music::play(music_id, false);
+  Debug::check_assertion(run_until_music_stops(env) < max_steps,
+      "Preloaded music played without loop not finished");
+
+  // Preloaded and played without a loop.
+  Music::preload(music_id, false);
+  env.step();
+  Music::play(music_id, false);
+  Debug::check_assertion(run_until_music_stops(env) < max_steps,
+      "Preloaded music without loop not finished");
+
+  // Preloaded and played with a loop.
+  Music::preload(music_id, true);
+  env.step();
+  Music::play(music_id, true);
+  Debug::check_assertion(run_until_music_stops(env) == max_steps,
+      "Preloaded music with a loop finished");
+  Music::stop_playing();
+}
+
+}
+
+/**
+ * \brief Tests playing musics.
+ *
+ * The audio is rendered offline, so this test is skipped if OpenAL
+ * does not support it.
+ */
+int main(int argc, char** argv) {
+
+  if (!alcIsExtensionPresent(nullptr, "ALC_SOFT_loopback")) {
+    std::cout << "Skipping the test: ALC_SOFT_loopback is not available" << std::endl;
+    return 0;
+  }
+
+  // Render the audio offline instead of disabling it.
+  std::string audio_output = "-audio-output=null";
+  std::vector<char*> arguments = { argv[0], &audio_output[0] };
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) != "-no-audio") {
+      arguments.push_back(argv[i]);
+    }
+  }
+  TestEnvironment env(int(arguments.size()), arguments.data());
+
+  check_play(env);
+  check_preload(env);
+
+  return 0;
+}
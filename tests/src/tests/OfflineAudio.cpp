@@ -0,0 +1,128 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/Music.h"
+#include "solarus/lowlevel/System.h"
+#include "test_tools/TestEnvironment.h"
+#include <alc.h>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace Solarus;
+
+namespace {
+
+const std::string wav_file_name = "offline_audio_test.wav";
+
+/**
+ * \brief Number of cycles simulated: one second.
+ */
+constexpr int num_steps = 100;
+
+/**
+ * \brief Sample rate of the offline audio.
+ */
+constexpr int frequency = 32000;
+
+/**
+ * \brief Reads a little-endian integer from a buffer.
+ */
+uint32_t read_le(const std::string& buffer, size_t offset, int size) {
+
+  uint32_t value = 0;
+  for (int i = 0; i < size; ++i) {
+    value |= uint32_t(uint8_t(buffer[offset + i])) << (8 * i);
+  }
+  return value;
+}
+
+/**
+ * \brief Checks the WAV file rendered offline while a music was playing.
+ */
+void check_wav_file() {
+
+  std::ifstream file(wav_file_name.c_str(), std::ios::binary);
+  Debug::check_assertion(bool(file), "Missing file '" + wav_file_name + "'");
+  const std::string content(
+      (std::istreambuf_iterator<char>(file)),
+      std::istreambuf_iterator<char>()
+  );
+  file.close();
+  std::remove(wav_file_name.c_str());
+
+  const size_t header_size = 44;
+  Debug::check_assertion(content.size() >= header_size, "Truncated WAV file");
+  Debug::check_assertion(content.compare(0, 4, "RIFF") == 0 &&
+      content.compare(8, 4, "WAVE") == 0 &&
+      content.compare(36, 4, "data") == 0, "Invalid WAV header");
+  Debug::check_assertion(read_le(content, 22, 2) == 2, "Wrong number of channels");
+  Debug::check_assertion(read_le(content, 24, 4) == frequency, "Wrong sample rate");
+
+  // Each cycle renders the samples of its duration.
+  const uint32_t expected_size = num_steps * System::timestep * frequency / 1000 * 2 * 2;
+  Debug::check_assertion(read_le(content, 40, 4) == expected_size,
+      "Wrong number of samples in the WAV header");
+  Debug::check_assertion(content.size() == header_size + expected_size,
+      "Wrong number of samples in the WAV file");
+
+  bool silent = true;
+  for (size_t i = header_size; i < content.size() && silent; i += 2) {
+    silent = read_le(content, i, 2) == 0;
+  }
+  Debug::check_assertion(!silent, "The music was not rendered");
+}
+
+}
+
+/**
+ * \brief Tests rendering the audio without a sound card.
+ *
+ * This test is skipped if OpenAL does not support it.
+ */
+int main(int argc, char** argv) {
+
+  if (!alcIsExtensionPresent(nullptr, "ALC_SOFT_loopback")) {
+    std::cout << "Skipping the test: ALC_SOFT_loopback is not available" << std::endl;
+    return 0;
+  }
+
+  // Render the audio into a file instead of disabling it.
+  std::string audio_output = "-audio-output=" + wav_file_name;
+  std::vector<char*> arguments = { argv[0], &audio_output[0] };
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) != "-no-audio") {
+      arguments.push_back(argv[i]);
+    }
+  }
+
+  {
+    TestEnvironment env(int(arguments.size()), arguments.data());
+    Music::play("short", false);
+    for (int i = 0; i < num_steps; ++i) {
+      env.step();
+    }
+  }  // The WAV file is finished when the audio system is closed.
+
+  check_wav_file();
+
+  return 0;
+}
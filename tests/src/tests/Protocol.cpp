@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/server/PacketReader.h"
+#include "solarus/server/Protocol.h"
+#include "solarus/server/RingBuffer.h"
+#include "test_tools/TestEnvironment.h"
+#include <string>
+#include <vector>
+
+using namespace Solarus;
+
+namespace {
+
+/**
+ * \brief Creates consecutive game command events.
+ * \param first_sequence Sequence number of the first event.
+ * \param num_events Number of events to create.
+ * \return The events.
+ */
+std::vector<Protocol::GameCommandEvent> make_events(
+    uint32_t first_sequence,
+    size_t num_events
+) {
+  std::vector<Protocol::GameCommandEvent> events(num_events);
+  for (size_t i = 0; i < num_events; ++i) {
+    events[i].sequence = first_sequence + static_cast<uint32_t>(i);
+    events[i].timestamp = 100000 + static_cast<uint32_t>(i) * 16;
+    events[i].command = static_cast<GameCommand>(i % 9);
+    events[i].pressed = i % 3 != 0;
+  }
+  return events;
+}
+
+/**
+ * \brief Reads all packets of a buffer and decodes their events.
+ * \param input The bytes received.
+ * \return The events decoded.
+ */
+std::vector<Protocol::GameCommandEvent> read_events(RingBuffer& input) {
+
+  std::vector<Protocol::GameCommandEvent> events;
+  PacketReader reader(input);
+  Protocol::Packet packet;
+  PacketReader::Result result;
+  while ((result = reader.next(packet)) == PacketReader::Result::PACKET) {
+    const Protocol::CommandBatch batch(packet);
+    Debug::check_assertion(batch.is_valid(), "Invalid batch");
+    for (size_t i = 0; i < batch.get_num_events(); ++i) {
+      events.push_back(batch.get_event(i));
+    }
+  }
+  reader.release();
+  Debug::check_assertion(result == PacketReader::Result::INCOMPLETE, "Invalid stream");
+  return events;
+}
+
+/**
+ * \brief Checks that two lists of events are equal.
+ */
+void check_same_events(
+    const std::vector<Protocol::GameCommandEvent>& expected,
+    const std::vector<Protocol::GameCommandEvent>& actual
+) {
+  Debug::check_assertion(expected.size() == actual.size(),
+      "Expected " + std::to_string(expected.size()) + " events, got " +
+      std::to_string(actual.size()));
+  for (size_t i = 0; i < expected.size(); ++i) {
+    Debug::check_assertion(expected[i].sequence == actual[i].sequence &&
+        expected[i].timestamp == actual[i].timestamp &&
+        expected[i].command == actual[i].command &&
+        expected[i].pressed == actual[i].pressed,
+        "Wrong event " + std::to_string(i));
+  }
+}
+
+/**
+ * \brief Checks encoding and decoding a batch of events.
+ */
+void check_round_trip(TestEnvironment& /* env */) {
+
+  const std::vector<Protocol::GameCommandEvent>& events = make_events(42, 10);
+  std::string bytes;
+  Debug::check_assertion(Protocol::encode_commands(events.data(), events.size(), bytes) == 1,
+      "Expected one packet");
+  Debug::check_assertion(bytes.size() == Protocol::header_size +
+      Protocol::commands_header_size + 10 * Protocol::command_event_size,
+      "Wrong packet size");
+
+  RingBuffer input(Protocol::max_packet_size);
+  input.push(bytes.data(), bytes.size());
+  check_same_events(events, read_events(input));
+  Debug::check_assertion(input.is_empty(), "Bytes left in the input buffer");
+}
+
+/**
+ * \brief Checks how events are split into packets.
+ */
+void check_batching(TestEnvironment& /* env */) {
+
+  // Too many events for a single packet.
+  std::vector<Protocol::GameCommandEvent> events =
+      make_events(0, Protocol::max_commands_per_packet * 2 + 1);
+  std::string bytes;
+  Debug::check_assertion(Protocol::encode_commands(events.data(), events.size(), bytes) == 3,
+      "Expected three packets");
+
+  // Gap in sequence numbers or in timestamps.
+  events = make_events(0, 6);
+  events[2].sequence = 100;
+  events[3].sequence = 101;
+  events[4].sequence = 102;
+  events[5].sequence = 103;
+  events[4].timestamp += 70000;
+  events[5].timestamp += 70000;
+  bytes.clear();
+  Debug::check_assertion(Protocol::encode_commands(events.data(), events.size(), bytes) == 3,
+      "Expected three packets");
+
+  RingBuffer input(Protocol::max_packet_size);
+  input.push(bytes.data(), bytes.size());
+  check_same_events(events, read_events(input));
+}
+
+/**
+ * \brief Checks packets received in several parts or wrapping around the
+ * end of the input buffer.
+ */
+void check_partial_packets(TestEnvironment& /* env */) {
+
+  const std::vector<Protocol::GameCommandEvent>& events = make_events(7, 100);
+  std::string bytes;
+  Protocol::encode_commands(events.data(), events.size(), bytes);
+
+  // One byte at a time.
+  RingBuffer input(Protocol::max_packet_size);
+  PacketReader reader(input);
+  Protocol::Packet packet;
+  for (size_t i = 0; i < bytes.size() - 1; ++i) {
+    input.push(&bytes[i], 1);
+    Debug::check_assertion(reader.next(packet) == PacketReader::Result::INCOMPLETE,
+        "Incomplete packet returned");
+  }
+  input.push(&bytes[bytes.size() - 1], 1);
+  Debug::check_assertion(reader.next(packet) == PacketReader::Result::PACKET,
+      "Complete packet not returned");
+  reader.release();
+  Debug::check_assertion(input.is_empty(), "Bytes left in the input buffer");
+
+  // Wrapping around the end of the ring.
+  const std::string padding(input.get_capacity() - 50, '\0');
+  input.push(padding.data(), padding.size());
+  input.consume(padding.size() - 1);
+  input.push(bytes.data(), bytes.size());
+  input.consume(1);
+  size_t contiguous_size = 0;
+  input.get_contiguous_data(contiguous_size);
+  Debug::check_assertion(contiguous_size < bytes.size(), "Packet does not wrap");
+  check_same_events(events, read_events(input));
+}
+
+/**
+ * \brief Checks that corrupted streams are detected.
+ */
+void check_invalid_packets(TestEnvironment& /* env */) {
+
+  RingBuffer input(Protocol::max_packet_size);
+  PacketReader reader(input);
+  Protocol::Packet packet;
+
+  // Unknown message type.
+  const char unknown_type[] = { 0, 0, 99 };
+  input.push(unknown_type, sizeof(unknown_type));
+  Debug::check_assertion(reader.next(packet) == PacketReader::Result::INVALID,
+      "Unknown message type accepted");
+  input.clear();
+
+  // Packet bigger than the maximum size.
+  const char too_big[] = { -1, -1, 1 };
+  input.push(too_big, sizeof(too_big));
+  Debug::check_assertion(reader.next(packet) == PacketReader::Result::INVALID,
+      "Oversized packet accepted");
+  input.clear();
+
+  // Unknown game command.
+  const std::vector<Protocol::GameCommandEvent>& events = make_events(0, 1);
+  std::string bytes;
+  Protocol::encode_commands(events.data(), events.size(), bytes);
+  bytes[Protocol::header_size + Protocol::commands_header_size] = 50;
+  input.push(bytes.data(), bytes.size());
+  Debug::check_assertion(reader.next(packet) == PacketReader::Result::PACKET,
+      "Packet not returned");
+  Debug::check_assertion(!Protocol::CommandBatch(packet).is_valid(),
+      "Unknown game command accepted");
+  reader.release();
+
+  // Truncated event.
+  bytes.clear();
+  Protocol::encode_commands(events.data(), events.size(), bytes);
+  bytes.resize(bytes.size() - 1);
+  bytes[0] = static_cast<char>(bytes[0] - 1);
+  input.push(bytes.data(), bytes.size());
+  Debug::check_assertion(reader.next(packet) == PacketReader::Result::PACKET,
+      "Packet not returned");
+  Debug::check_assertion(!Protocol::CommandBatch(packet).is_valid(),
+      "Truncated event accepted");
+}
+
+/**
+ * \brief Checks acknowledgements and sequence numbers.
+ */
+void check_ack(TestEnvironment& /* env */) {
+
+  std::string bytes;
+  Protocol::encode_ack(123456789, bytes);
+  Debug::check_assertion(bytes.size() == Protocol::ack_packet_size, "Wrong ACK size");
+
+  RingBuffer input(Protocol::max_packet_size);
+  input.push(bytes.data(), bytes.size());
+  PacketReader reader(input);
+  Protocol::Packet packet;
+  uint32_t sequence = 0;
+  Debug::check_assertion(reader.next(packet) == PacketReader::Result::PACKET,
+      "ACK not returned");
+  Debug::check_assertion(Protocol::decode_ack(packet, sequence) && sequence == 123456789,
+      "Wrong ACK");
+  Debug::check_assertion(!Protocol::CommandBatch(packet).is_valid(),
+      "ACK decoded as commands");
+
+  Debug::check_assertion(Protocol::is_sequence_newer(1, 0), "Wrong sequence order");
+  Debug::check_assertion(!Protocol::is_sequence_newer(0, 0), "Wrong sequence order");
+  Debug::check_assertion(Protocol::is_sequence_newer(2, 0xFFFFFFFF),
+      "Wrong sequence order after wrapping");
+}
+
+}
+
+/**
+ * \brief Tests the binary protocol of the game server.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  check_round_trip(env);
+  check_batching(env);
+  check_partial_packets(env);
+  check_invalid_packets(env);
+  check_ack(env);
+
+  return 0;
+}
+
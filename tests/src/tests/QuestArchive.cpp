@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/DataFileView.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestArchive.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/Arguments.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+using namespace Solarus;
+
+namespace {
+
+/**
+ * \brief Temporary file used to test truncated archives.
+ */
+const std::string truncated_file_name = "quest_archive_test.zip";
+
+/**
+ * \brief Number of entries of the prefetch directory of the archive.
+ */
+constexpr int nb_prefetch_entries = 8;
+
+/**
+ * \brief Returns the expected content of the deflated text entry.
+ */
+std::string get_deflated_text() {
+
+  std::string text;
+  for (int i = 0; i < 100; ++i) {
+    text += "Deflated entry\n";
+  }
+  return text;
+}
+
+/**
+ * \brief Returns the name of an entry of the prefetch directory.
+ */
+std::string get_prefetch_file_name(int index) {
+  return "prefetch/" + std::to_string(index) + ".txt";
+}
+
+/**
+ * \brief Returns the expected content of an entry of the prefetch directory.
+ */
+std::string get_prefetch_text(int index) {
+
+  const std::string line = "Prefetched entry " + std::to_string(index) + "\n";
+  std::string text;
+  for (int i = 0; i < 200; ++i) {
+    text += line;
+  }
+  return text;
+}
+
+/**
+ * \brief Checks that a data file of the archive has the expected content,
+ * both copied and viewed.
+ */
+void check_file(const std::string& file_name, const std::string& expected_content) {
+
+  Debug::check_assertion(QuestFiles::data_file_exists(file_name),
+      "Missing file '" + file_name + "'");
+  Debug::check_assertion(QuestFiles::data_file_get_location(file_name) ==
+      QuestFiles::LOCATION_DATA_ARCHIVE,
+      "'" + file_name + "' should be in the archive");
+  Debug::check_assertion(QuestFiles::data_file_read(file_name) == expected_content,
+      "Wrong content read for '" + file_name + "'");
+  const DataFileViewPtr& view = QuestFiles::data_file_read_view(file_name);
+  Debug::check_assertion(view != nullptr && view->to_string() == expected_content,
+      "Wrong content viewed for '" + file_name + "'");
+}
+
+/**
+ * \brief Checks reading stored and deflated entries through QuestFiles.
+ */
+void check_entries() {
+
+  check_file("text/stored.txt", "Stored entry\n");
+  check_file("text/deflated.txt", get_deflated_text());
+  check_file("text/empty.txt", "");
+
+  // Stored entries are views of the mapped archive.
+  const DataFileViewPtr& view = QuestFiles::data_file_read_view("text/stored.txt");
+  Debug::check_assertion(view->is_mapped(), "Stored entry was copied");
+
+  Debug::check_assertion(!QuestFiles::data_file_exists("text/no_such_file.txt"),
+      "Unexpected file");
+}
+
+/**
+ * \brief Checks that prefetched entries are read correctly, including the
+ * ones released by a later prefetch and the ones never prefetched.
+ */
+void check_prefetch() {
+
+  std::vector<std::string> first_half;
+  std::vector<std::string> second_half;
+  for (int i = 1; i <= nb_prefetch_entries; ++i) {
+    std::vector<std::string>& file_names = (i <= nb_prefetch_entries / 2) ?
+        first_half : second_half;
+    file_names.push_back(get_prefetch_file_name(i));
+  }
+
+  // Read some prefetched entries, possibly while they are being inflated.
+  QuestFiles::data_files_prefetch(first_half);
+  check_file(get_prefetch_file_name(1), get_prefetch_text(1));
+  check_file(get_prefetch_file_name(2), get_prefetch_text(2));
+
+  // The entries not read yet are released by the next prefetch.
+  // Stored entries, missing ones and entries requested again are fine.
+  second_half.push_back("text/stored.txt");
+  second_half.push_back("no_such_file.txt");
+  second_half.push_back(get_prefetch_file_name(3));
+  QuestFiles::data_files_prefetch(second_half);
+
+  for (int i = 1; i <= nb_prefetch_entries; ++i) {
+    check_file(get_prefetch_file_name(i), get_prefetch_text(i));
+  }
+
+  // Read again after everything was consumed.
+  check_file(get_prefetch_file_name(nb_prefetch_entries),
+      get_prefetch_text(nb_prefetch_entries));
+}
+
+/**
+ * \brief Checks that damaged entries are not returned.
+ * \param path Path of an archive whose entries bad_data.txt and
+ * bad_header.txt are damaged.
+ */
+void check_corrupt_entries(const std::string& path) {
+
+  std::unique_ptr<QuestArchive> archive = QuestArchive::open(path);
+  Debug::check_assertion(archive != nullptr, "Failed to open '" + path + "'");
+  Debug::check_assertion(archive->get_num_entries() == 3, "Wrong number of entries");
+
+  const DataFileViewPtr& view = archive->read("stored.txt");
+  Debug::check_assertion(view != nullptr && view->to_string() == "Stored entry\n",
+      "Wrong content for a valid entry");
+
+  Debug::check_assertion(archive->read("bad_data.txt") == nullptr,
+      "Invalid compressed data was accepted");
+  Debug::check_assertion(archive->read("bad_header.txt") == nullptr,
+      "Invalid local header was accepted");
+
+  // Same thing when inflated by a worker.
+  archive->prefetch({ "bad_data.txt", "bad_header.txt" });
+  Debug::check_assertion(archive->read("bad_data.txt") == nullptr,
+      "Invalid compressed data was prefetched");
+  Debug::check_assertion(archive->read("bad_header.txt") == nullptr,
+      "Invalid local header was prefetched");
+
+  Debug::check_assertion(archive->read("no_such_file.txt") == nullptr,
+      "Unexpected entry");
+}
+
+/**
+ * \brief Checks that truncated archives are rejected.
+ * \param path Path of a valid archive.
+ */
+void check_truncated_archive(const std::string& path) {
+
+  std::ifstream file(path.c_str(), std::ios::binary);
+  Debug::check_assertion(bool(file), "Missing file '" + path + "'");
+  const std::string content(
+      (std::istreambuf_iterator<char>(file)),
+      std::istreambuf_iterator<char>()
+  );
+  file.close();
+
+  const std::vector<size_t> sizes = {
+      0,                   // Empty file.
+      10,                  // Only a part of the first local header.
+      content.size() / 2,  // No central directory.
+      content.size() - 10  // Incomplete end of central directory.
+  };
+  for (const size_t size: sizes) {
+    std::ofstream truncated_file(truncated_file_name.c_str(), std::ios::binary);
+    truncated_file.write(content.data(), size);
+    truncated_file.close();
+
+    Debug::check_assertion(QuestArchive::open(truncated_file_name) == nullptr,
+        "Truncated archive of " + std::to_string(size) + " bytes was accepted");
+  }
+  std::remove(truncated_file_name.c_str());
+}
+
+}
+
+/**
+ * \brief Tests reading a quest packaged as a zip archive.
+ *
+ * The archive quest is next to the testing quest given on the command line.
+ */
+int main(int argc, char** argv) {
+
+#ifndef HAVE_SYS_MMAN_H
+  // Archives are only indexed when they can be mapped into memory.
+  std::cout << "Skipping the test: memory mapped files are not available" << std::endl;
+  return 0;
+#endif
+
+  Debug::check_assertion(argc > 1, "Missing testing quest path");
+  const std::string quest_path = std::string(argv[argc - 1]) + "/../testing_archive_quest";
+  const std::string archive_path = quest_path + "/data.solarus";
+
+  std::vector<char*> arguments = { argv[0], const_cast<char*>(quest_path.c_str()) };
+  QuestFiles::initialize(Arguments(int(arguments.size()), arguments.data()));
+
+  check_entries();
+  check_prefetch();
+
+  QuestFiles::quit();
+
+  check_corrupt_entries(quest_path + "/corrupt.zip");
+  check_truncated_archive(archive_path);
+
+  return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/DataFileView.h"
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "test_tools/TestEnvironment.h"
+#include <string>
+
+using namespace Solarus;
+
+namespace {
+
+/**
+ * \brief Checks that a view of a data file has the same content as a copy.
+ */
+void check_view_content(TestEnvironment& /* env */, const std::string& file_name) {
+
+  const std::string& buffer = QuestFiles::data_file_read(file_name);
+  const DataFileViewPtr& view = QuestFiles::data_file_read_view(file_name);
+  Debug::check_assertion(view != nullptr, "Missing view of '" + file_name + "'");
+  Debug::check_assertion(view->to_string() == buffer,
+      "View of '" + file_name + "' differs from the file content");
+}
+
+/**
+ * \brief Checks that views of a file still in use are shared.
+ */
+void check_view_shared(TestEnvironment& /* env */) {
+
+  const std::string file_name = "tilesets/castle.tiles.png";
+  const DataFileViewPtr& view_1 = QuestFiles::data_file_read_view(file_name);
+  const DataFileViewPtr& view_2 = QuestFiles::data_file_read_view(file_name);
+  Debug::check_assertion(view_1 == view_2,
+      "Views of '" + file_name + "' are not shared");
+}
+
+/**
+ * \brief Checks mapping a file of the data directory into memory.
+ */
+void check_mapped_file(TestEnvironment& /* env */) {
+
+  const std::string file_name = "tilesets/castle.tiles.png";
+  const std::string& path = QuestFiles::get_quest_path() + "/data/" + file_name;
+  const DataFileViewPtr& view = DataFileView::create_from_file(path, 0);
+
+#ifdef HAVE_SYS_MMAN_H
+  Debug::check_assertion(view != nullptr && view->is_mapped(),
+      "Failed to map '" + path + "'");
+  Debug::check_assertion(view->to_string() == QuestFiles::data_file_read(file_name),
+      "Mapped file '" + path + "' differs from the file content");
+  Debug::check_assertion(DataFileView::create_from_file(path, view->size() + 1) == nullptr,
+      "File '" + path + "' should be too small to be mapped");
+#else
+  Debug::check_assertion(view == nullptr, "Unexpected mapped file");
+#endif
+}
+
+/**
+ * \brief Checks that a file of the quest write directory takes precedence
+ * over the data file with the same name.
+ */
+void check_write_dir_precedence(TestEnvironment& /* env */) {
+
+  const std::string file_name = "sprites/todo.dat";
+  // Still a valid sprite file in case the test does not finish.
+  const std::string& content =
+      QuestFiles::data_file_read(file_name) + "\n-- Overridden.\n";
+
+  Debug::check_assertion(QuestFiles::data_file_mkdir("sprites"),
+      "Failed to create the sprites directory in the write directory");
+  QuestFiles::data_file_save(file_name, content);
+
+  Debug::check_assertion(QuestFiles::data_file_get_location(file_name) ==
+      QuestFiles::LOCATION_WRITE_DIRECTORY,
+      "'" + file_name + "' should be in the write directory");
+  Debug::check_assertion(QuestFiles::data_file_read(file_name) == content,
+      "Wrong content read for '" + file_name + "'");
+  Debug::check_assertion(QuestFiles::data_file_read_view(file_name)->to_string() == content,
+      "Wrong content viewed for '" + file_name + "'");
+
+  QuestFiles::data_file_delete(file_name);
+  Debug::check_assertion(QuestFiles::data_file_read(file_name) != content,
+      "'" + file_name + "' is still overridden");
+}
+
+}
+
+/**
+ * \brief Tests reading data files without copying them.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  check_view_content(env, "quest.dat");
+  check_view_content(env, "tilesets/castle.tiles.png");
+  check_view_content(env, "fonts/minecraftia.ttf");
+  check_view_content(env, "languages/en/text/strings.dat");
+  check_view_shared(env);
+  check_mapped_file(env);
+  check_write_dir_precedence(env);
+
+  return 0;
+}
+
@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/FileWriter.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/Savegame.h"
+#include "test_tools/TestEnvironment.h"
+#include <memory>
+#include <string>
+
+using namespace Solarus;
+
+namespace {
+
+/**
+ * \brief Checks that keys of the same name are interned once.
+ */
+void check_keys(TestEnvironment& /* env */) {
+
+  const Savegame::Key key_1("savegame_test_key");
+  const int num_keys = Savegame::Key::get_num_keys();
+  const Savegame::Key key_2("savegame_test_key");
+  Debug::check_assertion(key_1.get_index() == key_2.get_index(),
+      "Same name with different keys");
+  Debug::check_assertion(Savegame::Key::get_num_keys() == num_keys,
+      "Name interned twice");
+  Debug::check_assertion(key_1.get_name() == "savegame_test_key",
+      "Wrong key name");
+  Debug::check_assertion(
+      Savegame::Key("_current_life").get_index() ==
+      Savegame::KEY_CURRENT_LIFE.get_index(),
+      "Built-in key interned twice");
+}
+
+/**
+ * \brief Checks setting and unsetting many values.
+ */
+void check_values(TestEnvironment& env) {
+
+  std::shared_ptr<Savegame> savegame = std::make_shared<Savegame>(
+      env.get_main_loop(), "savegame_test.dat"
+  );
+
+  const int num_values = 1000;
+  for (int i = 0; i < num_values; ++i) {
+    savegame->set_integer("value_" + std::to_string(i), i);
+  }
+  Debug::check_assertion(savegame->get_num_values() == num_values,
+      "Wrong number of values");
+
+  // Remove one value out of two.
+  for (int i = 0; i < num_values; i += 2) {
+    savegame->unset("value_" + std::to_string(i));
+  }
+  Debug::check_assertion(savegame->get_num_values() == num_values / 2,
+      "Wrong number of values after unset");
+
+  for (int i = 0; i < num_values; ++i) {
+    const std::string& key = "value_" + std::to_string(i);
+    if (i % 2 == 0) {
+      Debug::check_assertion(!savegame->is_integer(key),
+          "Value '" + key + "' was not unset");
+    }
+    else {
+      Debug::check_assertion(savegame->get_integer(key) == i,
+          "Wrong value for '" + key + "'");
+    }
+  }
+
+  savegame->set_boolean(Savegame::KEY_ABILITY_RUN, true);
+  savegame->set_string(Savegame::KEY_STARTING_MAP, "outside");
+  Debug::check_assertion(savegame->is_boolean("_ability_run") &&
+      savegame->get_boolean(Savegame::KEY_ABILITY_RUN),
+      "Wrong boolean value");
+  Debug::check_assertion(savegame->get_string("_starting_map") == "outside",
+      "Wrong string value");
+}
+
+/**
+ * \brief Checks that values are saved sorted by name.
+ */
+void check_save(TestEnvironment& env) {
+
+  std::shared_ptr<Savegame> savegame = std::make_shared<Savegame>(
+      env.get_main_loop(), "savegame_test.dat"
+  );
+
+  savegame->set_string("zelda", "princess");
+  savegame->set_integer("b", 2);
+  savegame->set_boolean("a", true);
+  savegame->save();
+  FileWriter::flush();
+
+  const std::string& content = QuestFiles::data_file_read("savegame_test.dat");
+  Debug::check_assertion(content == "a = true\nb = 2\nzelda = \"princess\"\n",
+      "Wrong savegame file content: '" + content + "'");
+
+  QuestFiles::data_file_delete("savegame_test.dat");
+}
+
+}
+
+/**
+ * \brief Tests the storage of savegame values.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  check_keys(env);
+  check_values(env);
+  check_save(env);
+
+  return 0;
+}
+
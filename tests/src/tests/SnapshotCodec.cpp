@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/server/SnapshotCodec.h"
+#include "test_tools/TestEnvironment.h"
+#include <string>
+#include <vector>
+
+using namespace Solarus;
+
+namespace {
+
+/**
+ * \brief Creates the state of an entity.
+ */
+EntityState make_entity(uint32_t id, int32_t x, int32_t y) {
+
+  EntityState entity;
+  entity.id = id;
+  entity.x = x;
+  entity.y = y;
+  entity.layer = 1;
+  entity.sprite = 1;
+  entity.animation = 2;
+  entity.direction = 3;
+  entity.frame = 0;
+  return entity;
+}
+
+/**
+ * \brief Creates a snapshot with many entities.
+ */
+Snapshot make_snapshot(uint32_t tick, uint32_t num_entities) {
+
+  Snapshot snapshot;
+  snapshot.tick = tick;
+  snapshot.num_strings = 3;
+  for (uint32_t id = 0; id < num_entities; ++id) {
+    snapshot.entities.push_back(make_entity(id, id * 16, id * 8));
+  }
+  return snapshot;
+}
+
+/**
+ * \brief Checks that two snapshots have the same entities.
+ */
+void check_same_snapshot(const Snapshot& expected, const Snapshot& actual) {
+
+  Debug::check_assertion(expected.tick == actual.tick, "Wrong tick");
+  Debug::check_assertion(expected.entities.size() == actual.entities.size(),
+      "Expected " + std::to_string(expected.entities.size()) + " entities, got " +
+      std::to_string(actual.entities.size()));
+  for (size_t i = 0; i < expected.entities.size(); ++i) {
+    const EntityState& entity_1 = expected.entities[i];
+    const EntityState& entity_2 = actual.entities[i];
+    Debug::check_assertion(entity_1.id == entity_2.id &&
+        entity_1.x == entity_2.x &&
+        entity_1.y == entity_2.y &&
+        entity_1.layer == entity_2.layer &&
+        entity_1.sprite == entity_2.sprite &&
+        entity_1.animation == entity_2.animation &&
+        entity_1.direction == entity_2.direction &&
+        entity_1.frame == entity_2.frame,
+        "Wrong entity " + std::to_string(entity_1.id));
+  }
+}
+
+/**
+ * \brief Encodes a snapshot and decodes it as a client would do.
+ * \param baseline Baseline of the server and of the client.
+ * \param current The snapshot to encode.
+ * \param server_strings String table of the server.
+ * \param client_strings String table of the client.
+ * \param[out] sent Snapshot the server expects the client to have.
+ * \return Size of the packet.
+ */
+size_t transmit(
+    const Snapshot* baseline,
+    const Snapshot& current,
+    const std::vector<std::string>& server_strings,
+    std::vector<std::string>& client_strings,
+    Snapshot& sent
+) {
+  std::string buffer;
+  SnapshotCodec::encode(baseline, current, server_strings, buffer, sent);
+
+  Protocol::Packet packet;
+  size_t payload_size = 0;
+  Debug::check_assertion(Protocol::read_header(buffer.data(), packet.type, payload_size),
+      "Invalid snapshot header");
+  Debug::check_assertion(Protocol::header_size + payload_size == buffer.size(),
+      "Wrong snapshot size");
+  packet.payload = buffer.data() + Protocol::header_size;
+  packet.size = payload_size;
+
+  Snapshot received;
+  Debug::check_assertion(SnapshotCodec::decode(packet, baseline, client_strings, received),
+      "Failed to decode snapshot");
+  check_same_snapshot(sent, received);
+  Debug::check_assertion(received.num_strings == sent.num_strings, "Wrong string table");
+  return buffer.size();
+}
+
+/**
+ * \brief Checks full snapshots and deltas.
+ */
+void check_deltas(TestEnvironment& /* env */) {
+
+  const std::vector<std::string> strings = { "", "hero/tunic1", "walking" };
+  std::vector<std::string> client_strings;
+
+  const Snapshot& snapshot_1 = make_snapshot(1, 100);
+  Snapshot sent_1;
+  const size_t full_size = transmit(nullptr, snapshot_1, strings, client_strings, sent_1);
+  check_same_snapshot(snapshot_1, sent_1);
+  Debug::check_assertion(client_strings == strings, "Wrong string table");
+
+  // Nothing changed.
+  Snapshot snapshot_2 = snapshot_1;
+  snapshot_2.tick = 2;
+  Snapshot sent_2;
+  const size_t empty_size = transmit(&sent_1, snapshot_2, strings, client_strings, sent_2);
+  Debug::check_assertion(empty_size < 32, "Empty delta too big");
+
+  // One entity moves, one is removed, one is added.
+  Snapshot snapshot_3 = snapshot_2;
+  snapshot_3.tick = 3;
+  snapshot_3.entities[10].x += 2;
+  snapshot_3.entities[10].frame = 1;
+  snapshot_3.entities.erase(snapshot_3.entities.begin() + 50);
+  snapshot_3.entities.push_back(make_entity(500, 0, 0));
+  Snapshot sent_3;
+  const size_t delta_size = transmit(&sent_2, snapshot_3, strings, client_strings, sent_3);
+  check_same_snapshot(snapshot_3, sent_3);
+  Debug::check_assertion(delta_size * 10 < full_size, "Delta too big");
+
+  // Wrong baseline.
+  std::string buffer;
+  Snapshot sent;
+  SnapshotCodec::encode(&sent_2, snapshot_3, strings, buffer, sent);
+  Protocol::Packet packet;
+  packet.type = Protocol::MessageType::SNAPSHOT;
+  packet.payload = buffer.data() + Protocol::header_size;
+  packet.size = buffer.size() - Protocol::header_size;
+  Snapshot received;
+  Debug::check_assertion(!SnapshotCodec::decode(packet, &sent_1, client_strings, received),
+      "Snapshot decoded with a wrong baseline");
+  Debug::check_assertion(!SnapshotCodec::decode(packet, nullptr, client_strings, received),
+      "Snapshot decoded without its baseline");
+}
+
+/**
+ * \brief Checks new strings sent with a delta.
+ */
+void check_new_strings(TestEnvironment& /* env */) {
+
+  std::vector<std::string> strings = { "", "hero/tunic1", "walking" };
+  std::vector<std::string> client_strings;
+
+  const Snapshot& snapshot_1 = make_snapshot(1, 10);
+  Snapshot sent_1;
+  transmit(nullptr, snapshot_1, strings, client_strings, sent_1);
+
+  strings.push_back("stopped");
+  strings.push_back(std::string(SnapshotCodec::max_string_length, 'x'));  // Longest string.
+  Snapshot snapshot_2 = snapshot_1;
+  snapshot_2.tick = 2;
+  snapshot_2.num_strings = strings.size();
+  snapshot_2.entities[3].animation = 3;
+  Snapshot sent_2;
+  transmit(&sent_1, snapshot_2, strings, client_strings, sent_2);
+  check_same_snapshot(snapshot_2, sent_2);
+  Debug::check_assertion(client_strings == strings, "New string not received");
+}
+
+/**
+ * \brief Checks that changes that do not fit in a packet are sent later.
+ */
+void check_big_snapshot(TestEnvironment& /* env */) {
+
+  const std::vector<std::string> strings = { "", "hero/tunic1", "walking" };
+  std::vector<std::string> client_strings;
+
+  // More entities than a packet can hold.
+  const Snapshot& snapshot = make_snapshot(1, 5000);
+  Snapshot sent_1;
+  const size_t size = transmit(nullptr, snapshot, strings, client_strings, sent_1);
+  Debug::check_assertion(size <= Protocol::max_snapshot_packet_size, "Snapshot too big");
+  Debug::check_assertion(sent_1.entities.size() < snapshot.entities.size(),
+      "All entities cannot fit");
+
+  // The rest comes with the next one.
+  Snapshot snapshot_2 = snapshot;
+  snapshot_2.tick = 2;
+  Snapshot sent_2;
+  transmit(&sent_1, snapshot_2, strings, client_strings, sent_2);
+  check_same_snapshot(snapshot_2, sent_2);
+}
+
+}
+
+/**
+ * \brief Tests the delta encoding of game snapshots.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  check_deltas(env);
+  check_new_strings(env);
+  check_big_snapshot(env);
+
+  return 0;
+}
+
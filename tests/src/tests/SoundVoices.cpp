@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/lowlevel/QuestFiles.h"
+#include "solarus/lowlevel/Sound.h"
+#include "test_tools/TestEnvironment.h"
+#include <al.h>
+#include <alc.h>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace Solarus;
+
+namespace {
+
+const std::string wav_file_name = "sound_voices_test.wav";
+
+/**
+ * \brief Number of sources requested, more than any device has.
+ */
+const std::string requested_nb_sources = "100000";
+
+/**
+ * \brief Sounds used by the test.
+ */
+const std::vector<std::string> sound_ids = {
+    "voices_normal",
+    "voices_high",
+    "voices_low",
+    "voices_limited"
+};
+
+/**
+ * \brief Creates the sound files of the test in the quest write directory.
+ *
+ * The testing quest has no sound effect, so its music is used as one.
+ */
+void create_sounds() {
+
+  Debug::check_assertion(QuestFiles::data_file_mkdir("sounds"),
+      "Failed to create the sounds directory in the write directory");
+  const std::string& content = QuestFiles::data_file_read("musics/short.ogg");
+  for (const std::string& sound_id: sound_ids) {
+    QuestFiles::data_file_save("sounds/" + sound_id + ".ogg", content);
+  }
+}
+
+/**
+ * \brief Deletes the sound files created by create_sounds().
+ */
+void delete_sounds() {
+
+  for (const std::string& sound_id: sound_ids) {
+    QuestFiles::data_file_delete("sounds/" + sound_id + ".ogg");
+  }
+}
+
+/**
+ * \brief Checks that the pool leaves sources to the music when the device
+ * has less sources than requested.
+ */
+void check_music_sources() {
+
+  const Sound::VoiceStats& stats = Sound::get_voice_stats();
+  Debug::check_assertion(stats.nb_sources > 0, "No source for sounds");
+  if (std::to_string(stats.nb_sources) == requested_nb_sources) {
+    std::cout << "Skipping the music sources check: the device has no limit" << std::endl;
+    return;
+  }
+
+  // The current music and the preloaded one need a source each.
+  alGetError();
+  ALuint sources[2];
+  alGenSources(2, sources);
+  Debug::check_assertion(alGetError() == AL_NO_ERROR,
+      "No source left for the music");
+  alDeleteSources(2, sources);
+}
+
+/**
+ * \brief Checks the limit of voices of a single sound.
+ */
+void check_max_voices() {
+
+  Sound::set_max_voices("voices_limited", 1);
+  const Sound::VoiceStats stats = Sound::get_voice_stats();
+
+  Sound::play("voices_limited");
+  Sound::play("voices_limited");
+  const Sound::VoiceStats& new_stats = Sound::get_voice_stats();
+  Debug::check_assertion(new_stats.nb_active_voices == stats.nb_active_voices + 1,
+      "Sound played more times than its limit");
+  Debug::check_assertion(new_stats.nb_stolen_voices == stats.nb_stolen_voices + 1,
+      "Oldest instance of the sound not restarted");
+}
+
+/**
+ * \brief Checks what happens when more sounds are played than the pool has
+ * sources.
+ */
+void check_voice_stealing() {
+
+  const Sound::VoiceStats initial_stats = Sound::get_voice_stats();
+  const int nb_sources = initial_stats.nb_sources;
+  const int nb_stolen = initial_stats.nb_stolen_voices;
+
+  // Fill the pool.
+  Sound::set_priority("voices_high", 1);
+  Sound::play("voices_high");
+  while (Sound::get_voice_stats().nb_active_voices < nb_sources) {
+    Sound::play("voices_normal");
+  }
+  Sound::VoiceStats stats = Sound::get_voice_stats();
+  Debug::check_assertion(stats.nb_stolen_voices == nb_stolen &&
+      stats.nb_dropped_voices == 0,
+      "Voice interrupted while the pool was not full");
+  Debug::check_assertion(stats.max_active_voices == nb_sources,
+      "Wrong maximum number of voices");
+
+  // More sounds than sources: the oldest ones are interrupted.
+  for (int i = 0; i < nb_sources; ++i) {
+    Sound::play("voices_normal");
+  }
+  stats = Sound::get_voice_stats();
+  Debug::check_assertion(stats.nb_active_voices == nb_sources,
+      "Wrong number of voices when the pool is full");
+  Debug::check_assertion(stats.nb_stolen_voices == nb_stolen + nb_sources,
+      "Voices not stolen");
+  Debug::check_assertion(stats.nb_dropped_voices == 0, "Sound dropped");
+
+  // A sound of lower priority than all playing ones is dropped.
+  Sound::set_priority("voices_low", -1);
+  Sound::play("voices_low");
+  stats = Sound::get_voice_stats();
+  Debug::check_assertion(stats.nb_dropped_voices == 1,
+      "Low priority sound not dropped");
+  Debug::check_assertion(stats.nb_stolen_voices == nb_stolen + nb_sources,
+      "Voice stolen by a lower priority sound");
+
+  // Sounds of the same priority can interrupt each other.
+  Sound::set_priority("voices_normal", 1);
+  Sound::play("voices_normal");
+  stats = Sound::get_voice_stats();
+  Debug::check_assertion(stats.nb_stolen_voices == nb_stolen + nb_sources + 1,
+      "Voice of the same priority not stolen");
+  Sound::set_priority("voices_normal", 0);
+}
+
+/**
+ * \brief Checks that the sources of finished sounds go back to the pool.
+ */
+void check_voices_released(TestEnvironment& env) {
+
+  // 10 seconds at most.
+  for (int i = 0; i < 1000 && Sound::get_voice_stats().nb_active_voices > 0; ++i) {
+    env.step();
+  }
+  Debug::check_assertion(Sound::get_voice_stats().nb_active_voices == 0,
+      "Finished voices not released");
+
+  Sound::play("voices_normal");
+  Debug::check_assertion(Sound::get_voice_stats().nb_active_voices == 1,
+      "Released source not reused");
+}
+
+}
+
+/**
+ * \brief Tests the pool of sources that play sound effects.
+ *
+ * The audio is rendered to a file, so this test is skipped if OpenAL does
+ * not support it.
+ */
+int main(int argc, char** argv) {
+
+  if (!alcIsExtensionPresent(nullptr, "ALC_SOFT_loopback")) {
+    std::cout << "Skipping the test: ALC_SOFT_loopback is not available" << std::endl;
+    return 0;
+  }
+
+  std::string audio_output = "-audio-output=" + wav_file_name;
+  std::string sound_voices = "-sound-voices=" + requested_nb_sources;
+  std::vector<char*> arguments = { argv[0], &audio_output[0], &sound_voices[0] };
+  for (int i = 1; i < argc; ++i) {
+    if (std::string(argv[i]) != "-no-audio") {
+      arguments.push_back(argv[i]);
+    }
+  }
+
+  {
+    TestEnvironment env(int(arguments.size()), arguments.data());
+    create_sounds();
+
+    check_music_sources();
+    check_max_voices();
+    check_voice_stealing();
+    check_voices_released(env);
+
+    delete_sounds();
+  }
+  std::remove(wav_file_name.c_str());
+
+  return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2006-2015 Christopho, Solarus - http://www.solarus-games.org
+ *
+ * Solarus is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Solarus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "solarus/lowlevel/Debug.h"
+#include "solarus/Sprite.h"
+#include "solarus/SpriteAnimation.h"
+#include "solarus/SpriteAnimationSet.h"
+#include "test_tools/TestEnvironment.h"
+#include <memory>
+
+using namespace Solarus;
+
+namespace {
+
+/**
+ * \brief Checks that an animation set no longer used stays in memory.
+ */
+void check_release(TestEnvironment& /* env */) {
+
+  const size_t unused_memory = Sprite::get_unused_animation_sets_memory();
+  SpritePtr sprite = std::make_shared<Sprite>("entities/bush");
+  const int num_animation_sets = Sprite::get_num_animation_sets();
+  Debug::check_assertion(Sprite::has_animation_set("entities/bush"),
+      "Animation set not loaded");
+  Debug::check_assertion(sprite->get_animation_set().get_memory_used() > 0,
+      "Animation set without memory");
+
+  // Release it.
+  sprite = nullptr;
+  Debug::check_assertion(Sprite::has_animation_set("entities/bush"),
+      "Unused animation set was freed");
+  Debug::check_assertion(Sprite::get_unused_animation_sets_memory() > unused_memory,
+      "Unused animation set not counted");
+
+  // Use it again.
+  sprite = std::make_shared<Sprite>("entities/bush");
+  Debug::check_assertion(Sprite::get_num_animation_sets() == num_animation_sets,
+      "Animation set was loaded twice");
+  Debug::check_assertion(Sprite::get_unused_animation_sets_memory() == unused_memory,
+      "Animation set still counted as unused");
+}
+
+/**
+ * \brief Checks that animation sets loaded in advance are used by sprites.
+ */
+void check_prefetch(TestEnvironment& /* env */) {
+
+  Debug::check_assertion(!Sprite::has_animation_set("entities/chest"),
+      "Animation set already loaded");
+
+  std::shared_ptr<SpriteAnimationSet> animation_set =
+      std::make_shared<SpriteAnimationSet>("entities/chest");
+  Sprite::add_animation_sets({ animation_set });
+  Debug::check_assertion(Sprite::has_animation_set("entities/chest"),
+      "Prefetched animation set not added");
+
+  const int num_animation_sets = Sprite::get_num_animation_sets();
+  SpritePtr sprite = std::make_shared<Sprite>("entities/chest");
+  Debug::check_assertion(&sprite->get_animation_set() == animation_set.get(),
+      "Prefetched animation set not used");
+  Debug::check_assertion(Sprite::get_num_animation_sets() == num_animation_sets,
+      "Animation set was loaded twice");
+
+  // Other references than sprites do not keep it used.
+  const size_t unused_memory = Sprite::get_unused_animation_sets_memory();
+  sprite = nullptr;
+  Debug::check_assertion(Sprite::get_unused_animation_sets_memory() ==
+      unused_memory + animation_set->get_memory_used(),
+      "Animation set referenced elsewhere not counted as unused");
+}
+
+}
+
+/**
+ * \brief Tests the cache of sprite animation sets.
+ */
+int main(int argc, char** argv) {
+
+  TestEnvironment env(argc, argv);
+
+  check_release(env);
+  check_prefetch(env);
+
+  return 0;
+}
+
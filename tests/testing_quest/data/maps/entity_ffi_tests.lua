@@ -0,0 +1,69 @@
+local map = ...
+
+-- Tests that the FFI wrappers of entity methods return the same results as
+-- the classic bindings.
+-- Numbers given as strings are always forwarded to the classic bindings,
+-- so each method is called both ways on the same entity.
+
+local function classic_position(entity)
+  local x, y = entity:get_bounding_box()
+  local origin_x, origin_y = entity:get_origin()
+  return x + origin_x, y + origin_y
+end
+
+local function test_entity(entity, others)
+
+  local x, y, layer = entity:get_position()
+  local classic_x, classic_y = classic_position(entity)
+  assert_equal(x, classic_x)
+  assert_equal(y, classic_y)
+  assert(layer == 0 or layer == 1)
+
+  for _, other in ipairs(others) do
+    local other_x, other_y = classic_position(other)
+    local sx, sy = tostring(other_x), tostring(other_y)
+
+    assert_equal(entity:get_distance(other_x, other_y), entity:get_distance(sx, sy))
+    assert_equal(entity:get_distance(other), entity:get_distance(sx, sy))
+    assert_equal(entity:get_direction4_to(other_x, other_y), entity:get_direction4_to(sx, sy))
+    assert_equal(entity:get_direction4_to(other), entity:get_direction4_to(sx, sy))
+    assert_equal(entity:get_direction8_to(other_x, other_y), entity:get_direction8_to(sx, sy))
+    assert_equal(entity:get_direction8_to(other), entity:get_direction8_to(sx, sy))
+
+    local bx, by, bw, bh = other:get_bounding_box()
+    assert_equal(entity:overlaps(other), entity:overlaps(tostring(bx), tostring(by), tostring(bw), tostring(bh)))
+    assert_equal(entity:overlaps(bx, by, bw, bh), entity:overlaps(tostring(bx), tostring(by), tostring(bw), tostring(bh)))
+    assert_equal(entity:overlaps(other_x, other_y), entity:overlaps(sx, sy))
+  end
+
+  -- Non-integer coordinates go to the classic bindings too.
+  assert_equal(entity:overlaps(x + 0.5, y), entity:overlaps(tostring(x + 0.5), tostring(y)))
+  assert_equal(entity:overlaps(x, y), true)
+end
+
+function map:on_started()
+
+  local hero = map:get_hero()
+  local near = map:get_entity("near")
+  local far = map:get_entity("far")
+  local entities = { hero, near, far }
+
+  for _, entity in ipairs(entities) do
+    test_entity(entity, entities)
+  end
+
+  -- Move entities and check again that both ways see the new positions.
+  near:set_position(161, 110, 1)
+  far:set_position(7, 9, 0)
+  for _, entity in ipairs(entities) do
+    test_entity(entity, entities)
+  end
+  assert_equal(select(3, near:get_position()), 1)
+  assert_equal(select(3, far:get_position()), 0)
+
+  -- Wrong arguments still raise the errors of the classic bindings.
+  assert(not pcall(near.get_distance, near, "not a number", 0))
+  assert(not pcall(near.get_position, "not an entity"))
+
+  sol.main.exit()
+end
@@ -0,0 +1,3 @@
+local map = ...
+
+require("scripts/teleport_tests")(map)
@@ -0,0 +1,133 @@
+local map = ...
+
+-- Tests for sol.thread: serialization of messages, message passing
+-- in both directions, normal termination and stop requests.
+
+local function deep_equal(a, b)
+
+  if type(a) ~= "table" or type(b) ~= "table" then
+    return a == b
+  end
+  for key, value in pairs(a) do
+    if not deep_equal(value, b[key]) then
+      return false
+    end
+  end
+  for key in pairs(b) do
+    if a[key] == nil then
+      return false
+    end
+  end
+  return true
+end
+
+-- Values sent to the echo worker and expected back unchanged.
+local messages = {
+  true,
+  false,
+  0,
+  -12,
+  3.25,
+  1e300,
+  "",
+  "hello",
+  "with\0zero",
+  {},
+  { 1, 2, 3 },
+  { x = 16, y = -8.5, name = "abc", ok = true },
+  { [true] = "yes", [false] = "no", [2.5] = 2.5, [1] = { { { "deep" } } } },
+}
+
+local finished = {}
+
+local function check_all_finished()
+
+  if finished.echo and finished.busy and finished.waiting then
+    sol.main.exit()
+  end
+end
+
+local function test_invalid_messages(thread)
+
+  -- Functions and userdata cannot be sent.
+  assert(not pcall(thread.post, thread, print))
+  assert(not pcall(thread.post, thread, { f = print }))
+  assert(not pcall(thread.post, thread, thread))
+
+  -- Nor tables that contain themselves or that are too deep.
+  local loop = {}
+  loop.self = loop
+  assert(not pcall(thread.post, thread, loop))
+
+  local deep = {}
+  local t = deep
+  for i = 1, 100 do
+    t.next = {}
+    t = t.next
+  end
+  assert(not pcall(thread.post, thread, deep))
+end
+
+local function test_echo()
+
+  local echo = sol.thread.start("scripts/threads/echo")
+  assert(echo:is_running())
+
+  test_invalid_messages(echo)
+
+  local num_received = 0
+  function echo:on_message(message)
+    num_received = num_received + 1
+    if num_received <= #messages then
+      -- Messages arrive in the order they were sent.
+      assert(deep_equal(message, messages[num_received]),
+          "message " .. num_received .. " changed")
+    else
+      assert_equal(message, "bye")
+    end
+  end
+
+  function echo:on_finished()
+    assert_equal(num_received, #messages + 1)
+    assert(not echo:is_running())
+    finished.echo = true
+    check_all_finished()
+  end
+
+  for _, message in ipairs(messages) do
+    echo:post(message)
+  end
+  echo:post("quit")
+end
+
+local function test_stop(script_name, key)
+
+  local thread = sol.thread.start(script_name)
+  local started = false
+
+  function thread:on_message(message)
+    assert_equal(message, "started")
+    started = true
+    thread:stop()
+  end
+
+  function thread:on_finished()
+    assert(started)
+    assert(not thread:is_running())
+    finished[key] = true
+    check_all_finished()
+  end
+end
+
+function map:on_started()
+
+  assert(not pcall(sol.thread.start, "scripts/threads/no_such_script"))
+
+  test_echo()
+  test_stop("scripts/threads/busy", "busy")
+  test_stop("scripts/threads/waiting", "waiting")
+
+  -- This one is still running when the quest exits:
+  -- it has to be stopped and joined at shutdown.
+  sol.thread.start("scripts/threads/waiting")
+end
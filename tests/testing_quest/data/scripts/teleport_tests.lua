@@ -0,0 +1,82 @@
+-- Script shared by the maps teleport_tests/a and teleport_tests/b.
+-- The hero goes back and forth between them.
+-- The next map is prepared by a worker thread during the closing transition
+-- of the current one, and each step tests a different timing.
+
+-- What to check when arriving on a map and how to leave it.
+local steps = {
+  {
+    map_id = "teleport_tests/a",
+    destination = "start",
+    leave = function(hero)
+      -- Usual case: b is prepared and loaded during the fade.
+      hero:teleport("teleport_tests/b", "from_a", "fade")
+    end,
+  },
+  {
+    map_id = "teleport_tests/b",
+    destination = "from_a",
+    leave = function(hero)
+      -- No transition: a is committed at the next cycle,
+      -- waiting for its preparation if needed.
+      hero:teleport("teleport_tests/a", "from_b", "immediate")
+    end,
+  },
+  {
+    map_id = "teleport_tests/a",
+    destination = "from_b",
+    leave = function(hero)
+      -- Teleport again while the first preparation is still pending:
+      -- it is abandoned and the last destination wins.
+      hero:teleport("teleport_tests/b", "from_a", "fade")
+      hero:teleport("teleport_tests/b", "from_a_again", "fade")
+    end,
+  },
+  {
+    map_id = "teleport_tests/b",
+    destination = "from_a_again",
+    leave = function(hero)
+      hero:teleport("teleport_tests/a", "from_b", "fade")
+    end,
+  },
+  {
+    map_id = "teleport_tests/a",
+    destination = "from_b",
+    leave = function()
+      sol.main.exit()
+    end,
+  },
+}
+
+return function(map)
+
+  local game = map:get_game()
+
+  function map:on_started(destination)
+
+    local step_index = (game.teleport_tests_step or 0) + 1
+    game.teleport_tests_step = step_index
+    local step = steps[step_index]
+    assert(step ~= nil, "Too many maps started")
+
+    assert_equal(map:get_id(), step.map_id)
+    assert_equal(destination:get_name(), step.destination)
+
+    -- The hero is on the destination.
+    local hero = map:get_hero()
+    local x, y, layer = destination:get_position()
+    local hero_x, hero_y, hero_layer = hero:get_position()
+    assert_equal(hero_x, x)
+    assert_equal(hero_y, y)
+    assert_equal(hero_layer, layer)
+
+    -- Entities and their sprites are loaded.
+    local marker = map:get_entity("marker")
+    assert(marker ~= nil)
+    assert(marker:get_sprite() ~= nil)
+
+    sol.timer.start(map, 100, function()
+      step.leave(hero)
+    end)
+  end
+end
@@ -0,0 +1,8 @@
+-- Worker that never returns and never waits for messages.
+-- It can only be interrupted by thread:stop().
+
+sol.thread.post("started")
+local n = 0
+while true do
+  n = n + 1
+end
@@ -0,0 +1,10 @@
+-- Worker that sends back every message it receives until it gets "quit".
+
+while true do
+  local message = sol.thread.receive()
+  if message == "quit" then
+    sol.thread.post("bye")
+    return
+  end
+  sol.thread.post(message)
+end
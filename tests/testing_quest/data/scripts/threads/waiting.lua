@@ -0,0 +1,7 @@
+-- Worker that waits forever for messages and ignores them.
+-- It can only be interrupted by thread:stop().
+
+sol.thread.post("started")
+while true do
+  sol.thread.receive()
+end
@@ -0,0 +1,150 @@
+#!/usr/bin/luajit
+
+-- Replaces the Lua scripts and data files of a quest by precompiled bytecode.
+-- The engine loads bytecode directly, which skips the Lua parser when
+-- starting maps and reading sprites, tilesets or dialogs.
+--
+-- Work on a copy of your quest data, the source files are overwritten:
+--   cp -r path/to/quest/data build
+--   ./compile_quest.lua build [scripts/extra.lua ...]
+--   cd build && zip -r -n .ogg:.png ../data.solarus .
+--
+-- The -n option stores musics and images without compressing them again:
+-- the engine then reads them directly from the archive without any copy.
+--
+-- Files are found from the resource list (project_db.dat).
+-- Other scripts (like the ones loaded with require()) can be passed as
+-- additional arguments, relative to the data directory.
+--
+-- Bytecode is not portable: use the same Lua implementation (Lua 5.1 or
+-- LuaJIT, same version and architecture) as the one the engine is built
+-- with. The quest editor cannot open compiled files.
+
+if #arg < 1 then
+  print("Usage: " .. arg[0] .. " path/to/data/copy [extra_file ...]")
+  os.exit(1)
+end
+
+local data_path = arg[1] .. "/"
+
+local resource_type_names = {
+  "map",
+  "tileset",
+  "music",
+  "sprite",
+  "sound",
+  "item",
+  "enemy",
+  "language",
+  "entity",
+  "font",
+}
+
+-- Reads the resource list.
+local function read_resources()
+
+  local resources = {}
+  local env = {}
+  for _, resource_type_name in ipairs(resource_type_names) do
+    local resource = {}
+    resources[resource_type_name] = resource
+    env[resource_type_name] = function(resource_element)
+      resource[#resource + 1] = resource_element.id
+    end
+  end
+
+  local chunk, error = loadfile(data_path .. "project_db.dat")
+  if chunk == nil then
+    io.stderr:write("Error in resource list file: " .. error .. "\n")
+    os.exit(1)
+  end
+  setfenv(chunk, env)
+  local success, error = pcall(chunk)
+  if not success then
+    io.stderr:write("Error in resource list file: " .. error .. "\n")
+    os.exit(1)
+  end
+
+  return resources
+end
+
+-- Returns the content of a file or nil if it does not exist.
+local function read_file(file_name)
+
+  local file = io.open(data_path .. file_name, "rb")
+  if file == nil then
+    return nil
+  end
+  local content = file:read("*a")
+  file:close()
+  return content
+end
+
+local num_compiled = 0
+local num_errors = 0
+
+-- Compiles a file of the data directory in place.
+-- The chunk name is the same as the one the engine uses when loading
+-- the source, so that error messages are unchanged.
+local function compile(file_name)
+
+  local source = read_file(file_name)
+  if source == nil or source:byte(1) == 27 then
+    -- Does not exist or already compiled.
+    return
+  end
+
+  local chunk, error = loadstring(source, file_name)
+  if chunk == nil then
+    io.stderr:write("[error] " .. error .. "\n")
+    num_errors = num_errors + 1
+    return
+  end
+
+  local file = assert(io.open(data_path .. file_name, "wb"))
+  file:write(string.dump(chunk))
+  file:close()
+  num_compiled = num_compiled + 1
+end
+
+local resources = read_resources()
+
+compile("main.lua")
+compile("quest.dat")
+
+for _, id in ipairs(resources.map) do
+  compile("maps/" .. id .. ".dat")
+  compile("maps/" .. id .. ".lua")
+end
+for _, id in ipairs(resources.tileset) do
+  compile("tilesets/" .. id .. ".dat")
+end
+for _, id in ipairs(resources.sprite) do
+  compile("sprites/" .. id .. ".dat")
+end
+for _, id in ipairs(resources.item) do
+  compile("items/" .. id .. ".lua")
+end
+for _, id in ipairs(resources.enemy) do
+  compile("enemies/" .. id .. ".lua")
+end
+for _, id in ipairs(resources.entity) do
+  compile("entities/" .. id .. ".lua")
+end
+for _, id in ipairs(resources.language) do
+  compile("languages/" .. id .. "/text/strings.dat")
+  compile("languages/" .. id .. "/text/dialogs.dat")
+end
+
+for i = 2, #arg do
+  compile(arg[i])
+end
+
+-- Last because it was needed to find the other files.
+compile("project_db.dat")
+
+print(num_compiled .. " file(s) compiled, " .. num_errors .. " error(s).")
+if num_errors > 0 then
+  os.exit(1)
+end
+